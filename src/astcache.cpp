@@ -0,0 +1,323 @@
+#include "astcache.h"
+#include "pack.h"
+#include "vocab_extractor.h"
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+static_assert(sizeof(AstCacheHeader) == 40, "AstCacheHeader 布局固定为 40 字节");
+static_assert(sizeof(AstCacheRecordHeader) == 24,
+              "AstCacheRecordHeader 布局固定为 24 字节");
+static_assert(sizeof(FlatNode) == 16, "FlatNode 布局固定为 16 字节");
+
+bool flatten_ast(TSNode root, std::vector<FlatNode> &nodes,
+                 std::vector<uint32_t> &leaves) {
+  nodes.clear();
+  leaves.clear();
+  // 游标会经过匿名节点, 具名子节点的父节点取最近的具名祖先,
+  // 与 ts_node_named_child 穿过匿名节点的行为一致
+  std::vector<std::pair<uint32_t, uint32_t>> named; // (节点下标, 游标深度)
+  std::vector<char> ignored;   // 注释/空白/ERROR, 不能作为叶节点
+  std::vector<char> has_child; // 有具名子节点
+  TSTreeCursor cursor = ts_tree_cursor_new(root);
+  uint32_t cursor_depth = 0;
+  bool descend = true, ok = true;
+  while (ok) {
+    if (descend) {
+      TSNode node = ts_tree_cursor_current_node(&cursor);
+      if (ts_node_is_named(node)) {
+        while (!named.empty() && named.back().second >= cursor_depth)
+          named.pop_back();
+        uint32_t index = static_cast<uint32_t>(nodes.size());
+        uint32_t parent = named.empty() ? index : named.back().first;
+        size_t depth = named.size();
+        if (depth > UINT16_MAX) {
+          ok = false;
+          break;
+        }
+        bool error = ts_node_is_error(node);
+        nodes.push_back({parent, ts_node_start_byte(node),
+                         ts_node_end_byte(node),
+                         error ? FLAT_ERROR_TYPE : ts_node_symbol(node),
+                         static_cast<uint16_t>(depth)});
+        ignored.push_back(error || utils::is_comment(node) ||
+                          utils::is_line_comment(node) ||
+                          utils::is_block_comment(node) ||
+                          utils::is_whitespace(node));
+        has_child.push_back(0);
+        if (parent != index)
+          has_child[parent] = 1;
+        named.emplace_back(index, cursor_depth);
+      }
+      if (ts_tree_cursor_goto_first_child(&cursor)) {
+        cursor_depth++;
+        continue;
+      }
+    }
+    if (ts_tree_cursor_goto_next_sibling(&cursor)) {
+      descend = true;
+      continue;
+    }
+    if (!ts_tree_cursor_goto_parent(&cursor))
+      break;
+    cursor_depth--;
+    descend = false;
+  }
+  ts_tree_cursor_delete(&cursor);
+  if (!ok)
+    return false;
+  // 与 lca_path_traverse 的叶节点条件相同, 根节点除外
+  for (uint32_t i = 1; i < nodes.size(); ++i)
+    if (!has_child[i] && !ignored[i])
+      leaves.push_back(i);
+  return true;
+}
+
+std::vector<std::string> language_type_names(const TSLanguage *language) {
+  uint32_t count =
+      language != nullptr ? ts_language_symbol_count(language) : 0;
+  std::vector<std::string> types(count);
+  for (uint32_t symbol = 0; symbol < count; ++symbol) {
+    const char *raw = ts_language_symbol_name(language, symbol);
+    types[symbol] = raw != nullptr ? raw : "null";
+    cleanNodeType(types[symbol]);
+  }
+  return types;
+}
+
+AstCacheReader::~AstCacheReader() {
+  if (data_ != nullptr)
+    ::munmap(const_cast<char *>(data_), size_);
+}
+
+bool AstCacheReader::Open(const std::filesystem::path &cache_path) {
+  int fd = ::open(cache_path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (::fstat(fd, &st) != 0 ||
+      static_cast<size_t>(st.st_size) < sizeof(AstCacheHeader)) {
+    ::close(fd);
+    return false;
+  }
+  void *map = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED)
+    return false;
+
+  const char *data = static_cast<const char *>(map);
+  size_t size = static_cast<size_t>(st.st_size);
+  AstCacheHeader header;
+  std::memcpy(&header, data, sizeof(header));
+  // 各区依次为文件头、记录、类型表、索引; 以减法比较, 任意取值都不会溢出
+  if (std::memcmp(header.magic, AST_CACHE_MAGIC, sizeof(AST_CACHE_MAGIC)) !=
+          0 ||
+      header.version != AST_CACHE_VERSION ||
+      header.types_offset < sizeof(AstCacheHeader) ||
+      header.types_offset > header.index_offset ||
+      header.index_offset > size ||
+      header.index_offset % alignof(uint64_t) != 0 ||
+      header.record_count > (size - header.index_offset) / sizeof(uint64_t) ||
+      !LoadTypes(data + header.types_offset, data + header.index_offset) ||
+      !ValidRecords(data, header)) {
+    for (auto &types : types_)
+      types.clear();
+    ::munmap(map, size);
+    return false;
+  }
+  ::madvise(map, size, MADV_SEQUENTIAL);
+  data_ = data;
+  size_ = size;
+  count_ = header.record_count;
+  index_ = reinterpret_cast<const uint64_t *>(data + header.index_offset);
+  return true;
+}
+
+bool AstCacheReader::LoadTypes(const char *p, const char *end) {
+  // 类型表很小, 读出后常驻
+  for (auto &types : types_) {
+    uint32_t count;
+    if (static_cast<size_t>(end - p) < sizeof(count))
+      return false;
+    std::memcpy(&count, p, sizeof(count));
+    p += sizeof(count);
+    // 每个类型名至少占 2 字节长度, 按剩余字节限制预留, 防止损坏的计数
+    if (count > static_cast<size_t>(end - p) / sizeof(uint16_t))
+      return false;
+    types.reserve(count);
+    for (uint32_t i = 0; i < count; ++i) {
+      uint16_t length;
+      if (static_cast<size_t>(end - p) < sizeof(length))
+        return false;
+      std::memcpy(&length, p, sizeof(length));
+      p += sizeof(length);
+      if (length > static_cast<size_t>(end - p))
+        return false;
+      types.emplace_back(p, length);
+      p += length;
+    }
+  }
+  return true;
+}
+
+bool AstCacheReader::ValidRecords(const char *data,
+                                  const AstCacheHeader &header) {
+  const uint64_t *index =
+      reinterpret_cast<const uint64_t *>(data + header.index_offset);
+  // 记录都位于文件头与类型表之间, Get 因此无需再做检查
+  const uint64_t end = header.types_offset;
+  for (uint64_t i = 0; i < header.record_count; ++i) {
+    uint64_t offset = index[i];
+    // FlatNode 与叶节点下标按记录起点对齐后直接访问映射内存
+    if (offset < sizeof(AstCacheHeader) || offset > end ||
+        offset % alignof(FlatNode) != 0 ||
+        end - offset < sizeof(AstCacheRecordHeader))
+      return false;
+    AstCacheRecordHeader record;
+    std::memcpy(&record, data + offset, sizeof(record));
+    uint64_t rest = end - offset - sizeof(record);
+    uint64_t nodes = uint64_t{record.node_count} * sizeof(FlatNode);
+    uint64_t leaves = uint64_t{record.leaf_count} * sizeof(uint32_t);
+    if (record.lang > PACK_LANG_CPP || nodes > rest ||
+        leaves > rest - nodes || record.name_length > rest - nodes - leaves ||
+        record.source_length > rest - nodes - leaves - record.name_length)
+      return false;
+  }
+  return true;
+}
+
+bool AstCacheReader::ValidNodes(const FlatAst &ast) {
+  const size_t count = ast.node_count;
+  for (size_t i = 0; i < count; ++i) {
+    const FlatNode &node = ast.nodes[i];
+    // 先序排列, 父节点总在子节点之前, 上溯必然在根节点终止
+    bool root = i == 0 && node.parent == 0 && node.depth == 0;
+    if (!root && (node.parent >= i ||
+                  node.depth != ast.nodes[node.parent].depth + 1))
+      return false;
+    if (node.start > node.end || node.end > ast.source.size())
+      return false;
+  }
+  for (size_t i = 0; i < ast.leaf_count; ++i) {
+    if (ast.leaves[i] >= count)
+      return false;
+  }
+  return true;
+}
+
+FlatAst AstCacheReader::Get(size_t index) const {
+  const char *p = data_ + index_[index];
+  AstCacheRecordHeader header;
+  std::memcpy(&header, p, sizeof(header));
+  p += sizeof(header);
+  FlatAst ast;
+  ast.lang = header.lang;
+  ast.nodes = reinterpret_cast<const FlatNode *>(p);
+  ast.node_count = header.node_count;
+  p += header.node_count * sizeof(FlatNode);
+  ast.leaves = reinterpret_cast<const uint32_t *>(p);
+  ast.leaf_count = header.leaf_count;
+  p += header.leaf_count * sizeof(uint32_t);
+  ast.name = std::string_view(p, header.name_length);
+  ast.source = std::string_view(p + header.name_length, header.source_length);
+  return ast;
+}
+
+bool AstCacheReader::IsCache(const std::filesystem::path &path) {
+  std::error_code ec;
+  if (!std::filesystem::is_regular_file(path, ec))
+    return false;
+  std::FILE *file = std::fopen(path.c_str(), "rb");
+  if (file == nullptr)
+    return false;
+  char magic[sizeof(AST_CACHE_MAGIC)];
+  bool ok = std::fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+            std::memcmp(magic, AST_CACHE_MAGIC, sizeof(magic)) == 0;
+  std::fclose(file);
+  return ok;
+}
+
+AstCacheWriter::~AstCacheWriter() {
+  if (file_ != nullptr)
+    std::fclose(file_);
+}
+
+bool AstCacheWriter::Write(const void *data, size_t size) {
+  if (std::fwrite(data, 1, size, file_) != size)
+    return false;
+  offset_ += size;
+  return true;
+}
+
+bool AstCacheWriter::Open(const std::filesystem::path &cache_path) {
+  file_ = std::fopen(cache_path.c_str(), "wb");
+  if (file_ == nullptr)
+    return false;
+  // 先写占位文件头, Finish 时回填
+  AstCacheHeader header{};
+  std::memcpy(header.magic, AST_CACHE_MAGIC, sizeof(AST_CACHE_MAGIC));
+  header.version = AST_CACHE_VERSION;
+  return Write(&header, sizeof(header));
+}
+
+bool AstCacheWriter::Add(std::string_view name, uint8_t lang,
+                         std::string_view source,
+                         const std::vector<FlatNode> &nodes,
+                         const std::vector<uint32_t> &leaves) {
+  static const char padding[8] = {};
+  AstCacheRecordHeader header{};
+  header.name_length = static_cast<uint32_t>(name.size());
+  header.lang = lang;
+  header.node_count = static_cast<uint32_t>(nodes.size());
+  header.leaf_count = static_cast<uint32_t>(leaves.size());
+  header.source_length = source.size();
+  size_t record_size = sizeof(header) + nodes.size() * sizeof(FlatNode) +
+                       leaves.size() * sizeof(uint32_t) + name.size() +
+                       source.size();
+  std::lock_guard<std::mutex> lock(mutex_);
+  offsets_.push_back(offset_);
+  return Write(&header, sizeof(header)) &&
+         Write(nodes.data(), nodes.size() * sizeof(FlatNode)) &&
+         Write(leaves.data(), leaves.size() * sizeof(uint32_t)) &&
+         Write(name.data(), name.size()) &&
+         Write(source.data(), source.size()) &&
+         Write(padding, (8 - record_size % 8) % 8);
+}
+
+size_t AstCacheWriter::Size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return offsets_.size();
+}
+
+bool AstCacheWriter::Finish() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  AstCacheHeader header{};
+  std::memcpy(header.magic, AST_CACHE_MAGIC, sizeof(AST_CACHE_MAGIC));
+  header.version = AST_CACHE_VERSION;
+  header.record_count = offsets_.size();
+  header.types_offset = offset_;
+  // 类型表按语言下标顺序写出, 读取端据此把符号映射回类型名
+  bool ok = true;
+  for (const TSLanguage *language : {tree_sitter_c(), tree_sitter_cpp()}) {
+    std::vector<std::string> types = language_type_names(language);
+    uint32_t count = static_cast<uint32_t>(types.size());
+    ok = ok && Write(&count, sizeof(count));
+    for (uint32_t symbol = 0; ok && symbol < count; ++symbol) {
+      const std::string &type = types[symbol];
+      uint16_t length = static_cast<uint16_t>(type.size());
+      ok = Write(&length, sizeof(length)) && Write(type.data(), length);
+    }
+  }
+  static const char padding[8] = {};
+  ok = ok && Write(padding, (8 - offset_ % 8) % 8);
+  header.index_offset = offset_;
+  ok = ok && Write(offsets_.data(), offsets_.size() * sizeof(uint64_t)) &&
+       std::fseek(file_, 0, SEEK_SET) == 0 &&
+       std::fwrite(&header, sizeof(header), 1, file_) == 1;
+  ok = (std::fclose(file_) == 0) && ok;
+  file_ = nullptr;
+  return ok;
+}
@@ -0,0 +1,140 @@
+#ifndef __HAS_ASTCACHE__
+#define __HAS_ASTCACHE__
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <tree_sitter/api.h>
+#include <vector>
+
+/**
+ * 扁平语法树缓存, 所有整数为小端:
+ *   AstCacheHeader
+ *   记录 * N: AstCacheRecordHeader + FlatNode * node_count
+ *             + uint32 叶节点下标 * leaf_count + 文件名 + 源代码, 按 8 字节对齐
+ *   类型表: 每种语言 uint32 符号数, 再逐个 uint16 长度 + 清理后的类型名
+ *   索引: uint64 * N, 每条记录相对文件头的偏移
+ * 只保存具名节点 (先序), 与 traverse_ast 看到的树一致;
+ * 调整 path_width、采样率等参数重跑时直接读缓存, 不再调用 tree-sitter
+ */
+constexpr char AST_CACHE_MAGIC[8] = {'A', 'S', 'T', 'C', 'A', 'C', 'H', '1'};
+constexpr uint32_t AST_CACHE_VERSION = 1;
+constexpr uint16_t FLAT_ERROR_TYPE = 0xFFFF; // ts_builtin_sym_error
+
+struct AstCacheHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t flags;
+  uint64_t record_count;
+  uint64_t index_offset;
+  uint64_t types_offset;
+};
+
+struct AstCacheRecordHeader {
+  uint32_t name_length;
+  uint8_t lang; // PACK_LANG_C / PACK_LANG_CPP
+  uint8_t reserved[3];
+  uint32_t node_count;
+  uint32_t leaf_count;
+  uint64_t source_length;
+};
+
+struct FlatNode {
+  uint32_t parent; // 最近的具名祖先下标, 根节点指向自身
+  uint32_t start;  // 源代码字节区间 [start, end)
+  uint32_t end;
+  uint16_t type;  // 语言内的符号, FLAT_ERROR_TYPE 表示 ERROR 节点
+  uint16_t depth; // 根节点为 0
+};
+
+/**
+ * @brief 单个文件的扁平语法树, 指向缓存映射内存或调用方的缓冲区
+ */
+struct FlatAst {
+  std::string_view name;
+  uint8_t lang = 0;
+  const FlatNode *nodes = nullptr;
+  size_t node_count = 0;
+  const uint32_t *leaves = nullptr; // 满足 isRealNode 的非根叶节点, 先序
+  size_t leaf_count = 0;
+  std::string_view source;
+};
+
+/**
+ * @brief 把语法树展平到 nodes/leaves, 深度超出 uint16 时返回 false
+ */
+bool flatten_ast(TSNode root, std::vector<FlatNode> &nodes,
+                 std::vector<uint32_t> &leaves);
+
+/**
+ * @brief 语言的符号 -> 清理后的类型名, 即缓存类型表的内容
+ */
+std::vector<std::string> language_type_names(const TSLanguage *language);
+
+/**
+ * @brief 只读扁平语法树缓存, mmap 映射后线程安全
+ */
+class AstCacheReader {
+public:
+  AstCacheReader() = default;
+  AstCacheReader(const AstCacheReader &) = delete;
+  AstCacheReader &operator=(const AstCacheReader &) = delete;
+  ~AstCacheReader();
+
+  bool Open(const std::filesystem::path &cache_path);
+  bool IsOpen() const { return data_ != nullptr; }
+  size_t Size() const { return count_; }
+  FlatAst Get(size_t index) const;
+  // 语言 lang 的符号 -> 清理后的类型名 (与 node_type_to_string 一致)
+  // 记录中的 lang 已在 Open 时校验, 可直接作为下标
+  const std::vector<std::string> &TypeNames(uint8_t lang) const {
+    return types_[lang];
+  }
+  static bool IsCache(const std::filesystem::path &path);
+  /**
+   * @brief 检查记录内的父节点、深度、字节区间与叶节点下标
+   * Open 只校验记录边界, 节点内容在遍历前逐条检查, 代价与遍历同阶
+   */
+  static bool ValidNodes(const FlatAst &ast);
+
+private:
+  bool LoadTypes(const char *p, const char *end);
+  // 检查每条记录的偏移、长度与语言, 损坏或截断的缓存整体拒绝
+  static bool ValidRecords(const char *data, const AstCacheHeader &header);
+
+  const char *data_ = nullptr;
+  size_t size_ = 0;
+  size_t count_ = 0;
+  const uint64_t *index_ = nullptr;
+  std::vector<std::string> types_[2];
+};
+
+/**
+ * @brief 写入扁平语法树缓存, Add 可由多个工作线程并发调用
+ */
+class AstCacheWriter {
+public:
+  AstCacheWriter() = default;
+  AstCacheWriter(const AstCacheWriter &) = delete;
+  AstCacheWriter &operator=(const AstCacheWriter &) = delete;
+  ~AstCacheWriter();
+
+  bool Open(const std::filesystem::path &cache_path);
+  bool Add(std::string_view name, uint8_t lang, std::string_view source,
+           const std::vector<FlatNode> &nodes,
+           const std::vector<uint32_t> &leaves);
+  bool Finish();
+  size_t Size() const;
+
+private:
+  bool Write(const void *data, size_t size);
+  mutable std::mutex mutex_;
+  std::FILE *file_ = nullptr;
+  uint64_t offset_ = 0;
+  std::vector<uint64_t> offsets_;
+};
+
+#endif // !__HAS_ASTCACHE__
@@ -0,0 +1,246 @@
+#include "astdump.h"
+#include <charconv>
+
+namespace {
+constexpr size_t MAX_FREE_BUFFERS = 64;
+
+inline void put_varint(std::string &out, uint64_t value) {
+  while (value >= 0x80) {
+    out += static_cast<char>((value & 0x7f) | 0x80);
+    value >>= 7;
+  }
+  out += static_cast<char>(value);
+}
+
+inline void put_number(std::string &out, uint64_t value) {
+  char digits[24];
+  auto result = std::to_chars(digits, digits + sizeof(digits), value);
+  out.append(digits, result.ptr);
+}
+
+void put_escaped(std::string &out, std::string_view text) {
+  for (char c : text) {
+    switch (c) {
+    case '"':
+      out += "\\\"";
+      break;
+    case '\\':
+      out += "\\\\";
+      break;
+    case '\n':
+      out += "\\n";
+      break;
+    case '\r':
+      out += "\\r";
+      break;
+    case '\t':
+      out += "\\t";
+      break;
+    default:
+      out += c;
+    }
+  }
+}
+
+/**
+ * @brief 按格式输出单个节点, 子节点之前的部分
+ */
+void open_node(TSNode node, std::string_view source, int depth,
+               const DumpOptions &options, uint32_t &last_start,
+               std::string &out) {
+  switch (options.format) {
+  case DumpFormat::Text: {
+    TSPoint start = ts_node_start_point(node);
+    out.append(static_cast<size_t>(depth) * 2, ' ');
+    out += ts_node_type(node);
+    out += " @ L";
+    put_number(out, start.row + 1);
+    out += ":C";
+    put_number(out, start.column + 1);
+    if (options.with_source) {
+      uint32_t begin = ts_node_start_byte(node);
+      uint32_t end = ts_node_end_byte(node);
+      out += " \"";
+      if (begin <= end && end <= source.size())
+        put_escaped(out, source.substr(begin, end - begin));
+      out += '"';
+    }
+    out += '\n';
+    break;
+  }
+  case DumpFormat::Sexp:
+    // 匿名节点的类型即其文本, 如 "{" 与 "\"", 加引号以免破坏括号结构
+    out += " (";
+    if (ts_node_is_named(node)) {
+      out += ts_node_type(node);
+    } else {
+      out += '"';
+      put_escaped(out, ts_node_type(node));
+      out += '"';
+    }
+    break;
+  case DumpFormat::Binary: {
+    uint32_t start = ts_node_start_byte(node);
+    put_varint(out, ts_node_symbol(node));
+    put_varint(out, options.all_nodes ? ts_node_child_count(node)
+                                      : ts_node_named_child_count(node));
+    put_varint(out, start - last_start);
+    put_varint(out, ts_node_end_byte(node) - start);
+    last_start = start;
+    break;
+  }
+  default:
+    break;
+  }
+}
+} // namespace
+
+DumpFormat parse_dump_format(const std::string &name, bool &ok) {
+  ok = true;
+  if (name == "text")
+    return DumpFormat::Text;
+  if (name == "sexp")
+    return DumpFormat::Sexp;
+  if (name == "binary")
+    return DumpFormat::Binary;
+  ok = false;
+  return DumpFormat::None;
+}
+
+void dump_tree(TSNode root, std::string_view source, std::string_view name,
+               uint8_t lang, const DumpOptions &options, std::string &out) {
+  size_t count_offset = 0;
+  switch (options.format) {
+  case DumpFormat::Text:
+    out += '[';
+    out.append(name);
+    out += "]\n";
+    break;
+  case DumpFormat::Sexp:
+    out += "(\"";
+    put_escaped(out, name);
+    out += '"';
+    break;
+  case DumpFormat::Binary:
+    put_varint(out, name.size());
+    out.append(name);
+    out += static_cast<char>(lang | (options.all_nodes ? 2 : 0));
+    count_offset = out.size();
+    out.append(4, '\0'); // 节点数, 遍历后回填
+    break;
+  default:
+    return;
+  }
+
+  // 游标内部的栈随线程复用, 容量足够后重置不再分配
+  thread_local TSTreeCursor cursor = ts_tree_cursor_new(root);
+  ts_tree_cursor_reset(&cursor, root);
+  const bool sexp = options.format == DumpFormat::Sexp;
+  int depth = options.base_depth;
+  uint32_t last_start = 0, nodes = 0;
+  auto visible = [&](TSNode node) {
+    return options.all_nodes || ts_node_is_named(node);
+  };
+  auto open = [&]() {
+    TSNode node = ts_tree_cursor_current_node(&cursor);
+    if (visible(node)) {
+      open_node(node, source, depth, options, last_start, out);
+      nodes++;
+    }
+  };
+  auto close = [&]() {
+    if (sexp && visible(ts_tree_cursor_current_node(&cursor)))
+      out += ')';
+  };
+  open();
+  while (true) {
+    if (ts_tree_cursor_goto_first_child(&cursor)) {
+      depth++;
+      open();
+      continue;
+    }
+    close();
+    bool done = false;
+    while (!ts_tree_cursor_goto_next_sibling(&cursor)) {
+      if (!ts_tree_cursor_goto_parent(&cursor)) {
+        done = true;
+        break;
+      }
+      depth--;
+      close();
+    }
+    if (done)
+      break;
+    open();
+  }
+
+  if (sexp) {
+    out += ")\n";
+  } else if (options.format == DumpFormat::Binary) {
+    for (int i = 0; i < 4; ++i)
+      out[count_offset + i] = static_cast<char>((nodes >> (8 * i)) & 0xff);
+  }
+}
+
+DumpWriter::DumpWriter(std::ostream &out, DumpFormat format,
+                       size_t max_pending)
+    : out_(out), max_pending_(max_pending) {
+  if (format == DumpFormat::Binary) {
+    out_.write(AST_DUMP_MAGIC, sizeof(AST_DUMP_MAGIC));
+    bytes_ += sizeof(AST_DUMP_MAGIC);
+  }
+  thread_ = std::thread(&DumpWriter::Loop, this);
+}
+
+DumpWriter::~DumpWriter() { Close(); }
+
+void DumpWriter::Submit(std::string &buffer) {
+  if (buffer.empty())
+    return;
+  std::unique_lock<std::mutex> lock(mutex_);
+  // 单个超过上限的文件在队列为空时仍可提交
+  cv_.wait(lock, [&] {
+    return closed_ || pending_.empty() ||
+           pending_bytes_ + buffer.size() <= max_pending_;
+  });
+  pending_bytes_ += buffer.size();
+  pending_.push_back(std::move(buffer));
+  if (free_.empty()) {
+    buffer = std::string();
+  } else {
+    buffer = std::move(free_.back());
+    free_.pop_back();
+  }
+  cv_.notify_all();
+}
+
+void DumpWriter::Close() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    cv_.notify_all();
+  }
+  if (thread_.joinable())
+    thread_.join();
+  out_.flush();
+}
+
+void DumpWriter::Loop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    cv_.wait(lock, [this] { return closed_ || !pending_.empty(); });
+    if (pending_.empty())
+      return; // 已关闭且写完
+    std::string buffer = std::move(pending_.front());
+    pending_.pop_front();
+    lock.unlock();
+    out_.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    lock.lock();
+    bytes_ += buffer.size();
+    pending_bytes_ -= buffer.size();
+    buffer.clear();
+    if (free_.size() < MAX_FREE_BUFFERS)
+      free_.push_back(std::move(buffer));
+    cv_.notify_all();
+  }
+}
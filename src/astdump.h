@@ -0,0 +1,74 @@
+#ifndef __HAS_ASTDUMP__
+#define __HAS_ASTDUMP__
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tree_sitter/api.h>
+#include <vector>
+
+/**
+ * 语法树转储 (--dump):
+ *   text   每节点一行 "缩进类型 @ L行:C列[ "源码"]", 文件以 "[文件名]" 开头
+ *   sexp   每文件一行 (文件名 (类型 (子节点 ...) ...))
+ *   binary 流头 AST_DUMP_MAGIC, 之后每文件一条记录, 整数为 LEB128:
+ *     文件名长度, 文件名, u8 语言 | (全部节点 << 1), u32 小端节点数,
+ *     每节点先序: 符号, 子节点数, 起始字节与上一节点起始字节之差, 字节长度
+ * 以 TSTreeCursor 迭代遍历, 结果追加到调用方复用的缓冲区,
+ * 不加锁, 也不逐节点分配内存; 源码文本中的引号、反斜杠与换行会转义
+ */
+enum class DumpFormat { None, Text, Sexp, Binary };
+constexpr char AST_DUMP_MAGIC[8] = {'A', 'S', 'T', 'D', 'U', 'M', 'P', '1'};
+
+struct DumpOptions {
+  DumpFormat format = DumpFormat::None;
+  bool all_nodes = false;   // 包含匿名节点 (标点、关键字)
+  bool with_source = false; // 附带节点的源码文本 (仅文本格式)
+  int base_depth = 0;       // 起始缩进
+};
+
+DumpFormat parse_dump_format(const std::string &name, bool &ok);
+
+void dump_tree(TSNode root, std::string_view source, std::string_view name,
+               uint8_t lang, const DumpOptions &options, std::string &out);
+
+/**
+ * @brief 单写线程: 工作线程整文件提交缓冲区, 写线程按提交顺序写出
+ * 提交时与空闲缓冲区交换, 缓冲区在工作线程与写线程间循环复用;
+ * 待写字节超过 max_pending 时提交方等待
+ */
+class DumpWriter {
+public:
+  DumpWriter(std::ostream &out, DumpFormat format,
+             size_t max_pending = 64u << 20);
+  DumpWriter(const DumpWriter &) = delete;
+  DumpWriter &operator=(const DumpWriter &) = delete;
+  ~DumpWriter();
+
+  // 提交 buffer 的内容, 返回时 buffer 为空的可复用缓冲区
+  void Submit(std::string &buffer);
+  // 写出剩余内容并结束写线程
+  void Close();
+  uint64_t Bytes() const { return bytes_; }
+
+private:
+  void Loop();
+
+  std::ostream &out_;
+  const size_t max_pending_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::string> pending_;
+  std::vector<std::string> free_;
+  size_t pending_bytes_ = 0;
+  uint64_t bytes_ = 0;
+  bool closed_ = false;
+  std::thread thread_;
+};
+
+#endif // !__HAS_ASTDUMP__
@@ -1,368 +1,1079 @@
+#include "astcache.h"
+#include "chunkpool.h"
+#include "cli.h"
+#include "ctxstream.h"
+#include "dedup.h"
+#include "discovery.h"
+#include "lineage.h"
+#include "normalize.h"
+#include "numaplace.h"
+#include "pack.h"
+#include "perfcount.h"
+#include "prefetch.h"
+#include "quarantine.h"
+#include "randomwalk.h"
+#include "shard.h"
+#include "stats.h"
+#include "tensor.h"
+#include "vocab_extractor.h"
 #include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <csignal>
 #include <cstddef>
 #include <cstdint>
 #include <filesystem>
 #include <fstream>
-#include <functional>
 #include <iostream>
+#include <limits>
+#include <memory>
 #include <mutex>
-#include <queue>
 #include <random>
-#include <sstream>
 #include <string>
 #include <thread>
 #include <tree_sitter/api.h>
-#include <unordered_map>
 #include <vector>
 
-extern "C" TSLanguage *tree_sitter_c();
-extern "C" TSLanguage *tree_sitter_cpp();
-
-constexpr int MAX_DEPTH = 1200;
 int PATH_CONTEXT_LENGTH = 200;
 
 std::mutex cout_mutex;
-std::mutex queue_mutex;
-std::queue<std::filesystem::path> file_queue;
-
-std::unordered_map<std::string, unsigned int> token_vocab;
-std::unordered_map<std::string, unsigned int> type_vocab;
-struct VectorHash {
-  template <typename T> size_t operator()(const std::vector<T> &vec) const {
-    return std::hash<std::string>()(std::string(vec.begin(), vec.end()));
-  }
-};
-std::unordered_map<std::vector<unsigned int>, unsigned int, VectorHash>
-    path_vocab;
-
-std::atomic<int> files_processed{0};
-size_t total_files = 0;
+std::unique_ptr<Prefetcher> prefetcher;
 
-template <typename T> T min(T a, T b) { return a < b ? a : b; }
+Vocab vocab;
+// --numa=replicate 时每个节点一份词汇表副本, 工作线程指向所在节点的副本
+NumaTopology numa;
+NumaMode numa_mode = NumaMode::Off;
+bool pin_threads = false; // --pin-threads: 每个工作线程绑定一个CPU
+NodeReplicas<Vocab> vocab_replicas;
+thread_local const Vocab *worker_vocab = &vocab;
 
-namespace utils {
-bool is_leaf(TSNode node) { return ts_node_named_child_count(node) == 0; }
-bool is_comment(TSNode node) {
-  return std::string(ts_node_type(node)) == "comment";
-}
-bool is_line_comment(TSNode node) {
-  return std::string(ts_node_type(node)) == "line_comment";
-}
-bool is_block_comment(TSNode node) {
-  return std::string(ts_node_type(node)) == "block_comment";
-}
-bool is_whitespace(TSNode node) {
-  std::string type = ts_node_type(node);
-  return type.find("whitespace") != std::string::npos ||
-         type.find("newline") != std::string::npos;
-}
-} // namespace utils
+std::atomic<int> files_processed{0};
+std::atomic<int> files_quarantined{0};
+std::unique_ptr<Deduplicator> dedup;
+bool dedup_contexts = false; // 文件内相同三元组只输出一次并附带次数
+std::atomic<size_t> total_files{0};
+ParseLimits parse_limits;
+Quarantine quarantine;
+ErrorFilter error_filter;
+double max_error_ratio = 1; // 默认只降权不跳过
+CancelFlag parse_cancel_flag{0};
+PackReader corpus_pack;
+AstCacheReader ast_cache;                 // 扁平语法树缓存输入
+std::vector<uint32_t> cache_type_ids[2];  // 缓存符号 -> 类型词汇表ID
+std::unique_ptr<AstCacheWriter> cache_writer; // --write-ast-cache
+std::filesystem::path cache_root; // 缓存记录名相对的根: 语料目录或打包语料
+std::filesystem::path pack_path;
+std::vector<uint32_t> pack_records; // 打包语料或语法树缓存中待处理的记录
+std::atomic<size_t> next_record{0};
+LockStats cout_lock_stats("cout_mutex");
+LatencyHistogram file_latency;  // 源代码就绪到输出完成
+LatencyHistogram parse_latency; // 单文件解析
+// --incremental: 按提交谱系顺序增量重解析
+bool incremental = false;
+std::vector<std::vector<LineageFile>> lineages;
+std::atomic<size_t> next_lineage{0};
+LatencyHistogram incremental_latency; // 增量重解析
+std::atomic<uint64_t> parses_incremental{0};
+std::atomic<uint64_t> parses_full{0};
+std::atomic<uint64_t> parses_reused{0}; // 与上一版相同, 复用抽取结果
+// 超大文件的叶节点对分块, 由所有工作线程共同完成
+std::unique_ptr<ChunkPool> chunk_pool;
+size_t chunk_leaves = 4096;
+bool normalize = false; // --normalize: 解析前在内存中去注释与空白行
+Shard shard;            // --shard=i/N: 只处理属于本分片的文件
+// --functions: 每个函数定义一个样本, 以函数名为标签
+bool function_mode = false;
+std::atomic<uint64_t> functions_extracted{0};
+std::atomic<uint64_t> functions_skipped{0}; // 叶节点过少或超限
+// --tensor-out: 以定长数组代替文本输出, 上下文长度即 max_contexts
+std::unique_ptr<TensorWriter> tensor_writer;
+// --ctx-out: 变长编码分块压缩的上下文流, 以 ctxdecode 解码
+std::unique_ptr<CtxStreamWriter> ctx_writer;
+// --walks=N: 以随机游走代替叶节点对, 路径词汇表需由同样参数的
+// astparser_mulitthread --walks 生成
+WalkOptions walk_options;
 
-inline bool isRealNode(TSNode node) {
-  return (!ts_node_is_null(node) && utils::is_leaf(node) &&
-          !utils::is_comment(node) && !utils::is_line_comment(node) &&
-          !utils::is_block_comment(node) && !utils::is_whitespace(node) &&
-          !ts_node_is_error(node));
+/**
+ * @brief 写入张量或上下文流, 二者均未启用时返回 false 而改用文本输出
+ * @param identity 样本来源, 决定张量截断时的采样
+ */
+bool write_binary(const std::string &label, std::string_view identity,
+                  const std::vector<PathContext> &contexts,
+                  const std::vector<uint32_t> *counts) {
+  if (!tensor_writer && !ctx_writer)
+    return false;
+  // 张量只保存三元组, 去重后的次数不输出
+  if (tensor_writer)
+    tensor_writer->Add(label, identity, contexts);
+  if (ctx_writer)
+    ctx_writer->Add(label, contexts, counts);
+  return true;
 }
 
-void traverse_ast(TSNode node, const std::function<void(TSNode)> &callback) {
-  callback(node);
-  uint32_t child_count = ts_node_named_child_count(node);
-  for (uint32_t i = 0; i < child_count; ++i) {
-    TSNode child = ts_node_named_child(node, i);
-    traverse_ast(child, callback);
-  }
+/**
+ * @brief 单个文件的抽取参数
+ */
+ExtractOptions file_options(const std::filesystem::path &file_path) {
+  ExtractOptions options;
+  options.max_leaves = parse_limits.max_leaves;
+  options.keep_rate = 1.0 - error_filter.Ratio(file_path);
+  options.pool = chunk_pool.get();
+  options.chunk_leaves = chunk_leaves;
+  return options;
 }
 
-void cleanNodeType(std::string &type) {
-  type.erase(std::remove_if(type.begin(), type.end(),
-                            [](unsigned char c) { return std::isspace(c); }),
-             type.end());
-  std::replace(type.begin(), type.end(), '_', '|');
+/**
+ * @brief 解析得到的语法树的 符号 -> 类型词汇表ID, 每种语言只建一次
+ */
+const std::vector<uint32_t> &live_type_ids(const TSLanguage *language) {
+  static const std::vector<uint32_t> ids[2] = {
+      flat_type_ids(*worker_vocab, language_type_names(tree_sitter_c())),
+      flat_type_ids(*worker_vocab, language_type_names(tree_sitter_cpp()))};
+  return ids[language == tree_sitter_c() ? 0 : 1];
 }
 
-std::string node_type_to_string(TSNode node) {
-  if (ts_node_is_null(node))
-    return "null";
-  std::string tmp = ts_node_type(node);
-  cleanNodeType(tmp);
-  return tmp;
+/**
+ * @brief 按当前模式抽取 root 下的上下文: 叶节点对的 LCA 路径或随机游走
+ */
+ExtractStatus extract_tree(TSNode root, std::string_view source,
+                           std::mt19937 &gen, const ExtractOptions &options,
+                           std::vector<PathContext> &contexts) {
+  if (walk_options.walks_per_leaf == 0)
+    return lca_path_traverse(*worker_vocab, root, source, gen, options,
+                             contexts);
+  thread_local std::vector<FlatNode> flat_nodes;
+  thread_local std::vector<uint32_t> flat_leaves;
+  if (!flatten_ast(root, flat_nodes, flat_leaves))
+    return ExtractStatus::TooFewLeaves; // 深度超出 uint16
+  FlatAst ast;
+  ast.nodes = flat_nodes.data();
+  ast.node_count = flat_nodes.size();
+  ast.leaves = flat_leaves.data();
+  ast.leaf_count = flat_leaves.size();
+  ast.source = source;
+  return random_walk_traverse(*worker_vocab, ast,
+                              live_type_ids(ts_node_language(root)), gen,
+                              options, walk_options, contexts);
 }
 
-TSNode find_lca(TSNode source, TSNode target) {
-  std::vector<TSNode> path1, path2;
-  TSNode current = source;
-  if (ts_node_eq(source, target))
-    return source;
-  while (!ts_node_is_null(current)) {
-    path1.emplace_back(current);
-    current = ts_node_parent(current);
+/**
+ * @brief 输出单个文件的抽取结果, 叶节点超限时隔离
+ */
+void write_result(const std::filesystem::path &file_path, ExtractStatus status,
+                  std::vector<PathContext> &contexts, StageClock &clock) {
+  thread_local std::vector<uint32_t> counts;
+  thread_local ContextSet context_set;
+  if (status == ExtractStatus::OverLimit) {
+    quarantine.Add(file_path,
+                   "leaves>" + std::to_string(parse_limits.max_leaves));
+    files_quarantined.fetch_add(1, std::memory_order_relaxed);
+    return;
   }
-  current = target;
-  while (!ts_node_is_null(current)) {
-    path2.emplace_back(current);
-    current = ts_node_parent(current);
+  const std::string label = file_path.filename().string();
+  const std::vector<uint32_t> *context_counts = nullptr;
+  if (status == ExtractStatus::Ok && dedup_contexts) {
+    context_set.Compact(contexts, counts);
+    context_counts = &counts;
   }
-  TSNode lca = TSNode{};
-  int i = path1.size() - 1, j = path2.size() - 1;
-  while (i >= 0 && j >= 0 && ts_node_eq(path1[i], path2[j])) {
-    lca = path1[i];
-    i--;
-    j--;
+  if (tensor_writer || ctx_writer) {
+    clock.Lap(Stage::Serialize);
+    if (status == ExtractStatus::Ok)
+      write_binary(label, file_path.native(), contexts, context_counts);
+    clock.Lap(Stage::Write);
+    return;
   }
-  return lca;
+  std::string tmp;
+  if (status == ExtractStatus::Ok)
+    append_contexts(tmp, label, contexts, context_counts);
+  clock.Lap(Stage::Serialize);
+  std::unique_lock<std::mutex> lock(cout_mutex, std::defer_lock);
+  Stats::Lock(lock, cout_lock_stats);
+  std::cout << tmp << "\n";
+  lock.unlock();
+  clock.Lap(Stage::Write);
 }
 
-std::string lca_path_traverse(TSNode root,
-                              const std::filesystem::path &file_path,
-                              const std::string &source, std::mt19937 &gen,
-                              int path_width = 200) {
-  std::vector<TSNode> leaves;
-  traverse_ast(root, [&](TSNode node) {
-    if (isRealNode(node) && !ts_node_eq(node, root))
-      leaves.emplace_back(node);
-  });
-
-  int leaves_count = leaves.size();
-  std::string result;
-
-  if (leaves_count >= 2) {
-    result += (file_path.filename().string() + " ");
-    std::uniform_int_distribution<int> isGen(0, 1);
-    for (int i = 0; i < leaves_count; i++) {
-      for (int j = i + 1; j < min(leaves_count, i + path_width); j++) {
-        if (isGen(gen) == 0)
-          continue;
-
-        TSNode node1 = leaves[i];
-        TSNode node2 = leaves[j];
-
-        TSNode lca = find_lca(node1, node2);
-        std::vector<TSNode> path;
-        TSNode current = node1;
-        while (!ts_node_eq(current, lca)) {
-          if (ts_node_is_named(current) && !ts_node_is_error(current))
-            path.push_back(current);
-          current = ts_node_parent(current);
-        }
-
-        std::vector<TSNode> rpath;
-        current = node2;
-        while (!ts_node_eq(current, lca)) {
-          if (ts_node_is_named(current) && !ts_node_is_error(current))
-            rpath.push_back(current);
-          current = ts_node_parent(current);
-        }
-
-        path.insert(path.end(), rpath.rbegin(), rpath.rend());
-
-        std::string token1, token2, path_str;
-        unsigned int token1_hash = 0, token2_hash = 0;
-        std::vector<unsigned int> path_int;
-        for (auto it = path.begin(); it != path.end(); ++it) {
-          TSNode node = *it;
-          if (it == path.begin()) {
-            token1 = source.substr(ts_node_start_byte(node),
-                                   ts_node_end_byte(node) -
-                                       ts_node_start_byte(node));
-            cleanNodeType(token1);
-            auto it1 = token_vocab.find(token1);
-            token1_hash = (it1 != token_vocab.end()) ? it1->second : 0;
-          }
-
-          std::string tmp = node_type_to_string(node);
-          auto type_it = type_vocab.find(tmp);
-          unsigned int type_id =
-              (type_it != type_vocab.end()) ? type_it->second : 0;
-          path_int.push_back(type_id);
-
-          if (it == path.end() - 1) {
-            token2 = source.substr(ts_node_start_byte(node),
-                                   ts_node_end_byte(node) -
-                                       ts_node_start_byte(node));
-            cleanNodeType(token2);
-            auto it2 = token_vocab.find(token2);
-            token2_hash = (it2 != token_vocab.end()) ? it2->second : 0;
-
-            auto path_it = path_vocab.find(path_int);
-            path_str = (path_it != path_vocab.end())
-                           ? std::to_string(path_it->second)
-                           : "0";
-          }
-        }
-
-        result += std::to_string(token1_hash) + "," + path_str + "," +
-                  std::to_string(token2_hash) + " ";
-      }
+/**
+ * @brief 函数级抽取: 每个函数定义输出一行 "函数名 t1,p,t2 ...",
+ * 函数名 token 遮蔽为未登录 token 0; 各函数作为独立单位提交到共享池,
+ * 叶节点上限按函数计算
+ */
+void write_functions(const std::filesystem::path &file_path, TSNode root,
+                     std::string_view source, std::mt19937 &gen,
+                     StageClock &clock) {
+  // 池中的其他线程也会读取, 不能是 thread_local
+  std::vector<FunctionUnit> functions;
+  find_functions(root, source, functions);
+  clock.Lap(Stage::LeafCollect);
+  std::vector<uint32_t> seeds(functions.size());
+  for (uint32_t &seed : seeds)
+    seed = static_cast<uint32_t>(gen());
+  std::vector<std::string> lines(functions.size());
+  auto extract = [&](size_t f) {
+    thread_local std::vector<PathContext> contexts;
+    thread_local std::vector<uint32_t> counts;
+    thread_local ContextSet context_set;
+    std::mt19937 function_gen(seeds[f]);
+    ExtractOptions options = file_options(file_path);
+    options.pool = nullptr; // 函数本身已是分块单位
+    options.mask_byte = functions[f].name_byte;
+    contexts.clear();
+    if (extract_tree(functions[f].node, source, function_gen, options,
+                     contexts) != ExtractStatus::Ok) {
+      functions_skipped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    const std::vector<uint32_t> *context_counts = nullptr;
+    if (dedup_contexts) {
+      context_set.Compact(contexts, counts);
+      context_counts = &counts;
     }
+    const std::string identity =
+        file_path.native() + ':' + std::to_string(functions[f].name_byte);
+    if (write_binary(functions[f].label, identity, contexts, context_counts))
+      functions_extracted.fetch_add(1, std::memory_order_relaxed);
+    else
+      append_contexts(lines[f], functions[f].label, contexts, context_counts);
+  };
+  if (chunk_pool && functions.size() > 1) {
+    chunk_pool->Run(functions.size(), extract);
+  } else {
+    for (size_t f = 0; f < functions.size(); ++f)
+      extract(f);
   }
-  return result;
+  clock.Skip(); // 其后各阶段已在 lca_path_traverse 内计时
+  if (tensor_writer || ctx_writer)
+    return;
+  std::string tmp;
+  for (const std::string &line : lines) {
+    if (line.empty())
+      continue;
+    tmp += line;
+    tmp += '\n';
+    functions_extracted.fetch_add(1, std::memory_order_relaxed);
+  }
+  clock.Lap(Stage::Serialize);
+  std::unique_lock<std::mutex> lock(cout_mutex, std::defer_lock);
+  Stats::Lock(lock, cout_lock_stats);
+  std::cout << tmp;
+  lock.unlock();
+  clock.Lap(Stage::Write);
 }
 
-void load_token_vocab(const std::filesystem::path &file_path) {
-  std::ifstream infile(file_path);
-  std::string token;
-  unsigned int id;
-  while (infile >> token >> id)
-    token_vocab[token] = id;
+/**
+ * @brief 记录单文件延迟并刷新进度
+ */
+void finish_file(uint64_t file_start) {
+  if (Stats::Enabled())
+    file_latency.Record((Stats::Now() - file_start) / 1000);
+
+  int processed = files_processed.fetch_add(1, std::memory_order_relaxed) + 1;
+  std::unique_lock<std::mutex> lock(cout_mutex, std::defer_lock);
+  Stats::Lock(lock, cout_lock_stats);
+  std::clog << "\r已处理文件: " << processed << "/" << total_files << " ("
+            << (processed * 100) / total_files << "%)";
+  std::clog.flush();
 }
 
-void load_type_vocab(const std::filesystem::path &file_path) {
-  std::ifstream infile(file_path);
-  std::string type;
-  unsigned int id;
-  while (infile >> type >> id)
-    type_vocab[type] = id;
+/**
+ * @brief 展平后写入缓存, 供之后调整采样参数时免解析重跑
+ */
+void cache_tree(const std::filesystem::path &file_path, SourceLang lang,
+                std::string_view source, TSNode root) {
+  thread_local std::vector<FlatNode> flat_nodes;
+  thread_local std::vector<uint32_t> flat_leaves;
+  if (flatten_ast(root, flat_nodes, flat_leaves))
+    cache_writer->Add(file_path.lexically_relative(cache_root).string(),
+                      static_cast<uint8_t>(lang), source, flat_nodes,
+                      flat_leaves);
 }
 
-void load_path_vocab(const std::filesystem::path &file_path) {
-  std::ifstream infile(file_path);
-  std::string line;
-  while (std::getline(infile, line)) {
-    std::stringstream ss(line);
-    std::vector<unsigned int> path_vec;
-    std::string part;
-    // Parse all parts except the last one (ID)
-    while (std::getline(ss, part, ',')) {
-      part.erase(part.find_last_not_of(" \t") + 1); // Trim trailing spaces
-      if (ss.peek() == EOF) {                       // Last part is the ID
-        path_vocab[path_vec] = std::stoi(part);
-        break;
+/**
+ * @brief 直接在缓存的扁平语法树上抽取, 不调用 tree-sitter
+ */
+void cached_worker_thread() {
+  thread_local std::mt19937 gen(std::random_device{}());
+  thread_local std::vector<PathContext> contexts;
+  while (true) {
+    // 先协助其他线程未完成的大文件分块
+    while (chunk_pool && chunk_pool->Help()) {
+    }
+    StageClock clock;
+    size_t index = next_record.fetch_add(1, std::memory_order_relaxed);
+    if (index >= pack_records.size() || parse_cancel_flag != 0)
+      return;
+    FlatAst ast = ast_cache.Get(pack_records[index]);
+    std::filesystem::path file_path = pack_path / ast.name;
+    if (!AstCacheReader::ValidNodes(ast)) {
+      {
+        std::lock_guard<std::mutex> lock(cout_mutex);
+        std::cerr << "缓存记录损坏, 已跳过: " << file_path << "\n";
       }
-      path_vec.push_back(std::stoi(part));
+      files_processed.fetch_add(1, std::memory_order_relaxed);
+      continue;
+    }
+    clock.Lap(Stage::Read);
+    uint64_t file_start = Stats::Enabled() ? Stats::Now() : 0;
+    // 缓存中没有 TSNode, 只做内容哈希去重
+    DedupTicket ticket;
+    if (dedup && dedup->CheckContent(ast.source, ticket)) {
+      files_processed.fetch_add(1, std::memory_order_relaxed);
+      continue;
     }
 
-    // while (std::getline(ss, part, ',')) {
-    //   if (part.find(' ') != std::string::npos) {
-    //     std::stringstream parts(part);
-    //     std::string last, id_str;
-    //     std::getline(parts, last, ' ');
-    //     std::getline(parts, id_str);
-    //     if (!last.empty())
-    //       path_vec.push_back(std::stoi(last));
-    //     path_vocab[path_vec] = std::stoi(id_str);
-    //   } else {
-    //     path_vec.push_back(std::stoi(part));
-    //   }
-    // }
+    ExtractOptions options = file_options(file_path);
+    contexts.clear();
+    ExtractStatus status =
+        walk_options.walks_per_leaf != 0
+            ? random_walk_traverse(*worker_vocab, ast,
+                                   cache_type_ids[ast.lang], gen, options,
+                                   walk_options, contexts)
+            : lca_path_traverse(*worker_vocab, ast, cache_type_ids[ast.lang],
+                                gen, options, contexts);
+    clock.Skip(); // 其后各阶段已在 lca_path_traverse 内计时
+    write_result(file_path, status, contexts, clock);
+    finish_file(file_start);
   }
 }
 
 void worker_thread() {
   while (true) {
+    while (chunk_pool && chunk_pool->Help()) {
+    }
     std::filesystem::path file_path;
-    {
-      std::lock_guard<std::mutex> lock(queue_mutex);
-      if (file_queue.empty())
+    std::string buffer;
+    // 打包语料直接在映射内存上解析, 目录输入则指向 buffer
+    std::string_view source;
+    SourceLang lang;
+    StageClock clock;
+
+    if (corpus_pack.IsOpen()) {
+      size_t index = next_record.fetch_add(1, std::memory_order_relaxed);
+      if (index >= pack_records.size() || parse_cancel_flag != 0)
+        return;
+      PackRecord record = corpus_pack.Get(pack_records[index]);
+      file_path = pack_path / record.name;
+      lang = record.lang == PACK_LANG_C ? SourceLang::C : SourceLang::Cpp;
+      source = record.content;
+      if (parse_limits.max_bytes != 0 &&
+          source.size() > parse_limits.max_bytes) {
+        quarantine.Add(file_path, "bytes=" + std::to_string(source.size()));
+        files_quarantined.fetch_add(1, std::memory_order_relaxed);
+        files_processed.fetch_add(1, std::memory_order_relaxed);
+        continue;
+      }
+    } else {
+      PrefetchedFile item;
+      if (!prefetcher->Next(item) || parse_cancel_flag != 0)
         return;
-      file_path = file_queue.front();
-      file_queue.pop();
+      file_path = std::move(item.file.path);
+      lang = item.file.lang == PACK_LANG_C ? SourceLang::C : SourceLang::Cpp;
+      if (item.oversize) {
+        quarantine.Add(file_path, "bytes=" + std::to_string(item.size));
+        files_quarantined.fetch_add(1, std::memory_order_relaxed);
+        files_processed.fetch_add(1, std::memory_order_relaxed);
+        continue;
+      }
+      if (item.error != 0) {
+        files_processed.fetch_add(1, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(cout_mutex);
+        std::cerr << "无法打开文件: " << file_path << "\n";
+        continue;
+      }
+      buffer.swap(item.data);
+      source = buffer;
     }
-
-    std::ifstream file(file_path, std::ios::binary);
-    if (!file) {
-      std::lock_guard<std::mutex> lock(cout_mutex);
-      std::cerr << "无法打开文件: " << file_path << "\n";
+    clock.Lap(Stage::Read);
+    uint64_t file_start = Stats::Enabled() ? Stats::Now() : 0;
+    thread_local std::string normalized;
+    if (normalize) {
+      normalize_source(source, lang == SourceLang::Cpp, normalized);
+      source = normalized;
+      clock.Lap(Stage::Normalize);
+    }
+    DedupTicket ticket;
+    if (dedup && dedup->CheckContent(source, ticket)) {
+      if (prefetcher)
+        prefetcher->Recycle(std::move(buffer));
+      files_processed.fetch_add(1, std::memory_order_relaxed);
       continue;
     }
-
-    std::string source((std::istreambuf_iterator<char>(file)),
-                       std::istreambuf_iterator<char>());
-    TSParser *parser = ts_parser_new();
-    TSLanguage *lang;
     thread_local std::mt19937 gen(std::random_device{}());
+    thread_local std::vector<PathContext> contexts;
+    TSParser *parser = thread_parser(lang);
+    ts_parser_set_timeout_micros(parser, parse_limits.timeout_micros);
+    ts_parser_set_cancellation_flag(parser,
+                                    cancel_flag_address(parse_cancel_flag));
+    TSTree *tree = ts_parser_parse_string(parser, nullptr, source.data(),
+                                          source.size());
+    if (Stats::Enabled())
+      parse_latency.Record(clock.SinceMicros());
+    clock.Lap(Stage::Parse);
+    if (tree == nullptr) {
+      ts_parser_reset(parser);
+      if (parse_cancel_flag != 0)
+        return;
+      quarantine.Add(file_path, "timeout");
+      files_quarantined.fetch_add(1, std::memory_order_relaxed);
+      files_processed.fetch_add(1, std::memory_order_relaxed);
+      continue;
+    }
+    TSNode root = ts_tree_root_node(tree);
+    if (dedup && dedup->CheckStructure(file_path, root, ticket)) {
+      ts_tree_delete(tree);
+      if (prefetcher)
+        prefetcher->Recycle(std::move(buffer));
+      files_processed.fetch_add(1, std::memory_order_relaxed);
+      continue;
+    }
 
-    if (file_path.extension() == ".c") {
-      lang = tree_sitter_c();
+    if (cache_writer) {
+      cache_tree(file_path, lang, source, root);
+      clock.Skip();
+    }
+    if (function_mode) {
+      write_functions(file_path, root, source, gen, clock);
+      ts_tree_delete(tree);
     } else {
-      lang = tree_sitter_cpp();
+      ExtractOptions options = file_options(file_path);
+      contexts.clear();
+      ExtractStatus status =
+          extract_tree(root, source, gen, options, contexts);
+      clock.Skip(); // 其后各阶段已在 lca_path_traverse 内计时
+      ts_tree_delete(tree);
+      write_result(file_path, status, contexts, clock);
     }
+    if (prefetcher)
+      prefetcher->Recycle(std::move(buffer));
+    finish_file(file_start);
+  }
+}
 
-    ts_parser_set_language(parser, lang);
-    TSTree *tree =
-        ts_parser_parse_string(parser, nullptr, source.c_str(), source.size());
-    TSNode root = ts_tree_root_node(tree);
+bool read_source(const std::filesystem::path &file_path, std::string &source) {
+  std::ifstream file(file_path, std::ios::binary | std::ios::ate);
+  if (!file)
+    return false;
+  source.resize(static_cast<size_t>(file.tellg()));
+  file.seekg(0);
+  return static_cast<bool>(file.read(source.data(), source.size()));
+}
 
-    std::string tmp = lca_path_traverse(root, file_path, source, gen, 200);
-    {
-      std::lock_guard<std::mutex> lock(cout_mutex);
-      std::cout << tmp << "\n";
-    }
+/**
+ * @brief 逐个领取提交谱系, 组内按提交号顺序以上一版语法树增量重解析
+ */
+void lineage_worker_thread() {
+  thread_local std::mt19937 gen(std::random_device{}());
+  std::vector<PathContext> contexts, last_contexts;
+  ExtractStatus last_status = ExtractStatus::TooFewLeaves;
+  double last_keep_rate = 1.0; // last_contexts 抽取时的保留率
+  std::string source, previous;
+  while (true) {
+    size_t index = next_lineage.fetch_add(1, std::memory_order_relaxed);
+    if (index >= lineages.size() || parse_cancel_flag != 0)
+      return;
+    TSTree *old_tree = nullptr; // 上一版的语法树, 对应 previous
+    for (const LineageFile &file : lineages[index]) {
+      if (parse_cancel_flag != 0)
+        break;
+      while (chunk_pool && chunk_pool->Help()) {
+      }
+      StageClock clock;
+      const std::filesystem::path &file_path = file.path;
+      SourceLang lang =
+          file.lang == PACK_LANG_C ? SourceLang::C : SourceLang::Cpp;
+      if (corpus_pack.IsOpen()) {
+        source.assign(corpus_pack.Get(file.record).content);
+      } else if (!read_source(file_path, source)) {
+        std::lock_guard<std::mutex> lock(cout_mutex);
+        std::cerr << "无法打开文件: " << file_path << "\n";
+        continue;
+      }
+      if (parse_limits.max_bytes != 0 &&
+          source.size() > parse_limits.max_bytes) {
+        quarantine.Add(file_path, "bytes=" + std::to_string(source.size()));
+        files_quarantined.fetch_add(1, std::memory_order_relaxed);
+        files_processed.fetch_add(1, std::memory_order_relaxed);
+        continue;
+      }
+      clock.Lap(Stage::Read);
+      uint64_t file_start = Stats::Enabled() ? Stats::Now() : 0;
+      if (normalize) {
+        // 规范化后只差注释或空白的相邻提交按相同处理
+        thread_local std::string normalized;
+        normalize_source(source, lang == SourceLang::Cpp, normalized);
+        source.swap(normalized);
+        clock.Lap(Stage::Normalize);
+      }
+      DedupTicket ticket;
+      if (dedup && dedup->CheckContent(source, ticket)) {
+        files_processed.fetch_add(1, std::memory_order_relaxed);
+        continue;
+      }
 
-    ts_tree_delete(tree);
-    ts_parser_delete(parser);
+      TSInputEdit edit;
+      if (old_tree != nullptr && !source_edit(previous, source, edit)) {
+        // 与上一版逐字节相同: 语法树不变, 不再解析;
+        // 隔离与错误占比上限已在发现阶段按本路径筛过, 保留率按本路径重算,
+        // 与上一版相同时才复用其抽取结果
+        parses_reused.fetch_add(1, std::memory_order_relaxed);
+        if (function_mode) {
+          write_functions(file_path, ts_tree_root_node(old_tree), previous,
+                          gen, clock);
+        } else {
+          ExtractOptions options = file_options(file_path);
+          if (options.keep_rate != last_keep_rate) {
+            last_contexts.clear();
+            last_status = extract_tree(ts_tree_root_node(old_tree), previous,
+                                       gen, options, last_contexts);
+            last_keep_rate = options.keep_rate;
+            clock.Skip();
+          }
+          contexts = last_contexts;
+          write_result(file_path, last_status, contexts, clock);
+        }
+        finish_file(file_start);
+        continue;
+      }
+      // 改动过大时增量重解析不划算, 退回全量解析
+      bool reuse_tree =
+          old_tree != nullptr &&
+          edit.new_end_byte - edit.start_byte <=
+              INCREMENTAL_MAX_CHANGE * static_cast<double>(source.size());
+      if (reuse_tree)
+        ts_tree_edit(old_tree, &edit);
+      TSParser *parser = thread_parser(lang);
+      ts_parser_set_timeout_micros(parser, parse_limits.timeout_micros);
+      ts_parser_set_cancellation_flag(parser,
+                                      cancel_flag_address(parse_cancel_flag));
+      TSTree *tree =
+          ts_parser_parse_string(parser, reuse_tree ? old_tree : nullptr,
+                                 source.data(), source.size());
+      if (Stats::Enabled())
+        (reuse_tree ? incremental_latency : parse_latency)
+            .Record(clock.SinceMicros());
+      clock.Lap(Stage::Parse);
+      (reuse_tree ? parses_incremental : parses_full)
+          .fetch_add(1, std::memory_order_relaxed);
+      if (old_tree != nullptr)
+        ts_tree_delete(old_tree);
+      old_tree = nullptr;
+      if (tree == nullptr) {
+        ts_parser_reset(parser);
+        if (parse_cancel_flag != 0)
+          return;
+        quarantine.Add(file_path, "timeout");
+        files_quarantined.fetch_add(1, std::memory_order_relaxed);
+        files_processed.fetch_add(1, std::memory_order_relaxed);
+        continue;
+      }
+      // 之后的提交以本版为基础, 即使本版被去重跳过
+      old_tree = tree;
+      previous.swap(source);
+      TSNode root = ts_tree_root_node(tree);
+      if (dedup && dedup->CheckStructure(file_path, root, ticket)) {
+        // 本版未抽取, 保留率置为 NaN, 其后相同的提交必定重新抽取
+        last_status = ExtractStatus::TooFewLeaves;
+        last_contexts.clear();
+        last_keep_rate = std::numeric_limits<double>::quiet_NaN();
+        files_processed.fetch_add(1, std::memory_order_relaxed);
+        continue;
+      }
 
-    int processed = files_processed.fetch_add(1, std::memory_order_relaxed) + 1;
-    {
-      std::lock_guard<std::mutex> lock(cout_mutex);
-      std::clog << "\r已处理文件: " << processed << "/" << total_files << " ("
-                << (processed * 100) / total_files << "%)";
-      std::clog.flush();
+      if (cache_writer) {
+        cache_tree(file_path, lang, previous, root);
+        clock.Skip();
+      }
+      if (function_mode) {
+        write_functions(file_path, root, previous, gen, clock);
+        finish_file(file_start);
+        continue;
+      }
+      ExtractOptions options = file_options(file_path);
+      contexts.clear();
+      last_status = extract_tree(root, previous, gen, options, contexts);
+      last_keep_rate = options.keep_rate;
+      clock.Skip(); // 其后各阶段已在 lca_path_traverse 内计时
+      last_contexts = contexts;
+      write_result(file_path, last_status, contexts, clock);
+      finish_file(file_start);
     }
+    if (old_tree != nullptr)
+      ts_tree_delete(old_tree);
   }
 }
 
+/**
+ * @brief 按 --pin-threads / --numa 放置第 index 个工作线程
+ * 副本模式下线程至少绑定到所在节点, 保证只访问本地副本
+ */
+void place_worker(unsigned index) {
+  const size_t node = numa.NodeOf(index);
+  if (pin_threads)
+    pin_thread_cpu(numa.CpuOf(index));
+  else if (vocab_replicas.Size() != 0)
+    pin_thread_node(numa.Nodes()[node]);
+  if (vocab_replicas.Size() != 0)
+    worker_vocab = &vocab_replicas.Get(node);
+}
+
 int main(int argc, char **argv) {
   std::ios::sync_with_stdio(false);
   std::cin.tie(nullptr);
   std::cout.tie(nullptr);
 
-  if (argc < 2 || argc > 3) {
-    std::cerr << "用法: " << argv[0] << " <目标目录> [上下文长度]\n";
+  std::vector<std::string> positional;
+  std::string quarantine_file, stats_file, dedup_report, cache_file;
+  std::string tensor_prefix, ctx_file;
+  size_t ctx_block_bytes = 1 << 20;
+  TensorOptions tensor_options;
+  bool with_stats = false;
+  bool with_dedup = false;
+  DedupOptions dedup_options;
+  unsigned perf_sample_every = 0;
+  ExtensionMap extensions;
+  IgnoreRules ignore_rules;
+  unsigned discovery_threads = 4;
+  size_t prefetch_depth = 64;
+  unsigned io_threads = 4;
+  PrefetchBackend io_backend = PrefetchBackend::Auto;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i], value;
+    if (Cli::MatchOption(arg, "--parse-timeout-ms", value))
+      parse_limits.timeout_micros = std::stoull(value) * 1000;
+    else if (Cli::MatchOption(arg, "--max-bytes", value))
+      parse_limits.max_bytes = Cli::ParseBytes(value);
+    else if (Cli::MatchOption(arg, "--max-leaves", value))
+      parse_limits.max_leaves = std::stoull(value);
+    else if (Cli::MatchOption(arg, "--quarantine", value))
+      quarantine_file = value;
+    else if (Cli::MatchOption(arg, "--error-filter", value)) {
+      if (!error_filter.Load(value)) {
+        std::cerr << "无法读取过滤列表: " << value << "\n";
+        return 1;
+      }
+    } else if (Cli::MatchOption(arg, "--max-error-ratio", value))
+      max_error_ratio = std::stod(value);
+    else if (Cli::MatchOption(arg, "--ext", value)) {
+      if (!extensions.Parse(value)) {
+        std::cerr << "无法解析扩展名映射: " << value << "\n";
+        return 1;
+      }
+    } else if (arg == "--headers")
+      extensions.AddHeaders();
+    else if (Cli::MatchOption(arg, "--ignore", value))
+      ignore_rules.AddPatterns(value);
+    else if (Cli::MatchOption(arg, "--discovery-threads", value))
+      discovery_threads = std::max(1ul, std::stoul(value));
+    else if (arg == "--stats" || Cli::MatchOption(arg, "--stats", value)) {
+      with_stats = true;
+      stats_file = value;
+    } else if (arg == "--perf" || Cli::MatchOption(arg, "--perf", value)) {
+      with_stats = true;
+      perf_sample_every = value.empty() ? 16 : std::stoul(value);
+    } else if (arg == "--incremental")
+      incremental = true;
+    else if (Cli::MatchOption(arg, "--shard", value)) {
+      if (!shard.Parse(value)) {
+        std::cerr << "无法解析分片: " << value << ", 应为 i/N\n";
+        return 1;
+      }
+    } else if (arg == "--normalize")
+      normalize = true;
+    else if (arg == "--functions")
+      function_mode = true;
+    else if (Cli::MatchOption(arg, "--numa", value)) {
+      bool ok;
+      numa_mode = NumaTopology::ParseMode(value, ok);
+      if (!ok) {
+        std::cerr << "未知的 NUMA 模式: " << value << "\n";
+        return 1;
+      }
+    } else if (arg == "--pin-threads")
+      pin_threads = true;
+    else if (Cli::MatchOption(arg, "--chunk-leaves", value))
+      chunk_leaves = std::stoull(value);
+    else if (Cli::MatchOption(arg, "--tensor-out", value))
+      tensor_prefix = value;
+    else if (Cli::MatchOption(arg, "--tensor-format", value)) {
+      if (value != "npy" && value != "raw") {
+        std::cerr << "未知的张量格式: " << value << ", 应为 npy 或 raw\n";
+        return 1;
+      }
+      tensor_options.npy = value == "npy";
+    } else if (Cli::MatchOption(arg, "--tensor-chunk", value))
+      tensor_options.chunk_rows = std::max(1ul, std::stoul(value));
+    else if (Cli::MatchOption(arg, "--ctx-out", value))
+      ctx_file = value;
+    else if (Cli::MatchOption(arg, "--ctx-block", value))
+      ctx_block_bytes = std::max<size_t>(1, Cli::ParseBytes(value));
+    else if (Cli::MatchOption(arg, "--walks", value))
+      walk_options.walks_per_leaf = std::stoul(value);
+    else if (Cli::MatchOption(arg, "--walk-hops", value))
+      walk_options.max_hops = std::max(1ul, std::stoul(value));
+    else if (Cli::MatchOption(arg, "--walk-budget", value))
+      walk_options.budget = std::stoull(value);
+    else if (Cli::MatchOption(arg, "--seed", value))
+      tensor_options.seed = std::stoull(value);
+    else if (Cli::MatchOption(arg, "--write-ast-cache", value))
+      cache_file = value;
+    else if (arg == "--dedup-contexts")
+      dedup_contexts = true;
+    else if (arg == "--dedup")
+      with_dedup = true;
+    else if (Cli::MatchOption(arg, "--dedup-threshold", value)) {
+      with_dedup = true;
+      dedup_options.threshold = std::stod(value);
+    } else if (Cli::MatchOption(arg, "--dup-keep", value)) {
+      with_dedup = true;
+      dedup_options.keep = std::max(1ul, std::stoul(value));
+    } else if (Cli::MatchOption(arg, "--dedup-report", value)) {
+      with_dedup = true;
+      dedup_report = value;
+    } else if (Cli::MatchOption(arg, "--prefetch-depth", value))
+      prefetch_depth = std::stoul(value);
+    else if (Cli::MatchOption(arg, "--io-threads", value))
+      io_threads = std::stoul(value);
+    else if (Cli::MatchOption(arg, "--io-backend", value)) {
+      bool ok;
+      io_backend = Prefetcher::ParseBackend(value, ok);
+      if (!ok) {
+        std::cerr << "未知的 I/O 后端: " << value << "\n";
+        return 1;
+      }
+    } else
+      positional.push_back(arg);
+  }
+  if (positional.empty() || positional.size() > 2) {
+    std::cerr << "用法: " << argv[0]
+              << " <目标目录|打包语料|语法树缓存> [上下文长度]"
+                 " [--parse-timeout-ms=N]"
+                 " [--max-bytes=N[K|M|G]] [--max-leaves=N]"
+                 " [--quarantine=隔离列表] [--error-filter=过滤列表]"
+                 " [--max-error-ratio=R] [--ext=.c=c,.h=cpp,...]"
+                 " [--headers] [--ignore=模式,...] [--discovery-threads=N]"
+                 " [--prefetch-depth=N] [--io-threads=N]"
+                 " [--io-backend=auto|uring|threads] [--stats[=报告.json]]"
+                 " [--perf[=采样间隔]] [--dedup] [--dedup-threshold=R]"
+                 " [--dup-keep=N] [--dedup-report=报告.json]"
+                 " [--dedup-contexts] [--write-ast-cache=缓存文件]"
+                 " [--incremental] [--chunk-leaves=N] [--functions]"
+                 " [--normalize] [--shard=i/N] [--tensor-out=前缀]"
+                 " [--tensor-format=npy|raw] [--tensor-chunk=行数]"
+                 " [--seed=N] [--ctx-out=上下文流]"
+                 " [--ctx-block=N[K|M]] [--walks=N] [--walk-hops=N]"
+                 " [--walk-budget=N] [--numa=off|interleave|replicate]"
+                 " [--pin-threads]\n"
+              << (ctx_stream_compression()
+                      ? "--ctx-out 块压缩: 已启用\n"
+                      : "--ctx-out 块压缩: 未启用, 块按原样存储"
+                        " (以 make WITH_ZLIB=1 构建)\n");
     return 1;
   }
-  if (argc == 3)
-    PATH_CONTEXT_LENGTH = std::stoi(argv[2]);
+  if (with_dedup)
+    dedup = std::make_unique<Deduplicator>(dedup_options);
+  if (positional.size() == 2)
+    PATH_CONTEXT_LENGTH = std::stoi(positional[1]);
+  if (!tensor_prefix.empty()) {
+    tensor_options.max_contexts = std::max(1, PATH_CONTEXT_LENGTH);
+    tensor_writer = std::make_unique<TensorWriter>(tensor_options);
+    if (!tensor_writer->Open(tensor_prefix)) {
+      std::cerr << "无法写入张量输出: " << tensor_prefix << "\n";
+      return 1;
+    }
+  }
+  if (!ctx_file.empty()) {
+    ctx_writer = std::make_unique<CtxStreamWriter>(ctx_block_bytes);
+    if (!ctx_writer->Open(ctx_file)) {
+      std::cerr << "无法写入上下文流: " << ctx_file << "\n";
+      return 1;
+    }
+  }
 
-  const std::filesystem::path root_path(argv[1]);
-  const std::filesystem::path vocab_dir = root_path / "out";
+  const std::filesystem::path root_path(positional[0]);
+  const bool packed_input = PackReader::IsPack(root_path);
+  const bool cached_input = AstCacheReader::IsCache(root_path);
+  const std::filesystem::path vocab_dir =
+      (packed_input || cached_input ? root_path.parent_path() : root_path) /
+      "out";
+  if (quarantine_file.empty())
+    quarantine_file = (vocab_dir / "quarantine.txt").string();
+  if (!quarantine.Open(quarantine_file))
+    std::cerr << "无法打开隔离列表: " << quarantine_file << "\n";
+  std::signal(SIGINT, [](int) { parse_cancel_flag = 1; });
+  if (with_stats)
+    Stats::Enable();
+  if (perf_sample_every != 0) {
+    Perf::Enable(perf_sample_every);
+    std::string reason;
+    if (!Perf::Available(reason))
+      std::clog << "硬件计数器不可用, 只输出计时统计: " << reason << "\n";
+  }
 
-  load_token_vocab(vocab_dir / "token_vocab.txt");
-  load_type_vocab(vocab_dir / "type_vocab.txt");
-  load_path_vocab(vocab_dir / "path_vocab.txt");
+  numa.Load();
+  // 交错策略只作用于加载词汇表的这段分配
+  if (numa_mode == NumaMode::Interleave && numa.NodeCount() > 1 &&
+      !set_memory_interleave(numa.Nodes()))
+    std::clog << "无法设置交错分配, 词汇表按默认策略分配\n";
+  vocab.Load(vocab_dir);
+  if (numa_mode == NumaMode::Interleave)
+    reset_memory_policy();
 
-  if (path_vocab.empty()) {
+  if (vocab.path.empty()) {
     std::cerr << "路径词汇表为空，请检查路径词汇表文件\n";
     return 1;
   }
-  auto it = path_vocab.begin();
+  auto it = vocab.path.begin();
   std::cerr << "Path:";
   for (const auto &val : it->first) {
     std::cerr << val << ",";
   }
   std::cerr << "ID: " << it->second << std::endl;
 
-  for (const auto &entry :
-       std::filesystem::recursive_directory_iterator(root_path)) {
-    if (entry.is_regular_file()) {
-      const auto &path = entry.path();
-      std::string ext = path.extension().string();
-      if (ext == ".c" || ext == ".cpp" || ext == ".cc" || ext == ".cxx") {
-        std::lock_guard<std::mutex> lock(queue_mutex);
-        file_queue.push(path);
+  if (!cache_file.empty()) {
+    if (cached_input) {
+      std::cerr << "输入已是语法树缓存, 忽略 --write-ast-cache\n";
+    } else {
+      cache_writer = std::make_unique<AstCacheWriter>();
+      if (!cache_writer->Open(cache_file)) {
+        std::cerr << "无法写入语法树缓存: " << cache_file << "\n";
+        return 1;
       }
+      // 记录名与打包语料一致: 相对语料根目录的路径
+      cache_root = root_path;
+      if (!packed_input)
+        cache_root = std::filesystem::absolute(root_path).lexically_normal();
     }
   }
 
-  total_files = file_queue.size();
-  if (total_files == 0) {
-    std::cerr << "未找到C/C++文件\n";
-    return 1;
+  auto start = std::chrono::steady_clock::now();
+  std::atomic<size_t> skipped_files{0};
+  const std::filesystem::path shard_root =
+      std::filesystem::absolute(root_path).lexically_normal();
+  std::thread discoverer;
+  if (cached_input) {
+    if (incremental) {
+      std::clog << "语法树缓存输入无需解析, 忽略 --incremental\n";
+      incremental = false;
+    }
+    if (function_mode) {
+      std::cerr << "语法树缓存不含字段信息, 不支持 --functions\n";
+      return 1;
+    }
+    if (normalize)
+      std::clog << "语法树缓存保存的是建缓存时的源代码, 忽略 --normalize\n";
+    if (!ast_cache.Open(root_path)) {
+      std::cerr << "无法读取语法树缓存: " << root_path << "\n";
+      return 1;
+    }
+    pack_path = root_path;
+    for (uint8_t lang = 0; lang < 2; ++lang)
+      cache_type_ids[lang] = flat_type_ids(vocab, ast_cache.TypeNames(lang));
+    for (size_t i = 0; i < ast_cache.Size(); ++i) {
+      std::string_view name = ast_cache.Get(i).name;
+      if (!shard.Contains(name))
+        continue;
+      std::filesystem::path path = pack_path / name;
+      if (quarantine.Contains(path) ||
+          error_filter.Ratio(path) > max_error_ratio) {
+        skipped_files++;
+        continue;
+      }
+      pack_records.push_back(static_cast<uint32_t>(i));
+    }
+    total_files = pack_records.size();
+    if (total_files == 0) {
+      std::cerr << "语法树缓存中没有可处理的文件\n";
+      return 1;
+    }
+  } else if (packed_input) {
+    if (!corpus_pack.Open(root_path)) {
+      std::cerr << "无法读取打包语料: " << root_path << "\n";
+      return 1;
+    }
+    pack_path = root_path;
+    for (size_t i = 0; i < corpus_pack.Size(); ++i) {
+      std::string_view name = corpus_pack.Get(i).name;
+      if (!shard.Contains(name))
+        continue;
+      std::filesystem::path path = pack_path / name;
+      if (quarantine.Contains(path) ||
+          error_filter.Ratio(path) > max_error_ratio) {
+        skipped_files++;
+        continue;
+      }
+      pack_records.push_back(static_cast<uint32_t>(i));
+    }
+    total_files = pack_records.size();
+    if (total_files == 0) {
+      std::cerr << "未找到C/C++文件\n";
+      return 1;
+    }
+    if (incremental) {
+      std::vector<LineageFile> files;
+      for (uint32_t record : pack_records) {
+        PackRecord entry = corpus_pack.Get(record);
+        files.push_back({pack_path / entry.name, entry.lang, record});
+      }
+      lineages = group_lineages(files);
+    }
+  } else if (incremental) {
+    // 分组需要完整的文件列表, 先遍历完再开始处理
+    ignore_rules.AddPattern(".git");
+    ignore_rules.AddPath(vocab_dir);
+    std::mutex files_mutex;
+    std::vector<LineageFile> files;
+    Discovery discovery(extensions, ignore_rules);
+    discovery.Walk(root_path, discovery_threads,
+                   [&](std::vector<SourceFile> &batch) {
+                     std::lock_guard<std::mutex> lock(files_mutex);
+                     for (SourceFile &file : batch) {
+                       if (!shard.Contains(file.path, shard_root))
+                         continue;
+                       if (quarantine.Contains(file.path) ||
+                           error_filter.Ratio(file.path) > max_error_ratio) {
+                         skipped_files++;
+                         continue;
+                       }
+                       files.push_back({std::move(file.path), file.lang, 0});
+                     }
+                   });
+    total_files = files.size();
+    lineages = group_lineages(files);
+  } else {
+    ignore_rules.AddPattern(".git");
+    ignore_rules.AddPath(vocab_dir);
+    // 遍历 -> 预读 -> 解析三级流水线, 预读保持 prefetch_depth 个文件在内存中
+    prefetcher = std::make_unique<Prefetcher>(
+        prefetch_depth, io_threads, io_backend, parse_limits.max_bytes);
+    std::clog << "预读后端: " << prefetcher->BackendName() << ", 深度 "
+              << prefetch_depth << "\n";
+    discoverer = std::thread([&, discovery_threads]() {
+      Discovery discovery(extensions, ignore_rules);
+      discovery.Walk(root_path, discovery_threads,
+                     [&](std::vector<SourceFile> &files) {
+                       files.erase(std::remove_if(
+                                       files.begin(), files.end(),
+                                       [&](const SourceFile &file) {
+                                         return !shard.Contains(file.path,
+                                                                shard_root);
+                                       }),
+                                   files.end());
+                       auto kept = std::remove_if(
+                           files.begin(), files.end(),
+                           [&](const SourceFile &file) {
+                             return quarantine.Contains(file.path) ||
+                                    error_filter.Ratio(file.path) >
+                                        max_error_ratio;
+                           });
+                       skipped_files += files.end() - kept;
+                       files.erase(kept, files.end());
+                       total_files += files.size();
+                       prefetcher->Push(files);
+                     });
+      prefetcher->Close();
+    });
   }
 
   const unsigned num_threads = std::thread::hardware_concurrency();
   std::vector<std::thread> threads;
-  std::clog << "启动" << num_threads << "个线程处理" << total_files
-            << "个文件...\n";
+  if (incremental)
+    std::clog << "启动" << num_threads << "个线程处理" << lineages.size()
+              << "个提交谱系, 共" << total_files << "个文件...\n";
+  else if (packed_input || cached_input)
+    std::clog << "启动" << num_threads << "个线程处理" << total_files
+              << "个文件...\n";
+  else
+    std::clog << "启动" << num_threads << "个线程, 边遍历边处理...\n";
 
+  void (*worker)() = cached_input  ? cached_worker_thread
+                     : incremental ? lineage_worker_thread
+                                   : worker_thread;
+  // 叶节点数不超过 chunk_leaves 的文件仍由单个线程完成
+  if (chunk_leaves != 0 && num_threads > 1)
+    chunk_pool = std::make_unique<ChunkPool>(num_threads);
+  if (numa_mode == NumaMode::Replicate && numa.NodeCount() > 1) {
+    vocab_replicas.Build(numa, vocab);
+    std::clog << numa.NodeCount() << "个 NUMA 节点, 各建一份词汇表副本\n";
+  }
   for (unsigned i = 0; i < num_threads; ++i)
-    threads.emplace_back(worker_thread);
+    threads.emplace_back([worker, i]() {
+      place_worker(i);
+      worker();
+      // 没有文件可领取后继续协助仍在处理大文件的线程
+      if (chunk_pool)
+        chunk_pool->Drain();
+    });
 
+  if (discoverer.joinable())
+    discoverer.join();
   for (auto &t : threads)
     t.join();
+  if (skipped_files != 0)
+    std::clog << "\n跳过隔离或语法错误超限的" << skipped_files << "个文件\n";
+  if (total_files == 0) {
+    std::cerr << "未找到C/C++文件\n";
+    return 1;
+  }
 
   std::clog << "\n处理完成！已处理文件数: " << files_processed << "/"
             << total_files << "\n";
+  if (files_quarantined != 0)
+    std::clog << "新隔离文件数: " << files_quarantined << " -> "
+              << quarantine_file << "\n";
+  if (function_mode)
+    std::clog << "函数样本数: " << functions_extracted
+              << ", 叶节点过少或超限而跳过的函数: " << functions_skipped
+              << "\n";
+  if (incremental)
+    std::clog << "增量解析: " << parses_incremental << ", 全量解析: "
+              << parses_full << ", 与上一版相同而复用: " << parses_reused
+              << "\n";
+  if (tensor_writer) {
+    size_t rows = tensor_writer->Size();
+    if (tensor_writer->Finish())
+      std::clog << "张量样本: " << rows << "行 -> " << tensor_prefix
+                << ".*\n";
+    else
+      std::cerr << "写入张量输出失败: " << tensor_prefix << "\n";
+  }
+  if (ctx_writer) {
+    uint64_t samples = ctx_writer->Size();
+    if (ctx_writer->Finish())
+      std::clog << "上下文流: " << samples << "个样本 -> " << ctx_file << "\n";
+    else
+      std::cerr << "写入上下文流失败: " << ctx_file << "\n";
+  }
+  if (cache_writer) {
+    size_t cached = cache_writer->Size();
+    if (cache_writer->Finish())
+      std::clog << "语法树缓存: " << cached << "个文件 -> " << cache_file
+                << "\n";
+    else
+      std::cerr << "写入语法树缓存失败: " << cache_file << "\n";
+  }
+  if (dedup) {
+    std::clog << "重复提交跳过数: " << dedup->Skipped() << "\n";
+    if (!dedup_report.empty()) {
+      std::ofstream report(dedup_report);
+      dedup->WriteReport(report);
+    }
+  }
+  if (with_stats) {
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    std::vector<std::pair<std::string, const LatencyHistogram *>> histograms =
+        {{"file_latency_us", &file_latency},
+         {"parse_latency_us", &parse_latency}};
+    if (incremental)
+      histograms.emplace_back("incremental_parse_latency_us",
+                              &incremental_latency);
+    if (stats_file.empty()) {
+      Stats::WriteReport(std::clog, seconds, files_processed, histograms);
+    } else {
+      std::ofstream report(stats_file);
+      Stats::WriteReport(report, seconds, files_processed, histograms);
+    }
+  }
   return 0;
 }
@@ -0,0 +1,150 @@
+#include "cli.h"
+#include "latency.h"
+#include "protocol.h"
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+constexpr size_t MAX_SAMPLES = 1000; // 最多载入的样本文件数
+
+struct Sample {
+  uint8_t lang;
+  std::string source;
+};
+
+std::vector<Sample> samples;
+LatencyHistogram latency;
+std::atomic<uint64_t> requests_failed{0};
+std::atomic<uint64_t> contexts_received{0};
+uint8_t request_flags = 0;
+
+void load_sample(const std::filesystem::path &path) {
+  std::string ext = path.extension().string();
+  if (ext != ".c" && ext != ".cpp" && ext != ".cc" && ext != ".cxx")
+    return;
+  std::ifstream file(path, std::ios::binary);
+  if (!file)
+    return;
+  samples.push_back({static_cast<uint8_t>(ext == ".c" ? 0 : 1),
+                     std::string((std::istreambuf_iterator<char>(file)),
+                                 std::istreambuf_iterator<char>())});
+}
+
+/**
+ * @brief 单连接闭环压测: 发送请求后等待响应再发下一个
+ */
+void client_thread(const std::string &socket_path, int index, int requests) {
+  int fd = Protocol::Connect(socket_path);
+  if (fd < 0) {
+    requests_failed.fetch_add(requests, std::memory_order_relaxed);
+    return;
+  }
+  std::vector<char> payload;
+  for (int i = 0; i < requests; ++i) {
+    const Sample &sample = samples[(index + i) % samples.size()];
+    RequestHeader request{static_cast<uint32_t>(sample.source.size()),
+                          sample.lang,
+                          request_flags,
+                          {0, 0}};
+    auto start = std::chrono::steady_clock::now();
+    ResponseHeader response;
+    if (!Protocol::WriteFull(fd, &request, sizeof(request)) ||
+        !Protocol::WriteFull(fd, sample.source.data(), sample.source.size()) ||
+        !Protocol::ReadFull(fd, &response, sizeof(response))) {
+      requests_failed.fetch_add(requests - i, std::memory_order_relaxed);
+      break;
+    }
+    // 去重响应在三元组后附带 count 个出现次数
+    size_t words = (request_flags & REQUEST_DEDUP) ? 4 : 3;
+    payload.resize(static_cast<size_t>(response.count) * words *
+                   sizeof(uint32_t));
+    if (!Protocol::ReadFull(fd, payload.data(), payload.size())) {
+      requests_failed.fetch_add(requests - i, std::memory_order_relaxed);
+      break;
+    }
+    latency.Record(std::chrono::duration_cast<std::chrono::microseconds>(
+                       std::chrono::steady_clock::now() - start)
+                       .count());
+    if (response.status != static_cast<uint32_t>(ResponseStatus::Ok))
+      requests_failed.fetch_add(1, std::memory_order_relaxed);
+    contexts_received.fetch_add(response.count, std::memory_order_relaxed);
+  }
+  ::close(fd);
+}
+
+int main(int argc, char **argv) {
+  std::vector<std::string> positional;
+  std::string socket_path = DEFAULT_SOCKET_PATH;
+  int connections = 4;
+  int requests = 1000;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i], value;
+    if (Cli::MatchOption(arg, "--socket", value))
+      socket_path = value;
+    else if (Cli::MatchOption(arg, "--connections", value))
+      connections = std::stoi(value);
+    else if (Cli::MatchOption(arg, "--requests", value))
+      requests = std::stoi(value);
+    else if (arg == "--dedup-contexts")
+      request_flags |= REQUEST_DEDUP;
+    else
+      positional.push_back(arg);
+  }
+  if (positional.size() != 1 || connections <= 0 || requests <= 0) {
+    std::cerr << "用法: " << argv[0]
+              << " <样本文件或目录> [--socket=路径] [--connections=N]"
+                 " [--requests=每连接请求数] [--dedup-contexts]\n";
+    return 1;
+  }
+
+  const std::filesystem::path sample_path(positional[0]);
+  if (std::filesystem::is_directory(sample_path)) {
+    for (const auto &entry :
+         std::filesystem::recursive_directory_iterator(sample_path)) {
+      if (samples.size() >= MAX_SAMPLES)
+        break;
+      if (entry.is_regular_file())
+        load_sample(entry.path());
+    }
+  } else {
+    load_sample(sample_path);
+  }
+  if (samples.empty()) {
+    std::cerr << "未找到C/C++样本文件\n";
+    return 1;
+  }
+
+  std::clog << connections << "个连接, 每连接" << requests << "个请求, "
+            << samples.size() << "个样本" << std::endl;
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < connections; ++i)
+    threads.emplace_back(client_thread, socket_path, i, requests);
+  for (auto &t : threads)
+    t.join();
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+
+  std::cout << "请求数: " << latency.Count()
+            << " 失败: " << requests_failed.load()
+            << " 耗时: " << seconds << "s"
+            << " QPS: " << (seconds > 0 ? latency.Count() / seconds : 0.0)
+            << "\n上下文/请求: "
+            << (latency.Count() == 0
+                    ? 0.0
+                    : static_cast<double>(contexts_received.load()) /
+                          latency.Count())
+            << "\n延迟 p50: " << latency.Quantile(0.50)
+            << "us p90: " << latency.Quantile(0.90)
+            << "us p99: " << latency.Quantile(0.99)
+            << "us max: " << latency.Max() << "us mean: " << latency.Mean()
+            << "us" << std::endl;
+  return requests_failed.load() == 0 ? 0 : 1;
+}
@@ -1,5 +1,22 @@
+#include "astcache.h"
+#include "astdump.h"
+#include "cli.h"
+#include "dedup.h"
+#include "discovery.h"
+#include "membudget.h"
+#include "normalize.h"
+#include "pack.h"
+#include "perfcount.h"
+#include "prefetch.h"
+#include "quarantine.h"
+#include "randomwalk.h"
+#include "shard.h"
+#include "stats.h"
+#include "watch.h"
 #include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <csignal>
 #include <cstddef>
 #include <cstdint>
 #include <filesystem>
@@ -7,10 +24,13 @@
 #include <functional>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <queue>
 #include <random>
+#include <shared_mutex>
 #include <string>
+#include <string_view>
 #include <thread>
 #include <threads.h>
 #include <tree_sitter/api.h>
@@ -18,10 +38,6 @@
 // 声明 Tree-sitter 语言库
 extern "C" TSLanguage *tree_sitter_c();
 extern "C" TSLanguage *tree_sitter_cpp();
-constexpr bool SHOW_FILE_NAME = true; // 显示文件名
-constexpr bool SHOW_POSITION = true;  // 显示行列位置
-constexpr char INDENT_CHAR = ' ';     // 缩进字符
-constexpr int INDENT_SIZE = 2;        // 缩进量
 constexpr int MAX_DEPTH = 1200;
 int PATH_CONTEXT_LENGTH = 200; // 最长路径上下文长度
 unsigned int path_vocab_hash = 1;
@@ -34,9 +50,11 @@ std::mutex path_mutex;                        // 路径队列锁
 std::mutex token_mutex;                       // 词汇表锁
 std::mutex type_mutex;                        // 词汇表锁
 std::mutex path_vocab_mutex;                  // 路径词汇表锁
-std::queue<std::filesystem::path> file_queue; // 文件路径队列
+std::unique_ptr<Prefetcher> prefetcher;       // 源文件预读流水线
 std::queue<std::vector<TSNode>> path_queue;   // 路径队列
 std::atomic<int> files_processed{0};          // 已处理文件计数器
+std::atomic<int> files_quarantined{0};        // 本次新隔离文件计数器
+std::unique_ptr<Deduplicator> dedup;          // --dedup 时的重复提交检测
 std::atomic<int> slock{1};
 std::unordered_map<std::string, unsigned int> token_vocab;
 std::unordered_map<std::string, unsigned int> type_vocab;
@@ -46,9 +64,48 @@ struct VecrtorHash {
   }
 };
 std::map<std::string, int> m_path_vocab;
+// 各词汇表按ID的出现次数, 与对应词汇表同锁保护, vocabmerge 按频次合并分片
+std::vector<uint64_t> token_freq;
+std::vector<uint64_t> type_freq;
+std::vector<uint64_t> path_freq;
 std::unordered_map<std::vector<unsigned int>, unsigned int, VecrtorHash>
     path_vocab;
-size_t total_files = 0; // 总文件计数器
+std::atomic<size_t> total_files{0}; // 总文件计数器, 遍历期间持续增长
+// --stats 报告用的锁等待统计与单文件延迟直方图
+LockStats cout_lock_stats("cout_mutex");
+LockStats token_lock_stats("token_mutex");
+LockStats type_lock_stats("type_mutex");
+LockStats path_vocab_lock_stats("path_vocab_mutex");
+LatencyHistogram file_latency;  // 源代码就绪到输出完成
+LatencyHistogram parse_latency; // 单文件解析
+ParseLimits parse_limits;  // 单文件解析上限
+Quarantine quarantine;     // 病态文件隔离列表
+ErrorFilter error_filter;  // errorfilecount 生成的语法错误过滤列表
+double max_error_ratio = 1; // 错误字节占比超过该值的文件被跳过
+// 非0时 tree-sitter 中止正在进行的解析
+CancelFlag parse_cancel_flag{0};
+bool normalize = false;       // --normalize: 解析前在内存中去注释与空白行
+Shard shard;                  // --shard=i/N 时只处理属于本分片的文件
+std::ostream *contexts_out = &std::cout; // 分片模式写入分片目录
+PackReader corpus_pack;                 // 打包语料输入
+std::filesystem::path pack_path;        // 打包语料路径, 记录以其子路径标识
+std::vector<uint32_t> pack_records;     // 待处理的打包记录下标
+std::atomic<size_t> next_record{0};     // 下一个待领取的打包记录
+WalkOptions walk_options; // --walks=N 时以随机游走代替叶节点对
+bool watch_mode = false;  // --watch: 遍历完成后持续监视新提交
+MemoryBudget memory_budget; // --memory-limit 的内存占用统计与背压
+DumpOptions dump_options;   // --dump: 转储语法树代替路径抽取
+std::unique_ptr<DumpWriter> dump_writer;
+// 词汇表分段: --memory-limit 时词汇表超出预算即连同上下文写入 seg-K 并清空,
+// 之后由 vocabmerge 合并; 工作线程处理单个文件期间共享持有 segment_mutex,
+// 分段切换独占持有, 保证一行上下文的ID都属于同一分段
+std::shared_mutex segment_mutex;
+unsigned vocab_segment = 0; // 当前分段, 从1开始, 0 表示不分段
+std::filesystem::path vocab_root; // 输出目录, 分段目录位于其下
+std::ofstream segment_contexts;   // 当前分段的上下文文件
+thread_local SpillFile result_spill; // 超长单文件结果的临时落盘区
+// 词汇表条目除键以外的估算开销: 节点、哈希桶与频次计数
+constexpr size_t VOCAB_ENTRY_BYTES = 64;
 template <typename T> T min(T a, T b) { return a < b ? a : b; }
 namespace utils {
 bool is_leaf(TSNode node) { return ts_node_named_child_count(node) == 0; }
@@ -106,6 +163,7 @@ std::string node_type_to_string(TSNode node) {
 }
 /**
  * @brief 线程安全的AST遍历输出
+ * 整棵子树先转储到线程内缓冲区 (astdump.h), 只在写出时加锁一次
  * @param node 当前节点
  * @param source 源代码
  * @param depth 缩进深度
@@ -113,186 +171,34 @@ std::string node_type_to_string(TSNode node) {
  */
 void safe_traverse_ast(TSNode node, const std::string &source, int depth,
                        const std::filesystem::path &file_path) {
-  // 获取节点信息（线程安全部分）
-  const char *node_type = ts_node_type(node);
-  TSPoint start_point = ts_node_start_point(node);
-  uint32_t start_byte = ts_node_start_byte(node);
-  uint32_t end_byte = ts_node_end_byte(node);
-  std::string node_text = source.substr(start_byte, end_byte - start_byte);
-
-  // 加锁输出
-  {
-    std::lock_guard<std::mutex> lock(cout_mutex);
-    std::cout << "[" << file_path.filename() << "] "
-              << std::string(depth * 2, ' ') << "[" << node_type << "] "
-              << "L" << start_point.row + 1 << ":" << start_point.column + 1
-              << " \"" << node_text << "\"\n";
-  }
-
-  // 递归处理子节点（无锁操作）
-  uint32_t child_count = ts_node_child_count(node);
-  for (uint32_t i = 0; i < child_count; ++i) {
-    TSNode child = ts_node_child(node, i);
-    safe_traverse_ast(child, source, depth + 1, file_path);
-  }
+  DumpOptions options;
+  options.format = DumpFormat::Text;
+  options.all_nodes = true;
+  options.with_source = true;
+  options.base_depth = depth;
+  thread_local std::string buffer;
+  buffer.clear();
+  dump_tree(node, source, file_path.filename().native(), 0, options, buffer);
+  std::lock_guard<std::mutex> lock(cout_mutex);
+  std::cout << buffer;
 }
 /**
- * 不输出源代码的AST遍历
+ * 不输出源代码的AST遍历, 只含命名节点
  * @param node 当前节点
  * @param file_path 当前文件路径
  * @param depth 缩进深度
  */
 void simplified_traverse(TSNode node, const std::filesystem::path &file_path,
                          int depth = 0) {
-  const char *node_type = ts_node_type(node);
-  TSPoint start = ts_node_start_point(node);
-  {
-    std::lock_guard<std::mutex> lock(cout_mutex);
-    // 输出文件名（仅第一层节点显示）
-    if (depth == 0 && SHOW_FILE_NAME) {
-      std::cout << "[" << file_path.filename().string() << "]\n";
-    }
-    // 构建节点描述
-    std::string node_desc;
-    node_desc += std::string(depth * INDENT_SIZE, INDENT_CHAR);
-    node_desc += node_type;
-    // 添加位置信息
-    if (SHOW_POSITION) {
-      node_desc += " @ L" + std::to_string(start.row + 1) + ":C" +
-                   std::to_string(start.column + 1);
-    }
-    node_desc +=
-        "@child_count" + std::to_string(ts_node_named_child_count(node));
-    std::cout << node_desc << "\n";
-  }
-  // 递归处理子节点
-  uint32_t child_count = ts_node_named_child_count(node);
-  for (uint32_t i = 0; i < child_count; ++i) {
-    TSNode child = ts_node_named_child(node, i);
-    simplified_traverse(child, file_path, depth + 1);
-  }
-}
-
-/**
- * @brief 从指定叶节点出发随机游走，直到遇见另一叶节点，过程中构建游走路径
- *
- */
-// TODO: 添加词汇表生成过程
-void random_path_traverse(TSNode node, TSNode lastnode, std::string &path,
-                          const std::string &source, std::mt19937 gen,
-                          int depth, const TSNode root,
-                          bool can_parent = true) {
-  // 获得具名子节点计数
-  uint32_t child_count = ts_node_named_child_count(node);
-  // 递归出口,若当前节点无具名子节点,则记录该节点对应原始字符串并返回
-  if (child_count == 0) {
-    path += node_type_to_string(node);
-    path += ',';
-    path += source.substr(ts_node_start_byte(node),
-                          ts_node_end_byte(node) - ts_node_start_byte(node));
-    return;
-  }
-  if (depth > MAX_DEPTH) {
-    path += "[MAX_DEPTH] ";
-    return;
-  }
-  if (ts_node_is_error(node)) {
-    return;
-  }
-  std::uniform_int_distribution<int> dir(0, 1);
-  std::uniform_int_distribution<uint32_t> child_selector(0, child_count - 1);
-  TSNode next_node;
-  uint32_t random_index = child_selector(gen);
-  uint32_t new_random_index = random_index;
-  // 随机决定向父节点或是子节点游走(0:父节点,1:子节点)
-  if (((dir(gen) == 0 && can_parent && ts_node_eq(node, root)) ||
-       (child_count == 1 && can_parent &&
-        ts_node_eq(lastnode, ts_node_named_child(node, 0)))) &&
-      node.id != node.tree) {
-
-    next_node = ts_node_parent(node);
-    if (ts_node_is_named(node)) {
-      path += node_type_to_string(node);
-      path += ',';
-    }
-  } else {
-    next_node = ts_node_named_child(node, random_index);
-    if (ts_node_eq(next_node, lastnode) &&
-        (ts_node_named_child_count(node) > 1)) {
-      for (; new_random_index == random_index;
-           new_random_index = child_selector(gen))
-        ;
-      next_node = ts_node_named_child(node, new_random_index);
-    }
-    can_parent = false;
-    if (ts_node_is_named(node)) {
-      path += node_type_to_string(node);
-      path += ',';
-    }
-  }
-  random_path_traverse(next_node, node, path, source, gen, depth + 1, root,
-                       can_parent);
-}
-/**
- * @brief
- * 遍历AST，并根据指定的PathContext长度对超长路径截断。同时由Width控制在AST树上遍历时两叶节点间的宽度距离
- * @param node 当前节点
- * @param file_path 当前文件路径
- * @param depth 当前节点深度
- * @param source 源代码
- */
-void random_traverse(TSNode node, const std::filesystem::path &file_path,
-                     const std::string &source, const TSNode root,
-                     std::mt19937 gen, int depth = 0) {
-  const char *node_type = ts_node_type(node);
-
-  std::unique_lock<std::mutex> lock(cout_mutex, std::defer_lock);
-  if (depth == 0 && SHOW_FILE_NAME) {
-    lock.lock();
-    std::cout << file_path.filename().string() << " ";
-    lock.unlock();
-  }
-  if (depth > MAX_DEPTH) {
-    lock.lock();
-    std::cout << "[MAX_DEPTH] ";
-    lock.unlock();
-    return;
-  }
-  uint32_t child_count = ts_node_named_child_count(node);
-  if (child_count == 0 && !ts_node_is_null(node) && (!ts_node_eq(node, root))) {
-    std::string path;
-    if (!ts_node_is_error(node) && isRealNode(node)) {
-      std::string tmp =
-          source.substr(ts_node_start_byte(node),
-                        ts_node_end_byte(node) - ts_node_start_byte(node));
-      cleanNodeType(tmp);
-      path += tmp;
-      path += ",";
-      path += node_type_to_string(node);
-      path += ",";
-      random_path_traverse(ts_node_parent(node), node, path, source, gen, 0,
-                           root);
-    }
-    lock.lock();
-    if (path.length() > PATH_CONTEXT_LENGTH) {
-      int length = path.length();
-      for (int i = 0;
-           i < (length + PATH_CONTEXT_LENGTH - 1) / PATH_CONTEXT_LENGTH; i++) {
-        std::cout << path.substr(i * PATH_CONTEXT_LENGTH,
-                                 min<int>(PATH_CONTEXT_LENGTH,
-                                          length - i * PATH_CONTEXT_LENGTH))
-                  << " ";
-      }
-
-    } else if (path.length() > 0) {
-      std::cout << path << " ";
-    }
-    lock.unlock();
-  }
-  for (uint32_t i = 0; i < child_count; ++i) {
-    TSNode child = ts_node_named_child(node, i);
-    random_traverse(child, file_path, source, root, gen, depth + 1);
-  }
+  DumpOptions options;
+  options.format = DumpFormat::Text;
+  options.base_depth = depth;
+  thread_local std::string buffer;
+  buffer.clear();
+  dump_tree(node, std::string_view(), file_path.filename().native(), 0,
+            options, buffer);
+  std::lock_guard<std::mutex> lock(cout_mutex);
+  std::cout << buffer;
 }
 
 TSNode find_lca(TSNode source, TSNode targer) {
@@ -315,7 +221,7 @@ TSNode find_lca(TSNode source, TSNode targer) {
   TSNode lca = TSNode{};
   int i = path1.size() - 1;
   int j = path2.size() - 1;
-  while (i >= 0 && j >= 0 && ts_node_eq(path1[i], path2[2])) {
+  while (i >= 0 && j >= 0 && ts_node_eq(path1[i], path2[j])) {
     lca = path1[i];
     i--;
     j--;
@@ -323,19 +229,58 @@ TSNode find_lca(TSNode source, TSNode targer) {
   return lca;
 }
 
+inline void count_vocab(std::vector<uint64_t> &freq, unsigned int id) {
+  if (id >= freq.size())
+    freq.resize(id + 1);
+  freq[id]++;
+}
+
+// 新词汇表条目计入内存预算
+inline void charge_vocab(const std::string &key) {
+  memory_budget.Charge(MemClass::Vocab, key.size() + VOCAB_ENTRY_BYTES);
+}
+
+// 单文件结果超过阈值时转存到临时文件, 写出时由 write_result 拼接
+inline void spill_result(std::string &result) {
+  if (memory_budget.Enabled() &&
+      result.size() >= memory_budget.SpillThreshold()) {
+    size_t bytes = result.size();
+    if (result_spill.Spill(result))
+      memory_budget.CountSpill(bytes);
+  }
+}
+
 /**
  * @brief lca path extractor
+ * @param max_leaves 叶节点上限, 超出时不做抽取并置位 over_limit (0 不限制)
+ * @param keep_rate 叶节点对的额外保留率, 用于对含语法错误的文件降权
  */
 std::string lca_path_traverse(TSNode root,
                               const std::filesystem::path &file_path,
                               const std::string souce, std::mt19937 gen,
-                              int path_width = 200) {
+                              int path_width = 200, size_t max_leaves = 0,
+                              bool *over_limit = nullptr,
+                              double keep_rate = 1.0) {
+  StageClock clock;
+  PerfScope traverse_perf(PerfRegion::Traverse);
+  uint64_t contexts = 0;
   std::vector<TSNode> leaves;
+  size_t leaves_seen = 0;
   traverse_ast(root, [&](TSNode node) {
     if (isRealNode(node) && !ts_node_eq(node, root)) {
-      leaves.emplace_back(node);
+      // 超限后只计数不再保存, 避免病态文件撑爆内存
+      if (max_leaves == 0 || ++leaves_seen <= max_leaves) {
+        leaves.emplace_back(node);
+      }
     }
   });
+  clock.Lap(Stage::LeafCollect);
+  if (max_leaves != 0 && leaves_seen > max_leaves) {
+    if (over_limit != nullptr) {
+      *over_limit = true;
+    }
+    return std::string();
+  }
   int leaves_count = leaves.size();
   std::string result;
   std::unique_lock<std::mutex> lock_token(token_mutex, std::defer_lock);
@@ -346,11 +291,19 @@ std::string lca_path_traverse(TSNode root,
       result += (file_path.filename().string() + " ");
     }
     std::uniform_int_distribution<int> isGen(0, 1);
+    std::uniform_real_distribution<double> keep(0.0, 1.0);
+    // 被采样丢弃的叶节点对不计时, 其耗时并入下一个保留对的采样阶段
+    uint64_t sampled = 0;
     for (int i = 0; i < leaves_count; i++) {
       for (int j = i + 1; j < min(leaves_count, i + path_width); j++) {
-        if (isGen(gen) == 0) {
+        sampled++;
+        if (isGen(gen) == 0 || (keep_rate < 1.0 && keep(gen) >= keep_rate)) {
           continue;
         } else {
+          clock.Lap(Stage::PairSample, sampled);
+          sampled = 0;
+          bool perf_pair = Perf::SamplePair();
+          PerfScope path_perf(PerfRegion::PathBuild, perf_pair);
 
           std::vector<TSNode> path;
           std::string path_str;
@@ -376,6 +329,9 @@ std::string lca_path_traverse(TSNode root,
             }
 
             path.insert(path.end(), rpath.rbegin(), rpath.rend());
+            path_perf.Stop();
+            clock.Lap(Stage::PathBuild);
+            PerfScope vocab_perf(PerfRegion::VocabLookup, perf_pair);
             {
               std::string token1;
               std::string token2;
@@ -391,34 +347,26 @@ std::string lca_path_traverse(TSNode root,
                                           ts_node_end_byte(node) -
                                               ts_node_start_byte(node));
                     cleanNodeType(token1);
-                    lock_token.lock();
+                    Stats::Lock(lock_token, token_lock_stats);
                     if (token_vocab[token1] == 0) {
                       token_vocab[token1] = token_vocab_hash++;
+                      charge_vocab(token1);
                     }
                     token1_hash = token_vocab[token1];
+                    count_vocab(token_freq, token1_hash);
                     lock_token.unlock();
-                    std::string tmp;
-                    type_vocab_query_value = 0;
-                    tmp = node_type_to_string(node);
-                    lock_type.lock();
-                    type_vocab_query_value = type_vocab[tmp];
-                    if (type_vocab_query_value == 0) {
-                      type_vocab_query_value = type_vocab_hash++;
-                      type_vocab[tmp] = type_vocab_query_value;
-                    }
-                    // path_int.push_back(type_vocab[tmp]);
-                    path_str += "," + std::to_string(type_vocab_query_value);
-                    lock_type.unlock();
                   }
                 }
                 std::string tmp;
                 tmp = node_type_to_string(node);
-                lock_type.lock();
+                Stats::Lock(lock_type, type_lock_stats);
                 type_vocab_query_value = type_vocab[tmp];
                 if (type_vocab_query_value == 0) {
                   type_vocab[tmp] = type_vocab_hash++;
                   type_vocab_query_value = type_vocab[tmp];
+                  charge_vocab(tmp);
                 }
+                count_vocab(type_freq, type_vocab_query_value);
                 // path_int.push_back(type_vocab[tmp]);
                 path_str += "," + std::to_string(type_vocab_query_value);
                 lock_type.unlock();
@@ -427,49 +375,277 @@ std::string lca_path_traverse(TSNode root,
                                         ts_node_end_byte(node) -
                                             ts_node_start_byte(node));
                   cleanNodeType(token2);
-                  lock_token.lock();
+                  Stats::Lock(lock_token, token_lock_stats);
                   if (token_vocab[token2] == 0) {
                     token_vocab[token2] = token_vocab_hash++;
+                    charge_vocab(token2);
                   }
                   token2_hash = token_vocab[token2];
+                  count_vocab(token_freq, token2_hash);
                   lock_token.unlock();
-                  std::string tmp;
-                  tmp = node_type_to_string(node);
-                  lock_type.lock();
-                  type_vocab_query_value = type_vocab[tmp];
-                  if (type_vocab_query_value == 0) {
-                    type_vocab_query_value = type_vocab_hash++;
-                    type_vocab[tmp] = type_vocab_query_value;
-                  }
-                  // path_int.push_back(type_vocab[tmp]);
-                  path_str += "," + std::to_string(type_vocab_query_value);
-                  lock_type.unlock();
-                  lock_path.lock();
+                  Stats::Lock(lock_path, path_vocab_lock_stats);
                   // if (path_vocab[path_int] == 0) {
                   //   path_vocab[path_int] = path_vocab_hash++;
                   // }
                   // path_str = std::to_string(path_vocab[path_int]);
 
-                  if (m_path_vocab.find(path_str) == m_path_vocab.end()) {
+                  // 每个节点类型只出现一次, 与 vocab_extractor 查询的路径一致
+                  auto path_it = m_path_vocab.find(path_str);
+                  if (path_it == m_path_vocab.end()) {
                     path_hash_value = path_vocab_hash++;
                     m_path_vocab[path_str] = path_hash_value;
+                    charge_vocab(path_str);
+                  } else {
+                    path_hash_value = path_it->second;
                   }
+                  count_vocab(path_freq, path_hash_value);
                   lock_path.unlock();
                 }
               }
               // cleanNodeType(path_str);
+              vocab_perf.Stop();
+              clock.Lap(Stage::VocabLookup);
               result += (std::to_string(token1_hash) + ',' +
                          std::to_string(path_hash_value) + ',' +
                          std::to_string(token2_hash) + ' ');
+              spill_result(result);
+              clock.Lap(Stage::Serialize);
+              contexts++;
             }
           }
         }
       }
     }
+    if (sampled != 0) {
+      clock.Lap(Stage::PairSample, sampled);
+    }
   }
+  traverse_perf.Stop(contexts);
   return std::move(result);
 }
 
+/**
+ * @brief 查询或分配词汇表ID并计数
+ */
+template <typename Map>
+unsigned int register_vocab(Map &vocab, unsigned int &next_id,
+                            std::vector<uint64_t> &freq, std::mutex &mutex,
+                            LockStats &lock_stats, const std::string &key) {
+  std::unique_lock<std::mutex> lock(mutex, std::defer_lock);
+  Stats::Lock(lock, lock_stats);
+  auto it = vocab.find(key);
+  unsigned int id;
+  if (it == vocab.end()) {
+    id = next_id++;
+    vocab.emplace(key, id);
+    charge_vocab(key);
+  } else {
+    id = it->second;
+  }
+  count_vocab(freq, id);
+  return id;
+}
+
+/**
+ * @brief 随机游走抽取 (randomwalk.h), 取代逐步递归、按字符数截断的
+ * random_traverse; 路径键与 lca_path_traverse 相同, 为途经节点类型ID序列
+ */
+std::string random_walk_traverse(TSNode root,
+                                 const std::filesystem::path &file_path,
+                                 const std::string &source, std::mt19937 &gen,
+                                 size_t max_leaves = 0,
+                                 bool *over_limit = nullptr,
+                                 double keep_rate = 1.0) {
+  StageClock clock;
+  PerfScope traverse_perf(PerfRegion::Traverse);
+  thread_local std::vector<FlatNode> nodes;
+  thread_local std::vector<uint32_t> leaves;
+  thread_local RandomWalker walker;
+  if (!flatten_ast(root, nodes, leaves))
+    return std::string();
+  clock.Lap(Stage::LeafCollect);
+  if (max_leaves != 0 && leaves.size() > max_leaves) {
+    if (over_limit != nullptr)
+      *over_limit = true;
+    return std::string();
+  }
+  if (leaves.size() < 2)
+    return std::string();
+  static const std::vector<std::string> type_names[2] = {
+      language_type_names(tree_sitter_c()),
+      language_type_names(tree_sitter_cpp())};
+  const std::vector<std::string> &names =
+      type_names[ts_node_language(root) == tree_sitter_c() ? 0 : 1];
+  walker.Prepare(nodes.data(), nodes.size(), leaves.data(), leaves.size());
+
+  std::string result = file_path.filename().string() + " ";
+  std::uniform_real_distribution<double> keep(0.0, 1.0);
+  std::string token, path_str;
+  uint64_t contexts = 0;
+  walker.Walk(gen, walk_options, [&](const uint32_t *path, size_t length) {
+    if (keep_rate < 1.0 && keep(gen) >= keep_rate)
+      return;
+    auto token_id = [&](uint32_t index) {
+      token.assign(source, nodes[index].start,
+                   nodes[index].end - nodes[index].start);
+      cleanNodeType(token);
+      return register_vocab(token_vocab, token_vocab_hash, token_freq,
+                            token_mutex, token_lock_stats, token);
+    };
+    unsigned int token1 = token_id(path[0]);
+    path_str.clear();
+    for (size_t k = 0; k < length; ++k) {
+      uint16_t type = nodes[path[k]].type;
+      if (type == FLAT_ERROR_TYPE)
+        continue;
+      unsigned int type_id = register_vocab(
+          type_vocab, type_vocab_hash, type_freq, type_mutex, type_lock_stats,
+          type < names.size() ? names[type] : std::string("null"));
+      path_str += "," + std::to_string(type_id);
+    }
+    unsigned int path_id =
+        register_vocab(m_path_vocab, path_vocab_hash, path_freq,
+                       path_vocab_mutex, path_vocab_lock_stats, path_str);
+    unsigned int token2 = token_id(path[length - 1]);
+    result += std::to_string(token1) + ',' + std::to_string(path_id) + ',' +
+              std::to_string(token2) + ' ';
+    spill_result(result);
+    contexts++;
+  });
+  clock.Lap(Stage::PathBuild);
+  traverse_perf.Stop(contexts);
+  return result;
+}
+
+/**
+ * @brief 词汇表与频次的一份副本, 在锁外写出
+ */
+struct VocabSnapshot {
+  std::unordered_map<std::string, unsigned int> token;
+  std::unordered_map<std::string, unsigned int> type;
+  std::map<std::string, int> path;
+  std::vector<uint64_t> token_freq;
+  std::vector<uint64_t> type_freq;
+  std::vector<uint64_t> path_freq;
+};
+
+/**
+ * @brief 在全部词汇表锁下复制, 各文件ID一致; 只在复制期间阻塞工作线程
+ */
+VocabSnapshot copy_vocab() {
+  std::scoped_lock lock(token_mutex, type_mutex, path_vocab_mutex);
+  return {token_vocab, type_vocab, m_path_vocab,
+          token_freq,  type_freq,  path_freq};
+}
+
+/**
+ * @brief 取走词汇表并清空, ID 从1重新分配; 用于分段切换与最终写出
+ */
+VocabSnapshot take_vocab() {
+  std::scoped_lock lock(token_mutex, type_mutex, path_vocab_mutex);
+  VocabSnapshot vocab{std::move(token_vocab), std::move(type_vocab),
+                      std::move(m_path_vocab), std::move(token_freq),
+                      std::move(type_freq),    std::move(path_freq)};
+  token_vocab = {};
+  type_vocab = {};
+  m_path_vocab.clear();
+  token_freq = {};
+  type_freq = {};
+  path_freq = {};
+  token_vocab_hash = type_vocab_hash = path_vocab_hash = 1;
+  return vocab;
+}
+
+/**
+ * @brief 写出词汇表与频次文件, 不持有词汇表锁
+ * 先写临时文件再改名, 读取方不会看到写了一半的词汇表
+ */
+void write_vocab_files(const std::filesystem::path &vocab_dir,
+                       const VocabSnapshot &vocab) {
+  std::filesystem::create_directories(vocab_dir);
+  auto write = [&](const char *name, const auto &fill) {
+    std::filesystem::path path = vocab_dir / name;
+    std::filesystem::path tmp = path;
+    tmp += ".tmp";
+    {
+      std::ofstream file(tmp);
+      fill(file);
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, path, ec);
+    if (ec) {
+      std::cerr << "无法写入: " << path << ": " << ec.message() << "\n";
+    }
+  };
+  write("token_vocab.txt", [&](std::ofstream &file) {
+    for (const auto &entry : vocab.token) {
+      file << entry.first << " " << entry.second << "\n";
+    }
+  });
+  write("type_vocab.txt", [&](std::ofstream &file) {
+    for (const auto &entry : vocab.type) {
+      file << entry.first << " " << entry.second << "\n";
+    }
+  });
+  // 路径键为 ",类型ID,类型ID,...", 按 vocab_extractor 读取的 "ID,ID,..., 路径ID"
+  write("path_vocab.txt", [&](std::ofstream &file) {
+    for (const auto &entry : vocab.path) {
+      file << entry.first.substr(1) << ", " << entry.second << "\n";
+    }
+  });
+  // 每行 "ID 出现次数", 供 vocabmerge 按频次分配全局ID
+  for (const auto &freq :
+       {std::make_pair("token_freq.txt", &vocab.token_freq),
+        std::make_pair("type_freq.txt", &vocab.type_freq),
+        std::make_pair("path_freq.txt", &vocab.path_freq)}) {
+    write(freq.first, [&](std::ofstream &file) {
+      for (size_t id = 1; id < freq.second->size(); ++id) {
+        if ((*freq.second)[id] != 0) {
+          file << id << " " << (*freq.second)[id] << "\n";
+        }
+      }
+    });
+  }
+}
+
+std::filesystem::path segment_dir(unsigned segment) {
+  return vocab_root / ("seg-" + std::to_string(segment));
+}
+
+// 检查点与最终输出写入的目录
+std::filesystem::path current_vocab_dir() {
+  return vocab_segment != 0 ? segment_dir(vocab_segment) : vocab_root;
+}
+
+bool open_segment_contexts() {
+  std::filesystem::create_directories(segment_dir(vocab_segment));
+  segment_contexts.open(segment_dir(vocab_segment) / "contexts.txt");
+  return static_cast<bool>(segment_contexts);
+}
+
+/**
+ * @brief 词汇表超出预算时结束当前分段: 写出词汇表与上下文后清空, ID 从1重新分配
+ */
+void spill_vocab() {
+  std::unique_lock<std::shared_mutex> lock(segment_mutex);
+  if (!memory_budget.VocabOverBudget())
+    return; // 其他线程已完成切换
+  // 独占 segment_mutex, 工作线程均已停在文件边界, 取走后在词汇表锁外写出
+  write_vocab_files(segment_dir(vocab_segment), take_vocab());
+  {
+    std::lock_guard<std::mutex> out_lock(cout_mutex);
+    segment_contexts.close();
+    vocab_segment++;
+    if (!open_segment_contexts()) {
+      std::cerr << "\n无法写入: " << segment_dir(vocab_segment) << "\n";
+      parse_cancel_flag = 1;
+    }
+    std::clog << "\n词汇表超出预算, 切换到分段 " << vocab_segment << std::endl;
+  }
+  memory_budget.Release(MemClass::Vocab, memory_budget.Used(MemClass::Vocab));
+  memory_budget.CountVocabSpill();
+}
+
 /**
  * @brief 线程安全的文件解析函数
  * @param lang 语言解析器
@@ -478,40 +654,116 @@ std::string lca_path_traverse(TSNode root,
 void worker_thread() {
   while (true) {
     std::filesystem::path file_path;
+    std::string source;
+    bool is_c;
+    StageClock clock;
+    MemoryLease source_lease;
 
-    // 从队列获取任务
-    {
-      std::lock_guard<std::mutex> lock(queue_mutex);
-      if (file_queue.empty())
+    if (corpus_pack.IsOpen()) {
+      // 打包语料: 原子下标领取记录, 直接从映射内存复制, 无逐文件系统调用
+      size_t index = next_record.fetch_add(1, std::memory_order_relaxed);
+      if (index >= pack_records.size() || parse_cancel_flag != 0)
+        return;
+      PackRecord record = corpus_pack.Get(pack_records[index]);
+      file_path = pack_path / record.name;
+      is_c = record.lang == PACK_LANG_C;
+      if (parse_limits.max_bytes != 0 &&
+          record.content.size() > parse_limits.max_bytes) {
+        quarantine.Add(file_path,
+                       "bytes=" + std::to_string(record.content.size()));
+        files_quarantined.fetch_add(1, std::memory_order_relaxed);
+        files_processed.fetch_add(1, std::memory_order_relaxed);
+        continue;
+      }
+      memory_budget.Acquire(MemClass::Source, record.content.size());
+      source_lease = MemoryLease(&memory_budget, MemClass::Source,
+                                 record.content.size());
+      source.assign(record.content);
+    } else {
+      // 从预读流水线获取已读入内存的文件, 遍历与预读都结束时返回
+      PrefetchedFile item;
+      if (!prefetcher->Next(item) || parse_cancel_flag != 0)
         return;
-      file_path = file_queue.front();
-      file_queue.pop();
+      source_lease =
+          MemoryLease(&memory_budget, MemClass::Source, item.charged);
+      file_path = std::move(item.file.path);
+      is_c = item.file.lang == PACK_LANG_C;
+
+      // 超出字节上限的文件未被读入内存, 直接隔离
+      if (item.oversize) {
+        quarantine.Add(file_path, "bytes=" + std::to_string(item.size));
+        files_quarantined.fetch_add(1, std::memory_order_relaxed);
+        files_processed.fetch_add(1, std::memory_order_relaxed);
+        continue;
+      }
+      if (item.error != 0) {
+        files_processed.fetch_add(1, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(cout_mutex);
+        std::cerr << "无法打开文件: " << file_path << "\n";
+        continue;
+      }
+      source.swap(item.data);
     }
+    clock.Lap(Stage::Read);
+    uint64_t file_start = Stats::Enabled() ? Stats::Now() : 0;
 
-    // 读取文件内容
-    std::ifstream file(file_path, std::ios::binary);
-    if (!file) {
-      std::lock_guard<std::mutex> lock(cout_mutex);
-      std::cerr << "无法打开文件: " << file_path << "\n";
-      continue;
+    // 取代 process_file.sh 的逐文件子进程, 语料本身不改写
+    if (normalize) {
+      thread_local std::string normalized;
+      normalize_source(source, !is_c, normalized);
+      source.swap(normalized);
+      clock.Lap(Stage::Normalize);
     }
 
-    std::string source((std::istreambuf_iterator<char>(file)),
-                       std::istreambuf_iterator<char>());
+    // 内容完全相同且所在簇已保留足够文件时, 不必解析
+    DedupTicket ticket;
+    if (dedup && dedup->CheckContent(source, ticket)) {
+      if (prefetcher) {
+        prefetcher->Recycle(std::move(source));
+      }
+      files_processed.fetch_add(1, std::memory_order_relaxed);
+      continue;
+    }
 
     // 创建独立解析器实例（每个线程独立）
     TSParser *parser = ts_parser_new();
     TSLanguage *lang;
     thread_local std::mt19937 gen(std::random_device{}());
-    if (file_path.extension().string() == ".c") {
+    if (is_c) {
       lang = tree_sitter_c();
     } else {
       lang = tree_sitter_cpp();
     }
     ts_parser_set_language(parser, lang);
+    ts_parser_set_timeout_micros(parser, parse_limits.timeout_micros);
+    ts_parser_set_cancellation_flag(parser,
+                                    cancel_flag_address(parse_cancel_flag));
     TSTree *tree =
         ts_parser_parse_string(parser, nullptr, source.c_str(), source.size());
+    if (Stats::Enabled()) {
+      parse_latency.Record(clock.SinceMicros());
+    }
+    clock.Lap(Stage::Parse);
+    if (tree == nullptr) {
+      // 解析被中止: 取消标志置位说明用户中断, 否则为超时
+      ts_parser_delete(parser);
+      if (parse_cancel_flag != 0)
+        return;
+      quarantine.Add(file_path, "timeout");
+      files_quarantined.fetch_add(1, std::memory_order_relaxed);
+      files_processed.fetch_add(1, std::memory_order_relaxed);
+      continue;
+    }
     TSNode root = ts_tree_root_node(tree);
+    if (dedup && dedup->CheckStructure(file_path, root, ticket)) {
+      ts_tree_delete(tree);
+      ts_parser_delete(parser);
+      if (prefetcher) {
+        prefetcher->Recycle(std::move(source));
+      }
+      files_processed.fetch_add(1, std::memory_order_relaxed);
+      continue;
+    }
 
     // 处理AST
     // if (ts_node_has_error(root)) {
@@ -522,24 +774,77 @@ void worker_thread() {
     // } else {
     // safe_traverse_ast(root, source, 0, file_path);
     // simplified_traverse(root, file_path, 0);
-    // random_traverse(root, file_path, source, root, gen, 0);
     std::string tmp;
-    tmp = lca_path_traverse(root, file_path, source, gen, 200);
-    {
-      std::lock_guard<std::mutex> lock(cout_mutex);
-      std::cout << tmp << "\n";
+    bool over_limit = false;
+    // 分段切换等待本文件写出后进行
+    std::shared_lock<std::shared_mutex> segment_lock(segment_mutex,
+                                                     std::defer_lock);
+    if (memory_budget.Enabled()) {
+      segment_lock.lock();
+    }
+    if (dump_writer) {
+      // 转储模式: 整个文件写入线程内缓冲区, 一次提交给写线程
+      thread_local std::string dump_buffer;
+      dump_tree(root, source, file_path.filename().native(),
+                is_c ? PACK_LANG_C : PACK_LANG_CPP, dump_options,
+                dump_buffer);
+      dump_writer->Submit(dump_buffer);
+      clock.Lap(Stage::Write);
+    } else {
+      if (walk_options.walks_per_leaf != 0)
+        tmp = random_walk_traverse(root, file_path, source, gen,
+                                   parse_limits.max_leaves, &over_limit,
+                                   1.0 - error_filter.Ratio(file_path));
+      else
+        tmp = lca_path_traverse(root, file_path, source, gen, 200,
+                                parse_limits.max_leaves, &over_limit,
+                                1.0 - error_filter.Ratio(file_path));
+      clock.Skip(); // 其后各阶段已在 lca_path_traverse 内计时
+      if (over_limit) {
+        quarantine.Add(file_path,
+                       "leaves>" + std::to_string(parse_limits.max_leaves));
+        files_quarantined.fetch_add(1, std::memory_order_relaxed);
+      } else {
+        memory_budget.Charge(MemClass::Output, tmp.size());
+        MemoryLease output_lease(&memory_budget, MemClass::Output,
+                                 tmp.size());
+        std::unique_lock<std::mutex> lock(cout_mutex, std::defer_lock);
+        Stats::Lock(lock, cout_lock_stats);
+        if (!result_spill.Empty()) {
+          result_spill.CopyTo(*contexts_out); // 先写出已落盘的前半部分
+        }
+        *contexts_out << tmp << "\n";
+        if (watch_mode) {
+          contexts_out->flush(); // 新提交的结果立即可见
+        }
+        lock.unlock();
+        clock.Lap(Stage::Write);
+      }
     }
     // }
 
     // 清理资源
     ts_tree_delete(tree);
     ts_parser_delete(parser);
+    if (prefetcher) {
+      prefetcher->Recycle(std::move(source));
+    }
+    if (segment_lock.owns_lock()) {
+      segment_lock.unlock();
+      if (memory_budget.VocabOverBudget()) {
+        spill_vocab();
+      }
+    }
+    if (Stats::Enabled()) {
+      file_latency.Record((Stats::Now() - file_start) / 1000);
+    }
 
     // 更新计数器
     int processed = files_processed.fetch_add(1, std::memory_order_relaxed);
     processed++;
     {
-      std::lock_guard<std::mutex> lock(cout_mutex);
+      std::unique_lock<std::mutex> lock(cout_mutex, std::defer_lock);
+      Stats::Lock(lock, cout_lock_stats);
       std::clog << "\r已处理文件: " << processed << "/" << total_files << " ("
                 << (processed * 100) / total_files << "%)";
       std::clog.flush();
@@ -576,33 +881,265 @@ int main(int argc, char **argv) {
   std::ios::sync_with_stdio(false);
   std::cin.tie(nullptr);
   std::cout.tie(nullptr);
-  if (argc > 3) {
-    std::cerr << "用法: " << argv[0] << " <目标目录>\n";
+  std::vector<std::string> positional;
+  std::string quarantine_file, stats_file, dedup_report;
+  bool with_stats = false;
+  bool with_dedup = false;
+  DedupOptions dedup_options;
+  unsigned perf_sample_every = 0; // 0 表示不读取硬件计数器
+  ExtensionMap extensions;
+  IgnoreRules ignore_rules;
+  unsigned discovery_threads = 4;
+  size_t prefetch_depth = 64;
+  unsigned io_threads = 4;
+  PrefetchBackend io_backend = PrefetchBackend::Auto;
+  unsigned checkpoint_secs = 60; // 监视模式下词汇表的写出间隔
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i], value;
+    if (Cli::MatchOption(arg, "--parse-timeout-ms", value)) {
+      parse_limits.timeout_micros = std::stoull(value) * 1000;
+    } else if (Cli::MatchOption(arg, "--max-bytes", value)) {
+      parse_limits.max_bytes = Cli::ParseBytes(value);
+    } else if (Cli::MatchOption(arg, "--max-leaves", value)) {
+      parse_limits.max_leaves = std::stoull(value);
+    } else if (Cli::MatchOption(arg, "--quarantine", value)) {
+      quarantine_file = value;
+    } else if (Cli::MatchOption(arg, "--error-filter", value)) {
+      if (!error_filter.Load(value)) {
+        std::cerr << "无法读取过滤列表: " << value << "\n";
+        return 1;
+      }
+    } else if (Cli::MatchOption(arg, "--max-error-ratio", value)) {
+      max_error_ratio = std::stod(value);
+    } else if (Cli::MatchOption(arg, "--ext", value)) {
+      if (!extensions.Parse(value)) {
+        std::cerr << "无法解析扩展名映射: " << value << "\n";
+        return 1;
+      }
+    } else if (arg == "--headers") {
+      extensions.AddHeaders();
+    } else if (Cli::MatchOption(arg, "--ignore", value)) {
+      ignore_rules.AddPatterns(value);
+    } else if (Cli::MatchOption(arg, "--discovery-threads", value)) {
+      discovery_threads = std::max(1ul, std::stoul(value));
+    } else if (arg == "--stats" || Cli::MatchOption(arg, "--stats", value)) {
+      with_stats = true;
+      stats_file = value;
+    } else if (arg == "--perf" || Cli::MatchOption(arg, "--perf", value)) {
+      // 硬件计数器结果附在 --stats 报告中
+      with_stats = true;
+      perf_sample_every = value.empty() ? 16 : std::stoul(value);
+    } else if (Cli::MatchOption(arg, "--shard", value)) {
+      if (!shard.Parse(value)) {
+        std::cerr << "无法解析分片: " << value << ", 应为 i/N\n";
+        return 1;
+      }
+    } else if (arg == "--normalize") {
+      normalize = true;
+    } else if (Cli::MatchOption(arg, "--walks", value)) {
+      walk_options.walks_per_leaf = std::stoul(value);
+    } else if (Cli::MatchOption(arg, "--walk-hops", value)) {
+      walk_options.max_hops = std::max(1ul, std::stoul(value));
+    } else if (Cli::MatchOption(arg, "--walk-budget", value)) {
+      walk_options.budget = std::stoull(value);
+    } else if (arg == "--watch") {
+      watch_mode = true;
+    } else if (Cli::MatchOption(arg, "--dump", value)) {
+      bool ok;
+      dump_options.format = parse_dump_format(value, ok);
+      if (!ok) {
+        std::cerr << "未知的转储格式: " << value << "\n";
+        return 1;
+      }
+    } else if (arg == "--dump-all-nodes") {
+      dump_options.all_nodes = true;
+    } else if (arg == "--dump-source") {
+      dump_options.with_source = true;
+    } else if (Cli::MatchOption(arg, "--memory-limit", value)) {
+      memory_budget.SetLimit(Cli::ParseBytes(value));
+    } else if (Cli::MatchOption(arg, "--checkpoint-secs", value)) {
+      checkpoint_secs = std::max(1ul, std::stoul(value));
+    } else if (arg == "--dedup") {
+      with_dedup = true;
+    } else if (Cli::MatchOption(arg, "--dedup-threshold", value)) {
+      with_dedup = true;
+      dedup_options.threshold = std::stod(value);
+    } else if (Cli::MatchOption(arg, "--dup-keep", value)) {
+      with_dedup = true;
+      dedup_options.keep = std::max(1ul, std::stoul(value));
+    } else if (Cli::MatchOption(arg, "--dedup-report", value)) {
+      with_dedup = true;
+      dedup_report = value;
+    } else if (Cli::MatchOption(arg, "--prefetch-depth", value)) {
+      prefetch_depth = std::stoul(value);
+    } else if (Cli::MatchOption(arg, "--io-threads", value)) {
+      io_threads = std::stoul(value);
+    } else if (Cli::MatchOption(arg, "--io-backend", value)) {
+      bool ok;
+      io_backend = Prefetcher::ParseBackend(value, ok);
+      if (!ok) {
+        std::cerr << "未知的 I/O 后端: " << value << "\n";
+        return 1;
+      }
+    } else {
+      positional.push_back(arg);
+    }
+  }
+  if (positional.empty() || positional.size() > 2) {
+    std::cerr << "用法: " << argv[0]
+              << " <目标目录|打包语料> [上下文长度] [--parse-timeout-ms=N]"
+                 " [--max-bytes=N[K|M|G]] [--max-leaves=N]"
+                 " [--quarantine=隔离列表] [--error-filter=过滤列表]"
+                 " [--max-error-ratio=R] [--ext=.c=c,.h=cpp,...]"
+                 " [--headers] [--ignore=模式,...] [--discovery-threads=N]"
+                 " [--prefetch-depth=N] [--io-threads=N]"
+                 " [--io-backend=auto|uring|threads] [--stats[=报告.json]]"
+                 " [--perf[=采样间隔]] [--dedup] [--dedup-threshold=R]"
+                 " [--dup-keep=N] [--dedup-report=报告.json]"
+                 " [--normalize] [--shard=i/N] [--walks=N]"
+                 " [--walk-hops=N] [--walk-budget=N] [--watch]"
+                 " [--checkpoint-secs=N] [--memory-limit=N[K|M|G]]"
+                 " [--dump=text|sexp|binary] [--dump-all-nodes]"
+                 " [--dump-source]\n";
     return 1;
   }
-  if (argc == 3) {
-    PATH_CONTEXT_LENGTH = std::stoi(argv[2]);
+  if (with_dedup) {
+    dedup = std::make_unique<Deduplicator>(dedup_options);
+  }
+  if (positional.size() == 2) {
+    PATH_CONTEXT_LENGTH = std::stoi(positional[1]);
   }
   // 收集目标文件
-  const std::filesystem::path root_path(argv[1]);
-  for (const auto &entry :
-       std::filesystem::recursive_directory_iterator(root_path)) {
-    if (entry.is_regular_file()) {
-      const auto &path = entry.path();
-      std::string ext = path.extension().string();
-
-      // 识别C/C++文件
-      if (ext == ".c" || ext == ".cpp" || ext == ".cc" || ext == ".cxx") {
-        std::lock_guard<std::mutex> lock(queue_mutex);
-        file_queue.push(path);
-      }
+  const std::filesystem::path root_path(positional[0]);
+  const bool packed_input = PackReader::IsPack(root_path);
+  if (packed_input && watch_mode) {
+    std::cerr << "--watch 只能用于目录输入\n";
+    return 1;
+  }
+  // 打包语料的输出目录放在打包文件旁
+  const std::filesystem::path output_dir =
+      (packed_input ? root_path.parent_path() : root_path) / "out";
+  // 分片模式的词汇表与上下文写入 out/shard-i-of-N, 之后由 vocabmerge 合并
+  const std::filesystem::path vocab_dir =
+      shard.Enabled() ? output_dir / shard.Name() : output_dir;
+  vocab_root = vocab_dir;
+  std::ofstream contexts_file;
+  if (memory_budget.Enabled()) {
+    // 词汇表可能分段, 上下文随分段写入 seg-K/contexts.txt
+    vocab_segment = 1;
+    if (!open_segment_contexts()) {
+      std::cerr << "无法写入: " << segment_dir(1) / "contexts.txt" << "\n";
+      return 1;
+    }
+    contexts_out = &segment_contexts;
+    memory_budget.TrackTreeSitter();
+  } else if (shard.Enabled()) {
+    std::filesystem::create_directories(vocab_dir);
+    contexts_file.open(vocab_dir / "contexts.txt");
+    if (!contexts_file) {
+      std::cerr << "无法写入: " << vocab_dir / "contexts.txt" << "\n";
+      return 1;
     }
+    contexts_out = &contexts_file;
   }
-
-  total_files = file_queue.size();
-  if (total_files == 0) {
-    std::cerr << "未找到C/C++文件\n";
-    return 1;
+  if (dump_options.format != DumpFormat::None) {
+    dump_writer = std::make_unique<DumpWriter>(*contexts_out,
+                                               dump_options.format);
+  }
+  if (quarantine_file.empty()) {
+    quarantine_file = (output_dir / "quarantine.txt").string();
+  }
+  if (!quarantine.Open(quarantine_file)) {
+    std::cerr << "无法打开隔离列表: " << quarantine_file << "\n";
+  }
+  std::signal(SIGINT, [](int) { parse_cancel_flag = 1; });
+  if (with_stats) {
+    Stats::Enable();
+  }
+  if (perf_sample_every != 0) {
+    Perf::Enable(perf_sample_every);
+    std::string reason;
+    if (!Perf::Available(reason)) {
+      std::clog << "硬件计数器不可用, 只输出计时统计: " << reason << std::endl;
+    }
+  }
+  auto start = std::chrono::steady_clock::now();
+  std::atomic<size_t> skipped_files{0};
+  const std::filesystem::path shard_root =
+      std::filesystem::absolute(root_path).lexically_normal();
+  std::thread discoverer;
+  std::unique_ptr<DirectoryWatcher> watcher;
+  if (packed_input) {
+    if (!corpus_pack.Open(root_path)) {
+      std::cerr << "无法读取打包语料: " << root_path << "\n";
+      return 1;
+    }
+    pack_path = root_path;
+    for (size_t i = 0; i < corpus_pack.Size(); ++i) {
+      std::string_view name = corpus_pack.Get(i).name;
+      if (!shard.Contains(name))
+        continue;
+      std::filesystem::path path = pack_path / name;
+      if (quarantine.Contains(path) ||
+          error_filter.Ratio(path) > max_error_ratio) {
+        skipped_files++;
+        continue;
+      }
+      pack_records.push_back(static_cast<uint32_t>(i));
+    }
+    total_files = pack_records.size();
+    if (total_files == 0) {
+      std::cerr << "未找到C/C++文件\n";
+      return 1;
+    }
+  } else {
+    // 遍历与解析并行: 发现线程边遍历边入队, 工作线程立即开始消费
+    ignore_rules.AddPattern(".git");
+    ignore_rules.AddPath(output_dir);
+    // 遍历 -> 预读 -> 解析三级流水线, 预读保持 prefetch_depth 个文件在内存中
+    prefetcher = std::make_unique<Prefetcher>(
+        prefetch_depth, io_threads, io_backend, parse_limits.max_bytes,
+        &memory_budget);
+    std::clog << "预读后端: " << prefetcher->BackendName() << ", 深度 "
+              << prefetch_depth << std::endl;
+    // 其他分片的文件、隔离文件与错误占比超限的文件都不入队,
+    // 其余含错文件按占比降权
+    auto enqueue = [&](std::vector<SourceFile> &files) {
+      files.erase(std::remove_if(files.begin(), files.end(),
+                                 [&](const SourceFile &file) {
+                                   return !shard.Contains(file.path,
+                                                          shard_root);
+                                 }),
+                  files.end());
+      auto kept = std::remove_if(
+          files.begin(), files.end(), [&](const SourceFile &file) {
+            return quarantine.Contains(file.path) ||
+                   error_filter.Ratio(file.path) > max_error_ratio;
+          });
+      skipped_files += files.end() - kept;
+      files.erase(kept, files.end());
+      total_files += files.size();
+      prefetcher->Push(files);
+    };
+    if (watch_mode) {
+      // 先加监视再遍历, 遍历期间写入的文件由事件补上, 至多重复处理一次
+      watcher = std::make_unique<DirectoryWatcher>(extensions, ignore_rules);
+      std::string error;
+      if (!watcher->Start(root_path, error)) {
+        std::cerr << "无法监视目录: " << root_path << ": " << error << "\n";
+        return 1;
+      }
+      std::clog << "监视" << watcher->Directories() << "个目录, Ctrl-C 结束"
+                << std::endl;
+    }
+    discoverer = std::thread([&, discovery_threads]() {
+      Discovery discovery(extensions, ignore_rules);
+      discovery.Walk(root_path, discovery_threads, enqueue);
+      if (watcher) {
+        watcher->Run([] { return parse_cancel_flag != 0; }, enqueue);
+      }
+      prefetcher->Close();
+    });
   }
 
   // 根据硬件并发数创建线程
@@ -610,8 +1147,13 @@ int main(int argc, char **argv) {
   std::vector<std::thread> threads;
   // TSLanguage *cpp_lang = tree_sitter_cpp(); // 预获取语言对象
   // TSLanguage *c_lang = tree_sitter_c();   // 预获取语言对象
-  std::clog << "启动" << num_threads << "个线程处理" << total_files
-            << "个文件..." << std::endl;
+  if (packed_input) {
+    std::clog << "启动" << num_threads << "个线程处理" << total_files
+              << "个文件..." << std::endl;
+  } else {
+    std::clog << "启动" << num_threads << "个线程, 边遍历边处理..."
+              << std::endl;
+  }
 
   // 创建工作线程
   for (unsigned i = 0; i < num_threads; ++i) {
@@ -621,34 +1163,93 @@ int main(int argc, char **argv) {
   }
   // threads.emplace_back(output_thread);
   // 等待所有线程完成
+  if (watch_mode) {
+    // 工作线程持续运行, 主线程按间隔写出词汇表检查点, 中断后再写最终版本
+    auto checkpoint = std::chrono::steady_clock::now();
+    while (parse_cancel_flag == 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(200));
+      if (std::chrono::steady_clock::now() - checkpoint >=
+          std::chrono::seconds(checkpoint_secs)) {
+        {
+          // 只在复制期间持有词汇表锁, 写文件时工作线程照常登记新词;
+          // 共享持有 segment_mutex 直到写完, 以免覆盖分段切换写出的结果
+          std::shared_lock<std::shared_mutex> lock(segment_mutex);
+          write_vocab_files(current_vocab_dir(), copy_vocab());
+        }
+        checkpoint = std::chrono::steady_clock::now();
+      }
+    }
+  }
+  if (discoverer.joinable()) {
+    discoverer.join();
+  }
   for (auto &t : threads) {
     t.join();
   }
-  const std::filesystem::path output_dir = root_path / "out";
-  std::filesystem::create_directory(output_dir);
-  {
-    std::ofstream token_vocab_file(output_dir / "token_vocab.txt");
-    for (const auto &entry : token_vocab) {
-      token_vocab_file << entry.first << " " << entry.second << "\n";
-    }
+  if (watcher && watcher->Overflows() != 0) {
+    std::clog << "\n事件队列溢出" << watcher->Overflows()
+              << "次, 期间的新文件可能遗漏, 需重新遍历补齐" << std::endl;
   }
-  {
-    std::ofstream type_vocab_file(output_dir / "type_vocab.txt");
-    for (const auto &entry : type_vocab) {
-      type_vocab_file << entry.first << " " << entry.second << "\n";
-    }
+  if (skipped_files != 0) {
+    std::clog << "\n跳过隔离或语法错误超限的" << skipped_files << "个文件"
+              << std::endl;
   }
-  {
-    std::ofstream path_vocab_file(output_dir / "path_vocab.txt");
-    for (const auto &entry : path_vocab) {
-      for (const auto &v : entry.first) {
-        path_vocab_file << v << ",";
-      }
-      path_vocab_file << " " << entry.second << "\n";
+  if (total_files == 0) {
+    std::cerr << "未找到C/C++文件\n";
+    return 1;
+  }
+  if (dump_writer) {
+    dump_writer->Close();
+  }
+  contexts_file.close();
+  // 转储模式不产生词汇表, 不覆盖已有的词汇表文件
+  if (!dump_writer) {
+    write_vocab_files(current_vocab_dir(), take_vocab());
+  }
+  segment_contexts.close();
+  if (vocab_segment == 1) {
+    // 未发生切换, 唯一的分段即完整结果
+    for (const auto &entry :
+         std::filesystem::directory_iterator(segment_dir(1))) {
+      std::filesystem::rename(entry.path(),
+                              vocab_dir / entry.path().filename());
     }
+    std::filesystem::remove(segment_dir(1));
+  } else if (vocab_segment > 1) {
+    std::clog << "\n词汇表分为" << vocab_segment << "段, 合并: vocabmerge "
+              << vocab_dir.string() << " " << segment_dir(1).string()
+              << " ... " << segment_dir(vocab_segment).string() << std::endl;
   }
   // worker_thread(); // 由workthread内部决定使用的解析语言和解析器
   std::clog << "\n处理完成！已处理文件数: " << files_processed << "/"
             << total_files << std::endl;
+  if (files_quarantined != 0) {
+    std::clog << "新隔离文件数: " << files_quarantined << " -> "
+              << quarantine_file << std::endl;
+  }
+  if (memory_budget.Enabled()) {
+    memory_budget.WriteReport(std::clog);
+  }
+  if (dedup) {
+    std::clog << "重复提交跳过数: " << dedup->Skipped() << std::endl;
+    if (!dedup_report.empty()) {
+      std::ofstream report(dedup_report);
+      dedup->WriteReport(report);
+    }
+  }
+  if (with_stats) {
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    std::vector<std::pair<std::string, const LatencyHistogram *>> histograms =
+        {{"file_latency_us", &file_latency},
+         {"parse_latency_us", &parse_latency}};
+    if (stats_file.empty()) {
+      Stats::WriteReport(std::clog, seconds, files_processed, histograms);
+    } else {
+      std::ofstream report(stats_file);
+      Stats::WriteReport(report, seconds, files_processed, histograms);
+    }
+  }
   return 0;
 }
@@ -0,0 +1,388 @@
+#include "cli.h"
+#include "latency.h"
+#include "protocol.h"
+#include "quarantine.h"
+#include "vocab_extractor.h"
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <poll.h>
+#include <queue>
+#include <random>
+#include <string>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <thread>
+#include <tree_sitter/api.h>
+#include <unistd.h>
+#include <vector>
+
+constexpr int POLL_INTERVAL_MS = 500; // 检查退出标志的间隔
+// 未指定 --max-bytes 时单个请求的负载上限, 避免按请求头分配任意大的内存
+constexpr size_t DEFAULT_MAX_REQUEST_BYTES = 64u << 20;
+
+std::mutex conn_mutex;
+std::condition_variable conn_cv;
+std::queue<int> conn_queue; // 有数据待读的客户端连接
+
+// 工作线程处理完请求后把连接交还主线程, 空闲连接不占用工作线程
+std::mutex idle_mutex;
+std::vector<int> returned_fds;
+int wake_pipe[2] = {-1, -1}; // 交还连接时唤醒主线程的 poll
+
+Vocab vocab;
+ParseLimits parse_limits;
+ExtractOptions extract_options;
+bool fixed_seed = false;
+unsigned int seed = 0;
+CancelFlag parse_cancel_flag{0};
+volatile std::sig_atomic_t stop_requested = 0;
+
+int idle_timeout_secs = 60; // 空闲连接超时, 亦为请求中途停顿的上限
+
+LatencyHistogram latency;
+std::atomic<uint64_t> requests_rejected{0};
+std::atomic<uint64_t> contexts_served{0};
+std::atomic<uint64_t> idle_closed{0};
+
+void request_stop(int) {
+  stop_requested = 1;
+  parse_cancel_flag = 1;
+}
+
+/**
+ * @brief fd 上已有数据可读 (不等待)
+ */
+bool has_pending(int fd) {
+  pollfd pfd{fd, POLLIN, 0};
+  return ::poll(&pfd, 1, 0) > 0;
+}
+
+/**
+ * @brief 处理连接上已到达的请求, 没有待读数据时返回
+ * @return 连接仍可用, 应交还主线程等待下一个请求
+ */
+bool serve_connection(int fd) {
+  thread_local std::mt19937 gen(std::random_device{}());
+  thread_local std::string source;
+  thread_local std::vector<PathContext> contexts;
+  thread_local std::vector<uint32_t> counts;
+  thread_local ContextSet context_set;
+  const size_t max_request = parse_limits.max_bytes != 0
+                                 ? parse_limits.max_bytes
+                                 : DEFAULT_MAX_REQUEST_BYTES;
+  do {
+    RequestHeader request;
+    if (!Protocol::ReadFull(fd, &request, sizeof(request)))
+      return false;
+    auto start = std::chrono::steady_clock::now();
+    ResponseHeader response{static_cast<uint32_t>(ResponseStatus::Ok), 0};
+    contexts.clear();
+    counts.clear();
+
+    if (request.length > max_request) {
+      // 不读取超限负载, 回复后断开以免协议错位
+      response.status = static_cast<uint32_t>(ResponseStatus::Rejected);
+      Protocol::WriteFull(fd, &response, sizeof(response));
+      requests_rejected.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    source.resize(request.length);
+    if (!Protocol::ReadFull(fd, source.data(), source.size()))
+      return false;
+
+    if (request.lang > static_cast<uint8_t>(SourceLang::Cpp)) {
+      response.status = static_cast<uint32_t>(ResponseStatus::BadRequest);
+    } else {
+      TSParser *parser = thread_parser(static_cast<SourceLang>(request.lang));
+      ts_parser_set_timeout_micros(parser, parse_limits.timeout_micros);
+      ts_parser_set_cancellation_flag(parser,
+                                      cancel_flag_address(parse_cancel_flag));
+      TSTree *tree = ts_parser_parse_string(parser, nullptr, source.c_str(),
+                                            source.size());
+      if (tree == nullptr) {
+        ts_parser_reset(parser);
+        response.status = static_cast<uint32_t>(ResponseStatus::Rejected);
+      } else {
+        if (fixed_seed)
+          gen.seed(seed);
+        ExtractStatus status =
+            lca_path_traverse(vocab, ts_tree_root_node(tree), source, gen,
+                              extract_options, contexts);
+        if (status == ExtractStatus::OverLimit) {
+          contexts.clear();
+          response.status = static_cast<uint32_t>(ResponseStatus::Rejected);
+        } else if (request.flags & REQUEST_DEDUP) {
+          context_set.Compact(contexts, counts);
+        }
+        ts_tree_delete(tree);
+      }
+    }
+    if (response.status != static_cast<uint32_t>(ResponseStatus::Ok))
+      requests_rejected.fetch_add(1, std::memory_order_relaxed);
+
+    response.count = static_cast<uint32_t>(contexts.size());
+    iovec iov[3] = {
+        {&response, sizeof(response)},
+        {contexts.data(), contexts.size() * sizeof(PathContext)},
+        {counts.data(), counts.size() * sizeof(uint32_t)},
+    };
+    ssize_t written = ::writev(fd, iov, 3);
+    if (written < 0 && errno != EINTR)
+      return false;
+    // 短写时从中断处继续写满
+    size_t sent = written > 0 ? static_cast<size_t>(written) : 0;
+    bool ok = true;
+    for (const iovec &part : iov) {
+      if (sent >= part.iov_len) {
+        sent -= part.iov_len;
+        continue;
+      }
+      ok = Protocol::WriteFull(
+          fd, static_cast<const char *>(part.iov_base) + sent,
+          part.iov_len - sent);
+      sent = 0;
+      if (!ok)
+        break;
+    }
+    if (!ok)
+      return false;
+    contexts_served.fetch_add(contexts.size(), std::memory_order_relaxed);
+    latency.Record(std::chrono::duration_cast<std::chrono::microseconds>(
+                       std::chrono::steady_clock::now() - start)
+                       .count());
+    // 流水线发送的后续请求已到达时继续处理, 省去一次交还
+  } while (!stop_requested && has_pending(fd));
+  return true;
+}
+
+void worker_thread() {
+  while (true) {
+    int fd;
+    {
+      std::unique_lock<std::mutex> lock(conn_mutex);
+      conn_cv.wait(lock,
+                   [] { return stop_requested || !conn_queue.empty(); });
+      if (conn_queue.empty())
+        return;
+      fd = conn_queue.front();
+      conn_queue.pop();
+    }
+    if (!serve_connection(fd)) {
+      ::close(fd);
+      continue;
+    }
+    std::lock_guard<std::mutex> lock(idle_mutex);
+    returned_fds.push_back(fd);
+    char byte = 0;
+    (void)!::write(wake_pipe[1], &byte, 1);
+  }
+}
+
+/**
+ * @brief 主线程持有的空闲连接, 可读时派发给工作线程, 超时关闭
+ */
+class IdleConnections {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  void Add(int fd) { conns_.push_back({fd, Clock::now()}); }
+  // 追加到 fds 末尾, 供 poll 使用
+  void AppendPollFds(std::vector<pollfd> &fds) const {
+    for (const Conn &conn : conns_)
+      fds.push_back({conn.fd, POLLIN, 0});
+  }
+  /**
+   * @brief 派发可读或已挂断的连接, 关闭超时的连接
+   * @param ready poll 结果中对应空闲连接的部分, 与 AppendPollFds 顺序一致
+   */
+  void Dispatch(const pollfd *ready, Clock::time_point now) {
+    size_t kept = 0;
+    for (size_t i = 0; i < conns_.size(); ++i) {
+      if (ready[i].revents != 0) {
+        // 挂断也交给工作线程, 读取失败时关闭
+        std::lock_guard<std::mutex> lock(conn_mutex);
+        conn_queue.push(conns_[i].fd);
+        conn_cv.notify_one();
+      } else if (idle_timeout_secs > 0 &&
+                 now - conns_[i].since >=
+                     std::chrono::seconds(idle_timeout_secs)) {
+        ::close(conns_[i].fd);
+        idle_closed.fetch_add(1, std::memory_order_relaxed);
+      } else {
+        conns_[kept++] = conns_[i];
+      }
+    }
+    conns_.resize(kept);
+  }
+  size_t Size() const { return conns_.size(); }
+  void CloseAll() {
+    for (const Conn &conn : conns_)
+      ::close(conn.fd);
+    conns_.clear();
+  }
+
+private:
+  struct Conn {
+    int fd;
+    Clock::time_point since;
+  };
+  std::vector<Conn> conns_;
+};
+
+void report_latency(double seconds) {
+  std::clog << "请求数: " << latency.Count()
+            << " 拒绝: " << requests_rejected.load()
+            << " 空闲超时: " << idle_closed.load()
+            << " 上下文: " << contexts_served.load()
+            << " QPS: " << (seconds > 0 ? latency.Count() / seconds : 0.0)
+            << " p50: " << latency.Quantile(0.50) << "us"
+            << " p99: " << latency.Quantile(0.99) << "us"
+            << " max: " << latency.Max() << "us" << std::endl;
+}
+
+int main(int argc, char **argv) {
+  std::vector<std::string> positional;
+  std::string socket_path = DEFAULT_SOCKET_PATH;
+  unsigned num_threads = std::thread::hardware_concurrency();
+  int report_interval = 10;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i], value;
+    if (Cli::MatchOption(arg, "--socket", value))
+      socket_path = value;
+    else if (Cli::MatchOption(arg, "--threads", value))
+      num_threads = std::stoul(value);
+    else if (Cli::MatchOption(arg, "--path-width", value))
+      extract_options.path_width = std::stoi(value);
+    else if (Cli::MatchOption(arg, "--parse-timeout-ms", value))
+      parse_limits.timeout_micros = std::stoull(value) * 1000;
+    else if (Cli::MatchOption(arg, "--max-bytes", value))
+      parse_limits.max_bytes = Cli::ParseBytes(value);
+    else if (Cli::MatchOption(arg, "--max-leaves", value))
+      extract_options.max_leaves = std::stoull(value);
+    else if (Cli::MatchOption(arg, "--seed", value)) {
+      fixed_seed = true;
+      seed = std::stoul(value);
+    } else if (Cli::MatchOption(arg, "--report-interval", value))
+      report_interval = std::stoi(value);
+    else if (Cli::MatchOption(arg, "--idle-timeout", value))
+      idle_timeout_secs = std::stoi(value);
+    else
+      positional.push_back(arg);
+  }
+  if (positional.size() != 1 || num_threads == 0) {
+    std::cerr << "用法: " << argv[0]
+              << " <词汇表目录> [--socket=路径] [--threads=N]"
+                 " [--path-width=N] [--parse-timeout-ms=N]"
+                 " [--max-bytes=N[K|M|G]] [--max-leaves=N] [--seed=N]"
+                 " [--report-interval=秒] [--idle-timeout=秒]\n"
+              << "--max-bytes 默认 " << (DEFAULT_MAX_REQUEST_BYTES >> 20)
+              << "M, --idle-timeout 默认 60 秒, 0 为不超时\n";
+    return 1;
+  }
+
+  // 词汇表只在启动时加载一次
+  vocab.Load(positional[0]);
+  if (vocab.path.empty()) {
+    std::cerr << "路径词汇表为空，请检查路径词汇表文件\n";
+    return 1;
+  }
+
+  int listen_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  std::strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+  ::unlink(socket_path.c_str());
+  if (listen_fd < 0 ||
+      ::bind(listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) !=
+          0 ||
+      ::listen(listen_fd, SOMAXCONN) != 0) {
+    std::cerr << "无法监听套接字: " << socket_path << " ("
+              << std::strerror(errno) << ")\n";
+    return 1;
+  }
+  if (::pipe2(wake_pipe, O_NONBLOCK | O_CLOEXEC) != 0) {
+    std::cerr << "无法创建管道: " << std::strerror(errno) << "\n";
+    return 1;
+  }
+  std::signal(SIGINT, request_stop);
+  std::signal(SIGTERM, request_stop);
+  std::signal(SIGPIPE, SIG_IGN);
+
+  std::vector<std::thread> threads;
+  for (unsigned i = 0; i < num_threads; ++i)
+    threads.emplace_back(worker_thread);
+  std::clog << "监听 " << socket_path << ", " << num_threads << "个工作线程"
+            << std::endl;
+
+  // 请求中途停顿超过空闲超时的客户端读取失败并断开, 不会长期占用工作线程
+  timeval recv_timeout{idle_timeout_secs, 0};
+  IdleConnections idle;
+  std::vector<pollfd> fds;
+  auto start = std::chrono::steady_clock::now();
+  auto last_report = start;
+  while (!stop_requested) {
+    // 监听套接字、唤醒管道与全部空闲连接在同一个 poll 中等待
+    fds.assign({{listen_fd, POLLIN, 0}, {wake_pipe[0], POLLIN, 0}});
+    idle.AppendPollFds(fds);
+    if (::poll(fds.data(), fds.size(), POLL_INTERVAL_MS) < 0 &&
+        errno != EINTR)
+      break;
+    auto now = std::chrono::steady_clock::now();
+    idle.Dispatch(fds.data() + 2, now);
+    if (fds[1].revents != 0) {
+      char drain[64];
+      while (::read(wake_pipe[0], drain, sizeof(drain)) > 0) {
+      }
+      std::lock_guard<std::mutex> lock(idle_mutex);
+      for (int fd : returned_fds)
+        idle.Add(fd);
+      returned_fds.clear();
+    }
+    if (fds[0].revents != 0) {
+      int fd = ::accept(listen_fd, nullptr, nullptr);
+      if (fd >= 0) {
+        if (idle_timeout_secs > 0)
+          ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &recv_timeout,
+                       sizeof(recv_timeout));
+        idle.Add(fd);
+      }
+    }
+    if (report_interval > 0 &&
+        now - last_report >= std::chrono::seconds(report_interval)) {
+      last_report = now;
+      report_latency(std::chrono::duration<double>(now - start).count());
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(conn_mutex);
+    conn_cv.notify_all();
+  }
+  for (auto &t : threads)
+    t.join();
+  while (!conn_queue.empty()) {
+    ::close(conn_queue.front());
+    conn_queue.pop();
+  }
+  idle.CloseAll();
+  for (int fd : returned_fds)
+    ::close(fd);
+  ::close(wake_pipe[0]);
+  ::close(wake_pipe[1]);
+  ::close(listen_fd);
+  ::unlink(socket_path.c_str());
+  report_latency(std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - start)
+                     .count());
+  return 0;
+}
@@ -0,0 +1,54 @@
+#include "chunkpool.h"
+
+void ChunkPool::Run(size_t n, const std::function<void(size_t)> &task) {
+  Job job{&task, n};
+  std::unique_lock<std::mutex> lock(mutex_);
+  jobs_.push_back(&job);
+  cv_.notify_all();
+  // 先领取自己的分块, 领完后等待其他线程手上的分块
+  while (job.next < job.n) {
+    size_t index = job.next++;
+    lock.unlock();
+    task(index);
+    lock.lock();
+    job.done++;
+  }
+  jobs_.remove(&job);
+  cv_.wait(lock, [&]() { return job.done == job.n; });
+}
+
+bool ChunkPool::Help() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (Job *job : jobs_) {
+    if (job->next == job->n)
+      continue;
+    size_t index = job->next++;
+    lock.unlock();
+    (*job->task)(index);
+    lock.lock();
+    // 提交方在 done == n 之前不会返回, job 仍然有效
+    if (++job->done == job->n)
+      cv_.notify_all();
+    return true;
+  }
+  return false;
+}
+
+void ChunkPool::Drain() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  active_--;
+  cv_.notify_all();
+  while (true) {
+    lock.unlock();
+    while (Help()) {
+    }
+    lock.lock();
+    if (active_ == 0)
+      return;
+    bool pending = false;
+    for (Job *job : jobs_)
+      pending = pending || job->next < job->n;
+    if (!pending)
+      cv_.wait(lock);
+  }
+}
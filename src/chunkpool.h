@@ -0,0 +1,41 @@
+#ifndef __HAS_CHUNKPOOL__
+#define __HAS_CHUNKPOOL__
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <mutex>
+
+/**
+ * @brief 文件内分块任务的共享池, 不自带线程, 由抽取工作线程兼任
+ * 提交方在 Run 中自己也领取分块, 其余工作线程在取下一个文件前 Help,
+ * 没有文件可取后 Drain 继续协助, 直到所有工作线程都退出
+ */
+class ChunkPool {
+public:
+  explicit ChunkPool(unsigned workers) : active_(workers) {}
+  ChunkPool(const ChunkPool &) = delete;
+  ChunkPool &operator=(const ChunkPool &) = delete;
+
+  // 执行 task(0) .. task(n - 1), 全部完成后返回
+  void Run(size_t n, const std::function<void(size_t)> &task);
+  // 领取并执行一个分块, 没有待领取的分块时返回 false
+  bool Help();
+  // 工作线程退出前调用, 在其他线程仍可能提交分块时继续协助
+  void Drain();
+
+private:
+  struct Job {
+    const std::function<void(size_t)> *task;
+    size_t n;
+    size_t next = 0;
+    size_t done = 0;
+  };
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::list<Job *> jobs_;
+  unsigned active_; // 尚未 Drain 的工作线程数
+};
+
+#endif // !__HAS_CHUNKPOOL__
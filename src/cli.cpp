@@ -0,0 +1,33 @@
+#include "cli.h"
+#include <cctype>
+
+bool Cli::MatchOption(const std::string &arg, const std::string &name,
+                      std::string &value) noexcept {
+  if (arg.size() <= name.size() || arg.compare(0, name.size(), name) != 0 ||
+      arg[name.size()] != '=') {
+    return false;
+  }
+  value = arg.substr(name.size() + 1);
+  return true;
+}
+
+size_t Cli::ParseBytes(const std::string &value) {
+  size_t pos = 0;
+  size_t bytes = std::stoull(value, &pos);
+  if (pos < value.size()) {
+    switch (std::toupper(static_cast<unsigned char>(value[pos]))) {
+    case 'G':
+      bytes <<= 10;
+      [[fallthrough]];
+    case 'M':
+      bytes <<= 10;
+      [[fallthrough]];
+    case 'K':
+      bytes <<= 10;
+      break;
+    default:
+      break;
+    }
+  }
+  return bytes;
+}
@@ -0,0 +1,19 @@
+#ifndef __HAS_CLI__
+#define __HAS_CLI__
+#include <cstddef>
+#include <string>
+class Cli {
+public:
+  /**
+   * @brief 匹配形如 --name=value 的选项
+   * @param arg 命令行参数
+   * @param name 选项名(含前缀 --)
+   * @param value 匹配成功时写入 '=' 之后的内容
+   */
+  static bool MatchOption(const std::string &arg, const std::string &name,
+                          std::string &value) noexcept;
+  // 解析带可选单位(K/M/G)的字节数, 如 "64M"
+  static size_t ParseBytes(const std::string &value);
+};
+
+#endif // !__HAS_CLI__
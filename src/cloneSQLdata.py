@@ -1,6 +1,8 @@
-import pymysql
+import json
 import os
 
+import pymysql
+
 # 数据库连接配置
 db_config = {
     "host": "120.55.240.40",
@@ -13,7 +15,8 @@ db_config = {
 
 
 # 查询并保存数据
-def export_code_to_files(save_path):
+# with_user 为 True 时文件名为 pid_uid_submitid, 供 --incremental 按用户划分提交谱系
+def export_code_to_files(save_path, with_user=False):
     try:
         # 连接数据库
         connection = pymysql.connect(**db_config)
@@ -21,7 +24,7 @@ def export_code_to_files(save_path):
 
         # 查询 status 为 0 的数据，并获取对应的 content_type
         query = """
-            SELECT j.code, j.pid, j.submit_id, l.content_type
+            SELECT j.code, j.pid, j.submit_id, l.content_type, j.uid
             FROM judge j
             JOIN language l ON j.language = l.name
             WHERE j.status = 0 AND l.content_type IN ('text/x-c++src', 'text/x-csrc')
@@ -30,10 +33,11 @@ def export_code_to_files(save_path):
         results = cursor.fetchall()
 
         # 遍历查询结果并保存到文件
-        for code, pid, submit_id, content_type in results:
+        for code, pid, submit_id, content_type, uid in results:
             # 根据 content_type 确定文件后缀
             file_extension = ".cpp" if content_type == "text/x-c++src" else ".c"
-            filename = os.path.join(save_path, f"{pid}_{submit_id}{file_extension}")
+            stem = f"{pid}_{uid}" if with_user else f"{pid}"
+            filename = os.path.join(save_path, f"{stem}_{submit_id}{file_extension}")
             with open(filename, "w", encoding="utf-8") as file:
                 file.write(code)  # 将 code 写入文件
             print(f"Saved code to {filename}")
@@ -46,6 +50,41 @@ def export_code_to_files(save_path):
             connection.close()
 
 
+# 导出为 JSONL, 每行一条记录, 供 packcorpus 打包
+def export_code_to_jsonl(jsonl_path):
+    connection = None
+    try:
+        connection = pymysql.connect(**db_config)
+        cursor = connection.cursor()
+        cursor.execute(
+            """
+            SELECT j.code, j.pid, j.submit_id, l.content_type, j.uid
+            FROM judge j
+            JOIN language l ON j.language = l.name
+            WHERE j.status = 0 AND l.content_type IN ('text/x-c++src', 'text/x-csrc')
+        """
+        )
+        count = 0
+        with open(jsonl_path, "w", encoding="utf-8") as out:
+            for code, pid, submit_id, content_type, uid in cursor:
+                record = {
+                    "pid": pid,
+                    "uid": uid,
+                    "submit_id": submit_id,
+                    "content_type": content_type,
+                    "code": code,
+                }
+                out.write(json.dumps(record, ensure_ascii=False) + "\n")
+                count += 1
+        print(f"Saved {count} records to {jsonl_path}")
+
+    except pymysql.MySQLError as e:
+        print(f"Database error: {e}")
+    finally:
+        if connection:
+            connection.close()
+
+
 if __name__ == "__main__":
     save_path = "/home/hx/Dev/Project/CAM/ProProcess/examples/sql/"
     export_code_to_files(save_path)
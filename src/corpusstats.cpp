@@ -0,0 +1,428 @@
+#include "astcache.h"
+#include "cli.h"
+#include "discovery.h"
+#include "pack.h"
+#include "prefetch.h"
+#include "vocab_extractor.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tree_sitter/api.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+/**
+ * 语料规模统计, 取代 countAllLine.py / countLine.py / countFile.py:
+ * 复用抽取器的并行遍历与预读流水线 (或打包语料), 所有核心并行统计
+ * 文件数、字节数、行数, 按扩展名与题目 pid 分组;
+ * --ast 时另外解析并统计具名节点数、叶节点数与叶节点对数,
+ * 用于事先估计抽取耗时与采样预算
+ */
+
+/**
+ * @brief 一组文件的累计
+ */
+struct Tally {
+  uint64_t files = 0;
+  uint64_t bytes = 0;
+  uint64_t lines = 0;
+  uint64_t max_lines = 0;
+  uint64_t nodes = 0;  // 具名节点, --ast
+  uint64_t leaves = 0; // 与 lca_path_traverse 相同的叶节点, --ast
+  uint64_t max_leaves = 0;
+  uint64_t pairs = 0; // path_width 内的叶节点对, 约一半被采样
+
+  void Add(const Tally &other) {
+    files += other.files;
+    bytes += other.bytes;
+    lines += other.lines;
+    max_lines = std::max(max_lines, other.max_lines);
+    nodes += other.nodes;
+    leaves += other.leaves;
+    max_leaves = std::max(max_leaves, other.max_leaves);
+    pairs += other.pairs;
+  }
+};
+
+/**
+ * @brief 单个线程的分组累计, 线程结束时并入全局结果
+ */
+struct ThreadTally {
+  Tally total;
+  std::unordered_map<std::string, Tally> by_extension;
+  std::unordered_map<std::string, Tally> by_pid;
+};
+
+std::mutex merge_mutex;
+ThreadTally corpus; // 由各线程在结束时合并
+bool with_ast = false;
+bool with_pid = true;
+uint64_t path_width = 200;
+std::unique_ptr<Prefetcher> prefetcher;
+PackReader corpus_pack;
+std::atomic<size_t> next_record{0};
+std::atomic<size_t> files_processed{0};
+std::atomic<size_t> total_files{0};
+std::atomic<bool> discovery_done{false};
+
+namespace {
+uint64_t count_newlines_scalar(const char *p, size_t n) {
+  uint64_t count = 0;
+  for (size_t i = 0; i < n; ++i)
+    count += p[i] == '\n';
+  return count;
+}
+
+#if defined(__x86_64__)
+// 比较结果为 0/-1, 按字节累减, 至多 255 轮后以 SAD 横向求和, 避免溢出
+uint64_t count_newlines_sse2(const char *p, size_t n) {
+  const __m128i newline = _mm_set1_epi8('\n');
+  const __m128i zero = _mm_setzero_si128();
+  uint64_t count = 0;
+  size_t i = 0;
+  while (i + 16 <= n) {
+    __m128i sums = zero;
+    size_t rounds = std::min<size_t>(255, (n - i) / 16);
+    for (size_t r = 0; r < rounds; ++r, i += 16) {
+      __m128i chunk =
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+      sums = _mm_sub_epi8(sums, _mm_cmpeq_epi8(chunk, newline));
+    }
+    __m128i sad = _mm_sad_epu8(sums, zero);
+    count += _mm_cvtsi128_si64(sad) +
+             _mm_cvtsi128_si64(_mm_unpackhi_epi64(sad, sad));
+  }
+  return count + count_newlines_scalar(p + i, n - i);
+}
+
+__attribute__((target("avx2"))) uint64_t count_newlines_avx2(const char *p,
+                                                              size_t n) {
+  const __m256i newline = _mm256_set1_epi8('\n');
+  const __m256i zero = _mm256_setzero_si256();
+  uint64_t count = 0;
+  size_t i = 0;
+  while (i + 32 <= n) {
+    __m256i sums = zero;
+    size_t rounds = std::min<size_t>(255, (n - i) / 32);
+    for (size_t r = 0; r < rounds; ++r, i += 32) {
+      __m256i chunk =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i));
+      sums = _mm256_sub_epi8(sums, _mm256_cmpeq_epi8(chunk, newline));
+    }
+    __m256i sad = _mm256_sad_epu8(sums, zero);
+    count += _mm256_extract_epi64(sad, 0) + _mm256_extract_epi64(sad, 1) +
+             _mm256_extract_epi64(sad, 2) + _mm256_extract_epi64(sad, 3);
+  }
+  return count + count_newlines_scalar(p + i, n - i);
+}
+#endif
+
+/**
+ * @brief 行数与 Python 的 readlines 一致: 末行没有换行符也计一行
+ */
+uint64_t count_lines(std::string_view data) {
+  if (data.empty())
+    return 0;
+#if defined(__x86_64__)
+  static const bool avx2 = __builtin_cpu_supports("avx2");
+  uint64_t newlines = avx2 ? count_newlines_avx2(data.data(), data.size())
+                           : count_newlines_sse2(data.data(), data.size());
+#else
+  uint64_t newlines = count_newlines_scalar(data.data(), data.size());
+#endif
+  return newlines + (data.back() != '\n');
+}
+
+/**
+ * @brief cloneSQLdata.py 导出的文件名 pid[_uid]_submitid.ext 中的 pid
+ */
+std::string_view pid_of(std::string_view stem) {
+  size_t split = stem.find('_');
+  return split == std::string_view::npos ? std::string_view()
+                                         : stem.substr(0, split);
+}
+
+/**
+ * @brief path_width 内的叶节点对数, 与 lca_path_traverse 的双重循环一致
+ */
+uint64_t pair_count(uint64_t leaves) {
+  if (leaves < 2)
+    return 0;
+  if (leaves <= path_width)
+    return leaves * (leaves - 1) / 2;
+  return (leaves - path_width + 1) * (path_width - 1) +
+         (path_width - 1) * (path_width - 2) / 2;
+}
+
+void count_file(ThreadTally &tally, const std::filesystem::path &path,
+                uint8_t lang, std::string_view source) {
+  Tally file;
+  file.files = 1;
+  file.bytes = source.size();
+  file.lines = count_lines(source);
+  file.max_lines = file.lines;
+  if (with_ast) {
+    thread_local std::vector<FlatNode> nodes;
+    thread_local std::vector<uint32_t> leaves;
+    TSParser *parser =
+        thread_parser(lang == PACK_LANG_C ? SourceLang::C : SourceLang::Cpp);
+    TSTree *tree = ts_parser_parse_string(parser, nullptr, source.data(),
+                                          source.size());
+    // 与抽取器看到的树一致: 只计具名节点, 叶节点不含注释与 ERROR
+    if (tree != nullptr &&
+        flatten_ast(ts_tree_root_node(tree), nodes, leaves)) {
+      file.nodes = nodes.size();
+      file.leaves = leaves.size();
+      file.max_leaves = file.leaves;
+      file.pairs = pair_count(file.leaves);
+    }
+    if (tree != nullptr)
+      ts_tree_delete(tree);
+  }
+  tally.total.Add(file);
+  tally.by_extension[path.extension().string()].Add(file);
+  if (with_pid) {
+    std::string stem = path.stem().string();
+    std::string_view pid = pid_of(stem);
+    if (!pid.empty())
+      tally.by_pid[std::string(pid)].Add(file);
+  }
+  files_processed.fetch_add(1, std::memory_order_relaxed);
+}
+} // namespace
+
+void worker() {
+  ThreadTally tally;
+  while (true) {
+    if (corpus_pack.IsOpen()) {
+      size_t index = next_record.fetch_add(1, std::memory_order_relaxed);
+      if (index >= corpus_pack.Size())
+        break;
+      PackRecord record = corpus_pack.Get(index);
+      count_file(tally, std::filesystem::path(record.name), record.lang,
+                 record.content);
+      continue;
+    }
+    PrefetchedFile item;
+    if (!prefetcher->Next(item))
+      break;
+    if (item.error != 0) {
+      std::lock_guard<std::mutex> lock(merge_mutex);
+      std::cerr << "无法打开文件: " << item.file.path << "\n";
+      files_processed.fetch_add(1, std::memory_order_relaxed);
+      continue;
+    }
+    count_file(tally, item.file.path, item.file.lang, item.data);
+    prefetcher->Recycle(std::move(item.data));
+  }
+  std::lock_guard<std::mutex> lock(merge_mutex);
+  corpus.total.Add(tally.total);
+  for (const auto &entry : tally.by_extension)
+    corpus.by_extension[entry.first].Add(entry.second);
+  for (const auto &entry : tally.by_pid)
+    corpus.by_pid[entry.first].Add(entry.second);
+}
+
+/**
+ * @brief 输出 JSON 字符串, 分组键来自文件路径, 可能含引号与控制字符
+ */
+void write_json_string(std::ostream &out, std::string_view text) {
+  out << '"';
+  for (char c : text) {
+    switch (c) {
+    case '"':
+      out << "\\\"";
+      break;
+    case '\\':
+      out << "\\\\";
+      break;
+    case '\n':
+      out << "\\n";
+      break;
+    case '\t':
+      out << "\\t";
+      break;
+    default:
+      if (static_cast<unsigned char>(c) < 0x20) {
+        char escaped[8];
+        std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+        out << escaped;
+      } else {
+        out << c;
+      }
+    }
+  }
+  out << '"';
+}
+
+/**
+ * @brief 以 JSON 输出, 分组按文件数降序
+ */
+void write_tally(std::ostream &out, const Tally &tally) {
+  out << "{\"files\": " << tally.files << ", \"bytes\": " << tally.bytes
+      << ", \"lines\": " << tally.lines << ", \"max_lines\": "
+      << tally.max_lines;
+  if (with_ast)
+    out << ", \"nodes\": " << tally.nodes << ", \"leaves\": " << tally.leaves
+        << ", \"max_leaves\": " << tally.max_leaves
+        << ", \"pairs\": " << tally.pairs;
+  out << "}";
+}
+
+void write_groups(std::ostream &out, const char *name,
+                  const std::unordered_map<std::string, Tally> &groups) {
+  std::vector<std::pair<std::string, Tally>> sorted(groups.begin(),
+                                                     groups.end());
+  std::sort(sorted.begin(), sorted.end(), [](const auto &a, const auto &b) {
+    return a.second.files != b.second.files ? a.second.files > b.second.files
+                                            : a.first < b.first;
+  });
+  out << "  \"" << name << "\": {";
+  for (size_t i = 0; i < sorted.size(); ++i) {
+    out << (i == 0 ? "\n" : ",\n") << "    ";
+    write_json_string(out, sorted[i].first);
+    out << ": ";
+    write_tally(out, sorted[i].second);
+  }
+  out << (sorted.empty() ? "}" : "\n  }");
+}
+
+void write_report(std::ostream &out, double seconds) {
+  out << "{\n  \"total\": ";
+  write_tally(out, corpus.total);
+  out << ",\n";
+  write_groups(out, "by_extension", corpus.by_extension);
+  if (with_pid) {
+    out << ",\n";
+    write_groups(out, "by_pid", corpus.by_pid);
+  }
+  out << ",\n  \"seconds\": " << seconds << "\n}\n";
+}
+
+int main(int argc, char **argv) {
+  std::ios::sync_with_stdio(false);
+  std::vector<std::string> positional;
+  std::string report_path;
+  ExtensionMap extensions;
+  IgnoreRules ignore_rules;
+  unsigned discovery_threads = 4;
+  size_t prefetch_depth = 64;
+  unsigned io_threads = 4;
+  PrefetchBackend io_backend = PrefetchBackend::Auto;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i], value;
+    if (arg == "--ast") {
+      with_ast = true;
+    } else if (Cli::MatchOption(arg, "--path-width", value)) {
+      path_width = std::max(1ul, std::stoul(value));
+    } else if (arg == "--no-pid") {
+      with_pid = false;
+    } else if (Cli::MatchOption(arg, "--report", value)) {
+      report_path = value;
+    } else if (Cli::MatchOption(arg, "--ext", value)) {
+      if (!extensions.Parse(value)) {
+        std::cerr << "无法解析扩展名映射: " << value << "\n";
+        return 1;
+      }
+    } else if (arg == "--headers") {
+      extensions.AddHeaders();
+    } else if (Cli::MatchOption(arg, "--ignore", value)) {
+      ignore_rules.AddPatterns(value);
+    } else if (Cli::MatchOption(arg, "--discovery-threads", value)) {
+      discovery_threads = std::max(1ul, std::stoul(value));
+    } else if (Cli::MatchOption(arg, "--prefetch-depth", value)) {
+      prefetch_depth = std::stoul(value);
+    } else if (Cli::MatchOption(arg, "--io-threads", value)) {
+      io_threads = std::stoul(value);
+    } else if (Cli::MatchOption(arg, "--io-backend", value)) {
+      bool ok;
+      io_backend = Prefetcher::ParseBackend(value, ok);
+      if (!ok) {
+        std::cerr << "未知的 I/O 后端: " << value << "\n";
+        return 1;
+      }
+    } else {
+      positional.push_back(arg);
+    }
+  }
+  if (positional.size() != 1) {
+    std::cerr << "用法: " << argv[0]
+              << " <目标目录|打包语料> [--ast] [--path-width=N] [--no-pid]"
+                 " [--report=报告.json] [--ext=.c=c,.h=cpp,...] [--headers]"
+                 " [--ignore=模式,...] [--discovery-threads=N]"
+                 " [--prefetch-depth=N] [--io-threads=N]"
+                 " [--io-backend=auto|uring|threads]\n";
+    return 1;
+  }
+
+  const std::filesystem::path root_path(positional[0]);
+  auto start = std::chrono::steady_clock::now();
+  std::thread discoverer;
+  if (PackReader::IsPack(root_path)) {
+    if (!corpus_pack.Open(root_path)) {
+      std::cerr << "无法读取打包语料: " << root_path << "\n";
+      return 1;
+    }
+    total_files = corpus_pack.Size();
+    discovery_done = true;
+  } else {
+    ignore_rules.AddPattern(".git");
+    ignore_rules.AddPath(root_path / "out");
+    prefetcher =
+        std::make_unique<Prefetcher>(prefetch_depth, io_threads, io_backend);
+    discoverer = std::thread([&]() {
+      Discovery discovery(extensions, ignore_rules);
+      discovery.Walk(root_path, discovery_threads,
+                     [](std::vector<SourceFile> &files) {
+                       total_files += files.size();
+                       prefetcher->Push(files);
+                     });
+      discovery_done = true;
+      prefetcher->Close();
+    });
+  }
+
+  const unsigned num_threads = std::thread::hardware_concurrency();
+  std::vector<std::thread> threads;
+  for (unsigned i = 0; i < num_threads; ++i)
+    threads.emplace_back(worker);
+  while (!discovery_done || files_processed < total_files) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    size_t processed = files_processed, discovered = total_files;
+    std::clog << "\r已统计文件: " << processed << "/" << discovered;
+    std::clog.flush();
+  }
+  if (discoverer.joinable())
+    discoverer.join();
+  for (auto &t : threads)
+    t.join();
+  std::clog << "\n";
+  if (total_files == 0) {
+    std::cerr << "未找到C/C++文件\n";
+    return 1;
+  }
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  if (report_path.empty()) {
+    write_report(std::cout, seconds);
+  } else {
+    std::ofstream report(report_path);
+    write_report(report, seconds);
+  }
+  return 0;
+}
@@ -0,0 +1,174 @@
+#include "cli.h"
+#include "ctxstream.h"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/**
+ * 解码 astparser_from_vocab --ctx-out 写出的上下文流:
+ *   默认按文本格式 "名称 t1,p,t2[,次数] ..." 逐行写到标准输出
+ *   --sample=N 只解码第 N 个样本所在的块并输出该样本
+ *   --bench    解码全部样本并与等价文本比较大小与解析吞吐
+ */
+
+using Clock = std::chrono::steady_clock;
+
+double seconds_since(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/**
+ * @brief 按抽取器的方式解析一行文本, 作为文本格式的读取基线
+ */
+size_t parse_text_line(const std::string &line, std::vector<uint32_t> &ids) {
+  ids.clear();
+  const char *p = line.c_str();
+  p = std::strchr(p, ' ');
+  while (p != nullptr && *p != '\0') {
+    char *next;
+    unsigned long id = std::strtoul(p + 1, &next, 10);
+    if (next == p + 1)
+      break;
+    ids.push_back(static_cast<uint32_t>(id));
+    p = next;
+  }
+  return ids.size();
+}
+
+/**
+ * @brief 报告无法解码的块, 区分数据损坏与本构建不支持压缩
+ */
+void report_bad_block(const CtxStreamReader &reader, size_t block) {
+  if (reader.Block(block).codec == CTXSTREAM_DEFLATE &&
+      !ctx_stream_compression())
+    std::cerr << "块" << block << "为压缩块, 需以 make WITH_ZLIB=1 构建\n";
+  else
+    std::cerr << "块" << block << "损坏\n";
+}
+
+int bench(const CtxStreamReader &reader) {
+  std::vector<CtxSample> samples;
+  uint64_t contexts = 0, raw_bytes = 0;
+  auto start = Clock::now();
+  for (size_t b = 0; b < reader.BlockCount(); ++b) {
+    if (!reader.DecodeBlock(b, samples)) {
+      report_bad_block(reader, b);
+      return 1;
+    }
+    raw_bytes += reader.Block(b).raw_size;
+    for (const CtxSample &sample : samples)
+      contexts += sample.contexts.size();
+  }
+  double decode_seconds = seconds_since(start);
+
+  // 生成等价文本并计时解析, 文本只在内存中, 不含磁盘读取
+  std::string text;
+  std::vector<std::string> lines;
+  for (size_t b = 0; b < reader.BlockCount(); ++b) {
+    reader.DecodeBlock(b, samples);
+    for (const CtxSample &sample : samples) {
+      text.clear();
+      append_contexts(text, sample.label, sample.contexts,
+                      sample.counts.empty() ? nullptr : &sample.counts);
+      lines.push_back(text);
+    }
+  }
+  uint64_t text_bytes = 0, parsed = 0;
+  std::vector<uint32_t> ids;
+  start = Clock::now();
+  for (const std::string &line : lines) {
+    text_bytes += line.size() + 1;
+    parsed += parse_text_line(line, ids);
+  }
+  double parse_seconds = seconds_since(start);
+
+  const double mb = 1024.0 * 1024.0;
+  std::cout << "{\n  \"samples\": " << reader.SampleCount()
+            << ",\n  \"contexts\": " << contexts
+            << ",\n  \"blocks\": " << reader.BlockCount()
+            << ",\n  \"stream_bytes\": " << reader.FileSize()
+            << ",\n  \"varint_bytes\": " << raw_bytes
+            << ",\n  \"text_bytes\": " << text_bytes
+            << ",\n  \"ratio_vs_text\": "
+            << static_cast<double>(reader.FileSize()) / text_bytes
+            << ",\n  \"decode_seconds\": " << decode_seconds
+            << ",\n  \"decode_text_mb_per_s\": "
+            << text_bytes / mb / decode_seconds
+            << ",\n  \"text_parse_seconds\": " << parse_seconds
+            << ",\n  \"text_parse_mb_per_s\": "
+            << text_bytes / mb / parse_seconds
+            << ",\n  \"text_ids_parsed\": " << parsed << "\n}\n";
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  std::ios::sync_with_stdio(false);
+  std::vector<std::string> positional;
+  bool with_bench = false;
+  long long sample_index = -1;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i], value;
+    if (arg == "--bench")
+      with_bench = true;
+    else if (Cli::MatchOption(arg, "--sample", value))
+      sample_index = std::stoll(value);
+    else
+      positional.push_back(arg);
+  }
+  if (positional.size() != 1) {
+    std::cerr << "用法: " << argv[0]
+              << " <上下文流> [--sample=N] [--bench]\n"
+              << (ctx_stream_compression()
+                      ? "块压缩: 已启用\n"
+                      : "块压缩: 未启用, 压缩块无法解码"
+                        " (以 make WITH_ZLIB=1 构建)\n");
+    return 1;
+  }
+  CtxStreamReader reader;
+  if (!reader.Open(positional[0])) {
+    std::cerr << "无法读取上下文流: " << positional[0] << "\n";
+    return 1;
+  }
+  if (with_bench)
+    return bench(reader);
+
+  std::vector<CtxSample> samples;
+  std::string out;
+  auto emit = [&](const CtxSample &sample) {
+    out.clear();
+    append_contexts(out, sample.label, sample.contexts,
+                    sample.counts.empty() ? nullptr : &sample.counts);
+    out += '\n';
+    std::cout << out;
+  };
+  if (sample_index >= 0) {
+    if (static_cast<uint64_t>(sample_index) >= reader.SampleCount()) {
+      std::cerr << "样本下标超出范围, 共" << reader.SampleCount() << "个\n";
+      return 1;
+    }
+    size_t block = reader.FindBlock(sample_index);
+    if (!reader.DecodeBlock(block, samples)) {
+      report_bad_block(reader, block);
+      return 1;
+    }
+    uint64_t offset = sample_index - reader.FirstSample(block);
+    if (offset >= samples.size()) {
+      report_bad_block(reader, block);
+      return 1;
+    }
+    emit(samples[offset]);
+    return 0;
+  }
+  for (size_t b = 0; b < reader.BlockCount(); ++b) {
+    if (!reader.DecodeBlock(b, samples)) {
+      report_bad_block(reader, b);
+      return 1;
+    }
+    for (const CtxSample &sample : samples)
+      emit(sample);
+  }
+  return 0;
+}
@@ -0,0 +1,337 @@
+#include "ctxstream.h"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef CTXSTREAM_WITH_ZLIB
+#include <zlib.h>
+#endif
+
+static_assert(sizeof(CtxStreamHeader) == 32,
+              "CtxStreamHeader 布局固定为 32 字节");
+static_assert(sizeof(CtxBlockHeader) == 16,
+              "CtxBlockHeader 布局固定为 16 字节");
+static_assert(sizeof(CtxBlockIndex) == 16,
+              "CtxBlockIndex 布局固定为 16 字节");
+
+namespace {
+inline void put_varint(std::string &out, uint64_t value) {
+  while (value >= 0x80) {
+    out += static_cast<char>(value | 0x80);
+    value >>= 7;
+  }
+  out += static_cast<char>(value);
+}
+
+inline bool get_varint(const uint8_t *&p, const uint8_t *end,
+                       uint64_t &value) {
+  value = 0;
+  for (unsigned shift = 0; p < end && shift < 64; shift += 7) {
+    uint8_t byte = *p++;
+    value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0)
+      return true;
+  }
+  return false;
+}
+
+inline uint64_t zigzag(int64_t delta) {
+  return (static_cast<uint64_t>(delta) << 1) ^
+         static_cast<uint64_t>(delta >> 63);
+}
+
+inline int64_t unzigzag(uint64_t value) {
+  return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+} // namespace
+
+void ctx_encode_sample(std::string &out, std::string_view label,
+                       const std::vector<PathContext> &contexts,
+                       const std::vector<uint32_t> *counts) {
+  put_varint(out, label.size());
+  out += label;
+  put_varint(out, (contexts.size() << 1) | (counts != nullptr ? 1 : 0));
+  uint32_t previous = 0;
+  for (size_t i = 0; i < contexts.size(); ++i) {
+    const PathContext &context = contexts[i];
+    put_varint(out, zigzag(static_cast<int64_t>(context.token1) - previous));
+    put_varint(out, context.path);
+    put_varint(out, context.token2);
+    if (counts != nullptr)
+      put_varint(out, (*counts)[i]);
+    previous = context.token1;
+  }
+}
+
+bool ctx_decode_sample(const uint8_t *&p, const uint8_t *end,
+                       CtxSample &sample) {
+  uint64_t length, header;
+  if (!get_varint(p, end, length) || length > static_cast<size_t>(end - p))
+    return false;
+  sample.label.assign(reinterpret_cast<const char *>(p), length);
+  p += length;
+  if (!get_varint(p, end, header))
+    return false;
+  const uint64_t n = header >> 1;
+  const bool with_counts = (header & 1) != 0;
+  // 每个上下文至少占 3 字节, 防止损坏数据导致超大分配
+  if (n > static_cast<size_t>(end - p) / 3)
+    return false;
+  sample.contexts.resize(n);
+  sample.counts.resize(with_counts ? n : 0);
+  int64_t previous = 0;
+  for (uint64_t i = 0; i < n; ++i) {
+    uint64_t delta, path, token2, count;
+    if (!get_varint(p, end, delta) || !get_varint(p, end, path) ||
+        !get_varint(p, end, token2))
+      return false;
+    previous += unzigzag(delta);
+    sample.contexts[i] = {static_cast<uint32_t>(previous),
+                          static_cast<uint32_t>(path),
+                          static_cast<uint32_t>(token2)};
+    if (with_counts) {
+      if (!get_varint(p, end, count))
+        return false;
+      sample.counts[i] = static_cast<uint32_t>(count);
+    }
+  }
+  return true;
+}
+
+bool ctx_stream_compression() {
+#ifdef CTXSTREAM_WITH_ZLIB
+  return true;
+#else
+  return false;
+#endif
+}
+
+CtxStreamReader::~CtxStreamReader() {
+  if (data_ != nullptr)
+    ::munmap(const_cast<char *>(data_), size_);
+}
+
+bool CtxStreamReader::Open(const std::filesystem::path &stream_path) {
+  int fd = ::open(stream_path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (::fstat(fd, &st) != 0 ||
+      static_cast<size_t>(st.st_size) < sizeof(CtxStreamHeader)) {
+    ::close(fd);
+    return false;
+  }
+  void *map = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED)
+    return false;
+
+  const char *data = static_cast<const char *>(map);
+  size_t size = static_cast<size_t>(st.st_size);
+  CtxStreamHeader header;
+  std::memcpy(&header, data, sizeof(header));
+  bool ok = std::memcmp(header.magic, CTXSTREAM_MAGIC,
+                        sizeof(CTXSTREAM_MAGIC)) == 0 &&
+            header.version == CTXSTREAM_VERSION &&
+            header.index_offset <= size &&
+            header.block_count <=
+                (size - header.index_offset) / sizeof(CtxBlockIndex);
+  if (ok) {
+    index_.resize(header.block_count);
+    std::memcpy(index_.data(), data + header.index_offset,
+                index_.size() * sizeof(CtxBlockIndex));
+    // 各块的样本须首尾相接, 样本数不超过解压后字节数的一半
+    // (每个样本至少含标签长度与上下文数两个字节), 比较均以减法避免溢出
+    for (const CtxBlockIndex &entry : index_) {
+      CtxBlockHeader block;
+      ok = entry.first_sample == samples_ &&
+           entry.offset >= sizeof(CtxStreamHeader) &&
+           entry.offset <= header.index_offset &&
+           header.index_offset - entry.offset >= sizeof(block);
+      if (!ok)
+        break;
+      std::memcpy(&block, data + entry.offset, sizeof(block));
+      ok = block.stored_size <=
+               header.index_offset - entry.offset - sizeof(block) &&
+           block.sample_count <= block.raw_size / 2;
+      if (!ok)
+        break;
+      samples_ += block.sample_count;
+    }
+  }
+  if (!ok) {
+    ::munmap(map, size);
+    index_.clear();
+    samples_ = 0;
+    return false;
+  }
+  data_ = data;
+  size_ = size;
+  return true;
+}
+
+CtxBlockHeader CtxStreamReader::Block(size_t block) const {
+  // 块头不保证对齐
+  CtxBlockHeader header;
+  std::memcpy(&header, data_ + index_[block].offset, sizeof(header));
+  return header;
+}
+
+size_t CtxStreamReader::FindBlock(uint64_t sample) const {
+  auto it = std::upper_bound(index_.begin(), index_.end(), sample,
+                             [](uint64_t value, const CtxBlockIndex &entry) {
+                               return value < entry.first_sample;
+                             });
+  return it == index_.begin() ? 0 : (it - index_.begin()) - 1;
+}
+
+bool CtxStreamReader::DecodeBlock(size_t block,
+                                  std::vector<CtxSample> &samples) const {
+  CtxBlockHeader header = Block(block);
+  const uint8_t *stored = reinterpret_cast<const uint8_t *>(
+      data_ + index_[block].offset + sizeof(header));
+  thread_local std::vector<uint8_t> buffer;
+  const uint8_t *p = stored;
+  if (header.codec == CTXSTREAM_DEFLATE) {
+#ifdef CTXSTREAM_WITH_ZLIB
+    buffer.resize(header.raw_size);
+    uLongf raw_size = header.raw_size;
+    if (::uncompress(buffer.data(), &raw_size, stored, header.stored_size) !=
+            Z_OK ||
+        raw_size != header.raw_size)
+      return false;
+    p = buffer.data();
+#else
+    return false; // 未启用 zlib 时无法解码压缩块
+#endif
+  } else if (header.codec != CTXSTREAM_RAW ||
+             header.raw_size != header.stored_size) {
+    return false;
+  }
+  const uint8_t *end = p + header.raw_size;
+  samples.resize(header.sample_count);
+  for (CtxSample &sample : samples) {
+    if (!ctx_decode_sample(p, end, sample))
+      return false;
+  }
+  return p == end;
+}
+
+bool CtxStreamReader::IsStream(const std::filesystem::path &path) {
+  std::error_code ec;
+  if (!std::filesystem::is_regular_file(path, ec))
+    return false;
+  std::FILE *file = std::fopen(path.c_str(), "rb");
+  if (file == nullptr)
+    return false;
+  char magic[sizeof(CTXSTREAM_MAGIC)];
+  bool ok = std::fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+            std::memcmp(magic, CTXSTREAM_MAGIC, sizeof(magic)) == 0;
+  std::fclose(file);
+  return ok;
+}
+
+CtxStreamWriter::~CtxStreamWriter() {
+  if (file_ != nullptr)
+    std::fclose(file_);
+}
+
+bool CtxStreamWriter::Write(const void *data, size_t size) {
+  if (std::fwrite(data, 1, size, file_) != size)
+    return false;
+  offset_ += size;
+  return true;
+}
+
+bool CtxStreamWriter::Open(const std::filesystem::path &stream_path) {
+  file_ = std::fopen(stream_path.c_str(), "wb");
+  if (file_ == nullptr)
+    return false;
+  // 先写占位文件头, Finish 时回填块数与索引偏移
+  CtxStreamHeader header{};
+  std::memcpy(header.magic, CTXSTREAM_MAGIC, sizeof(CTXSTREAM_MAGIC));
+  header.version = CTXSTREAM_VERSION;
+  return Write(&header, sizeof(header));
+}
+
+bool CtxStreamWriter::Add(std::string_view label,
+                          const std::vector<PathContext> &contexts,
+                          const std::vector<uint32_t> *counts) {
+  thread_local std::string encoded;
+  encoded.clear();
+  ctx_encode_sample(encoded, label, contexts, counts);
+  Block full;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (current_.samples == 0)
+      current_.first_sample = samples_;
+    current_.data += encoded;
+    current_.samples++;
+    samples_++;
+    if (current_.data.size() < block_bytes_)
+      return true;
+    std::swap(full, current_);
+  }
+  return WriteBlock(full);
+}
+
+bool CtxStreamWriter::WriteBlock(const Block &block) {
+  CtxBlockHeader header{};
+  header.raw_size = static_cast<uint32_t>(block.data.size());
+  header.sample_count = block.samples;
+  header.codec = CTXSTREAM_RAW;
+  const void *stored = block.data.data();
+  size_t stored_size = block.data.size();
+#ifdef CTXSTREAM_WITH_ZLIB
+  // 在锁外压缩, 多个线程可同时压缩各自的满块
+  thread_local std::vector<Bytef> compressed;
+  uLongf compressed_size = ::compressBound(block.data.size());
+  compressed.resize(compressed_size);
+  if (::compress2(compressed.data(), &compressed_size,
+                  reinterpret_cast<const Bytef *>(block.data.data()),
+                  block.data.size(), Z_BEST_SPEED) == Z_OK &&
+      compressed_size < block.data.size()) {
+    header.codec = CTXSTREAM_DEFLATE;
+    stored = compressed.data();
+    stored_size = compressed_size;
+  }
+#endif
+  header.stored_size = static_cast<uint32_t>(stored_size);
+  std::lock_guard<std::mutex> lock(file_mutex_);
+  index_.push_back({offset_, block.first_sample});
+  ok_ = ok_ && Write(&header, sizeof(header)) && Write(stored, stored_size);
+  return ok_;
+}
+
+bool CtxStreamWriter::Finish() {
+  Block last;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::swap(last, current_);
+  }
+  bool ok = last.samples == 0 || WriteBlock(last);
+  std::lock_guard<std::mutex> lock(file_mutex_);
+  std::sort(index_.begin(), index_.end(),
+            [](const CtxBlockIndex &a, const CtxBlockIndex &b) {
+              return a.first_sample < b.first_sample;
+            });
+  CtxStreamHeader header{};
+  std::memcpy(header.magic, CTXSTREAM_MAGIC, sizeof(CTXSTREAM_MAGIC));
+  header.version = CTXSTREAM_VERSION;
+  header.block_count = index_.size();
+  header.index_offset = offset_;
+  ok = ok && ok_ &&
+       Write(index_.data(), index_.size() * sizeof(CtxBlockIndex)) &&
+       std::fseek(file_, 0, SEEK_SET) == 0 &&
+       std::fwrite(&header, sizeof(header), 1, file_) == 1;
+  ok = (std::fclose(file_) == 0) && ok;
+  file_ = nullptr;
+  return ok;
+}
+
+uint64_t CtxStreamWriter::Size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return samples_;
+}
@@ -0,0 +1,143 @@
+#ifndef __HAS_CTXSTREAM__
+#define __HAS_CTXSTREAM__
+#include "pathcontext.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * 路径上下文的二进制流格式, 所有定长整数为小端:
+ *   CtxStreamHeader
+ *   块 * N: CtxBlockHeader + 块数据, 每块可独立解码
+ *   索引: CtxBlockIndex * N, 按 first_sample 升序
+ * 块数据解压后为连续的样本, 整数均为 LEB128 变长编码:
+ *   标签长度, 标签, (上下文数 << 1 | 带次数), 每个上下文:
+ *   zigzag(token1 - 上一 token1), path, token2[, 次数]
+ * 同一叶节点与其后各叶节点配对, token1 连续相同, 差分后多为单字节 0;
+ * 词汇表ID越小编码越短, 按频次分配ID的词汇表 (如 vocabmerge 的输出) 效果最好
+ * 块压缩需以 -DCTXSTREAM_WITH_ZLIB -lz 编译 (make WITH_ZLIB=1),
+ * 否则块按原样存储, 也无法解码其他构建写出的压缩块
+ */
+constexpr char CTXSTREAM_MAGIC[8] = {'A', 'S', 'T', 'C', 'T', 'X', 'S', '1'};
+constexpr uint32_t CTXSTREAM_VERSION = 1;
+constexpr uint8_t CTXSTREAM_RAW = 0;
+constexpr uint8_t CTXSTREAM_DEFLATE = 1;
+
+struct CtxStreamHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t flags;
+  uint64_t block_count;
+  uint64_t index_offset;
+};
+
+struct CtxBlockHeader {
+  uint32_t raw_size;
+  uint32_t stored_size;
+  uint32_t sample_count;
+  uint8_t codec;
+  uint8_t reserved[3];
+};
+
+struct CtxBlockIndex {
+  uint64_t offset; // 块头相对文件头的偏移
+  uint64_t first_sample;
+};
+
+struct CtxSample {
+  std::string label;
+  std::vector<PathContext> contexts;
+  std::vector<uint32_t> counts; // 无次数时为空
+};
+
+// 本构建是否支持块压缩
+bool ctx_stream_compression();
+
+/**
+ * @brief 追加一个样本的编码
+ */
+void ctx_encode_sample(std::string &out, std::string_view label,
+                       const std::vector<PathContext> &contexts,
+                       const std::vector<uint32_t> *counts = nullptr);
+
+/**
+ * @brief 解码 [p, end) 处的一个样本并前移 p, 数据截断时返回 false
+ */
+bool ctx_decode_sample(const uint8_t *&p, const uint8_t *end,
+                       CtxSample &sample);
+
+/**
+ * @brief 只读上下文流, mmap 映射后线程安全, 支持按块随机访问
+ */
+class CtxStreamReader {
+public:
+  CtxStreamReader() = default;
+  CtxStreamReader(const CtxStreamReader &) = delete;
+  CtxStreamReader &operator=(const CtxStreamReader &) = delete;
+  ~CtxStreamReader();
+
+  bool Open(const std::filesystem::path &stream_path);
+  size_t BlockCount() const { return index_.size(); }
+  uint64_t SampleCount() const { return samples_; }
+  size_t FileSize() const { return size_; }
+  CtxBlockHeader Block(size_t block) const;
+  uint64_t FirstSample(size_t block) const {
+    return index_[block].first_sample;
+  }
+  // 包含第 sample 个样本的块
+  size_t FindBlock(uint64_t sample) const;
+  // 解码整块, samples 依次为 first_sample 起的样本
+  bool DecodeBlock(size_t block, std::vector<CtxSample> &samples) const;
+  static bool IsStream(const std::filesystem::path &path);
+
+private:
+  const char *data_ = nullptr;
+  size_t size_ = 0;
+  uint64_t samples_ = 0;
+  std::vector<CtxBlockIndex> index_;
+};
+
+/**
+ * @brief 上下文流写入, Add 可由多个工作线程并发调用
+ * 块满后在锁外压缩, 块在文件中的顺序取决于完成顺序, 由索引还原
+ */
+class CtxStreamWriter {
+public:
+  explicit CtxStreamWriter(size_t block_bytes = 1 << 20)
+      : block_bytes_(block_bytes) {}
+  CtxStreamWriter(const CtxStreamWriter &) = delete;
+  CtxStreamWriter &operator=(const CtxStreamWriter &) = delete;
+  ~CtxStreamWriter();
+
+  bool Open(const std::filesystem::path &stream_path);
+  bool Add(std::string_view label, const std::vector<PathContext> &contexts,
+           const std::vector<uint32_t> *counts = nullptr);
+  bool Finish();
+  uint64_t Size() const;
+
+private:
+  struct Block {
+    std::string data;
+    uint32_t samples = 0;
+    uint64_t first_sample = 0;
+  };
+  bool WriteBlock(const Block &block);
+  bool Write(const void *data, size_t size);
+
+  const size_t block_bytes_;
+  mutable std::mutex mutex_; // 保护 current_ 与 samples_
+  Block current_;
+  uint64_t samples_ = 0;
+  std::mutex file_mutex_; // 保护文件与索引
+  std::FILE *file_ = nullptr;
+  uint64_t offset_ = 0;
+  bool ok_ = true;
+  std::vector<CtxBlockIndex> index_;
+};
+
+#endif // !__HAS_CTXSTREAM__
@@ -0,0 +1,214 @@
+#include "dedup.h"
+#include "hash.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+uint64_t mix64(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ULL;
+  x ^= x >> 33;
+  return x;
+}
+
+/**
+ * @brief MinHash 的 MINHASH_SIZE 个哈希函数 h_i(x) = (a_i * x + b_i) >> 32
+ */
+struct MinHashParams {
+  uint64_t a[MINHASH_SIZE];
+  uint64_t b[MINHASH_SIZE];
+  MinHashParams() {
+    // 固定种子, 保证不同运行之间签名可比
+    uint64_t state = 0x9e3779b97f4a7c15ULL;
+    for (int i = 0; i < MINHASH_SIZE; ++i) {
+      a[i] = mix64(state += 0x9e3779b97f4a7c15ULL) | 1;
+      b[i] = mix64(state += 0x9e3779b97f4a7c15ULL);
+    }
+  }
+};
+const MinHashParams minhash_params;
+
+uint64_t band_key(const uint32_t signature[MINHASH_SIZE], int band) {
+  uint64_t key = static_cast<uint64_t>(band);
+  for (int r = 0; r < LSH_ROWS; ++r)
+    key = mix64(key ^ signature[band * LSH_ROWS + r]);
+  return key;
+}
+
+double similarity(const uint32_t a[MINHASH_SIZE],
+                  const uint32_t b[MINHASH_SIZE]) {
+  int same = 0;
+  for (int i = 0; i < MINHASH_SIZE; ++i)
+    same += a[i] == b[i];
+  return static_cast<double>(same) / MINHASH_SIZE;
+}
+} // namespace
+
+/**
+ * @brief 先序遍历具名节点, 以连续 4 个节点类型 (symbol) 为一个 shingle
+ * 4 个 16 位 symbol 恰好拼成一个 64 位整数, 无需拼接字符串
+ * @return shingle 数不足 MIN_SHINGLES 时返回 false
+ */
+bool Deduplicator::Signature(TSNode root, uint32_t signature[MINHASH_SIZE]) {
+  std::fill(signature, signature + MINHASH_SIZE, UINT32_MAX);
+  uint64_t window = 0;
+  size_t symbols = 0;
+  TSTreeCursor cursor = ts_tree_cursor_new(root);
+  bool descend = true;
+  while (true) {
+    TSNode node = ts_tree_cursor_current_node(&cursor);
+    if (descend && ts_node_is_named(node) && !ts_node_is_extra(node)) {
+      window = (window << 16) | ts_node_symbol(node);
+      if (++symbols >= 4) {
+        uint64_t shingle = mix64(window);
+        for (int i = 0; i < MINHASH_SIZE; ++i) {
+          uint32_t h = static_cast<uint32_t>(
+              (minhash_params.a[i] * shingle + minhash_params.b[i]) >> 32);
+          signature[i] = std::min(signature[i], h);
+        }
+      }
+    }
+    if (descend && ts_tree_cursor_goto_first_child(&cursor))
+      continue;
+    if (ts_tree_cursor_goto_next_sibling(&cursor)) {
+      descend = true;
+      continue;
+    }
+    if (!ts_tree_cursor_goto_parent(&cursor))
+      break;
+    descend = false;
+  }
+  ts_tree_cursor_delete(&cursor);
+  return symbols >= MIN_SHINGLES + 3;
+}
+
+/**
+ * @brief 新成员加入簇, 返回是否保留 (调用方持有锁)
+ */
+bool Deduplicator::Admit(Cluster &cluster) {
+  cluster.size++;
+  if (cluster.kept < options_.keep) {
+    cluster.kept++;
+    return true;
+  }
+  skipped_++;
+  return false;
+}
+
+bool Deduplicator::CheckContent(std::string_view source, DedupTicket &ticket) {
+  ticket.content_hash = Hash::HashString(source);
+  std::lock_guard<std::mutex> lock(mutex_);
+  files_++;
+  auto it = by_content_.find(ticket.content_hash);
+  if (it == by_content_.end())
+    return false;
+  Cluster &cluster = clusters_[it->second];
+  cluster.exact++;
+  exact_duplicates_++;
+  ticket.assigned = true;
+  return !Admit(cluster);
+}
+
+bool Deduplicator::CheckStructure(const std::filesystem::path &file,
+                                  TSNode root, DedupTicket &ticket) {
+  if (ticket.assigned)
+    return false;
+  Cluster candidate;
+  candidate.representative = file.string();
+  // 签名在锁外计算
+  if (!Signature(root, candidate.signature)) {
+    // 过短的文件只参与内容哈希比较, 不进入 LSH 分带
+    std::lock_guard<std::mutex> lock(mutex_);
+    too_small_++;
+    by_content_.emplace(ticket.content_hash,
+                        static_cast<uint32_t>(clusters_.size()));
+    clusters_.push_back(std::move(candidate));
+    return false;
+  }
+  uint64_t keys[LSH_BANDS];
+  for (int band = 0; band < LSH_BANDS; ++band)
+    keys[band] = band_key(candidate.signature, band);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  // 任一分带相同即为候选, 再以完整签名估计相似度确认
+  for (int band = 0; band < LSH_BANDS; ++band) {
+    auto it = bands_[band].find(keys[band]);
+    if (it == bands_[band].end())
+      continue;
+    for (uint32_t id : it->second) {
+      Cluster &cluster = clusters_[id];
+      if (similarity(cluster.signature, candidate.signature) <
+          options_.threshold)
+        continue;
+      near_duplicates_++;
+      by_content_.emplace(ticket.content_hash, id);
+      return !Admit(cluster);
+    }
+  }
+
+  uint32_t id = static_cast<uint32_t>(clusters_.size());
+  clusters_.push_back(std::move(candidate));
+  by_content_.emplace(ticket.content_hash, id);
+  for (int band = 0; band < LSH_BANDS; ++band)
+    bands_[band][keys[band]].push_back(id);
+  return false;
+}
+
+size_t Deduplicator::Skipped() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return skipped_;
+}
+
+void Deduplicator::WriteReport(std::ostream &out) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  // 簇大小按 2 的幂分桶: 1, 2, 3-4, 5-8, ...
+  std::vector<size_t> histogram;
+  std::vector<uint32_t> largest;
+  size_t duplicated_clusters = 0;
+  for (uint32_t id = 0; id < clusters_.size(); ++id) {
+    uint32_t size = clusters_[id].size;
+    size_t bucket = size <= 1 ? 0 : 64 - __builtin_clzll(size - 1);
+    if (histogram.size() <= bucket)
+      histogram.resize(bucket + 1);
+    histogram[bucket]++;
+    if (size > 1) {
+      duplicated_clusters++;
+      largest.push_back(id);
+    }
+  }
+  size_t top = std::min<size_t>(largest.size(), 20);
+  std::partial_sort(largest.begin(), largest.begin() + top, largest.end(),
+                    [this](uint32_t a, uint32_t b) {
+                      return clusters_[a].size > clusters_[b].size;
+                    });
+
+  out << "{\n"
+      << "  \"files\": " << files_ << ",\n"
+      << "  \"threshold\": " << options_.threshold << ",\n"
+      << "  \"keep\": " << options_.keep << ",\n"
+      << "  \"exact_duplicates\": " << exact_duplicates_ << ",\n"
+      << "  \"near_duplicates\": " << near_duplicates_ << ",\n"
+      << "  \"skipped\": " << skipped_ << ",\n"
+      << "  \"too_small\": " << too_small_ << ",\n"
+      << "  \"clusters\": " << clusters_.size() << ",\n"
+      << "  \"clusters_with_duplicates\": " << duplicated_clusters << ",\n"
+      << "  \"cluster_size_histogram\": [";
+  for (size_t i = 0; i < histogram.size(); ++i)
+    out << (i == 0 ? "" : ", ") << histogram[i];
+  out << "],\n  \"largest_clusters\": [";
+  for (size_t i = 0; i < top; ++i) {
+    const Cluster &cluster = clusters_[largest[i]];
+    std::string name;
+    for (char c : cluster.representative) {
+      if (c == '"' || c == '\\')
+        name += '\\';
+      name += c;
+    }
+    out << (i == 0 ? "\n" : ",\n") << "    {\"representative\": \"" << name
+        << "\", \"size\": " << cluster.size << ", \"exact\": " << cluster.exact
+        << "}";
+  }
+  out << (top == 0 ? "]\n" : "\n  ]\n") << "}\n";
+}
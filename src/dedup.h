@@ -0,0 +1,74 @@
+#ifndef __HAS_DEDUP__
+#define __HAS_DEDUP__
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <tree_sitter/api.h>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * 语料去重, 分两级:
+ *   内容哈希: 解析前比较, 字节完全相同的文件直接归入已有簇
+ *   结构 MinHash/LSH: 解析后对语法树节点类型序列取 4-gram,
+ *     与标识符、字面量、注释、空白无关, 改名/调格式的复制提交会被识别为近似重复
+ * 每个簇保留前 keep 个文件, 其余在路径抽取前跳过
+ */
+constexpr int MINHASH_SIZE = 64;                      // 签名长度
+constexpr int LSH_BANDS = 16;                         // LSH 分带数
+constexpr int LSH_ROWS = MINHASH_SIZE / LSH_BANDS;    // 每带行数
+constexpr size_t MIN_SHINGLES = 8; // 过短的文件不做结构比较
+
+struct DedupOptions {
+  double threshold = 0.9; // 估计 Jaccard 相似度达到该值视为近似重复
+  size_t keep = 1;        // 每簇保留的文件数
+};
+
+/**
+ * @brief 单个文件在两级检查之间传递的状态
+ */
+struct DedupTicket {
+  uint64_t content_hash = 0;
+  bool assigned = false; // 已按内容哈希归簇
+};
+
+class Deduplicator {
+public:
+  explicit Deduplicator(const DedupOptions &options) : options_(options) {}
+
+  // 解析前调用, 返回 true 表示应跳过该文件
+  bool CheckContent(std::string_view source, DedupTicket &ticket);
+  // 解析后调用, 返回 true 表示应跳过该文件
+  bool CheckStructure(const std::filesystem::path &file, TSNode root,
+                      DedupTicket &ticket);
+  void WriteReport(std::ostream &out) const;
+  size_t Skipped() const;
+
+private:
+  struct Cluster {
+    std::string representative;
+    uint32_t signature[MINHASH_SIZE];
+    uint32_t size = 1;
+    uint32_t kept = 1;
+    uint32_t exact = 0; // 内容完全相同的成员数
+  };
+  static bool Signature(TSNode root, uint32_t signature[MINHASH_SIZE]);
+  bool Admit(Cluster &cluster);
+
+  DedupOptions options_;
+  mutable std::mutex mutex_;
+  std::vector<Cluster> clusters_;
+  std::unordered_map<uint64_t, uint32_t> by_content_;
+  std::unordered_map<uint64_t, std::vector<uint32_t>> bands_[LSH_BANDS];
+  size_t files_ = 0;
+  size_t exact_duplicates_ = 0;
+  size_t near_duplicates_ = 0;
+  size_t skipped_ = 0;
+  size_t too_small_ = 0;
+};
+
+#endif // !__HAS_DEDUP__
@@ -0,0 +1,170 @@
+#include "discovery.h"
+#include <condition_variable>
+#include <fnmatch.h>
+#include <mutex>
+#include <system_error>
+#include <thread>
+
+ExtensionMap::ExtensionMap() {
+  langs_ = {{".c", PACK_LANG_C},
+            {".cpp", PACK_LANG_CPP},
+            {".cc", PACK_LANG_CPP},
+            {".cxx", PACK_LANG_CPP}};
+}
+
+void ExtensionMap::AddHeaders() {
+  for (const char *ext : {".h", ".hh", ".hpp", ".hxx"})
+    langs_[ext] = PACK_LANG_CPP;
+}
+
+bool ExtensionMap::Parse(const std::string &spec) {
+  std::unordered_map<std::string, uint8_t> langs;
+  size_t begin = 0;
+  while (begin <= spec.size()) {
+    size_t end = spec.find(',', begin);
+    if (end == std::string::npos)
+      end = spec.size();
+    std::string item = spec.substr(begin, end - begin);
+    begin = end + 1;
+    if (item.empty())
+      continue;
+    size_t eq = item.find('=');
+    if (eq == std::string::npos || eq == 0)
+      return false;
+    std::string ext = item.substr(0, eq), lang = item.substr(eq + 1);
+    if (ext[0] != '.')
+      ext.insert(ext.begin(), '.');
+    if (lang == "c")
+      langs[ext] = PACK_LANG_C;
+    else if (lang == "cpp" || lang == "c++")
+      langs[ext] = PACK_LANG_CPP;
+    else
+      return false;
+  }
+  if (langs.empty())
+    return false;
+  langs_ = std::move(langs);
+  return true;
+}
+
+bool ExtensionMap::Lookup(const std::filesystem::path &path,
+                          uint8_t &lang) const {
+  auto it = langs_.find(path.extension().string());
+  if (it == langs_.end())
+    return false;
+  lang = it->second;
+  return true;
+}
+
+void IgnoreRules::AddPattern(const std::string &pattern) {
+  if (!pattern.empty())
+    patterns_.push_back(pattern);
+}
+
+void IgnoreRules::AddPatterns(const std::string &patterns) {
+  size_t begin = 0;
+  while (begin <= patterns.size()) {
+    size_t end = patterns.find(',', begin);
+    if (end == std::string::npos)
+      end = patterns.size();
+    AddPattern(patterns.substr(begin, end - begin));
+    begin = end + 1;
+  }
+}
+
+void IgnoreRules::AddPath(const std::filesystem::path &path) {
+  std::filesystem::path normal =
+      std::filesystem::absolute(path).lexically_normal();
+  // 去掉末尾分隔符, 与遍历时生成的路径一致
+  if (!normal.has_filename())
+    normal = normal.parent_path();
+  paths_.insert(normal.string());
+}
+
+bool IgnoreRules::Ignored(const std::filesystem::path &path) const {
+  if (!paths_.empty() && paths_.count(path.string()) != 0)
+    return true;
+  if (patterns_.empty())
+    return false;
+  std::string name = path.filename().string();
+  for (const auto &pattern : patterns_) {
+    if (::fnmatch(pattern.c_str(), name.c_str(), 0) == 0)
+      return true;
+  }
+  return false;
+}
+
+void Discovery::ScanDirectory(const std::filesystem::path &dir,
+                              std::vector<std::filesystem::path> &subdirs,
+                              std::vector<SourceFile> &files) {
+  std::error_code ec;
+  std::filesystem::directory_iterator it(
+      dir, std::filesystem::directory_options::skip_permission_denied, ec);
+  for (; !ec && it != std::filesystem::directory_iterator(); it.increment(ec)) {
+    const auto &entry = *it;
+    const auto &path = entry.path();
+    if (ignore_.Ignored(path))
+      continue;
+    // directory_entry 缓存了 readdir 给出的类型, 普通文件与目录无需 stat
+    std::error_code type_ec;
+    auto type = entry.symlink_status(type_ec).type();
+    if (type == std::filesystem::file_type::directory) {
+      subdirs.push_back(path);
+      continue;
+    }
+    // 先按扩展名过滤, 只对候选的符号链接做 stat
+    uint8_t lang;
+    if (extensions_.Lookup(path, lang) && entry.is_regular_file(type_ec))
+      files.push_back({path, lang});
+  }
+}
+
+void Discovery::Walk(const std::filesystem::path &root, unsigned num_threads,
+                     const Sink &sink) {
+  std::mutex mutex;
+  std::condition_variable cv;
+  // 待遍历目录按栈使用 (深度优先), 待处理集合保持较小
+  std::vector<std::filesystem::path> pending{
+      std::filesystem::absolute(root).lexically_normal()};
+  size_t active = 0;
+
+  auto walker = [&]() {
+    std::vector<std::filesystem::path> subdirs;
+    std::vector<SourceFile> files;
+    while (true) {
+      std::filesystem::path dir;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&] { return !pending.empty() || active == 0; });
+        if (pending.empty())
+          return;
+        dir = std::move(pending.back());
+        pending.pop_back();
+        active++;
+      }
+      ScanDirectory(dir, subdirs, files);
+      directories_.fetch_add(1, std::memory_order_relaxed);
+      if (!files.empty()) {
+        files_.fetch_add(files.size(), std::memory_order_relaxed);
+        sink(files);
+        files.clear();
+      }
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        active--;
+        for (auto &subdir : subdirs)
+          pending.push_back(std::move(subdir));
+        if (!subdirs.empty() || active == 0)
+          cv.notify_all();
+      }
+      subdirs.clear();
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (unsigned i = 1; i < num_threads; ++i)
+    threads.emplace_back(walker);
+  walker();
+  for (auto &t : threads)
+    t.join();
+}
@@ -0,0 +1,84 @@
+#ifndef __HAS_DISCOVERY__
+#define __HAS_DISCOVERY__
+#include "pack.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * @brief 待处理的源文件, lang 取 PACK_LANG_C / PACK_LANG_CPP
+ */
+struct SourceFile {
+  std::filesystem::path path;
+  uint8_t lang;
+};
+
+/**
+ * @brief 扩展名到解析语言的映射, 区分大小写
+ * 默认 .c 为 C, .cpp/.cc/.cxx 为 C++, 头文件需显式启用
+ */
+class ExtensionMap {
+public:
+  ExtensionMap();
+  // 加入 .h/.hh/.hpp/.hxx, 按 C++ 解析 (C++ 语法覆盖绝大多数 C 头文件)
+  void AddHeaders();
+  // 解析形如 ".c=c,.h=cpp,.inc=cpp" 的映射并替换默认值
+  bool Parse(const std::string &spec);
+  bool Lookup(const std::filesystem::path &path, uint8_t &lang) const;
+
+private:
+  std::unordered_map<std::string, uint8_t> langs_;
+};
+
+/**
+ * @brief 遍历时跳过的文件与目录
+ * 模式按文件名做通配匹配 (fnmatch), 路径按整棵子树跳过
+ */
+class IgnoreRules {
+public:
+  void AddPattern(const std::string &pattern);
+  // 以逗号分隔的多个模式
+  void AddPatterns(const std::string &patterns);
+  void AddPath(const std::filesystem::path &path);
+  bool Ignored(const std::filesystem::path &path) const;
+
+private:
+  std::vector<std::string> patterns_;
+  std::unordered_set<std::string> paths_;
+};
+
+/**
+ * @brief 多线程目录遍历, 边发现边交付, 使解析与遍历重叠
+ * 每个目录的文件打包成一批交给 sink, sink 会被多个遍历线程并发调用;
+ * 交付的路径均为规范化的绝对路径, 不跟随指向目录的符号链接
+ */
+class Discovery {
+public:
+  using Sink = std::function<void(std::vector<SourceFile> &)>;
+
+  Discovery(const ExtensionMap &extensions, const IgnoreRules &ignore)
+      : extensions_(extensions), ignore_(ignore) {}
+
+  void Walk(const std::filesystem::path &root, unsigned num_threads,
+            const Sink &sink);
+  size_t Files() const { return files_.load(); }
+  size_t Directories() const { return directories_.load(); }
+
+private:
+  void ScanDirectory(const std::filesystem::path &dir,
+                     std::vector<std::filesystem::path> &subdirs,
+                     std::vector<SourceFile> &files);
+
+  const ExtensionMap &extensions_;
+  const IgnoreRules &ignore_;
+  std::atomic<size_t> files_{0};
+  std::atomic<size_t> directories_{0};
+};
+
+#endif // !__HAS_DISCOVERY__
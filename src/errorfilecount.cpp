@@ -1,9 +1,18 @@
+#include "cli.h"
+#include "discovery.h"
+#include "pack.h"
+#include "quarantine.h"
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <filesystem>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <mutex>
 #include <queue>
+#include <sstream>
 #include <thread>
 #include <tree_sitter/api.h>
 #include <vector>
@@ -11,124 +20,344 @@
 extern "C" TSLanguage *tree_sitter_c();
 extern "C" TSLanguage *tree_sitter_cpp();
 
+constexpr size_t FLUSH_THRESHOLD = 1 << 16; // 线程本地输出缓冲刷新阈值
+constexpr int RATIO_BUCKETS = 10;           // 错误占比直方图桶数
+
 std::mutex cout_mutex;
 std::mutex queue_mutex;
-std::queue<std::filesystem::path> file_queue;
+std::mutex filter_mutex;
+std::condition_variable queue_cv;
+std::queue<SourceFile> file_queue;
+std::atomic<bool> discovery_done{false};
 std::atomic<int> files_processed{0};
 std::atomic<int> error_files{0};
-size_t total_files{0};
-void worker() {
+std::atomic<uint64_t> total_bytes{0};
+std::atomic<uint64_t> total_error_bytes{0};
+std::atomic<uint64_t> total_error_nodes{0};
+std::atomic<uint64_t> total_missing_nodes{0};
+std::atomic<uint64_t> ratio_histogram[RATIO_BUCKETS];
+std::ofstream filter_file; // 供抽取器使用的过滤列表
+std::atomic<size_t> total_files{0};
+PackReader corpus_pack;             // 打包语料输入
+std::filesystem::path pack_path;    // 打包语料路径, 记录键的前缀
+std::atomic<size_t> next_record{0}; // 下一条待领取的打包记录
 
-  while (true) {
-    std::filesystem::path file_path;
+/**
+ * @brief 单文件语法错误统计
+ */
+struct ErrorReport {
+  uint32_t error_nodes = 0;   // ERROR 节点数
+  uint32_t missing_nodes = 0; // MISSING 节点数
+  uint32_t error_bytes = 0;   // 最外层 ERROR 节点覆盖的字节数
+  bool has_first = false;
+  TSPoint first_error{0, 0}; // 第一个错误位置
+};
 
-    // 从队列获取任务
-    {
-      std::lock_guard<std::mutex> lock(queue_mutex);
-      if (file_queue.empty())
-        return;
-      file_path = file_queue.front();
-      file_queue.pop();
+/**
+ * @brief 统计错误节点, 只进入 ts_node_has_error 为真的子树
+ * @param root 语法树根节点
+ */
+ErrorReport locate_errors(TSNode root) {
+  ErrorReport report;
+  TSTreeCursor cursor = ts_tree_cursor_new(root);
+  // error_depth 记录最外层 ERROR 节点的深度+1, 避免嵌套 ERROR 重复计字节
+  uint32_t depth = 0, error_depth = 0;
+  bool descend = true;
+  while (true) {
+    TSNode node = ts_tree_cursor_current_node(&cursor);
+    if (descend) {
+      bool is_error = ts_node_is_error(node);
+      bool is_missing = ts_node_is_missing(node);
+      if ((is_error || is_missing) && !report.has_first) {
+        report.has_first = true;
+        report.first_error = ts_node_start_point(node);
+      }
+      if (is_missing)
+        report.missing_nodes++;
+      if (is_error) {
+        report.error_nodes++;
+        if (error_depth == 0) {
+          report.error_bytes +=
+              ts_node_end_byte(node) - ts_node_start_byte(node);
+          error_depth = depth + 1;
+        }
+      }
+      if (ts_node_has_error(node) &&
+          ts_tree_cursor_goto_first_child(&cursor)) {
+        depth++;
+        continue;
+      }
     }
+    if (error_depth == depth + 1)
+      error_depth = 0;
+    if (ts_tree_cursor_goto_next_sibling(&cursor)) {
+      descend = true;
+      continue;
+    }
+    if (depth == 0 || !ts_tree_cursor_goto_parent(&cursor))
+      break;
+    depth--;
+    descend = false;
+  }
+  ts_tree_cursor_delete(&cursor);
+  return report;
+}
 
-    // 读取文件内容
-    std::ifstream file(file_path, std::ios::binary);
-    if (!file) {
+void worker() {
+  // 每个线程复用两个解析器, 避免逐文件创建, 线程退出前释放
+  TSParser *c_parser = ts_parser_new();
+  ts_parser_set_language(c_parser, tree_sitter_c());
+  TSParser *cpp_parser = ts_parser_new();
+  ts_parser_set_language(cpp_parser, tree_sitter_cpp());
+  std::string out_buffer, filter_buffer;
+  auto flush = [&](bool force) {
+    if (!out_buffer.empty() &&
+        (force || out_buffer.size() > FLUSH_THRESHOLD)) {
       std::lock_guard<std::mutex> lock(cout_mutex);
-      std::cerr << "无法打开文件: " << file_path << "\n";
-      continue;
+      std::cout << out_buffer;
+      out_buffer.clear();
     }
+    if (!filter_buffer.empty() &&
+        (force || filter_buffer.size() > FLUSH_THRESHOLD)) {
+      std::lock_guard<std::mutex> lock(filter_mutex);
+      filter_file << filter_buffer;
+      filter_buffer.clear();
+    }
+  };
 
-    std::string source((std::istreambuf_iterator<char>(file)),
-                       std::istreambuf_iterator<char>());
+  while (true) {
+    std::filesystem::path file_path;
+    bool is_c;
+    std::string buffer;
+    std::string_view source;
 
-    // 创建独立解析器实例（每个线程独立）
-    TSParser *parser = ts_parser_new();
-    TSLanguage *lang;
-    if (file_path.extension().string() == ".c") {
-      lang = tree_sitter_c();
+    if (corpus_pack.IsOpen()) {
+      // 打包语料: 记录键与抽取器一致, 为 <打包语料路径>/<记录名>
+      size_t index = next_record.fetch_add(1, std::memory_order_relaxed);
+      if (index >= corpus_pack.Size())
+        break;
+      PackRecord record = corpus_pack.Get(index);
+      file_path = pack_path / record.name;
+      is_c = record.lang == PACK_LANG_C;
+      source = record.content;
     } else {
-      lang = tree_sitter_cpp();
+      // 从队列获取任务, 队列暂空而遍历未结束时等待
+      {
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        queue_cv.wait(lock,
+                      [] { return !file_queue.empty() || discovery_done; });
+        if (file_queue.empty())
+          break;
+        file_path = std::move(file_queue.front().path);
+        is_c = file_queue.front().lang == PACK_LANG_C;
+        file_queue.pop();
+      }
+
+      // 读取文件内容
+      std::ifstream file(file_path, std::ios::binary);
+      if (!file) {
+        std::lock_guard<std::mutex> lock(cout_mutex);
+        std::cerr << "无法打开文件: " << file_path << "\n";
+        files_processed.fetch_add(1, std::memory_order_relaxed);
+        continue;
+      }
+      buffer.assign(std::istreambuf_iterator<char>(file),
+                    std::istreambuf_iterator<char>());
+      source = buffer;
     }
-    ts_parser_set_language(parser, lang);
+
+    TSParser *parser = is_c ? c_parser : cpp_parser;
     TSTree *tree =
-        ts_parser_parse_string(parser, nullptr, source.c_str(), source.size());
+        ts_parser_parse_string(parser, nullptr, source.data(), source.size());
     TSNode root = ts_tree_root_node(tree);
+    total_bytes.fetch_add(source.size(), std::memory_order_relaxed);
 
-    // 处理AST
+    // 处理AST: 无错误的文件不做遍历
     if (ts_node_has_error(root)) {
-      std::lock_guard<std::mutex> lock(cout_mutex);
-      std::cout << "[语法错误] " << file_path << "\n";
-      error_files++;
+      ErrorReport report = locate_errors(root);
+      double ratio = source.empty() ? 0.0
+                                    : static_cast<double>(report.error_bytes) /
+                                          source.size();
+      error_files.fetch_add(1, std::memory_order_relaxed);
+      total_error_bytes.fetch_add(report.error_bytes,
+                                  std::memory_order_relaxed);
+      total_error_nodes.fetch_add(report.error_nodes,
+                                  std::memory_order_relaxed);
+      total_missing_nodes.fetch_add(report.missing_nodes,
+                                    std::memory_order_relaxed);
+      int bucket = std::min<int>(RATIO_BUCKETS - 1, ratio * RATIO_BUCKETS);
+      ratio_histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+
+      std::string key = Quarantine::Key(file_path);
+      std::ostringstream line;
+      line << key << '\t' << report.error_nodes << '\t'
+           << report.missing_nodes << '\t' << report.error_bytes << '\t'
+           << source.size() << '\t' << std::fixed << std::setprecision(6)
+           << ratio << '\t' << report.first_error.row + 1 << ':'
+           << report.first_error.column + 1 << '\n';
+      out_buffer += line.str();
+      if (filter_file.is_open()) {
+        filter_buffer += key + '\t' + std::to_string(ratio) + '\n';
+      }
     }
 
     // 清理资源
     ts_tree_delete(tree);
-    ts_parser_delete(parser);
+    files_processed.fetch_add(1, std::memory_order_relaxed);
+    flush(false);
+  }
+  flush(true);
+  ts_parser_delete(c_parser);
+  ts_parser_delete(cpp_parser);
+}
 
-    // 更新计数器
-    ++files_processed;
-    {
-      std::lock_guard<std::mutex> lock(cout_mutex);
-      std::clog << "\r已处理文件: " << files_processed << "/" << total_files
-                << " (" << (files_processed * 100) / total_files << "%)";
-      std::clog << " 语法错误文件: " << error_files;
-      std::clog.flush();
-    }
+/**
+ * @brief 以 JSON 输出汇总信息
+ */
+void write_summary(std::ostream &out, double seconds) {
+  uint64_t bytes = total_bytes.load();
+  out << "{\n"
+      << "  \"files\": " << files_processed.load() << ",\n"
+      << "  \"error_files\": " << error_files.load() << ",\n"
+      << "  \"bytes\": " << bytes << ",\n"
+      << "  \"error_bytes\": " << total_error_bytes.load() << ",\n"
+      << "  \"error_byte_ratio\": "
+      << (bytes == 0 ? 0.0
+                     : static_cast<double>(total_error_bytes.load()) / bytes)
+      << ",\n"
+      << "  \"error_nodes\": " << total_error_nodes.load() << ",\n"
+      << "  \"missing_nodes\": " << total_missing_nodes.load() << ",\n"
+      << "  \"ratio_histogram\": [";
+  for (int i = 0; i < RATIO_BUCKETS; ++i) {
+    out << (i == 0 ? "" : ", ") << ratio_histogram[i].load();
   }
+  out << "],\n"
+      << "  \"seconds\": " << seconds << "\n"
+      << "}\n";
 }
+
 int main(int argc, char **argv) {
 
   std::ios::sync_with_stdio(false);
   std::cin.tie(nullptr);
   std::cout.tie(nullptr);
-  if (argc > 3) {
-    std::cerr << "用法: " << argv[0] << " <目标目录>\n";
-    return 1;
-  }
-  // 收集目标文件
-  const std::filesystem::path root_path(argv[1]);
-  for (const auto &entry :
-       std::filesystem::recursive_directory_iterator(root_path)) {
-    if (entry.is_regular_file()) {
-      const auto &path = entry.path();
-      std::string ext = path.extension().string();
-
-      // 识别C/C++文件
-      if (ext == ".c" || ext == ".cpp" || ext == ".cc" || ext == ".cxx") {
-        std::lock_guard<std::mutex> lock(queue_mutex);
-        file_queue.push(path);
+  std::vector<std::string> positional;
+  std::string summary_path, filter_path;
+  ExtensionMap extensions;
+  IgnoreRules ignore_rules;
+  unsigned discovery_threads = 4;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i], value;
+    if (Cli::MatchOption(arg, "--summary", value)) {
+      summary_path = value;
+    } else if (Cli::MatchOption(arg, "--filter-out", value)) {
+      filter_path = value;
+    } else if (Cli::MatchOption(arg, "--ext", value)) {
+      if (!extensions.Parse(value)) {
+        std::cerr << "无法解析扩展名映射: " << value << "\n";
+        return 1;
       }
+    } else if (arg == "--headers") {
+      extensions.AddHeaders();
+    } else if (Cli::MatchOption(arg, "--ignore", value)) {
+      ignore_rules.AddPatterns(value);
+    } else if (Cli::MatchOption(arg, "--discovery-threads", value)) {
+      discovery_threads = std::max(1ul, std::stoul(value));
+    } else {
+      positional.push_back(arg);
     }
   }
-
-  total_files = file_queue.size();
-  if (total_files == 0) {
-    std::cerr << "未找到C/C++文件\n";
+  if (positional.size() != 1) {
+    std::cerr << "用法: " << argv[0]
+              << " <目标目录|打包语料> [--summary=汇总.json] [--filter-out=过滤列表]"
+                 " [--ext=.c=c,.h=cpp,...] [--headers] [--ignore=模式,...]"
+                 " [--discovery-threads=N]\n"
+              << "标准输出每行: 路径\\tERROR数\\tMISSING数\\t错误字节\\t总字节"
+                 "\\t错误占比\\t首个错误行:列\n";
     return 1;
   }
+  if (!filter_path.empty()) {
+    filter_file.open(filter_path);
+    if (!filter_file) {
+      std::cerr << "无法写入过滤列表: " << filter_path << "\n";
+      return 1;
+    }
+  }
+  const std::filesystem::path root_path(positional[0]);
+  std::thread discoverer;
+  if (PackReader::IsPack(root_path)) {
+    if (!corpus_pack.Open(root_path)) {
+      std::cerr << "无法读取打包语料: " << root_path << "\n";
+      return 1;
+    }
+    pack_path = root_path;
+    total_files = corpus_pack.Size();
+    discovery_done = true;
+  } else {
+    // 遍历与统计并行: 发现线程边遍历边入队
+    ignore_rules.AddPattern(".git");
+    ignore_rules.AddPath(root_path / "out");
+    discoverer = std::thread([&]() {
+      Discovery discovery(extensions, ignore_rules);
+      discovery.Walk(root_path, discovery_threads,
+                     [](std::vector<SourceFile> &files) {
+                       std::lock_guard<std::mutex> lock(queue_mutex);
+                       for (auto &file : files)
+                         file_queue.push(std::move(file));
+                       total_files += files.size();
+                       queue_cv.notify_all();
+                     });
+      std::lock_guard<std::mutex> lock(queue_mutex);
+      discovery_done = true;
+      queue_cv.notify_all();
+    });
+  }
 
   // 根据硬件并发数创建线程
   const unsigned num_threads = std::thread::hardware_concurrency();
   std::vector<std::thread> threads;
-  // TSLanguage *cpp_lang = tree_sitter_cpp(); // 预获取语言对象
-  // TSLanguage *c_lang = tree_sitter_c();   // 预获取语言对象
-  std::clog << "启动" << num_threads << "个线程处理" << total_files
-            << "个文件..." << std::endl;
+  std::clog << "启动" << num_threads << "个线程, 边遍历边统计..." << std::endl;
+  auto start = std::chrono::steady_clock::now();
 
   // 创建工作线程
   for (unsigned i = 0; i < num_threads; ++i) {
-    // threads.emplace_back(worker_thread, cpp_lang);
-    threads.emplace_back(worker); // 由workthread内部决定使用的解析语言和解析器
+    threads.emplace_back(worker);
+  }
+
+  // 进度由主线程定期输出, 工作线程只更新原子计数
+  while (!discovery_done ||
+         static_cast<size_t>(files_processed.load(std::memory_order_relaxed)) <
+             total_files) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    size_t processed = files_processed.load(std::memory_order_relaxed);
+    size_t discovered = total_files;
+    std::clog << "\r已处理文件: " << processed << "/" << discovered << " ("
+              << (discovered == 0 ? 0 : (processed * 100) / discovered) << "%)"
+              << " 语法错误文件: " << error_files;
+    std::clog.flush();
   }
 
   // 等待所有线程完成
+  if (discoverer.joinable())
+    discoverer.join();
   for (auto &t : threads) {
     t.join();
   }
+  if (total_files == 0) {
+    std::cerr << "\n未找到C/C++文件\n";
+    return 1;
+  }
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
 
-  // worker_thread(); // 由workthread内部决定使用的解析语言和解析器
   std::clog << "\n处理完成！已处理文件数: " << files_processed << "/"
             << total_files << std::endl;
+  if (summary_path.empty()) {
+    write_summary(std::clog, seconds);
+  } else {
+    std::ofstream summary(summary_path);
+    write_summary(summary, seconds);
+  }
   return 0;
 }
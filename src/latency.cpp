@@ -0,0 +1,76 @@
+#include "latency.h"
+
+int LatencyHistogram::BucketOf(uint64_t micros) noexcept {
+  if (micros < SUB_BUCKETS)
+    return static_cast<int>(micros);
+  int exponent = 63 - __builtin_clzll(micros);
+  // 取最高位之后的 log2(SUB_BUCKETS) 位作为桶内偏移
+  int shift = exponent - 3;
+  int sub = static_cast<int>((micros >> shift) & (SUB_BUCKETS - 1));
+  int bucket = (exponent - 2) * SUB_BUCKETS + sub;
+  return bucket < BUCKETS ? bucket : BUCKETS - 1;
+}
+
+uint64_t LatencyHistogram::UpperBound(int bucket) noexcept {
+  if (bucket < SUB_BUCKETS)
+    return static_cast<uint64_t>(bucket);
+  int exponent = bucket / SUB_BUCKETS + 2;
+  int sub = bucket % SUB_BUCKETS;
+  int shift = exponent - 3;
+  return ((static_cast<uint64_t>(SUB_BUCKETS + sub) + 1) << shift) - 1;
+}
+
+void LatencyHistogram::Record(uint64_t micros) noexcept {
+  buckets_[BucketOf(micros)].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  sum_.fetch_add(micros, std::memory_order_relaxed);
+  uint64_t prev = max_.load(std::memory_order_relaxed);
+  while (micros > prev &&
+         !max_.compare_exchange_weak(prev, micros, std::memory_order_relaxed))
+    ;
+}
+
+uint64_t LatencyHistogram::Quantile(double q) const noexcept {
+  uint64_t total = Count();
+  if (total == 0)
+    return 0;
+  uint64_t target = static_cast<uint64_t>(q * (total - 1)) + 1;
+  uint64_t seen = 0;
+  for (int i = 0; i < BUCKETS; ++i) {
+    seen += buckets_[i].load(std::memory_order_relaxed);
+    if (seen >= target) {
+      uint64_t bound = UpperBound(i);
+      uint64_t max = Max();
+      return bound < max ? bound : max;
+    }
+  }
+  return Max();
+}
+
+uint64_t LatencyHistogram::Count() const noexcept {
+  return count_.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::Max() const noexcept {
+  return max_.load(std::memory_order_relaxed);
+}
+
+double LatencyHistogram::Mean() const noexcept {
+  uint64_t total = Count();
+  uint64_t sum = sum_.load(std::memory_order_relaxed);
+  return total == 0 ? 0.0 : static_cast<double>(sum) / total;
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram &other) noexcept {
+  for (int i = 0; i < BUCKETS; ++i)
+    buckets_[i].fetch_add(other.buckets_[i].load(std::memory_order_relaxed),
+                          std::memory_order_relaxed);
+  count_.fetch_add(other.Count(), std::memory_order_relaxed);
+  sum_.fetch_add(other.sum_.load(std::memory_order_relaxed),
+                 std::memory_order_relaxed);
+  uint64_t other_max = other.Max();
+  uint64_t prev = max_.load(std::memory_order_relaxed);
+  while (other_max > prev && !max_.compare_exchange_weak(
+                                 prev, other_max, std::memory_order_relaxed))
+    ;
+}
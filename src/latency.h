@@ -0,0 +1,33 @@
+#ifndef __HAS_LATENCY__
+#define __HAS_LATENCY__
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief 对数分桶的延迟直方图, 记录为无锁原子自增
+ * 每个2的幂区间再细分为 SUB_BUCKETS 个桶, 分位数误差约 1/SUB_BUCKETS
+ */
+class LatencyHistogram {
+public:
+  static constexpr int SUB_BUCKETS = 8;
+  static constexpr int BUCKETS = 64 * SUB_BUCKETS;
+
+  void Record(uint64_t micros) noexcept;
+  // q 取 [0,1], 返回对应分位的延迟上界(微秒)
+  uint64_t Quantile(double q) const noexcept;
+  uint64_t Count() const noexcept;
+  uint64_t Max() const noexcept;
+  double Mean() const noexcept;
+  void Merge(const LatencyHistogram &other) noexcept;
+
+private:
+  static int BucketOf(uint64_t micros) noexcept;
+  static uint64_t UpperBound(int bucket) noexcept;
+  std::atomic<uint64_t> buckets_[BUCKETS]{};
+  std::atomic<uint64_t> count_{0};
+  std::atomic<uint64_t> sum_{0};
+  std::atomic<uint64_t> max_{0};
+};
+
+#endif // !__HAS_LATENCY__
@@ -0,0 +1,106 @@
+#include "lineage.h"
+#include <algorithm>
+#include <unordered_map>
+
+namespace {
+/**
+ * @brief 从文件名拆出谱系键与提交号, 不符合约定时返回 false
+ */
+bool submission_key(const std::filesystem::path &path, std::string &key,
+                    uint64_t &order) {
+  std::string stem = path.stem().string();
+  size_t split = stem.rfind('_');
+  if (split == std::string::npos || split == 0 || split + 1 == stem.size())
+    return false;
+  order = 0;
+  for (size_t i = split + 1; i < stem.size(); ++i) {
+    if (stem[i] < '0' || stem[i] > '9')
+      return false;
+    order = order * 10 + (stem[i] - '0');
+  }
+  // 不同目录、不同语言的同名提交不属于同一谱系
+  key = (path.parent_path() / stem.substr(0, split)).string();
+  key += path.extension().string();
+  return true;
+}
+
+TSPoint point_at(std::string_view source, size_t byte) {
+  TSPoint point{0, 0};
+  size_t line_start = 0;
+  for (size_t i = 0; i < byte; ++i) {
+    if (source[i] == '\n') {
+      point.row++;
+      line_start = i + 1;
+    }
+  }
+  point.column = static_cast<uint32_t>(byte - line_start);
+  return point;
+}
+} // namespace
+
+std::vector<std::vector<LineageFile>>
+group_lineages(std::vector<LineageFile> &files) {
+  std::vector<std::vector<LineageFile>> groups;
+  std::vector<std::vector<uint64_t>> orders;
+  std::unordered_map<std::string, size_t> index;
+  std::string key;
+  for (LineageFile &file : files) {
+    uint64_t order;
+    if (!submission_key(file.path, key, order)) {
+      groups.emplace_back().push_back(std::move(file));
+      orders.emplace_back().push_back(0);
+      continue;
+    }
+    auto it = index.emplace(key, groups.size()).first;
+    if (it->second == groups.size()) {
+      groups.emplace_back();
+      orders.emplace_back();
+    }
+    groups[it->second].push_back(std::move(file));
+    orders[it->second].push_back(order);
+  }
+  files.clear();
+  for (size_t g = 0; g < groups.size(); ++g) {
+    std::vector<size_t> perm(groups[g].size());
+    for (size_t i = 0; i < perm.size(); ++i)
+      perm[i] = i;
+    std::sort(perm.begin(), perm.end(), [&](size_t a, size_t b) {
+      return orders[g][a] < orders[g][b];
+    });
+    std::vector<LineageFile> sorted;
+    sorted.reserve(perm.size());
+    for (size_t i : perm)
+      sorted.push_back(std::move(groups[g][i]));
+    groups[g].swap(sorted);
+  }
+  // 长谱系先领取, 避免最后只剩一个线程处理大组
+  std::stable_sort(groups.begin(), groups.end(),
+                   [](const std::vector<LineageFile> &a,
+                      const std::vector<LineageFile> &b) {
+                     return a.size() > b.size();
+                   });
+  return groups;
+}
+
+bool source_edit(std::string_view old_source, std::string_view new_source,
+                 TSInputEdit &edit) {
+  size_t prefix = 0;
+  size_t limit = std::min(old_source.size(), new_source.size());
+  while (prefix < limit && old_source[prefix] == new_source[prefix])
+    prefix++;
+  if (prefix == old_source.size() && prefix == new_source.size())
+    return false;
+  // 公共后缀不与公共前缀重叠
+  size_t suffix = 0;
+  while (suffix < limit - prefix &&
+         old_source[old_source.size() - 1 - suffix] ==
+             new_source[new_source.size() - 1 - suffix])
+    suffix++;
+  edit.start_byte = static_cast<uint32_t>(prefix);
+  edit.old_end_byte = static_cast<uint32_t>(old_source.size() - suffix);
+  edit.new_end_byte = static_cast<uint32_t>(new_source.size() - suffix);
+  edit.start_point = point_at(old_source, edit.start_byte);
+  edit.old_end_point = point_at(old_source, edit.old_end_byte);
+  edit.new_end_point = point_at(new_source, edit.new_end_byte);
+  return true;
+}
@@ -0,0 +1,38 @@
+#ifndef __HAS_LINEAGE__
+#define __HAS_LINEAGE__
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <tree_sitter/api.h>
+#include <vector>
+
+/**
+ * 提交谱系: 同一题目 (同一用户) 的连续提交通常只有少量改动,
+ * 按提交号顺序解析时把上一版语法树经 ts_tree_edit 后传给 tree-sitter 增量重解析
+ * 文件名约定为 cloneSQLdata.py 导出的 "<题目>[_<用户>]_<提交号>.c/.cpp",
+ * 最后一个 '_' 之前的部分为谱系键, 之后为提交号
+ */
+constexpr double INCREMENTAL_MAX_CHANGE = 0.5; // 改动超过新文件该比例时全量解析
+
+struct LineageFile {
+  std::filesystem::path path;
+  uint8_t lang;
+  uint32_t record; // 打包语料中的记录下标, 目录输入时不用
+};
+
+/**
+ * @brief 按谱系键分组, 组内按提交号升序; 无法识别提交号的文件单独成组
+ */
+std::vector<std::vector<LineageFile>>
+group_lineages(std::vector<LineageFile> &files);
+
+/**
+ * @brief 用公共前后缀求出 old_source -> new_source 的单个编辑区间
+ * @return 两者相同时返回 false
+ */
+bool source_edit(std::string_view old_source, std::string_view new_source,
+                 TSInputEdit &edit);
+
+#endif // !__HAS_LINEAGE__
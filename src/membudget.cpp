@@ -0,0 +1,205 @@
+#include "membudget.h"
+#include <cstdlib>
+#include <malloc.h>
+#include <unistd.h>
+#include <tree_sitter/api.h>
+
+namespace {
+MemoryBudget *tree_budget = nullptr;
+
+/**
+ * @brief 本线程已计入全局而未用的 Tree 占用
+ * 解析时每个节点都经过分配器, 逐次修改全局原子量会在线程间争用同一缓存行;
+ * 余额不足时向全局预支整块, 超过两块时归还到一块
+ */
+struct TreeCredit {
+  MemoryBudget *budget = nullptr; // 非空时已计入其 credit_threads_
+  size_t bytes = 0;
+  bool exited = false; // 线程退出后直接计入全局
+};
+thread_local TreeCredit tree_credit;
+
+struct TreeCreditExit {
+  ~TreeCreditExit() { tree_credit.budget->ReturnTreeCredit(); }
+};
+
+void *tracked_malloc(size_t size) {
+  void *ptr = std::malloc(size);
+  if (ptr != nullptr)
+    tree_budget->ChargeTree(malloc_usable_size(ptr));
+  return ptr;
+}
+
+void *tracked_calloc(size_t count, size_t size) {
+  void *ptr = std::calloc(count, size);
+  if (ptr != nullptr)
+    tree_budget->ChargeTree(malloc_usable_size(ptr));
+  return ptr;
+}
+
+void *tracked_realloc(void *ptr, size_t size) {
+  size_t old_size = ptr != nullptr ? malloc_usable_size(ptr) : 0;
+  void *moved = std::realloc(ptr, size);
+  if (moved == nullptr && size != 0)
+    return nullptr; // 失败时原内存仍有效
+  tree_budget->ReleaseTree(old_size);
+  if (moved != nullptr)
+    tree_budget->ChargeTree(malloc_usable_size(moved));
+  return moved;
+}
+
+void tracked_free(void *ptr) {
+  if (ptr == nullptr)
+    return;
+  tree_budget->ReleaseTree(malloc_usable_size(ptr));
+  std::free(ptr);
+}
+
+const char *const CLASS_NAMES[MEM_CLASS_COUNT] = {"source", "tree", "output",
+                                                  "vocab"};
+} // namespace
+
+bool MemoryBudget::Admit(size_t bytes) const {
+  // 各线程的 Tree 余额至多两块, 不算在途, 否则空闲线程的余额会一直阻塞放行
+  size_t slack = credit_threads_.load() * 2 * TREE_CREDIT_CHUNK;
+  bool idle = Used(MemClass::Source) + Used(MemClass::Output) == 0 &&
+              Used(MemClass::Tree) <= slack;
+  return idle || total_.load() + bytes <= limit_;
+}
+
+void MemoryBudget::Acquire(MemClass kind, size_t bytes) {
+  if (limit_ != 0 && !Admit(bytes)) {
+    // waiters_ 与占用计数均为顺序一致的原子操作: 释放方先减占用再读 waiters_,
+    // 等待方先增 waiters_ 再检查占用, 两者至少有一方看到对方的修改
+    std::unique_lock<std::mutex> lock(mutex_);
+    waiters_++;
+    waits_++;
+    cv_.wait(lock, [&] { return Admit(bytes); });
+    waiters_--;
+  }
+  Charge(kind, bytes);
+}
+
+bool MemoryBudget::TryAcquire(MemClass kind, size_t bytes) {
+  if (limit_ != 0 && !Admit(bytes))
+    return false;
+  Charge(kind, bytes);
+  return true;
+}
+
+void MemoryBudget::Charge(MemClass kind, size_t bytes) {
+  used_[static_cast<size_t>(kind)] += bytes;
+  size_t total = total_ += bytes;
+  size_t peak = peak_.load(std::memory_order_relaxed);
+  while (total > peak &&
+         !peak_.compare_exchange_weak(peak, total, std::memory_order_relaxed))
+    ;
+}
+
+void MemoryBudget::Release(MemClass kind, size_t bytes) {
+  used_[static_cast<size_t>(kind)] -= bytes;
+  total_ -= bytes;
+  if (waiters_.load() != 0) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    cv_.notify_all();
+  }
+}
+
+void MemoryBudget::AddCreditThread() {
+  thread_local TreeCreditExit exit_hook;
+  (void)exit_hook;
+  tree_credit.budget = this;
+  credit_threads_++;
+}
+
+void MemoryBudget::ChargeTree(size_t bytes) {
+  TreeCredit &credit = tree_credit;
+  if (credit.exited) {
+    Charge(MemClass::Tree, bytes);
+    return;
+  }
+  if (bytes > credit.bytes) {
+    if (credit.budget == nullptr)
+      AddCreditThread();
+    size_t grant = (bytes - credit.bytes + TREE_CREDIT_CHUNK - 1) /
+                   TREE_CREDIT_CHUNK * TREE_CREDIT_CHUNK;
+    Charge(MemClass::Tree, grant);
+    credit.bytes += grant;
+  }
+  credit.bytes -= bytes;
+}
+
+void MemoryBudget::ReleaseTree(size_t bytes) {
+  TreeCredit &credit = tree_credit;
+  if (credit.exited) {
+    Release(MemClass::Tree, bytes);
+    return;
+  }
+  if (credit.budget == nullptr)
+    AddCreditThread(); // 释放其他线程分配的内存
+  credit.bytes += bytes;
+  // 有等待者时全部归还, 使 Acquire 及时看到释放
+  size_t keep = waiters_.load() != 0 ? 0 : TREE_CREDIT_CHUNK;
+  if (credit.bytes > 2 * TREE_CREDIT_CHUNK ||
+      (keep == 0 && credit.bytes != 0)) {
+    Release(MemClass::Tree, credit.bytes - keep);
+    credit.bytes = keep;
+  }
+}
+
+void MemoryBudget::ReturnTreeCredit() {
+  TreeCredit &credit = tree_credit;
+  credit.exited = true;
+  if (credit.bytes != 0)
+    Release(MemClass::Tree, credit.bytes);
+  credit.bytes = 0;
+  credit_threads_--;
+}
+
+void MemoryBudget::TrackTreeSitter() {
+  tree_budget = this;
+  ts_set_allocator(tracked_malloc, tracked_calloc, tracked_realloc,
+                   tracked_free);
+}
+
+void MemoryBudget::WriteReport(std::ostream &out) const {
+  const double mb = 1024.0 * 1024.0;
+  out << "内存预算 " << limit_ / mb << "MB, 峰值 " << Peak() / mb << "MB (";
+  for (size_t i = 0; i < MEM_CLASS_COUNT; ++i) {
+    out << (i == 0 ? "" : ", ") << CLASS_NAMES[i] << " "
+        << used_[i].load() / mb << "MB";
+  }
+  out << "), 等待 " << waits_.load() << "次, 结果落盘 "
+      << spilled_bytes_.load() / mb << "MB, 词汇表落盘 "
+      << vocab_spills_.load() << "次\n";
+}
+
+SpillFile::~SpillFile() {
+  if (file_ != nullptr)
+    std::fclose(file_);
+}
+
+bool SpillFile::Spill(std::string &data) {
+  if (file_ == nullptr && (file_ = std::tmpfile()) == nullptr)
+    return false;
+  if (std::fwrite(data.data(), 1, data.size(), file_) != data.size())
+    return false;
+  bytes_ += data.size();
+  data.clear();
+  return true;
+}
+
+bool SpillFile::CopyTo(std::ostream &out) {
+  if (bytes_ == 0)
+    return true;
+  bool ok = std::fflush(file_) == 0 && std::fseek(file_, 0, SEEK_SET) == 0;
+  char buffer[64 * 1024];
+  size_t n;
+  while (ok && (n = std::fread(buffer, 1, sizeof(buffer), file_)) > 0)
+    out.write(buffer, static_cast<std::streamsize>(n));
+  // 截断后复用同一临时文件
+  ok = ok && ::ftruncate(fileno(file_), 0) == 0 &&
+       std::fseek(file_, 0, SEEK_SET) == 0;
+  bytes_ = 0;
+  return ok;
+}
@@ -0,0 +1,132 @@
+#ifndef __HAS_MEMBUDGET__
+#define __HAS_MEMBUDGET__
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <utility>
+
+/**
+ * 全局内存预算 (--memory-limit):
+ *   Source 预读/复制到内存的源文件, Tree tree-sitter 堆 (解析器与语法树),
+ *   Output 已抽取未写出的结果, Vocab 词汇表估算大小
+ * 只在入口处阻塞: 读取源文件前 Acquire, 超出预算时等待下游释放,
+ * 下游各阶段只 Charge 计入占用, 持有占用时不再等待, 不会互相死锁;
+ * 没有任何在途占用时总是放行, 单个超过预算的文件也能处理
+ * 并发放行的检查与计入不是原子的, 峰值可能略超预算;
+ * Tree 由各线程以块为单位预支, 每线程至多多计两块未用的余额
+ */
+enum class MemClass : uint8_t { Source, Tree, Output, Vocab };
+constexpr size_t MEM_CLASS_COUNT = 4;
+
+class MemoryBudget {
+public:
+  void SetLimit(size_t bytes) { limit_ = bytes; }
+  size_t Limit() const { return limit_; }
+  bool Enabled() const { return limit_ != 0; }
+
+  // 等待直到计入 bytes 后不超过预算, 再计入
+  void Acquire(MemClass kind, size_t bytes);
+  // 不等待, 超出预算时返回 false 且不计入
+  bool TryAcquire(MemClass kind, size_t bytes);
+  void Charge(MemClass kind, size_t bytes);
+  void Release(MemClass kind, size_t bytes);
+
+  size_t Used(MemClass kind) const {
+    return used_[static_cast<size_t>(kind)].load();
+  }
+  size_t Total() const { return total_.load(); }
+  size_t Peak() const { return peak_.load(); }
+  // 词汇表超过预算的一半时应落盘, 为在途数据留出空间
+  bool VocabOverBudget() const {
+    return limit_ != 0 && Used(MemClass::Vocab) > limit_ / 2;
+  }
+  // 单文件结果超过该长度时转存到临时文件
+  size_t SpillThreshold() const {
+    return limit_ / 64 > (64u << 10) ? limit_ / 64 : (64u << 10);
+  }
+  void CountSpill(size_t bytes) { spilled_bytes_ += bytes; }
+  void CountVocabSpill() { vocab_spills_++; }
+
+  // tree-sitter 分配器的计入与释放, 只改本线程余额, 按块与全局结算
+  void ChargeTree(size_t bytes);
+  void ReleaseTree(size_t bytes);
+  // 线程退出时归还本线程余额
+  void ReturnTreeCredit();
+  // 以自定义分配器统计 tree-sitter 的堆占用, 须在创建解析器之前调用
+  void TrackTreeSitter();
+  void WriteReport(std::ostream &out) const;
+
+  static constexpr size_t TREE_CREDIT_CHUNK = 64u << 10;
+
+private:
+  bool Admit(size_t bytes) const;
+  void AddCreditThread();
+
+  size_t limit_ = 0;
+  std::atomic<size_t> used_[MEM_CLASS_COUNT] = {};
+  std::atomic<size_t> total_{0};
+  std::atomic<size_t> peak_{0};
+  std::atomic<unsigned> waiters_{0};
+  std::atomic<uint64_t> waits_{0};
+  std::atomic<uint64_t> spilled_bytes_{0};
+  std::atomic<uint64_t> vocab_spills_{0};
+  std::atomic<size_t> credit_threads_{0}; // 持有 Tree 余额的线程数
+  std::mutex mutex_;
+  std::condition_variable cv_;
+};
+
+/**
+ * @brief 接管一笔已计入的占用, 析构时释放, 覆盖处理流程中的各个提前返回
+ */
+class MemoryLease {
+public:
+  MemoryLease() = default;
+  MemoryLease(MemoryBudget *budget, MemClass kind, size_t bytes)
+      : budget_(budget), kind_(kind), bytes_(bytes) {}
+  MemoryLease(const MemoryLease &) = delete;
+  MemoryLease &operator=(const MemoryLease &) = delete;
+  MemoryLease &operator=(MemoryLease &&other) noexcept {
+    std::swap(budget_, other.budget_);
+    std::swap(kind_, other.kind_);
+    std::swap(bytes_, other.bytes_);
+    return *this;
+  }
+  ~MemoryLease() {
+    if (budget_ != nullptr && bytes_ != 0)
+      budget_->Release(kind_, bytes_);
+  }
+
+private:
+  MemoryBudget *budget_ = nullptr;
+  MemClass kind_ = MemClass::Source;
+  size_t bytes_ = 0;
+};
+
+/**
+ * @brief 单文件结果的临时落盘区, 每个工作线程一个
+ * 结果按顺序追加, 写出时先复制落盘部分, 再写内存中的剩余部分
+ */
+class SpillFile {
+public:
+  SpillFile() = default;
+  SpillFile(const SpillFile &) = delete;
+  SpillFile &operator=(const SpillFile &) = delete;
+  ~SpillFile();
+
+  // 追加 data 并清空, 失败时保留 data 在内存中
+  bool Spill(std::string &data);
+  bool Empty() const { return bytes_ == 0; }
+  // 复制已落盘内容到 out 并清空落盘区
+  bool CopyTo(std::ostream &out);
+
+private:
+  std::FILE *file_ = nullptr;
+  uint64_t bytes_ = 0;
+};
+
+#endif // !__HAS_MEMBUDGET__
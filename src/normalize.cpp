@@ -0,0 +1,128 @@
+#include "normalize.h"
+
+namespace {
+bool is_ident(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+         (c >= '0' && c <= '9') || c == '_';
+}
+
+/**
+ * @brief source[quote] 处的 '"' 是否为原始字符串的开头 (R/LR/uR/UR/u8R")
+ */
+bool raw_string_at(std::string_view source, size_t quote) {
+  if (quote == 0 || source[quote - 1] != 'R')
+    return false;
+  size_t start = quote - 1;
+  while (start > 0 && is_ident(source[start - 1]))
+    start--;
+  std::string_view prefix = source.substr(start, quote - 1 - start);
+  return prefix.empty() || prefix == "L" || prefix == "u" || prefix == "U" ||
+         prefix == "u8";
+}
+
+/**
+ * @brief 跳过从 begin 开始的字符串或字符字面量, 返回结束引号之后的下标
+ * 未闭合时止于行尾 (续行除外), 与编译器的报错位置一致
+ */
+size_t skip_quoted(std::string_view source, size_t begin) {
+  char quote = source[begin];
+  size_t i = begin + 1;
+  while (i < source.size()) {
+    char c = source[i];
+    if (c == '\\') {
+      i += 2;
+      continue;
+    }
+    if (c == quote)
+      return i + 1;
+    if (c == '\n')
+      return i;
+    i++;
+  }
+  return source.size();
+}
+
+/**
+ * @brief 跳过从 quote 处 '"' 开始的原始字符串
+ */
+size_t skip_raw_string(std::string_view source, size_t quote) {
+  size_t open = source.find('(', quote + 1);
+  if (open == std::string_view::npos)
+    return source.size();
+  std::string close = ")";
+  close.append(source.substr(quote + 1, open - quote - 1));
+  close += '"';
+  size_t end = source.find(close, open + 1);
+  return end == std::string_view::npos ? source.size() : end + close.size();
+}
+} // namespace
+
+void normalize_source(std::string_view source, bool cpp, std::string &out) {
+  out.clear();
+  out.reserve(source.size());
+  size_t line_start = 0;  // out 中当前行的起点
+  size_t keep = 0;        // 不可截去的位置, 原始字符串内部的空白需保留
+  bool continued = false; // 上一输出行以续行符结尾
+  bool in_number = false; // 数字内的单引号是 C++14 数字分隔符
+  auto end_line = [&]() {
+    size_t end = out.size();
+    while (end > keep && end > line_start &&
+           (out[end - 1] == ' ' || out[end - 1] == '\t' ||
+            out[end - 1] == '\r' || out[end - 1] == '\f' ||
+            out[end - 1] == '\v'))
+      end--;
+    out.resize(end);
+    if (end == line_start && !continued)
+      return; // 空白行
+    continued = end > line_start && out[end - 1] == '\\';
+    out += '\n';
+    line_start = out.size();
+  };
+
+  size_t i = 0;
+  while (i < source.size()) {
+    char c = source[i];
+    char next = i + 1 < source.size() ? source[i + 1] : '\0';
+    if (c >= '0' && c <= '9' && !(i > 0 && is_ident(source[i - 1])))
+      in_number = true;
+    else if (!is_ident(c) && c != '.' && c != '\'')
+      in_number = false;
+    if (c == '\n') {
+      end_line();
+      i++;
+    } else if (c == '/' && next == '/') {
+      // 行注释以续行符延续到下一行
+      i += 2;
+      while (i < source.size() && source[i] != '\n') {
+        if (source[i] == '\\' && i + 1 < source.size() &&
+            (source[i + 1] == '\n' ||
+             (source[i + 1] == '\r' && i + 2 < source.size() &&
+              source[i + 2] == '\n')))
+          i += source[i + 1] == '\r' ? 2 : 1;
+        i++;
+      }
+    } else if (c == '/' && next == '*') {
+      size_t end = source.find("*/", i + 2);
+      i = end == std::string_view::npos ? source.size() : end + 2;
+      if (out.size() > line_start && out.back() != ' ' && out.back() != '\t')
+        out += ' ';
+    } else if (c == '"' && cpp && raw_string_at(source, i)) {
+      size_t end = skip_raw_string(source, i);
+      out.append(source.substr(i, end - i));
+      // 原始字符串中的换行不计为行尾, 之后的行从字面量结束处算起
+      size_t newline = out.rfind('\n');
+      if (newline != std::string::npos && newline >= out.size() - (end - i))
+        line_start = newline + 1;
+      keep = out.size();
+      i = end;
+    } else if (c == '"' || (c == '\'' && !in_number)) {
+      size_t end = skip_quoted(source, i);
+      out.append(source.substr(i, end - i));
+      i = end;
+    } else {
+      out += c;
+      i++;
+    }
+  }
+  end_line();
+}
@@ -0,0 +1,21 @@
+#ifndef __HAS_NORMALIZE__
+#define __HAS_NORMALIZE__
+#include <string>
+#include <string_view>
+
+/**
+ * 解析前的源代码规范化, 取代 process_file.sh 中逐文件启动
+ * perl | awk | clang-format | sed 并原地改写语料的做法:
+ *   去掉 // 与 块注释 (块注释以一个空格代替, 不会把两侧的记号连在一起),
+ *   去掉行尾空白与空白行
+ * 字符串、字符字面量与 C++ 原始字符串内部原样保留; 续行符之后的空白行保留,
+ * 以免改变宏定义. 不做 clang-format 排版, 排版不影响语法树与清理后的 token
+ */
+
+/**
+ * @brief 把 source 规范化到 out, out 原有内容被覆盖
+ * @param cpp 为 true 时识别 C++11 原始字符串 R"delim(...)delim"
+ */
+void normalize_source(std::string_view source, bool cpp, std::string &out);
+
+#endif // !__HAS_NORMALIZE__
@@ -0,0 +1,149 @@
+#include "numaplace.h"
+#include <algorithm>
+#include <exception>
+#include <fstream>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+// <numaif.h> 来自 libnuma, 只需其中的策略常量
+constexpr int MPOL_DEFAULT = 0;
+constexpr int MPOL_PREFERRED = 1;
+constexpr int MPOL_INTERLEAVE = 3;
+constexpr int MAX_NODES = 1024;
+
+/**
+ * @brief 解析 sysfs 的列表格式, 如 "0-3,8,10-11"
+ */
+std::vector<int> parse_list(const std::string &text) {
+  std::vector<int> values;
+  size_t begin = 0;
+  while (begin < text.size()) {
+    size_t end = std::min(text.find(',', begin), text.size());
+    std::string item = text.substr(begin, end - begin);
+    begin = end + 1;
+    size_t dash = item.find('-');
+    try {
+      int first = std::stoi(item);
+      int last = dash == std::string::npos ? first
+                                           : std::stoi(item.substr(dash + 1));
+      for (int v = first; v <= last; ++v)
+        values.push_back(v);
+    } catch (const std::exception &) {
+      // 空项 (末尾换行) 或格式不符时跳过
+    }
+  }
+  return values;
+}
+
+std::string read_line(const std::string &path) {
+  std::ifstream file(path);
+  std::string line;
+  std::getline(file, line);
+  return line;
+}
+
+bool set_policy(int mode, const std::vector<int> &nodes) {
+  unsigned long mask[MAX_NODES / (8 * sizeof(unsigned long))] = {};
+  const size_t bits = 8 * sizeof(unsigned long);
+  for (int node : nodes) {
+    if (node >= 0 && node < MAX_NODES)
+      mask[node / bits] |= 1ul << (node % bits);
+  }
+  long ret = ::syscall(SYS_set_mempolicy, mode,
+                       nodes.empty() ? nullptr : mask,
+                       nodes.empty() ? 0 : MAX_NODES + 1);
+  return ret == 0;
+}
+} // namespace
+
+void NumaTopology::Load() {
+  nodes_.clear();
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  bool have_mask = ::sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+  auto usable = [&](int cpu) {
+    return !have_mask || (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed));
+  };
+  for (int id : parse_list(read_line("/sys/devices/system/node/online"))) {
+    NumaNode node;
+    node.id = id;
+    for (int cpu : parse_list(read_line("/sys/devices/system/node/node" +
+                                        std::to_string(id) + "/cpulist"))) {
+      if (usable(cpu))
+        node.cpus.push_back(cpu);
+    }
+    // 只有内存没有可用CPU的节点 (如 CXL 内存扩展) 不放置线程
+    if (!node.cpus.empty())
+      nodes_.push_back(std::move(node));
+  }
+  if (!nodes_.empty())
+    return;
+  NumaNode node;
+  const int cpu_count =
+      have_mask ? CPU_SETSIZE
+                : static_cast<int>(std::thread::hardware_concurrency());
+  for (int cpu = 0; cpu < cpu_count; ++cpu) {
+    if (usable(cpu))
+      node.cpus.push_back(cpu);
+  }
+  if (node.cpus.empty())
+    node.cpus.push_back(0);
+  nodes_.push_back(std::move(node));
+}
+
+int NumaTopology::CpuOf(unsigned worker) const {
+  const NumaNode &node = nodes_[NodeOf(worker)];
+  return node.cpus[(worker / nodes_.size()) % node.cpus.size()];
+}
+
+NumaMode NumaTopology::ParseMode(const std::string &name, bool &ok) {
+  ok = true;
+  if (name == "interleave")
+    return NumaMode::Interleave;
+  if (name == "replicate")
+    return NumaMode::Replicate;
+  ok = name == "off";
+  return NumaMode::Off;
+}
+
+const char *NumaTopology::ModeName(NumaMode mode) {
+  switch (mode) {
+  case NumaMode::Interleave:
+    return "interleave";
+  case NumaMode::Replicate:
+    return "replicate";
+  default:
+    return "off";
+  }
+}
+
+bool pin_thread_cpu(int cpu) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set) == 0;
+}
+
+bool pin_thread_node(const NumaNode &node) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu : node.cpus)
+    CPU_SET(cpu, &set);
+  return ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set) == 0;
+}
+
+bool set_memory_interleave(const std::vector<NumaNode> &nodes) {
+  std::vector<int> ids;
+  for (const NumaNode &node : nodes)
+    ids.push_back(node.id);
+  return set_policy(MPOL_INTERLEAVE, ids);
+}
+
+bool set_memory_preferred(int node) {
+  return set_policy(MPOL_PREFERRED, {node});
+}
+
+bool reset_memory_policy() { return set_policy(MPOL_DEFAULT, {}); }
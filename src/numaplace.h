@@ -0,0 +1,77 @@
+#ifndef __HAS_NUMAPLACE__
+#define __HAS_NUMAPLACE__
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * NUMA 拓扑与线程/内存放置, 读取 sysfs 并直接调用系统调用, 不依赖 libnuma
+ *   interleave 词汇表加载期间内存页在各节点间交错, 各插槽访问代价均等
+ *   replicate  每个节点一份只读词汇表副本, 工作线程绑定到节点并只读本地副本
+ * 非 NUMA 系统只有一个节点, 各模式均退化为普通分配
+ */
+enum class NumaMode { Off, Interleave, Replicate };
+
+struct NumaNode {
+  int id = 0;
+  std::vector<int> cpus; // 本进程可用的在线CPU
+};
+
+class NumaTopology {
+public:
+  // 读取 /sys/devices/system/node, 失败时为包含全部可用CPU的单个节点
+  void Load();
+  const std::vector<NumaNode> &Nodes() const { return nodes_; }
+  size_t NodeCount() const { return nodes_.size(); }
+  // 工作线程按节点轮流分配, 线程数少于CPU数时也分布到各插槽
+  size_t NodeOf(unsigned worker) const { return worker % nodes_.size(); }
+  int CpuOf(unsigned worker) const;
+  static NumaMode ParseMode(const std::string &name, bool &ok);
+  static const char *ModeName(NumaMode mode);
+
+private:
+  std::vector<NumaNode> nodes_;
+};
+
+// 设置当前线程的CPU亲和性, 失败时保持原有亲和性并返回 false
+bool pin_thread_cpu(int cpu);
+bool pin_thread_node(const NumaNode &node);
+// 当前线程此后分配的内存页策略, 内核不支持或被禁止时返回 false
+bool set_memory_interleave(const std::vector<NumaNode> &nodes);
+bool set_memory_preferred(int node);
+bool reset_memory_policy();
+
+/**
+ * @brief 只读数据的每节点副本
+ * 每个副本由绑定到对应节点的线程复制, 按首次访问分配在该节点的内存上
+ */
+template <typename T> class NodeReplicas {
+public:
+  void Build(const NumaTopology &topology, const T &source);
+  const T &Get(size_t node) const { return *replicas_[node]; }
+  size_t Size() const { return replicas_.size(); }
+
+private:
+  std::vector<std::unique_ptr<T>> replicas_;
+};
+
+template <typename T>
+void NodeReplicas<T>::Build(const NumaTopology &topology, const T &source) {
+  replicas_.clear();
+  replicas_.resize(topology.NodeCount());
+  std::vector<std::thread> threads;
+  for (size_t n = 0; n < topology.NodeCount(); ++n) {
+    threads.emplace_back([&, n]() {
+      const NumaNode &node = topology.Nodes()[n];
+      pin_thread_node(node);
+      set_memory_preferred(node.id);
+      replicas_[n] = std::make_unique<T>(source);
+    });
+  }
+  for (auto &t : threads)
+    t.join();
+}
+
+#endif // !__HAS_NUMAPLACE__
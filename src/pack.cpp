@@ -0,0 +1,165 @@
+#include "pack.h"
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static_assert(sizeof(PackHeader) == 32, "PackHeader 布局固定为 32 字节");
+static_assert(sizeof(PackRecordHeader) == 16,
+              "PackRecordHeader 布局固定为 16 字节");
+
+PackReader::~PackReader() {
+  if (data_ != nullptr)
+    ::munmap(const_cast<char *>(data_), size_);
+}
+
+bool PackReader::Open(const std::filesystem::path &pack_path) {
+  int fd = ::open(pack_path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (::fstat(fd, &st) != 0 ||
+      static_cast<size_t>(st.st_size) < sizeof(PackHeader)) {
+    ::close(fd);
+    return false;
+  }
+  void *map = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (map == MAP_FAILED)
+    return false;
+
+  const char *data = static_cast<const char *>(map);
+  size_t size = static_cast<size_t>(st.st_size);
+  PackHeader header;
+  std::memcpy(&header, data, sizeof(header));
+  // 以减法比较, 文件头中的任意取值都不会溢出
+  if (std::memcmp(header.magic, PACK_MAGIC, sizeof(PACK_MAGIC)) != 0 ||
+      header.version != PACK_VERSION ||
+      header.index_offset < sizeof(PackHeader) ||
+      header.index_offset > size ||
+      header.index_offset % alignof(uint64_t) != 0 ||
+      header.record_count > (size - header.index_offset) / sizeof(uint64_t) ||
+      !ValidRecords(data, header)) {
+    ::munmap(map, size);
+    return false;
+  }
+  // 工作线程按下标顺序领取记录, 提示内核顺序预读
+  ::madvise(map, size, MADV_SEQUENTIAL);
+  data_ = data;
+  size_ = size;
+  count_ = header.record_count;
+  index_ = reinterpret_cast<const uint64_t *>(data + header.index_offset);
+  return true;
+}
+
+bool PackReader::ValidRecords(const char *data, const PackHeader &header) {
+  const uint64_t *index =
+      reinterpret_cast<const uint64_t *>(data + header.index_offset);
+  // 记录都位于文件头与索引之间, Get 因此无需再做检查
+  const uint64_t end = header.index_offset;
+  for (uint64_t i = 0; i < header.record_count; ++i) {
+    uint64_t offset = index[i];
+    if (offset < sizeof(PackHeader) || offset > end ||
+        end - offset < sizeof(PackRecordHeader))
+      return false;
+    PackRecordHeader record;
+    std::memcpy(&record, data + offset, sizeof(record));
+    uint64_t rest = end - offset - sizeof(record);
+    if (record.name_length > rest ||
+        record.content_length > rest - record.name_length)
+      return false;
+  }
+  return true;
+}
+
+PackRecord PackReader::Get(size_t index) const {
+  const char *p = data_ + index_[index];
+  PackRecordHeader header;
+  std::memcpy(&header, p, sizeof(header));
+  p += sizeof(header);
+  PackRecord record;
+  record.name = std::string_view(p, header.name_length);
+  record.lang = header.lang;
+  record.content =
+      std::string_view(p + header.name_length, header.content_length);
+  return record;
+}
+
+bool PackReader::IsPack(const std::filesystem::path &path) {
+  std::error_code ec;
+  if (!std::filesystem::is_regular_file(path, ec))
+    return false;
+  std::FILE *file = std::fopen(path.c_str(), "rb");
+  if (file == nullptr)
+    return false;
+  char magic[sizeof(PACK_MAGIC)];
+  bool ok = std::fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+            std::memcmp(magic, PACK_MAGIC, sizeof(magic)) == 0;
+  std::fclose(file);
+  return ok;
+}
+
+PackWriter::~PackWriter() {
+  if (file_ != nullptr)
+    std::fclose(file_);
+}
+
+bool PackWriter::Write(const void *data, size_t size) {
+  if (std::fwrite(data, 1, size, file_) != size)
+    return false;
+  offset_ += size;
+  return true;
+}
+
+bool PackWriter::Open(const std::filesystem::path &pack_path) {
+  file_ = std::fopen(pack_path.c_str(), "wb");
+  if (file_ == nullptr)
+    return false;
+  // 先写占位文件头, Finish 时回填记录数与索引偏移
+  PackHeader header{};
+  std::memcpy(header.magic, PACK_MAGIC, sizeof(PACK_MAGIC));
+  header.version = PACK_VERSION;
+  return Write(&header, sizeof(header));
+}
+
+bool PackWriter::Add(std::string_view name, uint8_t lang,
+                     std::string_view content) {
+  static const char padding[8] = {};
+  offsets_.push_back(offset_);
+  PackRecordHeader header{};
+  header.name_length = static_cast<uint32_t>(name.size());
+  header.lang = lang;
+  header.content_length = content.size();
+  size_t record_size = sizeof(header) + name.size() + content.size();
+  return Write(&header, sizeof(header)) && Write(name.data(), name.size()) &&
+         Write(content.data(), content.size()) &&
+         Write(padding, (8 - record_size % 8) % 8);
+}
+
+bool PackWriter::Finish() {
+  PackHeader header{};
+  std::memcpy(header.magic, PACK_MAGIC, sizeof(PACK_MAGIC));
+  header.version = PACK_VERSION;
+  header.record_count = offsets_.size();
+  header.index_offset = offset_;
+  bool ok = Write(offsets_.data(), offsets_.size() * sizeof(uint64_t)) &&
+            std::fseek(file_, 0, SEEK_SET) == 0 &&
+            std::fwrite(&header, sizeof(header), 1, file_) == 1;
+  ok = (std::fclose(file_) == 0) && ok;
+  file_ = nullptr;
+  return ok;
+}
+
+bool pack_lang_for_path(const std::filesystem::path &path, uint8_t &lang) {
+  std::string ext = path.extension().string();
+  if (ext == ".c") {
+    lang = PACK_LANG_C;
+    return true;
+  }
+  if (ext == ".cpp" || ext == ".cc" || ext == ".cxx") {
+    lang = PACK_LANG_CPP;
+    return true;
+  }
+  return false;
+}
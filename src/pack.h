@@ -0,0 +1,96 @@
+#ifndef __HAS_PACK__
+#define __HAS_PACK__
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * 打包语料格式, 所有整数为小端:
+ *   PackHeader
+ *   记录 * N: PackRecordHeader + 文件名 + 源代码, 每条记录按 8 字节对齐
+ *   索引: uint64 * N, 每条记录相对文件头的偏移
+ * 读取端 mmap 整个文件, 按下标直接定位记录, 不产生逐文件系统调用;
+ * 打开时校验索引与全部记录的边界, 之后的读取不再检查
+ */
+constexpr char PACK_MAGIC[8] = {'A', 'S', 'T', 'P', 'A', 'C', 'K', '1'};
+constexpr uint32_t PACK_VERSION = 1;
+constexpr uint8_t PACK_LANG_C = 0;
+constexpr uint8_t PACK_LANG_CPP = 1;
+
+struct PackHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t flags;
+  uint64_t record_count;
+  uint64_t index_offset;
+};
+
+struct PackRecordHeader {
+  uint32_t name_length;
+  uint8_t lang;
+  uint8_t reserved[3];
+  uint64_t content_length;
+};
+
+struct PackRecord {
+  std::string_view name;
+  uint8_t lang;
+  std::string_view content;
+};
+
+/**
+ * @brief 只读打包语料, mmap 映射后线程安全
+ */
+class PackReader {
+public:
+  PackReader() = default;
+  PackReader(const PackReader &) = delete;
+  PackReader &operator=(const PackReader &) = delete;
+  ~PackReader();
+
+  bool Open(const std::filesystem::path &pack_path);
+  bool IsOpen() const { return data_ != nullptr; }
+  size_t Size() const { return count_; }
+  PackRecord Get(size_t index) const;
+  static bool IsPack(const std::filesystem::path &path);
+
+private:
+  // 检查每条记录的偏移与长度都落在记录区内, 损坏或截断的文件整体拒绝
+  static bool ValidRecords(const char *data, const PackHeader &header);
+
+  const char *data_ = nullptr;
+  size_t size_ = 0;
+  size_t count_ = 0;
+  const uint64_t *index_ = nullptr;
+};
+
+/**
+ * @brief 顺序写入打包语料, Finish 时追加索引并回填文件头
+ */
+class PackWriter {
+public:
+  PackWriter() = default;
+  PackWriter(const PackWriter &) = delete;
+  PackWriter &operator=(const PackWriter &) = delete;
+  ~PackWriter();
+
+  bool Open(const std::filesystem::path &pack_path);
+  bool Add(std::string_view name, uint8_t lang, std::string_view content);
+  bool Finish();
+  size_t Size() const { return offsets_.size(); }
+
+private:
+  bool Write(const void *data, size_t size);
+  std::FILE *file_ = nullptr;
+  uint64_t offset_ = 0;
+  std::vector<uint64_t> offsets_;
+};
+
+// 按扩展名判断语言, 非 C/C++ 源文件返回 false
+bool pack_lang_for_path(const std::filesystem::path &path, uint8_t &lang);
+
+#endif // !__HAS_PACK__
@@ -0,0 +1,358 @@
+#include "cli.h"
+#include "discovery.h"
+#include "pack.h"
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#ifdef PACK_WITH_SQLITE
+#include <sqlite3.h>
+#endif
+
+/**
+ * 将语料打包为单个文件, 供抽取器 mmap 读取
+ *   源目录: 并行遍历收集 C/C++ 源文件, 记录名为相对路径
+ *   JSONL : 每行一个对象, 字段为 name/lang/code 或 cloneSQLdata.py 导出的
+ *           pid/[uid/]submit_id/content_type/code
+ *   SQLite: 以 --query 查询 (pid, submit_id, code, content_type) 四列,
+ *           需以 -DPACK_WITH_SQLITE -lsqlite3 编译
+ */
+
+size_t records_skipped = 0;
+
+/**
+ * @brief 解析只含字符串/数字/布尔/null 值的单层 JSON 对象
+ * @return 格式错误时返回 false
+ */
+bool parse_flat_json(const std::string &line,
+                     std::unordered_map<std::string, std::string> &fields) {
+  size_t i = 0;
+  auto skip_ws = [&]() {
+    while (i < line.size() && std::isspace(static_cast<unsigned char>(line[i])))
+      i++;
+  };
+  auto append_utf8 = [](std::string &out, uint32_t cp) {
+    if (cp < 0x80) {
+      out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+      out += static_cast<char>(0xC0 | (cp >> 6));
+      out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+      out += static_cast<char>(0xE0 | (cp >> 12));
+      out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+      out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+      out += static_cast<char>(0xF0 | (cp >> 18));
+      out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+      out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+      out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+  };
+  auto parse_hex4 = [&](uint32_t &cp) {
+    if (i + 4 > line.size())
+      return false;
+    cp = std::stoul(line.substr(i, 4), nullptr, 16);
+    i += 4;
+    return true;
+  };
+  auto parse_string = [&](std::string &out) {
+    if (line[i] != '"')
+      return false;
+    i++;
+    while (i < line.size() && line[i] != '"') {
+      char c = line[i++];
+      if (c != '\\') {
+        out += c;
+        continue;
+      }
+      if (i >= line.size())
+        return false;
+      char e = line[i++];
+      switch (e) {
+      case 'n':
+        out += '\n';
+        break;
+      case 't':
+        out += '\t';
+        break;
+      case 'r':
+        out += '\r';
+        break;
+      case 'b':
+        out += '\b';
+        break;
+      case 'f':
+        out += '\f';
+        break;
+      case 'u': {
+        uint32_t cp;
+        if (!parse_hex4(cp))
+          return false;
+        // 代理对
+        if (cp >= 0xD800 && cp < 0xDC00 && i + 1 < line.size() &&
+            line[i] == '\\' && line[i + 1] == 'u') {
+          i += 2;
+          uint32_t low;
+          if (!parse_hex4(low))
+            return false;
+          cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+        }
+        append_utf8(out, cp);
+        break;
+      }
+      default:
+        out += e;
+        break;
+      }
+    }
+    if (i >= line.size())
+      return false;
+    i++;
+    return true;
+  };
+
+  skip_ws();
+  if (i >= line.size() || line[i++] != '{')
+    return false;
+  while (true) {
+    skip_ws();
+    if (i < line.size() && line[i] == '}')
+      return true;
+    std::string key, value;
+    if (i >= line.size() || !parse_string(key))
+      return false;
+    skip_ws();
+    if (i >= line.size() || line[i++] != ':')
+      return false;
+    skip_ws();
+    if (i >= line.size())
+      return false;
+    if (line[i] == '"') {
+      if (!parse_string(value))
+        return false;
+    } else {
+      size_t end = line.find_first_of(",}", i);
+      if (end == std::string::npos)
+        return false;
+      value = line.substr(i, end - i);
+      value.erase(value.find_last_not_of(" \t\r") + 1);
+      i = end;
+    }
+    fields[key] = std::move(value);
+    skip_ws();
+    if (i < line.size() && line[i] == ',') {
+      i++;
+      continue;
+    }
+    if (i < line.size() && line[i] == '}')
+      return true;
+    return false;
+  }
+}
+
+/**
+ * @brief 按 cloneSQLdata.py 的命名规则生成记录名 pid[_uid]_submitid.ext
+ * 带 uid 时同一用户对同一题目的提交构成一个谱系 (见 lineage.h)
+ */
+bool judge_record(const std::string &pid, const std::string &uid,
+                  const std::string &submit_id,
+                  const std::string &content_type, std::string &name,
+                  uint8_t &lang) {
+  std::string stem = uid.empty() || uid == "null" ? pid : pid + "_" + uid;
+  if (content_type == "text/x-c++src") {
+    lang = PACK_LANG_CPP;
+    name = stem + "_" + submit_id + ".cpp";
+  } else if (content_type == "text/x-csrc") {
+    lang = PACK_LANG_C;
+    name = stem + "_" + submit_id + ".c";
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool pack_directory(PackWriter &writer, const std::filesystem::path &root,
+                    const ExtensionMap &extensions,
+                    const IgnoreRules &ignore_rules) {
+  std::mutex files_mutex;
+  std::vector<SourceFile> files;
+  Discovery discovery(extensions, ignore_rules);
+  discovery.Walk(root, std::thread::hardware_concurrency(),
+                 [&](std::vector<SourceFile> &batch) {
+                   std::lock_guard<std::mutex> lock(files_mutex);
+                   files.insert(files.end(), batch.begin(), batch.end());
+                 });
+  // 排序保证同一目录生成的打包文件内容稳定
+  std::sort(files.begin(), files.end(),
+            [](const SourceFile &a, const SourceFile &b) {
+              return a.path < b.path;
+            });
+  const std::filesystem::path base =
+      std::filesystem::absolute(root).lexically_normal();
+  for (const auto &file : files) {
+    std::ifstream in(file.path, std::ios::binary);
+    if (!in) {
+      std::cerr << "无法打开文件: " << file.path << "\n";
+      records_skipped++;
+      continue;
+    }
+    std::string source((std::istreambuf_iterator<char>(in)),
+                       std::istreambuf_iterator<char>());
+    if (!writer.Add(file.path.lexically_relative(base).string(), file.lang,
+                    source))
+      return false;
+  }
+  return true;
+}
+
+bool pack_jsonl(PackWriter &writer, const std::filesystem::path &dump) {
+  std::ifstream infile(dump);
+  std::string line;
+  size_t line_number = 0;
+  while (std::getline(infile, line)) {
+    line_number++;
+    if (line.empty())
+      continue;
+    std::unordered_map<std::string, std::string> fields;
+    std::string name;
+    uint8_t lang = PACK_LANG_CPP;
+    bool ok;
+    try {
+      ok = parse_flat_json(line, fields) && fields.count("code") != 0;
+    } catch (const std::exception &) {
+      ok = false; // \u 转义中的非法十六进制
+    }
+    if (ok && fields.count("content_type") != 0) {
+      ok = judge_record(fields["pid"], fields["uid"], fields["submit_id"],
+                        fields["content_type"], name, lang);
+    } else if (ok) {
+      name = fields["name"];
+      const std::string &lang_field = fields["lang"];
+      if (lang_field == "c" || lang_field == "C") {
+        lang = PACK_LANG_C;
+      } else if (!lang_field.empty()) {
+        lang = PACK_LANG_CPP;
+      } else {
+        ok = pack_lang_for_path(name, lang);
+      }
+      ok = ok && !name.empty();
+    }
+    if (!ok) {
+      std::cerr << "跳过无法识别的记录: 第" << line_number << "行\n";
+      records_skipped++;
+      continue;
+    }
+    if (!writer.Add(name, lang, fields["code"]))
+      return false;
+  }
+  return true;
+}
+
+#ifdef PACK_WITH_SQLITE
+bool pack_sqlite(PackWriter &writer, const std::filesystem::path &dump,
+                 const std::string &query) {
+  sqlite3 *db = nullptr;
+  if (sqlite3_open_v2(dump.c_str(), &db, SQLITE_OPEN_READONLY, nullptr) !=
+      SQLITE_OK) {
+    std::cerr << "无法打开数据库: " << sqlite3_errmsg(db) << "\n";
+    sqlite3_close(db);
+    return false;
+  }
+  sqlite3_stmt *stmt = nullptr;
+  if (sqlite3_prepare_v2(db, query.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+    std::cerr << "查询失败: " << sqlite3_errmsg(db) << "\n";
+    sqlite3_close(db);
+    return false;
+  }
+  bool ok = true;
+  while (ok && sqlite3_step(stmt) == SQLITE_ROW) {
+    auto text = [&](int column) {
+      const unsigned char *value = sqlite3_column_text(stmt, column);
+      return value == nullptr
+                 ? std::string()
+                 : std::string(reinterpret_cast<const char *>(value),
+                               sqlite3_column_bytes(stmt, column));
+    };
+    std::string name;
+    uint8_t lang;
+    if (!judge_record(text(0), "", text(1), text(3), name, lang)) {
+      records_skipped++;
+      continue;
+    }
+    ok = writer.Add(name, lang, text(2));
+  }
+  sqlite3_finalize(stmt);
+  sqlite3_close(db);
+  return ok;
+}
+#endif
+
+int main(int argc, char **argv) {
+  std::vector<std::string> positional;
+  std::string query = "SELECT pid, submit_id, code, content_type FROM judge";
+  ExtensionMap extensions;
+  IgnoreRules ignore_rules;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i], value;
+    if (Cli::MatchOption(arg, "--query", value))
+      query = value;
+    else if (Cli::MatchOption(arg, "--ext", value)) {
+      if (!extensions.Parse(value)) {
+        std::cerr << "无法解析扩展名映射: " << value << "\n";
+        return 1;
+      }
+    } else if (arg == "--headers")
+      extensions.AddHeaders();
+    else if (Cli::MatchOption(arg, "--ignore", value))
+      ignore_rules.AddPatterns(value);
+    else
+      positional.push_back(arg);
+  }
+  if (positional.size() != 2) {
+    std::cerr << "用法: " << argv[0]
+              << " <输出.pack> <源目录|导出.jsonl|导出.sqlite> [--query=SQL]"
+                 " [--ext=.c=c,.h=cpp,...] [--headers] [--ignore=模式,...]\n";
+    return 1;
+  }
+  const std::filesystem::path output(positional[0]);
+  const std::filesystem::path input(positional[1]);
+
+  PackWriter writer;
+  if (!writer.Open(output)) {
+    std::cerr << "无法写入: " << output << "\n";
+    return 1;
+  }
+  bool ok;
+  std::string ext = input.extension().string();
+  if (std::filesystem::is_directory(input)) {
+    ignore_rules.AddPattern(".git");
+    ignore_rules.AddPath(input / "out");
+    ignore_rules.AddPath(output);
+    ok = pack_directory(writer, input, extensions, ignore_rules);
+  } else if (ext == ".jsonl" || ext == ".json") {
+    ok = pack_jsonl(writer, input);
+  } else if (ext == ".sqlite" || ext == ".db" || ext == ".sqlite3") {
+#ifdef PACK_WITH_SQLITE
+    ok = pack_sqlite(writer, input, query);
+#else
+    std::cerr << "未启用 SQLite 支持, 请以 -DPACK_WITH_SQLITE 重新编译\n";
+    ok = false;
+#endif
+  } else {
+    std::cerr << "无法识别的输入: " << input << "\n";
+    ok = false;
+  }
+  if (!ok || !writer.Finish()) {
+    std::cerr << "打包失败\n";
+    return 1;
+  }
+  std::clog << "已打包" << writer.Size() << "条记录, 跳过" << records_skipped
+            << "条 -> " << output << std::endl;
+  return 0;
+}
@@ -0,0 +1,21 @@
+#include "pathcontext.h"
+
+void append_contexts(std::string &out, const std::string &name,
+                     const std::vector<PathContext> &contexts,
+                     const std::vector<uint32_t> *counts) {
+  out += name;
+  out += ' ';
+  for (size_t i = 0; i < contexts.size(); ++i) {
+    const PathContext &context = contexts[i];
+    out += std::to_string(context.token1);
+    out += ',';
+    out += std::to_string(context.path);
+    out += ',';
+    out += std::to_string(context.token2);
+    if (counts != nullptr) {
+      out += ',';
+      out += std::to_string((*counts)[i]);
+    }
+    out += ' ';
+  }
+}
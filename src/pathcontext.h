@@ -0,0 +1,27 @@
+#ifndef __HAS_PATHCONTEXT__
+#define __HAS_PATHCONTEXT__
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * 路径上下文及其文本格式, 不依赖 tree-sitter,
+ * 供上下文流解码等只处理抽取结果的模块单独使用
+ */
+
+/**
+ * @brief 以词汇表ID编码的路径上下文 (token1, path, token2)
+ */
+struct PathContext {
+  uint32_t token1;
+  uint32_t path;
+  uint32_t token2;
+};
+
+// 以 "名称 t1,p,t2 t1,p,t2 ..." 的文本格式追加到 out
+// 给出 counts 时每项为 t1,p,t2,次数
+void append_contexts(std::string &out, const std::string &name,
+                     const std::vector<PathContext> &contexts,
+                     const std::vector<uint32_t> *counts = nullptr);
+
+#endif // !__HAS_PATHCONTEXT__
@@ -0,0 +1,226 @@
+#include "pathctx.h"
+#include "vocab_extractor.h"
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <new>
+#include <thread>
+#include <vector>
+
+struct pathctx_extractor {
+  Vocab vocab;
+  pathctx_options options;
+};
+
+struct pathctx_buffer {
+  std::vector<PathContext> contexts;
+  std::vector<uint32_t> counts;
+  bool with_counts = false;
+  std::vector<uint64_t> offsets;
+  std::vector<int32_t> status;
+};
+
+static_assert(sizeof(PathContext) == 3 * sizeof(uint32_t),
+              "PathContext 需与 uint32[3] 布局一致");
+
+/**
+ * @brief 抽取单个源, 结果追加到 contexts
+ */
+static int32_t extract_one(const pathctx_extractor &extractor,
+                           const char *source, size_t length, uint8_t lang,
+                           uint32_t seed, std::vector<PathContext> &contexts,
+                           std::vector<uint32_t> &counts) {
+  if (source == nullptr || lang > PATHCTX_LANG_CPP)
+    return PATHCTX_BAD_ARGUMENT;
+  const pathctx_options &options = extractor.options;
+  if (options.max_bytes != 0 && length > options.max_bytes)
+    return PATHCTX_REJECTED;
+
+  TSParser *parser = thread_parser(static_cast<SourceLang>(lang));
+  ts_parser_set_timeout_micros(parser, options.timeout_micros);
+  // 直接在调用方的缓冲区上解析, 不复制源代码
+  std::string_view text(source, length);
+  TSTree *tree = ts_parser_parse_string(parser, nullptr, text.data(),
+                                        static_cast<uint32_t>(text.size()));
+  if (tree == nullptr) {
+    ts_parser_reset(parser);
+    return PATHCTX_REJECTED;
+  }
+  std::mt19937 gen(seed);
+  ExtractOptions extract_options;
+  extract_options.path_width = options.path_width;
+  extract_options.max_leaves = options.max_leaves;
+  size_t before = contexts.size();
+  ExtractStatus status =
+      lca_path_traverse(extractor.vocab, ts_tree_root_node(tree), text, gen,
+                        extract_options, contexts);
+  ts_tree_delete(tree);
+  if (status == ExtractStatus::OverLimit) {
+    contexts.resize(before);
+    return PATHCTX_REJECTED;
+  }
+  if (options.dedup != 0) {
+    thread_local ContextSet context_set;
+    context_set.Compact(contexts, counts);
+  }
+  return PATHCTX_OK;
+}
+
+extern "C" {
+
+uint32_t pathctx_abi_version(void) { return PATHCTX_ABI_VERSION; }
+
+void pathctx_options_default(pathctx_options *options) {
+  if (options == nullptr)
+    return;
+  options->path_width = 200;
+  options->max_leaves = 0;
+  options->max_bytes = 0;
+  options->timeout_micros = 0;
+  options->seed = 0;
+  options->dedup = 0;
+}
+
+pathctx_extractor *pathctx_open(const char *vocab_dir,
+                                const pathctx_options *options) {
+  if (vocab_dir == nullptr)
+    return nullptr;
+  auto *extractor = new (std::nothrow) pathctx_extractor();
+  if (extractor == nullptr)
+    return nullptr;
+  if (options != nullptr)
+    extractor->options = *options;
+  else
+    pathctx_options_default(&extractor->options);
+  try {
+    extractor->vocab.Load(vocab_dir);
+  } catch (...) {
+    delete extractor;
+    return nullptr;
+  }
+  if (extractor->vocab.path.empty()) {
+    delete extractor;
+    return nullptr;
+  }
+  return extractor;
+}
+
+void pathctx_close(pathctx_extractor *extractor) { delete extractor; }
+
+int pathctx_extract_batch(pathctx_extractor *extractor,
+                          const char *const *sources, const size_t *lengths,
+                          const uint8_t *langs, size_t n, uint32_t num_threads,
+                          pathctx_buffer **out) {
+  if (extractor == nullptr || out == nullptr)
+    return PATHCTX_BAD_ARGUMENT;
+  if (n != 0 && (sources == nullptr || lengths == nullptr || langs == nullptr))
+    return PATHCTX_BAD_ARGUMENT;
+  auto *buffer = new (std::nothrow) pathctx_buffer();
+  if (buffer == nullptr)
+    return PATHCTX_BAD_ARGUMENT;
+
+  // 每个源独立抽取到自己的向量, 最后按输入顺序拼接, 保证结果与线程数无关
+  std::vector<std::vector<PathContext>> per_source(n);
+  std::vector<std::vector<uint32_t>> per_source_counts(n);
+  buffer->status.assign(n, PATHCTX_OK);
+  if (num_threads == 0)
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  num_threads = static_cast<uint32_t>(std::min<size_t>(num_threads, n));
+  std::atomic<size_t> next{0};
+  auto work = [&]() {
+    for (size_t i = next.fetch_add(1); i < n; i = next.fetch_add(1)) {
+      try {
+        buffer->status[i] =
+            extract_one(*extractor, sources[i], lengths[i], langs[i],
+                        extractor->options.seed + static_cast<uint32_t>(i),
+                        per_source[i], per_source_counts[i]);
+      } catch (...) {
+        per_source[i].clear();
+        per_source_counts[i].clear();
+        buffer->status[i] = PATHCTX_REJECTED;
+      }
+    }
+  };
+  if (num_threads <= 1) {
+    work();
+  } else {
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < num_threads; ++t)
+      threads.emplace_back(work);
+    for (auto &t : threads)
+      t.join();
+  }
+
+  buffer->offsets.resize(n + 1);
+  buffer->offsets[0] = 0;
+  for (size_t i = 0; i < n; ++i)
+    buffer->offsets[i + 1] = buffer->offsets[i] + per_source[i].size();
+  buffer->contexts.reserve(buffer->offsets[n]);
+  for (auto &contexts : per_source) {
+    buffer->contexts.insert(buffer->contexts.end(), contexts.begin(),
+                            contexts.end());
+    std::vector<PathContext>().swap(contexts);
+  }
+  if (extractor->options.dedup != 0) {
+    buffer->with_counts = true;
+    buffer->counts.reserve(buffer->offsets[n]);
+    for (auto &counts : per_source_counts)
+      buffer->counts.insert(buffer->counts.end(), counts.begin(), counts.end());
+  }
+  *out = buffer;
+  return PATHCTX_OK;
+}
+
+int pathctx_extract(pathctx_extractor *extractor, const char *source,
+                    size_t length, uint8_t lang, pathctx_buffer **out) {
+  return pathctx_extract_batch(extractor, &source, &length, &lang, 1, 1, out);
+}
+
+const uint32_t *pathctx_buffer_contexts(const pathctx_buffer *buffer,
+                                        size_t *count) {
+  if (count != nullptr)
+    *count = buffer->contexts.size();
+  return reinterpret_cast<const uint32_t *>(buffer->contexts.data());
+}
+
+const uint32_t *pathctx_buffer_counts(const pathctx_buffer *buffer) {
+  if (!buffer->with_counts)
+    return nullptr;
+  // 没有上下文时也返回非空指针, 以区分未开启 dedup
+  static const uint32_t empty = 0;
+  return buffer->counts.empty() ? &empty : buffer->counts.data();
+}
+
+const uint64_t *pathctx_buffer_offsets(const pathctx_buffer *buffer,
+                                       size_t *n) {
+  if (n != nullptr)
+    *n = buffer->status.size();
+  return buffer->offsets.data();
+}
+
+const int32_t *pathctx_buffer_status(const pathctx_buffer *buffer) {
+  return buffer->status.data();
+}
+
+void pathctx_buffer_free(pathctx_buffer *buffer) { delete buffer; }
+
+uint32_t pathctx_token_id(const pathctx_extractor *extractor,
+                          const char *token, size_t length) {
+  auto it = extractor->vocab.token.find(std::string(token, length));
+  return it == extractor->vocab.token.end() ? 0 : it->second;
+}
+
+uint32_t pathctx_type_id(const pathctx_extractor *extractor,
+                         const char *type, size_t length) {
+  auto it = extractor->vocab.type.find(std::string(type, length));
+  return it == extractor->vocab.type.end() ? 0 : it->second;
+}
+
+uint32_t pathctx_path_id(const pathctx_extractor *extractor,
+                         const uint32_t *type_ids, size_t length) {
+  std::vector<unsigned int> key(type_ids, type_ids + length);
+  auto it = extractor->vocab.path.find(key);
+  return it == extractor->vocab.path.end() ? 0 : it->second;
+}
+
+} // extern "C"
@@ -0,0 +1,84 @@
+#ifndef __HAS_PATHCTX__
+#define __HAS_PATHCTX__
+/**
+ * 路径上下文抽取的稳定 C ABI, 供 Python 等语言进程内调用
+ * 编译: make build/libpathctx.so GRAMMARS="<语法库>", 或
+ *   g++ -std=c++17 -O2 -shared -fPIC pathctx.cpp vocab_extractor.cpp
+ *       pathcontext.cpp chunkpool.cpp randomwalk.cpp perfcount.cpp
+ *       stats.cpp latency.cpp
+ *       <语法库> libtree-sitter.a -pthread -o libpathctx.so
+ * 新增字段只追加在结构体末尾, 不兼容修改时递增 PATHCTX_ABI_VERSION
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PATHCTX_ABI_VERSION 1
+
+#define PATHCTX_LANG_C 0
+#define PATHCTX_LANG_CPP 1
+
+/* 返回码, 也用作批量抽取中每个源文件的状态 */
+#define PATHCTX_OK 0
+#define PATHCTX_REJECTED 1    /* 超出字节/叶节点上限或解析超时 */
+#define PATHCTX_BAD_ARGUMENT 2
+
+typedef struct pathctx_extractor pathctx_extractor;
+typedef struct pathctx_buffer pathctx_buffer;
+
+typedef struct pathctx_options {
+  int32_t path_width;      /* 叶节点对的最大下标间距, 默认 200 */
+  uint64_t max_leaves;     /* 叶节点上限, 0 不限制 */
+  uint64_t max_bytes;      /* 源代码字节上限, 0 不限制 */
+  uint64_t timeout_micros; /* 单次解析超时, 0 不限制 */
+  uint32_t seed;           /* 采样种子, 第 i 个源使用 seed + i */
+  uint32_t dedup;          /* 非 0 时每个源内相同三元组只保留一个并计数 */
+} pathctx_options;
+
+uint32_t pathctx_abi_version(void);
+void pathctx_options_default(pathctx_options *options);
+
+/* 加载 vocab_dir 下的词汇表, 失败返回 NULL; options 可为 NULL */
+pathctx_extractor *pathctx_open(const char *vocab_dir,
+                                const pathctx_options *options);
+void pathctx_close(pathctx_extractor *extractor);
+
+/*
+ * 批量抽取, 结果写入 *out, 由 pathctx_buffer_free 释放
+ * num_threads 为 0 时使用硬件并发数; 结果按输入顺序排列, 与线程数无关
+ */
+int pathctx_extract_batch(pathctx_extractor *extractor,
+                          const char *const *sources, const size_t *lengths,
+                          const uint8_t *langs, size_t n, uint32_t num_threads,
+                          pathctx_buffer **out);
+int pathctx_extract(pathctx_extractor *extractor, const char *source,
+                    size_t length, uint8_t lang, pathctx_buffer **out);
+
+/* 连续的 uint32[count][3] (token1, path, token2) */
+const uint32_t *pathctx_buffer_contexts(const pathctx_buffer *buffer,
+                                        size_t *count);
+/* uint32[count], 与上下文一一对应的出现次数; 未开启 dedup 时返回 NULL */
+const uint32_t *pathctx_buffer_counts(const pathctx_buffer *buffer);
+/* uint64[n + 1], 第 i 个源的上下文为 [offsets[i], offsets[i+1]) */
+const uint64_t *pathctx_buffer_offsets(const pathctx_buffer *buffer,
+                                       size_t *n);
+/* int32[n], 每个源的状态码 */
+const int32_t *pathctx_buffer_status(const pathctx_buffer *buffer);
+void pathctx_buffer_free(pathctx_buffer *buffer);
+
+/* 词汇表查询, 未登录返回 0 */
+uint32_t pathctx_token_id(const pathctx_extractor *extractor,
+                          const char *token, size_t length);
+uint32_t pathctx_type_id(const pathctx_extractor *extractor,
+                         const char *type, size_t length);
+uint32_t pathctx_path_id(const pathctx_extractor *extractor,
+                         const uint32_t *type_ids, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // !__HAS_PATHCTX__
@@ -0,0 +1,220 @@
+import ctypes
+import os
+
+import numpy as np
+
+# libpathctx.so 的 ABI 版本, 与 pathctx.h 中的 PATHCTX_ABI_VERSION 一致
+ABI_VERSION = 1
+
+LANG_C = 0
+LANG_CPP = 1
+
+OK = 0
+REJECTED = 1
+BAD_ARGUMENT = 2
+
+
+class Options(ctypes.Structure):
+    _fields_ = [
+        ("path_width", ctypes.c_int32),
+        ("max_leaves", ctypes.c_uint64),
+        ("max_bytes", ctypes.c_uint64),
+        ("timeout_micros", ctypes.c_uint64),
+        ("seed", ctypes.c_uint32),
+        ("dedup", ctypes.c_uint32),
+    ]
+
+
+def _load_library(path=None):
+    """按 参数 > 环境变量 PATHCTX_LIB > 本文件同目录 的顺序查找动态库"""
+    path = path or os.environ.get("PATHCTX_LIB")
+    if not path:
+        here = os.path.dirname(os.path.abspath(__file__))
+        path = os.path.join(here, "libpathctx.so")
+    lib = ctypes.CDLL(path)
+    size_p = ctypes.POINTER(ctypes.c_size_t)
+    lib.pathctx_abi_version.restype = ctypes.c_uint32
+    lib.pathctx_options_default.argtypes = [ctypes.POINTER(Options)]
+    lib.pathctx_open.restype = ctypes.c_void_p
+    lib.pathctx_open.argtypes = [ctypes.c_char_p, ctypes.POINTER(Options)]
+    lib.pathctx_close.argtypes = [ctypes.c_void_p]
+    lib.pathctx_extract_batch.restype = ctypes.c_int
+    lib.pathctx_extract_batch.argtypes = [
+        ctypes.c_void_p,
+        ctypes.POINTER(ctypes.c_char_p),
+        size_p,
+        ctypes.POINTER(ctypes.c_uint8),
+        ctypes.c_size_t,
+        ctypes.c_uint32,
+        ctypes.POINTER(ctypes.c_void_p),
+    ]
+    lib.pathctx_buffer_contexts.restype = ctypes.POINTER(ctypes.c_uint32)
+    lib.pathctx_buffer_contexts.argtypes = [ctypes.c_void_p, size_p]
+    lib.pathctx_buffer_counts.restype = ctypes.POINTER(ctypes.c_uint32)
+    lib.pathctx_buffer_counts.argtypes = [ctypes.c_void_p]
+    lib.pathctx_buffer_offsets.restype = ctypes.POINTER(ctypes.c_uint64)
+    lib.pathctx_buffer_offsets.argtypes = [ctypes.c_void_p, size_p]
+    lib.pathctx_buffer_status.restype = ctypes.POINTER(ctypes.c_int32)
+    lib.pathctx_buffer_status.argtypes = [ctypes.c_void_p]
+    lib.pathctx_buffer_free.argtypes = [ctypes.c_void_p]
+    for name in ("pathctx_token_id", "pathctx_type_id"):
+        getattr(lib, name).restype = ctypes.c_uint32
+        getattr(lib, name).argtypes = [
+            ctypes.c_void_p,
+            ctypes.c_char_p,
+            ctypes.c_size_t,
+        ]
+    lib.pathctx_path_id.restype = ctypes.c_uint32
+    lib.pathctx_path_id.argtypes = [
+        ctypes.c_void_p,
+        ctypes.POINTER(ctypes.c_uint32),
+        ctypes.c_size_t,
+    ]
+    version = lib.pathctx_abi_version()
+    if version != ABI_VERSION:
+        raise RuntimeError(f"libpathctx ABI 版本不匹配: {version} != {ABI_VERSION}")
+    return lib
+
+
+class _Buffer:
+    """持有 C 侧结果缓冲区, 所有 NumPy 视图释放后才调用 pathctx_buffer_free"""
+
+    def __init__(self, lib, handle):
+        self._lib = lib
+        self._handle = handle
+
+    def view(self, pointer, count, ctype, shape):
+        if count == 0:
+            return np.zeros(shape, dtype=np.dtype(ctype))
+        raw = (ctype * count).from_address(ctypes.addressof(pointer.contents))
+        raw._owner = self  # NumPy 数组经 base 引用 raw, raw 再引用缓冲区
+        return np.frombuffer(raw, dtype=ctype).reshape(shape)
+
+    def __del__(self):
+        if self._handle:
+            self._lib.pathctx_buffer_free(self._handle)
+            self._handle = None
+
+
+class Extractor:
+    """
+    进程内调用 C++ 路径上下文抽取
+    extract_batch 返回 (contexts[N,3] uint32, offsets[n+1] uint64, status[n] int32),
+    三者都是直接指向 C 侧内存的零拷贝视图
+    dedup=True 时每个源内相同三元组只保留一个, 并追加返回 counts[N] uint32
+    """
+
+    def __init__(
+        self,
+        vocab_dir,
+        path_width=200,
+        max_leaves=0,
+        max_bytes=0,
+        timeout_ms=0,
+        seed=0,
+        dedup=False,
+        library=None,
+    ):
+        self._lib = _load_library(library)
+        options = Options()
+        self._lib.pathctx_options_default(ctypes.byref(options))
+        options.path_width = path_width
+        options.max_leaves = max_leaves
+        options.max_bytes = max_bytes
+        options.timeout_micros = timeout_ms * 1000
+        options.seed = seed
+        options.dedup = 1 if dedup else 0
+        self._dedup = dedup
+        self._handle = self._lib.pathctx_open(
+            os.fsencode(vocab_dir), ctypes.byref(options)
+        )
+        if not self._handle:
+            raise RuntimeError(f"无法加载词汇表: {vocab_dir}")
+
+    def close(self):
+        if self._handle:
+            self._lib.pathctx_close(self._handle)
+            self._handle = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def __del__(self):
+        self.close()
+
+    def extract_batch(self, sources, langs=LANG_CPP, num_threads=0):
+        """sources 为 bytes 序列; langs 为单个语言或与 sources 等长的序列"""
+        n = len(sources)
+        if isinstance(langs, int):
+            langs = [langs] * n
+        # bytes 对象在调用期间保持存活, C 侧直接读取其内存
+        c_sources = (ctypes.c_char_p * n)(*sources)
+        c_lengths = (ctypes.c_size_t * n)(*[len(s) for s in sources])
+        c_langs = (ctypes.c_uint8 * n)(*langs)
+        handle = ctypes.c_void_p()
+        rc = self._lib.pathctx_extract_batch(
+            self._handle,
+            c_sources,
+            c_lengths,
+            c_langs,
+            n,
+            num_threads,
+            ctypes.byref(handle),
+        )
+        if rc != OK:
+            raise RuntimeError(f"pathctx_extract_batch 失败: {rc}")
+        buffer = _Buffer(self._lib, handle.value)
+        count = ctypes.c_size_t()
+        contexts = self._lib.pathctx_buffer_contexts(handle, ctypes.byref(count))
+        offsets = self._lib.pathctx_buffer_offsets(handle, None)
+        status = self._lib.pathctx_buffer_status(handle)
+        k = count.value
+        result = (
+            buffer.view(contexts, k * 3, ctypes.c_uint32, (k, 3)),
+            buffer.view(offsets, n + 1, ctypes.c_uint64, (n + 1,)),
+            buffer.view(status, n, ctypes.c_int32, (n,)),
+        )
+        if not self._dedup:
+            return result
+        counts = self._lib.pathctx_buffer_counts(handle)
+        return result + (buffer.view(counts, k, ctypes.c_uint32, (k,)),)
+
+    def extract(self, source, lang=LANG_CPP):
+        """抽取单个源, 返回 ([K,3] 上下文, 状态码)"""
+        result = self.extract_batch([source], lang, num_threads=1)
+        return result[0], int(result[2][0])
+
+    def token_id(self, token):
+        data = token.encode() if isinstance(token, str) else token
+        return self._lib.pathctx_token_id(self._handle, data, len(data))
+
+    def type_id(self, node_type):
+        data = node_type.encode() if isinstance(node_type, str) else node_type
+        return self._lib.pathctx_type_id(self._handle, data, len(data))
+
+    def path_id(self, type_ids):
+        arr = (ctypes.c_uint32 * len(type_ids))(*type_ids)
+        return self._lib.pathctx_path_id(self._handle, arr, len(type_ids))
+
+
+if __name__ == "__main__":
+    import sys
+
+    if len(sys.argv) < 3:
+        print("Usage: python pathctx.py <vocab_dir> <source_file>...")
+        sys.exit(1)
+    with Extractor(sys.argv[1]) as extractor:
+        files = sys.argv[2:]
+        sources = []
+        for file in files:
+            with open(file, "rb") as f:
+                sources.append(f.read())
+        langs = [LANG_C if f.endswith(".c") else LANG_CPP for f in files]
+        contexts, offsets, status = extractor.extract_batch(sources, langs)
+        for i, file in enumerate(files):
+            n_contexts = offsets[i + 1] - offsets[i]
+            print(f"{file}: status={status[i]} contexts={n_contexts}")
+        print(f"total contexts: {contexts.shape[0]}")
@@ -0,0 +1,235 @@
+#include "perfcount.h"
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+std::atomic<bool> perf_enabled{false};
+std::atomic<unsigned> perf_sample_every{16};
+
+const char *const EVENT_NAMES[PERF_EVENT_COUNT] = {
+    "cycles", "instructions", "llc_misses", "branch_misses"};
+const char *const REGION_NAMES[PERF_REGION_COUNT] = {
+    "traverse", "path_build", "vocab_lookup"};
+
+struct PerfAccum {
+  PerfTotals region[PERF_REGION_COUNT];
+};
+
+std::mutex registry_mutex;
+std::vector<std::unique_ptr<PerfAccum>> registry;
+std::atomic<int> events_available[PERF_EVENT_COUNT];
+
+/**
+ * @brief 线程本地计数器组, 线程退出时关闭文件描述符, 累计值归注册表所有
+ */
+struct PerfThread {
+  int group_fd = -1;
+  int fds[PERF_EVENT_COUNT];
+  int slot[PERF_EVENT_COUNT]; // 事件在组读取结果中的位置, -1 表示不可用
+  int members = 0;
+  int error = 0;
+  uint64_t pairs = 0;
+  PerfAccum *accum = nullptr;
+
+  PerfThread() {
+    for (int i = 0; i < PERF_EVENT_COUNT; ++i) {
+      fds[i] = -1;
+      slot[i] = -1;
+    }
+#ifdef __linux__
+    const uint64_t configs[PERF_EVENT_COUNT] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+    for (int i = 0; i < PERF_EVENT_COUNT; ++i) {
+      perf_event_attr attr;
+      std::memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.config = configs[i];
+      attr.disabled = group_fd < 0 ? 1 : 0;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                         PERF_FORMAT_TOTAL_TIME_RUNNING;
+      int fd = static_cast<int>(
+          ::syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0));
+      if (fd < 0) {
+        // 单个事件不受支持 (如虚拟机中的 LLC) 时跳过, 其余照常计数
+        if (error == 0)
+          error = errno;
+        continue;
+      }
+      if (group_fd < 0)
+        group_fd = fd;
+      fds[i] = fd;
+      slot[i] = members++;
+    }
+    if (group_fd >= 0) {
+      ::ioctl(group_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+      ::ioctl(group_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+#else
+    error = ENOSYS;
+#endif
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    registry.push_back(std::make_unique<PerfAccum>());
+    accum = registry.back().get();
+    for (int i = 0; i < PERF_EVENT_COUNT; ++i)
+      if (slot[i] >= 0)
+        events_available[i].store(1);
+  }
+
+  ~PerfThread() {
+#ifdef __linux__
+    for (int fd : fds)
+      if (fd >= 0)
+        ::close(fd);
+#endif
+  }
+
+  bool Ok() const { return group_fd >= 0; }
+
+  /**
+   * @brief 读取整组计数器, 按启用/运行时间比例修正多路复用的影响
+   */
+  void Read(uint64_t out[PERF_EVENT_COUNT]) {
+    std::memset(out, 0, sizeof(uint64_t) * PERF_EVENT_COUNT);
+#ifdef __linux__
+    uint64_t buffer[3 + PERF_EVENT_COUNT];
+    if (::read(group_fd, buffer, sizeof(buffer)) <
+        static_cast<ssize_t>(sizeof(uint64_t) * (3 + members)))
+      return;
+    uint64_t enabled = buffer[1], running = buffer[2];
+    for (int i = 0; i < PERF_EVENT_COUNT; ++i) {
+      if (slot[i] < 0)
+        continue;
+      uint64_t value = buffer[3 + slot[i]];
+      out[i] = running == 0 || running == enabled
+                   ? value
+                   : static_cast<uint64_t>(static_cast<double>(value) *
+                                           enabled / running);
+    }
+#endif
+  }
+};
+
+PerfThread &local_perf() {
+  thread_local PerfThread perf;
+  return perf;
+}
+} // namespace
+
+void Perf::Enable(unsigned sample_every) {
+  perf_sample_every.store(sample_every == 0 ? 1 : sample_every);
+  perf_enabled.store(true);
+}
+
+bool Perf::Enabled() { return perf_enabled.load(std::memory_order_relaxed); }
+
+bool Perf::Available(std::string &reason) {
+  PerfThread &perf = local_perf();
+  if (perf.Ok())
+    return true;
+  reason = std::strerror(perf.error);
+  if (perf.error == EACCES || perf.error == EPERM)
+    reason += " (检查 /proc/sys/kernel/perf_event_paranoid)";
+  return false;
+}
+
+bool Perf::SamplePair() {
+  if (!Enabled())
+    return false;
+  PerfThread &perf = local_perf();
+  return perf.Ok() &&
+         perf.pairs++ % perf_sample_every.load(std::memory_order_relaxed) == 0;
+}
+
+PerfScope::PerfScope(PerfRegion region, bool active)
+    : region_(region), active_(active && Perf::Enabled()) {
+  if (active_) {
+    PerfThread &perf = local_perf();
+    active_ = perf.Ok();
+    if (active_)
+      perf.Read(start_);
+  }
+}
+
+void PerfScope::Stop(uint64_t contexts) {
+  if (!active_)
+    return;
+  active_ = false;
+  PerfThread &perf = local_perf();
+  uint64_t end[PERF_EVENT_COUNT];
+  perf.Read(end);
+  PerfTotals &totals = perf.accum->region[static_cast<int>(region_)];
+  for (int i = 0; i < PERF_EVENT_COUNT; ++i)
+    totals.value[i] += end[i] > start_[i] ? end[i] - start_[i] : 0;
+  totals.samples++;
+  totals.contexts += contexts;
+}
+
+void Perf::WriteReport(std::ostream &out, const std::string &indent) {
+  std::string reason;
+  bool available = Available(reason);
+  out << "{\n"
+      << indent << "  \"available\": " << (available ? "true" : "false");
+  if (!available) {
+    out << ",\n" << indent << "  \"reason\": \"" << reason << "\"\n"
+        << indent << "}";
+    return;
+  }
+  out << ",\n"
+      << indent << "  \"sample_every\": " << perf_sample_every.load();
+  PerfTotals totals[PERF_REGION_COUNT];
+  {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    for (const auto &accum : registry) {
+      for (int r = 0; r < PERF_REGION_COUNT; ++r) {
+        for (int i = 0; i < PERF_EVENT_COUNT; ++i)
+          totals[r].value[i] += accum->region[r].value[i];
+        totals[r].samples += accum->region[r].samples;
+        totals[r].contexts += accum->region[r].contexts;
+      }
+    }
+  }
+  // 不可用的事件输出 null, 每上下文指标以区域覆盖的上下文数为分母
+  for (int r = 0; r < PERF_REGION_COUNT; ++r) {
+    const PerfTotals &t = totals[r];
+    out << ",\n"
+        << indent << "  \"" << REGION_NAMES[r] << "\": {\"samples\": "
+        << t.samples << ", \"contexts\": " << t.contexts;
+    for (int i = 0; i < PERF_EVENT_COUNT; ++i) {
+      out << ", \"" << EVENT_NAMES[i] << "\": ";
+      if (events_available[i].load() == 0)
+        out << "null";
+      else
+        out << t.value[i];
+    }
+    uint64_t cycles = t.value[static_cast<int>(PerfEvent::Cycles)];
+    uint64_t instructions = t.value[static_cast<int>(PerfEvent::Instructions)];
+    out << ", \"ipc\": "
+        << (cycles == 0 ? 0.0 : static_cast<double>(instructions) / cycles);
+    for (PerfEvent event : {PerfEvent::Cycles, PerfEvent::LlcMisses,
+                            PerfEvent::BranchMisses}) {
+      int i = static_cast<int>(event);
+      out << ", \"" << EVENT_NAMES[i] << "_per_context\": ";
+      if (events_available[i].load() == 0)
+        out << "null";
+      else
+        out << (t.contexts == 0 ? 0.0
+                                : static_cast<double>(t.value[i]) / t.contexts);
+    }
+    out << "}";
+  }
+  out << "\n" << indent << "}";
+}
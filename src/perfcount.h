@@ -0,0 +1,65 @@
+#ifndef __HAS_PERFCOUNT__
+#define __HAS_PERFCOUNT__
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+/**
+ * 硬件计数器 (perf_event_open) 采样, 只统计用户态
+ * 每个线程打开一组计数器, 在热点区域前后各读一次取差值;
+ * 内核不支持或权限不足时 Available() 为 false, 所有区域退化为空操作
+ */
+enum class PerfEvent : int {
+  Cycles,
+  Instructions,
+  LlcMisses, // PERF_COUNT_HW_CACHE_MISSES, 多数平台上即末级缓存未命中
+  BranchMisses,
+  Count
+};
+constexpr int PERF_EVENT_COUNT = static_cast<int>(PerfEvent::Count);
+
+enum class PerfRegion : int {
+  Traverse,    // 整个 lca_path_traverse, 按产出的路径上下文计数
+  PathBuild,   // find_lca 与路径构建, 按采样的叶节点对计数
+  VocabLookup, // 词汇表查询, 按采样的叶节点对计数
+  Count
+};
+constexpr int PERF_REGION_COUNT = static_cast<int>(PerfRegion::Count);
+
+struct PerfTotals {
+  uint64_t value[PERF_EVENT_COUNT] = {};
+  uint64_t samples = 0;  // 区域执行次数
+  uint64_t contexts = 0; // 区域覆盖的路径上下文数
+};
+
+class Perf {
+public:
+  // 每 sample_every 个叶节点对测量一次 PathBuild/VocabLookup
+  static void Enable(unsigned sample_every);
+  static bool Enabled();
+  // 在当前线程试探打开计数器, 失败时 reason 给出原因
+  static bool Available(std::string &reason);
+  // 当前线程是否测量本次叶节点对
+  static bool SamplePair();
+  static void WriteReport(std::ostream &out, const std::string &indent);
+};
+
+/**
+ * @brief 区域计数: 构造时读一次计数器, Stop 时再读并累加差值
+ */
+class PerfScope {
+public:
+  explicit PerfScope(PerfRegion region, bool active = true);
+  PerfScope(const PerfScope &) = delete;
+  PerfScope &operator=(const PerfScope &) = delete;
+  ~PerfScope() { Stop(0); }
+  void Stop(uint64_t contexts = 1);
+
+private:
+  PerfRegion region_;
+  bool active_;
+  uint64_t start_[PERF_EVENT_COUNT];
+};
+
+#endif // !__HAS_PERFCOUNT__
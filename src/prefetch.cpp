@@ -0,0 +1,468 @@
+#include "prefetch.h"
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+constexpr size_t MAX_FREE_BUFFERS = 256;  // 缓冲池最多保留的空闲缓冲区
+constexpr uint32_t MAX_READ_CHUNK = 1u << 30; // 单个读请求的最大长度
+
+#ifdef __linux__
+/**
+ * @brief 最小化的 io_uring 封装, 直接使用系统调用, 不依赖 liburing
+ * 只由一个 I/O 线程访问, 无需加锁
+ */
+class Uring {
+public:
+  Uring() = default;
+  Uring(const Uring &) = delete;
+  Uring &operator=(const Uring &) = delete;
+  ~Uring() {
+    if (sqes_ != MAP_FAILED)
+      ::munmap(sqes_, sqes_size_);
+    if (cq_ptr_ != MAP_FAILED && cq_ptr_ != sq_ptr_)
+      ::munmap(cq_ptr_, cq_size_);
+    if (sq_ptr_ != MAP_FAILED)
+      ::munmap(sq_ptr_, sq_size_);
+    if (fd_ >= 0)
+      ::close(fd_);
+  }
+
+  static int Setup(unsigned entries, io_uring_params &params) {
+    return static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+  }
+
+  bool Init(unsigned entries) {
+    io_uring_params params{};
+    fd_ = Setup(entries, params);
+    if (fd_ < 0)
+      return false;
+    sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap)
+      sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+    sq_ptr_ = ::mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    if (sq_ptr_ == MAP_FAILED)
+      return false;
+    cq_ptr_ = single_mmap ? sq_ptr_
+                          : ::mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE,
+                                   MAP_SHARED | MAP_POPULATE, fd_,
+                                   IORING_OFF_CQ_RING);
+    if (cq_ptr_ == MAP_FAILED)
+      return false;
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = ::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+    if (sqes_ == MAP_FAILED)
+      return false;
+
+    char *sq = static_cast<char *>(sq_ptr_);
+    sq_tail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    char *cq = static_cast<char *>(cq_ptr_);
+    cq_head_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+    entries_ = params.sq_entries;
+    return true;
+  }
+
+  unsigned Entries() const { return entries_; }
+
+  void PrepareRead(int fd, char *buffer, uint32_t length, uint64_t offset,
+                   uint64_t user_data) {
+    unsigned tail = *sq_tail_ + queued_;
+    unsigned index = tail & sq_mask_;
+    io_uring_sqe *sqe = static_cast<io_uring_sqe *>(sqes_) + index;
+    *sqe = io_uring_sqe{};
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(buffer);
+    sqe->len = length;
+    sqe->off = offset;
+    sqe->user_data = user_data;
+    sq_array_[index] = index;
+    queued_++;
+  }
+
+  // 提交已准备的请求, 并至少等待 wait_nr 个完成事件
+  bool Submit(unsigned wait_nr) {
+    __atomic_store_n(sq_tail_, *sq_tail_ + queued_, __ATOMIC_RELEASE);
+    unsigned to_submit = queued_;
+    queued_ = 0;
+    while (true) {
+      long ret = ::syscall(__NR_io_uring_enter, fd_, to_submit, wait_nr,
+                           wait_nr != 0 ? IORING_ENTER_GETEVENTS : 0, nullptr,
+                           0);
+      if (ret >= 0)
+        return true;
+      if (errno != EINTR)
+        return false;
+      to_submit = 0; // 已提交的请求不重复提交
+    }
+  }
+
+  bool Peek(io_uring_cqe &out) {
+    unsigned head = *cq_head_;
+    if (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE))
+      return false;
+    out = cqes_[head & cq_mask_];
+    __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+    return true;
+  }
+
+private:
+  int fd_ = -1;
+  void *sq_ptr_ = MAP_FAILED;
+  void *cq_ptr_ = MAP_FAILED;
+  void *sqes_ = MAP_FAILED;
+  size_t sq_size_ = 0, cq_size_ = 0, sqes_size_ = 0;
+  unsigned *sq_tail_ = nullptr, *sq_array_ = nullptr;
+  unsigned *cq_head_ = nullptr, *cq_tail_ = nullptr;
+  unsigned sq_mask_ = 0, cq_mask_ = 0, entries_ = 0;
+  unsigned queued_ = 0;
+  io_uring_cqe *cqes_ = nullptr;
+};
+#endif
+
+Prefetcher::Prefetcher(size_t depth, unsigned io_threads,
+                       PrefetchBackend backend, size_t max_bytes,
+                       MemoryBudget *budget)
+    : depth_(std::max<size_t>(1, depth)), max_bytes_(max_bytes),
+      budget_(budget) {
+#ifdef __linux__
+  if (backend != PrefetchBackend::Threads) {
+    // 容器/seccomp 环境常禁止 io_uring, 先试探能否建立队列
+    io_uring_params params{};
+    int fd = Uring::Setup(1, params);
+    if (fd >= 0) {
+      ::close(fd);
+      uring_ = true;
+    }
+  }
+#endif
+  if (uring_) {
+#ifdef __linux__
+    io_running_ = 1;
+    threads_.emplace_back(&Prefetcher::UringLoop, this);
+#endif
+  } else {
+    io_running_ = std::max(1u, io_threads);
+    for (unsigned i = 0; i < io_running_; ++i)
+      threads_.emplace_back(&Prefetcher::ThreadLoop, this);
+  }
+}
+
+Prefetcher::~Prefetcher() {
+  Stop();
+  for (auto &t : threads_)
+    t.join();
+}
+
+PrefetchBackend Prefetcher::ParseBackend(const std::string &name, bool &ok) {
+  ok = true;
+  if (name == "uring" || name == "io_uring")
+    return PrefetchBackend::Uring;
+  if (name == "threads")
+    return PrefetchBackend::Threads;
+  ok = name == "auto";
+  return PrefetchBackend::Auto;
+}
+
+void Prefetcher::Push(std::vector<SourceFile> &files) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto &file : files)
+    pending_.push_back(std::move(file));
+  cv_.notify_all();
+}
+
+void Prefetcher::Close() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  closed_ = true;
+  cv_.notify_all();
+}
+
+void Prefetcher::Stop() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  closed_ = stopping_ = true;
+  pending_.clear();
+  cv_.notify_all();
+}
+
+bool Prefetcher::Next(PrefetchedFile &out) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  cv_.wait(lock, [this] { return !ready_.empty() || io_running_ == 0; });
+  if (ready_.empty())
+    return false;
+  out = std::move(ready_.front());
+  ready_.pop_front();
+  // 腾出一个预读槽位
+  cv_.notify_all();
+  return true;
+}
+
+void Prefetcher::Recycle(std::string &&buffer) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (free_buffers_.size() < MAX_FREE_BUFFERS)
+    free_buffers_.push_back(std::move(buffer));
+}
+
+std::string Prefetcher::TakeBuffer() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (free_buffers_.empty())
+    return std::string();
+  std::string buffer = std::move(free_buffers_.back());
+  free_buffers_.pop_back();
+  return buffer;
+}
+
+/**
+ * @brief 等待空闲槽位并领取一个待读文件
+ * @return 没有更多文件时返回 false
+ */
+bool Prefetcher::WaitForSlot(SourceFile &file) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  cv_.wait(lock, [this] {
+    return stopping_ || (closed_ && pending_.empty()) ||
+           (!pending_.empty() && ready_.size() + in_flight_ < depth_);
+  });
+  if (stopping_ || pending_.empty())
+    return false;
+  file = std::move(pending_.front());
+  pending_.pop_front();
+  in_flight_++;
+  return true;
+}
+
+void Prefetcher::Finish(PrefetchedFile &&file) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  in_flight_--;
+  if (!stopping_)
+    ready_.push_back(std::move(file));
+  else if (budget_ != nullptr)
+    budget_->Release(MemClass::Source, file.charged);
+  cv_.notify_all();
+}
+
+void Prefetcher::ReadFile(PrefetchedFile &item) {
+  int fd = ::open(item.file.path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    item.error = errno;
+    return;
+  }
+  struct stat st;
+  if (::fstat(fd, &st) != 0) {
+    item.error = errno;
+    ::close(fd);
+    return;
+  }
+  item.size = static_cast<uint64_t>(st.st_size);
+  if (max_bytes_ != 0 && item.size > max_bytes_) {
+    item.oversize = true;
+    ::close(fd);
+    return;
+  }
+  if (budget_ != nullptr) {
+    budget_->Acquire(MemClass::Source, item.size);
+    item.charged = item.size;
+  }
+  item.data = TakeBuffer();
+  item.data.resize(item.size);
+  size_t done = 0;
+  while (done < item.data.size()) {
+    ssize_t n = ::pread(fd, &item.data[done], item.data.size() - done, done);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0) {
+      item.error = errno;
+      break;
+    }
+    if (n == 0)
+      break; // 文件在读取期间被截短
+    done += static_cast<size_t>(n);
+  }
+  item.data.resize(done);
+  ::close(fd);
+}
+
+void Prefetcher::ThreadLoop() {
+  SourceFile file;
+  while (WaitForSlot(file)) {
+    PrefetchedFile item;
+    item.file = std::move(file);
+    ReadFile(item);
+    Finish(std::move(item));
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  io_running_--;
+  cv_.notify_all();
+}
+
+#ifdef __linux__
+void Prefetcher::UringLoop() {
+  Uring ring;
+  if (!ring.Init(static_cast<unsigned>(std::min<size_t>(depth_, 4096)))) {
+    // 试探成功但建立失败 (如内存锁定额度不足), 就地退回同步读取
+    SourceFile file;
+    while (WaitForSlot(file)) {
+      PrefetchedFile item;
+      item.file = std::move(file);
+      ReadFile(item);
+      Finish(std::move(item));
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    io_running_--;
+    cv_.notify_all();
+    return;
+  }
+
+  struct Slot {
+    PrefetchedFile item;
+    int fd = -1;
+    size_t done = 0;
+  };
+  // 在途请求以槽位下标作为 user_data
+  std::vector<Slot> slots(ring.Entries());
+  std::vector<size_t> free_slots;
+  for (size_t i = slots.size(); i > 0; --i)
+    free_slots.push_back(i - 1);
+  size_t submitted = 0;
+
+  auto submit_read = [&](size_t index) {
+    Slot &slot = slots[index];
+    size_t remaining = slot.item.data.size() - slot.done;
+    ring.PrepareRead(slot.fd, &slot.item.data[slot.done],
+                     static_cast<uint32_t>(
+                         std::min<size_t>(remaining, MAX_READ_CHUNK)),
+                     slot.done, index);
+    submitted++;
+  };
+  auto complete = [&](size_t index) {
+    Slot &slot = slots[index];
+    slot.item.data.resize(slot.done);
+    if (slot.fd >= 0)
+      ::close(slot.fd);
+    slot.fd = -1;
+    slot.done = 0;
+    Finish(std::move(slot.item));
+    slot.item = PrefetchedFile();
+    free_slots.push_back(index);
+  };
+
+  while (true) {
+    // 在途请求为空时才阻塞等待新文件, 否则只领取已有的文件
+    bool idle = submitted == 0;
+    while (!free_slots.empty()) {
+      SourceFile file;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (idle)
+          cv_.wait(lock, [this] {
+            return stopping_ || (closed_ && pending_.empty()) ||
+                   (!pending_.empty() && ready_.size() + in_flight_ < depth_);
+          });
+        if (stopping_ || pending_.empty() ||
+            ready_.size() + in_flight_ >= depth_)
+          break;
+        file = std::move(pending_.front());
+        pending_.pop_front();
+        in_flight_++;
+      }
+      idle = false;
+      size_t index = free_slots.back();
+      free_slots.pop_back();
+      Slot &slot = slots[index];
+      slot.item.file = std::move(file);
+      // 打开与 fstat 同步完成, 只有读取走 io_uring
+      slot.fd = ::open(slot.item.file.path.c_str(), O_RDONLY | O_CLOEXEC);
+      struct stat st;
+      if (slot.fd < 0 || ::fstat(slot.fd, &st) != 0) {
+        slot.item.error = errno;
+        complete(index);
+        continue;
+      }
+      slot.item.size = static_cast<uint64_t>(st.st_size);
+      if (max_bytes_ != 0 && slot.item.size > max_bytes_) {
+        slot.item.oversize = true;
+        complete(index);
+        continue;
+      }
+      if (budget_ != nullptr) {
+        // 有在途读请求时不能阻塞等待, 否则其占用无法交给消费者释放;
+        // 预算不足时放回队首, 先处理完成事件
+        if (submitted == 0) {
+          budget_->Acquire(MemClass::Source, slot.item.size);
+        } else if (!budget_->TryAcquire(MemClass::Source, slot.item.size)) {
+          ::close(slot.fd);
+          slot.fd = -1;
+          {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_.push_front(std::move(slot.item.file));
+            in_flight_--;
+          }
+          slot.item = PrefetchedFile();
+          free_slots.push_back(index);
+          break;
+        }
+        slot.item.charged = slot.item.size;
+      }
+      slot.item.data = TakeBuffer();
+      slot.item.data.resize(slot.item.size);
+      if (slot.item.data.empty()) {
+        complete(index);
+        continue;
+      }
+      submit_read(index);
+    }
+
+    if (submitted == 0) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (stopping_ || (closed_ && pending_.empty()))
+        break;
+      continue;
+    }
+    if (!ring.Submit(1))
+      break;
+    io_uring_cqe cqe;
+    while (ring.Peek(cqe)) {
+      submitted--;
+      size_t index = static_cast<size_t>(cqe.user_data);
+      Slot &slot = slots[index];
+      if (cqe.res < 0) {
+        slot.item.error = -cqe.res;
+      } else if (cqe.res > 0) {
+        slot.done += static_cast<size_t>(cqe.res);
+        // 短读时继续读取剩余部分
+        if (slot.done < slot.item.data.size()) {
+          submit_read(index);
+          continue;
+        }
+      }
+      complete(index);
+    }
+  }
+
+  // 提交失败时等待剩余请求结束, 确保内核不再写入缓冲区
+  while (submitted != 0 && ring.Submit(1)) {
+    io_uring_cqe cqe;
+    while (ring.Peek(cqe)) {
+      submitted--;
+      slots[cqe.user_data].item.error = cqe.res < 0 ? -cqe.res : 0;
+      complete(static_cast<size_t>(cqe.user_data));
+    }
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  io_running_--;
+  cv_.notify_all();
+}
+#endif
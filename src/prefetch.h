@@ -0,0 +1,85 @@
+#ifndef __HAS_PREFETCH__
+#define __HAS_PREFETCH__
+#include "discovery.h"
+#include "membudget.h"
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief 预读完成的文件
+ * error 为 errno, 0 表示成功; oversize 表示超过字节上限而未读取
+ * charged 为计入内存预算的字节数, 由消费者处理完后释放
+ */
+struct PrefetchedFile {
+  SourceFile file;
+  std::string data;
+  uint64_t size = 0;
+  int error = 0;
+  bool oversize = false;
+  size_t charged = 0;
+};
+
+enum class PrefetchBackend { Auto, Uring, Threads };
+
+/**
+ * @brief 源文件预读流水线: 在解析线程之前保持 depth 个文件已读入内存
+ * 生产者 Push 待读文件, 消费者 Next 取出已读文件, 用完后 Recycle 归还缓冲区
+ * Linux 下优先使用 io_uring (单个 I/O 线程提交读请求),
+ * 内核不支持或被禁止时退回线程池 pread
+ * 给定 budget 时读取前按文件大小申请预算, 超出时暂停读取
+ */
+class Prefetcher {
+public:
+  Prefetcher(size_t depth, unsigned io_threads,
+             PrefetchBackend backend = PrefetchBackend::Auto,
+             size_t max_bytes = 0, MemoryBudget *budget = nullptr);
+  Prefetcher(const Prefetcher &) = delete;
+  Prefetcher &operator=(const Prefetcher &) = delete;
+  ~Prefetcher();
+
+  // 可被多个线程并发调用
+  void Push(std::vector<SourceFile> &files);
+  // 不再有新文件, 读完剩余文件后 Next 返回 false
+  void Close();
+  // 放弃未读文件, 等待在途读请求结束
+  void Stop();
+  bool Next(PrefetchedFile &out);
+  void Recycle(std::string &&buffer);
+  const char *BackendName() const { return uring_ ? "io_uring" : "threads"; }
+  static PrefetchBackend ParseBackend(const std::string &name, bool &ok);
+
+private:
+  bool WaitForSlot(SourceFile &file);
+  void Finish(PrefetchedFile &&file);
+  std::string TakeBuffer();
+  void ReadFile(PrefetchedFile &item);
+  void ThreadLoop();
+#ifdef __linux__
+  void UringLoop();
+#endif
+
+  const size_t depth_;
+  const size_t max_bytes_;
+  MemoryBudget *const budget_;
+  bool uring_ = false;
+  int ring_fd_ = -1;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<SourceFile> pending_;
+  std::deque<PrefetchedFile> ready_;
+  std::vector<std::string> free_buffers_;
+  size_t in_flight_ = 0;
+  unsigned io_running_ = 0; // 仍在运行的 I/O 线程数
+  bool closed_ = false;
+  bool stopping_ = false;
+  std::vector<std::thread> threads_;
+};
+
+#endif // !__HAS_PREFETCH__
@@ -0,0 +1,190 @@
+#include "cli.h"
+#include "discovery.h"
+#include "prefetch.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * 源文件读取基准: 对比逐文件 ifstream 与预读流水线的吞吐
+ * --drop-caches 在每轮前清空页缓存 (需要 root), 分别测量冷/热缓存
+ * 消费线程只对内容做校验和, 以隔离 I/O 开销
+ */
+
+std::vector<SourceFile> files;
+
+struct BenchResult {
+  double seconds = 0;
+  uint64_t bytes = 0;
+  uint64_t checksum = 0;
+};
+
+bool drop_caches() {
+  ::sync();
+  std::ofstream control("/proc/sys/vm/drop_caches");
+  control << "3\n";
+  return static_cast<bool>(control.flush());
+}
+
+uint64_t checksum(const std::string &data) {
+  uint64_t sum = 0;
+  for (unsigned char c : data)
+    sum = sum * 31 + c;
+  return sum;
+}
+
+BenchResult run_ifstream(unsigned num_threads) {
+  std::atomic<size_t> next{0};
+  std::atomic<uint64_t> bytes{0}, sum{0};
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (unsigned i = 0; i < num_threads; ++i) {
+    threads.emplace_back([&]() {
+      size_t index;
+      while ((index = next.fetch_add(1)) < files.size()) {
+        std::ifstream file(files[index].path, std::ios::binary);
+        std::string source((std::istreambuf_iterator<char>(file)),
+                           std::istreambuf_iterator<char>());
+        bytes.fetch_add(source.size(), std::memory_order_relaxed);
+        sum.fetch_add(checksum(source), std::memory_order_relaxed);
+      }
+    });
+  }
+  for (auto &t : threads)
+    t.join();
+  return {std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                        start)
+              .count(),
+          bytes.load(), sum.load()};
+}
+
+BenchResult run_prefetch(unsigned num_threads, size_t depth,
+                         unsigned io_threads, PrefetchBackend backend,
+                         std::string &backend_name) {
+  std::atomic<uint64_t> bytes{0}, sum{0};
+  auto start = std::chrono::steady_clock::now();
+  Prefetcher prefetcher(depth, io_threads, backend);
+  backend_name = prefetcher.BackendName();
+  std::vector<SourceFile> batch(files);
+  prefetcher.Push(batch);
+  prefetcher.Close();
+  std::vector<std::thread> threads;
+  for (unsigned i = 0; i < num_threads; ++i) {
+    threads.emplace_back([&]() {
+      PrefetchedFile item;
+      while (prefetcher.Next(item)) {
+        bytes.fetch_add(item.data.size(), std::memory_order_relaxed);
+        sum.fetch_add(checksum(item.data), std::memory_order_relaxed);
+        prefetcher.Recycle(std::move(item.data));
+      }
+    });
+  }
+  for (auto &t : threads)
+    t.join();
+  return {std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                        start)
+              .count(),
+          bytes.load(), sum.load()};
+}
+
+void report(const std::string &name, bool cold, const BenchResult &result) {
+  std::cout << name << (cold ? " 冷缓存" : " 热缓存") << ": " << result.seconds
+            << "s " << files.size() / result.seconds << " 文件/s "
+            << result.bytes / result.seconds / (1 << 20) << " MB/s"
+            << " 校验和=" << result.checksum << std::endl;
+}
+
+int main(int argc, char **argv) {
+  std::vector<std::string> positional;
+  std::vector<size_t> depths = {64};
+  unsigned io_threads = 4;
+  unsigned num_threads = std::thread::hardware_concurrency();
+  PrefetchBackend backend = PrefetchBackend::Auto;
+  bool cold = false;
+  int repeat = 1;
+  ExtensionMap extensions;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i], value;
+    if (Cli::MatchOption(arg, "--depth", value)) {
+      // 逗号分隔多个深度, 逐一测量
+      depths.clear();
+      size_t begin = 0;
+      while (begin < value.size()) {
+        size_t end = std::min(value.find(',', begin), value.size());
+        depths.push_back(std::stoul(value.substr(begin, end - begin)));
+        begin = end + 1;
+      }
+    } else if (Cli::MatchOption(arg, "--io-threads", value)) {
+      io_threads = std::stoul(value);
+    } else if (Cli::MatchOption(arg, "--threads", value)) {
+      num_threads = std::stoul(value);
+    } else if (Cli::MatchOption(arg, "--io-backend", value)) {
+      bool ok;
+      backend = Prefetcher::ParseBackend(value, ok);
+      if (!ok) {
+        std::cerr << "未知的 I/O 后端: " << value << "\n";
+        return 1;
+      }
+    } else if (Cli::MatchOption(arg, "--repeat", value)) {
+      repeat = std::stoi(value);
+    } else if (arg == "--drop-caches") {
+      cold = true;
+    } else if (arg == "--headers") {
+      extensions.AddHeaders();
+    } else {
+      positional.push_back(arg);
+    }
+  }
+  if (positional.size() != 1 || depths.empty() || num_threads == 0) {
+    std::cerr << "用法: " << argv[0]
+              << " <目标目录> [--depth=N[,N...]] [--io-threads=N]"
+                 " [--threads=N] [--io-backend=auto|uring|threads]"
+                 " [--repeat=N] [--drop-caches] [--headers]\n";
+    return 1;
+  }
+
+  IgnoreRules ignore_rules;
+  ignore_rules.AddPattern(".git");
+  std::mutex files_mutex;
+  Discovery discovery(extensions, ignore_rules);
+  discovery.Walk(positional[0], 4, [&](std::vector<SourceFile> &batch) {
+    std::lock_guard<std::mutex> lock(files_mutex);
+    files.insert(files.end(), batch.begin(), batch.end());
+  });
+  if (files.empty()) {
+    std::cerr << "未找到C/C++文件\n";
+    return 1;
+  }
+  std::clog << files.size() << "个文件, " << num_threads << "个消费线程"
+            << std::endl;
+
+  // 冷缓存模式下先测冷缓存, 再不清缓存重跑一次得到热缓存结果
+  std::vector<bool> modes = cold ? std::vector<bool>{true, false}
+                                 : std::vector<bool>{false};
+  for (int r = 0; r < repeat; ++r) {
+    for (bool is_cold : modes) {
+      if (is_cold && !drop_caches()) {
+        std::cerr << "无法清空页缓存, 需要 root 权限\n";
+        return 1;
+      }
+      report("ifstream", is_cold, run_ifstream(num_threads));
+      for (size_t depth : depths) {
+        if (is_cold)
+          drop_caches();
+        std::string name;
+        BenchResult result =
+            run_prefetch(num_threads, depth, io_threads, backend, name);
+        report("prefetch[" + name + " depth=" + std::to_string(depth) + "]",
+               is_cold, result);
+      }
+    }
+  }
+  return 0;
+}
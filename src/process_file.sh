@@ -1,5 +1,7 @@
 #!/bin/bash
 
+# 抽取器的 --normalize 在解析前于内存中完成同样的去注释/空白行, 不改写语料
+
 JOBS=8
 TARGET_DIR="${1:-.}"
 
@@ -0,0 +1,44 @@
+#ifndef __HAS_PROTOCOL__
+#define __HAS_PROTOCOL__
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * astparser_server 的 Unix 域套接字协议, 所有整数为本机字节序
+ * 请求: RequestHeader + length 字节源代码, 同一连接可连续发送多个请求
+ * 响应: ResponseHeader + count 个 (token1, path, token2) uint32 三元组
+ *   请求带 REQUEST_DEDUP 时三元组互不相同, 其后再跟 count 个 uint32 出现次数
+ */
+constexpr const char *DEFAULT_SOCKET_PATH = "/tmp/astparser.sock";
+
+constexpr uint8_t REQUEST_DEDUP = 1; // 文件内去重并附带出现次数
+
+struct RequestHeader {
+  uint32_t length; // 源代码字节数
+  uint8_t lang;    // SourceLang: 0 为 C, 1 为 C++
+  uint8_t flags;   // REQUEST_* 位组合, 旧客户端填 0
+  uint8_t reserved[2];
+};
+
+enum class ResponseStatus : uint32_t {
+  Ok = 0,
+  Rejected = 1,   // 超出字节/叶节点上限或解析超时
+  BadRequest = 2, // 语言字段非法
+};
+
+struct ResponseHeader {
+  uint32_t status;
+  uint32_t count; // 三元组个数
+};
+
+class Protocol {
+public:
+  // 读满/写满 size 字节, 对端关闭或出错时返回 false
+  static bool ReadFull(int fd, void *buf, size_t size) noexcept;
+  static bool WriteFull(int fd, const void *buf, size_t size) noexcept;
+  // 连接到 socket_path, 失败返回 -1
+  static int Connect(const std::string &socket_path) noexcept;
+};
+
+#endif // !__HAS_PROTOCOL__
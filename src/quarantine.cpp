@@ -0,0 +1,70 @@
+#include "quarantine.h"
+
+std::string Quarantine::Key(const std::filesystem::path &file) {
+  std::error_code ec;
+  std::filesystem::path abs = std::filesystem::absolute(file, ec);
+  return (ec ? file : abs).lexically_normal().string();
+}
+
+bool Quarantine::Open(const std::filesystem::path &list_path) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  {
+    std::ifstream infile(list_path);
+    std::string line;
+    while (std::getline(infile, line)) {
+      std::string::size_type tab = line.find('\t');
+      entries_.insert(line.substr(0, tab));
+    }
+  }
+  if (list_path.has_parent_path()) {
+    std::error_code ec;
+    std::filesystem::create_directories(list_path.parent_path(), ec);
+  }
+  out_.open(list_path, std::ios::app);
+  return static_cast<bool>(out_);
+}
+
+bool Quarantine::Contains(const std::filesystem::path &file) const {
+  std::string key = Key(file);
+  std::lock_guard<std::mutex> lock(mutex_);
+  return entries_.count(key) != 0;
+}
+
+void Quarantine::Add(const std::filesystem::path &file,
+                     const std::string &reason) {
+  std::string key = Key(file);
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!entries_.insert(key).second)
+    return;
+  if (out_) {
+    // 逐条落盘, 进程被杀时已记录的文件下次仍会被跳过
+    out_ << key << '\t' << reason << '\n';
+    out_.flush();
+  }
+}
+
+size_t Quarantine::Size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return entries_.size();
+}
+
+bool ErrorFilter::Load(const std::filesystem::path &list_path) {
+  std::ifstream infile(list_path);
+  if (!infile)
+    return false;
+  std::string line;
+  while (std::getline(infile, line)) {
+    std::string::size_type tab = line.find('\t');
+    if (tab == std::string::npos)
+      continue;
+    ratios_[line.substr(0, tab)] = std::stod(line.substr(tab + 1));
+  }
+  return true;
+}
+
+double ErrorFilter::Ratio(const std::filesystem::path &file) const {
+  if (ratios_.empty())
+    return 0.0;
+  auto it = ratios_.find(Quarantine::Key(file));
+  return it == ratios_.end() ? 0.0 : it->second;
+}
@@ -0,0 +1,74 @@
+#ifndef __HAS_QUARANTINE__
+#define __HAS_QUARANTINE__
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+/**
+ * @brief 单文件处理上限, 0 表示不限制
+ */
+struct ParseLimits {
+  uint64_t timeout_micros = 0; // ts_parser 解析超时
+  size_t max_bytes = 0;        // 源文件字节上限
+  size_t max_leaves = 0;       // lca_path_traverse 叶节点上限
+};
+
+/**
+ * @brief 解析取消标志: 信号处理函数置位, 工作线程与 tree-sitter 读取
+ * 信号处理函数中只能写入无锁原子量或 volatile sig_atomic_t;
+ * ts_parser_set_cancellation_flag 只接受 const size_t*, tree-sitter
+ * 内部对该地址做原子读取, 因此要求 std::atomic<size_t> 无锁且与 size_t 同布局
+ */
+using CancelFlag = std::atomic<size_t>;
+static_assert(CancelFlag::is_always_lock_free,
+              "取消标志须无锁, 才能在信号处理函数中写入");
+static_assert(sizeof(CancelFlag) == sizeof(size_t) &&
+                  alignof(CancelFlag) == alignof(size_t),
+              "取消标志须与 size_t 同布局, 才能交给 tree-sitter 读取");
+
+inline const size_t *cancel_flag_address(const CancelFlag &flag) {
+  return reinterpret_cast<const size_t *>(&flag);
+}
+
+/**
+ * @brief 隔离列表: 记录超时/超限的病态文件, 重跑时直接跳过
+ * 文件格式为每行 "<绝对路径>\t<原因>"
+ */
+class Quarantine {
+public:
+  // 加载已有列表并以追加方式打开, 文件不存在时新建
+  bool Open(const std::filesystem::path &list_path);
+  bool Contains(const std::filesystem::path &file) const;
+  void Add(const std::filesystem::path &file, const std::string &reason);
+  size_t Size() const;
+  // 统一的路径键: 绝对路径并规范化
+  static std::string Key(const std::filesystem::path &file);
+
+private:
+  mutable std::mutex mutex_;
+  std::unordered_set<std::string> entries_;
+  std::ofstream out_;
+};
+
+/**
+ * @brief 语法错误过滤列表, 由 errorfilecount --filter-out 生成
+ * 文件格式为每行 "<绝对路径>\t<错误字节占比>", 加载后只读
+ */
+class ErrorFilter {
+public:
+  bool Load(const std::filesystem::path &list_path);
+  // 返回文件的错误字节占比, 不在列表中返回 0
+  double Ratio(const std::filesystem::path &file) const;
+  bool Empty() const { return ratios_.empty(); }
+
+private:
+  std::unordered_map<std::string, double> ratios_;
+};
+
+#endif // !__HAS_QUARANTINE__
@@ -0,0 +1,62 @@
+#include "randomwalk.h"
+
+void RandomWalker::Prepare(const FlatNode *nodes, size_t node_count,
+                           const uint32_t *leaves, size_t leaf_count) {
+  nodes_ = nodes;
+  leaves_ = leaves;
+  leaf_count_ = leaf_count;
+  leaf_.assign(node_count, 0);
+  for (size_t i = 0; i < leaf_count; ++i)
+    leaf_[leaves[i]] = 1;
+  // 先序排列中子节点总在父节点之后, 逆序一遍即可判断子树内是否有叶节点,
+  // 不含叶节点的子节点只会让游走走入死端, 不放入子节点表
+  useful_.assign(leaf_.begin(), leaf_.end());
+  begin_.assign(node_count + 1, 0);
+  for (size_t i = node_count; i-- > 1;) {
+    uint32_t parent = nodes[i].parent;
+    if (useful_[i]) {
+      useful_[parent] = 1;
+      begin_[parent + 1]++;
+    }
+  }
+  for (size_t i = 0; i < node_count; ++i)
+    begin_[i + 1] += begin_[i];
+  children_.resize(begin_[node_count]);
+  fill_.assign(begin_.begin(), begin_.end() - 1);
+  for (size_t i = 1; i < node_count; ++i) {
+    if (useful_[i])
+      children_[fill_[nodes[i].parent]++] = static_cast<uint32_t>(i);
+  }
+}
+
+bool RandomWalker::WalkFrom(uint32_t start, std::mt19937 &gen,
+                            unsigned max_hops) {
+  path_.clear();
+  path_.push_back(start);
+  uint32_t previous = start, current = nodes_[start].parent;
+  if (current == start)
+    return false;
+  for (unsigned hop = 0; hop < max_hops; ++hop) {
+    path_.push_back(current);
+    if (leaf_[current])
+      return current != start;
+    // 邻居: 父节点 (根节点没有) 与可行子节点, 排除来时的节点
+    const uint32_t parent = nodes_[current].parent;
+    const bool has_parent = parent != current;
+    const uint32_t first = begin_[current];
+    const uint32_t child_count = begin_[current + 1] - first;
+    const uint32_t degree = child_count + (has_parent ? 1 : 0);
+    if (degree <= 1)
+      return false; // 只能折返
+    // 拒绝采样: 抽中来时的节点则重抽, 期望不超过两次, 与度数无关
+    std::uniform_int_distribution<uint32_t> pick(0, degree - 1);
+    uint32_t next;
+    do {
+      uint32_t k = pick(gen);
+      next = k < child_count ? children_[first + k] : parent;
+    } while (next == previous);
+    previous = current;
+    current = next;
+  }
+  return false;
+}
@@ -0,0 +1,74 @@
+#ifndef __HAS_RANDOMWALK__
+#define __HAS_RANDOMWALK__
+#include "astcache.h"
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+/**
+ * 扁平语法树 (astcache.h) 上的随机游走:
+ *   从每个叶节点出发 walks_per_leaf 次, 每步在父节点与子节点中等概率选择,
+ *   不立即折返, 到达另一叶节点即得到一条路径, 超过 max_hops 或走入
+ *   注释等不能作为叶节点的死端则放弃
+ *   budget 限制单文件的游走总数, 超出时改为随机选取起点
+ * 子节点表在 Prepare 时由父节点数组一次建立, 线程内复用的 RandomWalker
+ * 在容量足够后游走过程不再分配内存
+ */
+struct WalkOptions {
+  unsigned walks_per_leaf = 0; // 0 关闭游走模式
+  unsigned max_hops = 16;
+  size_t budget = 0; // 单文件的游走总数上限, 0 不限制
+};
+
+class RandomWalker {
+public:
+  void Prepare(const FlatNode *nodes, size_t node_count,
+               const uint32_t *leaves, size_t leaf_count);
+
+  /**
+   * @brief 执行游走, 每条成功的路径回调 on_path(path, length),
+   * path[0] 与 path[length - 1] 为两端叶节点的下标, 中间为途经节点
+   * @return 成功的游走数
+   */
+  template <typename OnPath>
+  size_t Walk(std::mt19937 &gen, const WalkOptions &options,
+              OnPath &&on_path);
+
+private:
+  bool WalkFrom(uint32_t start, std::mt19937 &gen, unsigned max_hops);
+
+  const FlatNode *nodes_ = nullptr;
+  const uint32_t *leaves_ = nullptr;
+  size_t leaf_count_ = 0;
+  // 子节点表 (CSR): 节点 i 的可行子节点为 children_[begin_[i], begin_[i+1])
+  std::vector<uint32_t> begin_;
+  std::vector<uint32_t> children_;
+  std::vector<uint8_t> leaf_; // 是否可作为终点
+  std::vector<uint32_t> path_;
+  std::vector<uint8_t> useful_; // Prepare 的临时缓冲区, 复用以免重复分配
+  std::vector<uint32_t> fill_;
+};
+
+template <typename OnPath>
+size_t RandomWalker::Walk(std::mt19937 &gen, const WalkOptions &options,
+                          OnPath &&on_path) {
+  if (leaf_count_ < 2 || options.walks_per_leaf == 0)
+    return 0;
+  size_t total = leaf_count_ * options.walks_per_leaf;
+  const bool sampled = options.budget != 0 && total > options.budget;
+  if (sampled)
+    total = options.budget;
+  std::uniform_int_distribution<size_t> pick_leaf(0, leaf_count_ - 1);
+  size_t found = 0;
+  for (size_t w = 0; w < total; ++w) {
+    size_t leaf = sampled ? pick_leaf(gen) : w / options.walks_per_leaf;
+    if (!WalkFrom(leaves_[leaf], gen, options.max_hops))
+      continue;
+    on_path(path_.data(), path_.size());
+    found++;
+  }
+  return found;
+}
+
+#endif // !__HAS_RANDOMWALK__
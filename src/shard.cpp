@@ -0,0 +1,42 @@
+#include "shard.h"
+#include <cstdint>
+#include <exception>
+
+bool Shard::Parse(const std::string &value) {
+  size_t slash = value.find('/');
+  if (slash == std::string::npos)
+    return false;
+  try {
+    unsigned long i = std::stoul(value.substr(0, slash));
+    unsigned long n = std::stoul(value.substr(slash + 1));
+    if (n == 0 || i >= n)
+      return false;
+    index = static_cast<unsigned>(i);
+    count = static_cast<unsigned>(n);
+  } catch (const std::exception &) {
+    return false;
+  }
+  return true;
+}
+
+bool Shard::Contains(std::string_view relative_path) const {
+  if (count <= 1)
+    return true;
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (unsigned char c : relative_path) {
+    hash ^= c;
+    hash *= 0x100000001b3ULL;
+  }
+  return hash % count == index;
+}
+
+bool Shard::Contains(const std::filesystem::path &path,
+                     const std::filesystem::path &root) const {
+  if (count <= 1)
+    return true;
+  return Contains(path.lexically_relative(root).generic_string());
+}
+
+std::string Shard::Name() const {
+  return "shard-" + std::to_string(index) + "-of-" + std::to_string(count);
+}
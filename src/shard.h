@@ -0,0 +1,27 @@
+#ifndef __HAS_SHARD__
+#define __HAS_SHARD__
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief --shard=i/N: 按语料内相对路径的 FNV-1a 哈希把文件划分到 N 个分片
+ * 划分与遍历顺序、机器和标准库实现无关, 各分片可由不同进程或机器独立处理,
+ * 之后用 vocabmerge 合并各分片的词汇表并把上下文改写为全局ID
+ */
+struct Shard {
+  unsigned index = 0;
+  unsigned count = 1;
+
+  // 解析 "i/N", 要求 0 <= i < N
+  bool Parse(const std::string &value);
+  bool Enabled() const { return count > 1; }
+  bool Contains(std::string_view relative_path) const;
+  // 目录输入时以相对 root 的路径划分, 打包语料直接用记录名
+  bool Contains(const std::filesystem::path &path,
+                const std::filesystem::path &root) const;
+  // 分片输出目录名, 如 shard-0-of-4
+  std::string Name() const;
+};
+
+#endif // !__HAS_SHARD__
@@ -0,0 +1,144 @@
+#include "stats.h"
+#include "perfcount.h"
+#include <chrono>
+#include <memory>
+#include <sys/resource.h>
+
+std::atomic<bool> Stats::enabled_{false};
+
+namespace {
+const char *const STAGE_NAMES[STAGE_COUNT] = {
+    "read",        "normalize",  "parse",        "leaf_collect",
+    "pair_sample", "path_build", "vocab_lookup", "serialize",
+    "write"};
+
+// 函数内静态变量, 避免与其他翻译单元的全局 LockStats 产生初始化顺序问题
+std::mutex &registry_mutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+std::vector<std::unique_ptr<StageCounters>> &stage_registry() {
+  static std::vector<std::unique_ptr<StageCounters>> counters;
+  return counters;
+}
+
+std::vector<LockStats *> &lock_registry() {
+  static std::vector<LockStats *> locks;
+  return locks;
+}
+
+void write_histogram(std::ostream &out, const LatencyHistogram &histogram) {
+  out << "{\"count\": " << histogram.Count()
+      << ", \"p50\": " << histogram.Quantile(0.50)
+      << ", \"p90\": " << histogram.Quantile(0.90)
+      << ", \"p99\": " << histogram.Quantile(0.99)
+      << ", \"max\": " << histogram.Max() << ", \"mean\": " << histogram.Mean()
+      << "}";
+}
+} // namespace
+
+LockStats::LockStats(const char *name) : name(name) {
+  std::lock_guard<std::mutex> lock(registry_mutex());
+  lock_registry().push_back(this);
+}
+
+uint64_t Stats::Now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+StageCounters &Stats::Local() {
+  // 计数器归注册表所有, 线程退出后仍可汇总
+  thread_local StageCounters *counters = nullptr;
+  if (counters == nullptr) {
+    std::lock_guard<std::mutex> lock(registry_mutex());
+    stage_registry().push_back(std::make_unique<StageCounters>());
+    counters = stage_registry().back().get();
+  }
+  return *counters;
+}
+
+void Stats::Lock(std::unique_lock<std::mutex> &lock, LockStats &stats) {
+  if (!Enabled()) {
+    lock.lock();
+    return;
+  }
+  stats.acquisitions.fetch_add(1, std::memory_order_relaxed);
+  if (lock.try_lock())
+    return;
+  uint64_t start = Now();
+  lock.lock();
+  stats.contended.fetch_add(1, std::memory_order_relaxed);
+  stats.wait_nanos.fetch_add(Now() - start, std::memory_order_relaxed);
+}
+
+long Stats::PeakRssKb() {
+  rusage usage{};
+  ::getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+void Stats::WriteReport(
+    std::ostream &out, double seconds, uint64_t files,
+    const std::vector<std::pair<std::string, const LatencyHistogram *>>
+        &histograms) {
+  StageCounters total;
+  size_t threads;
+  {
+    std::lock_guard<std::mutex> lock(registry_mutex());
+    threads = stage_registry().size();
+    for (const auto &counters : stage_registry()) {
+      for (int i = 0; i < STAGE_COUNT; ++i) {
+        total.nanos[i] += counters->nanos[i];
+        total.calls[i] += counters->calls[i];
+      }
+    }
+  }
+  uint64_t stage_nanos = 0;
+  for (int i = 0; i < STAGE_COUNT; ++i)
+    stage_nanos += total.nanos[i];
+
+  out << "{\n"
+      << "  \"seconds\": " << seconds << ",\n"
+      << "  \"files\": " << files << ",\n"
+      << "  \"threads\": " << threads << ",\n"
+      << "  \"peak_rss_kb\": " << PeakRssKb() << ",\n"
+      << "  \"stages\": {\n";
+  // seconds 为各线程累计时间, share 为占全部阶段时间的比例
+  for (int i = 0; i < STAGE_COUNT; ++i) {
+    out << "    \"" << STAGE_NAMES[i] << "\": {\"seconds\": "
+        << total.nanos[i] / 1e9 << ", \"calls\": " << total.calls[i]
+        << ", \"share\": "
+        << (stage_nanos == 0 ? 0.0
+                             : static_cast<double>(total.nanos[i]) /
+                                   stage_nanos)
+        << "}" << (i + 1 < STAGE_COUNT ? "," : "") << "\n";
+  }
+  out << "  },\n";
+  for (const auto &histogram : histograms) {
+    out << "  \"" << histogram.first << "\": ";
+    write_histogram(out, *histogram.second);
+    out << ",\n";
+  }
+  if (Perf::Enabled()) {
+    out << "  \"perf\": ";
+    Perf::WriteReport(out, "  ");
+    out << ",\n";
+  }
+  out << "  \"locks\": {";
+  {
+    std::lock_guard<std::mutex> lock(registry_mutex());
+    const auto &locks = lock_registry();
+    for (size_t i = 0; i < locks.size(); ++i) {
+      out << (i == 0 ? "\n" : ",\n") << "    \"" << locks[i]->name
+          << "\": {\"acquisitions\": " << locks[i]->acquisitions.load()
+          << ", \"contended\": " << locks[i]->contended.load()
+          << ", \"wait_seconds\": " << locks[i]->wait_nanos.load() / 1e9
+          << "}";
+    }
+    out << (locks.empty() ? "}\n" : "\n  }\n");
+  }
+  out << "}\n";
+}
@@ -0,0 +1,105 @@
+#ifndef __HAS_STATS__
+#define __HAS_STATS__
+#include "latency.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * 流水线各阶段, 顺序即报告中的输出顺序
+ */
+enum class Stage : int {
+  Read,        // 取得源代码: 预读等待/打包记录/ifstream
+  Normalize,   // 去注释与空白行 (--normalize)
+  Parse,       // tree-sitter 解析
+  LeafCollect, // 收集叶节点
+  PairSample,  // 叶节点对采样
+  PathBuild,   // LCA 与路径构建
+  VocabLookup, // 词汇表查询/插入
+  Serialize,   // 拼接输出文本
+  Write,       // 写标准输出
+  Count
+};
+constexpr int STAGE_COUNT = static_cast<int>(Stage::Count);
+
+/**
+ * @brief 单个线程的阶段累计, 只由所属线程写入, 线程结束后汇总
+ */
+struct StageCounters {
+  uint64_t nanos[STAGE_COUNT] = {};
+  uint64_t calls[STAGE_COUNT] = {};
+};
+
+/**
+ * @brief 互斥锁等待统计, 构造时登记到全局列表
+ */
+struct LockStats {
+  explicit LockStats(const char *name);
+  const char *name;
+  std::atomic<uint64_t> acquisitions{0};
+  std::atomic<uint64_t> contended{0};
+  std::atomic<uint64_t> wait_nanos{0};
+};
+
+/**
+ * @brief 阶段计时与 --stats 报告, 未启用时不读时钟
+ */
+class Stats {
+public:
+  static void Enable() { enabled_.store(true, std::memory_order_relaxed); }
+  static bool Enabled() { return enabled_.load(std::memory_order_relaxed); }
+  static uint64_t Now();
+  // 当前线程的计数器, 首次调用时登记
+  static StageCounters &Local();
+  // 先 try_lock, 失败时才计时等待
+  static void Lock(std::unique_lock<std::mutex> &lock, LockStats &stats);
+  // 峰值常驻内存 (KB)
+  static long PeakRssKb();
+  static void WriteReport(
+      std::ostream &out, double seconds, uint64_t files,
+      const std::vector<std::pair<std::string, const LatencyHistogram *>>
+          &histograms);
+
+private:
+  static std::atomic<bool> enabled_;
+};
+
+/**
+ * @brief 分段计时: 每次 Lap 把自上次 Lap 以来的时间记到指定阶段
+ * 高频循环中被跳过的迭代不调用 Lap, 其耗时并入下一次 Lap
+ */
+class StageClock {
+public:
+  StageClock()
+      : counters_(Stats::Enabled() ? &Stats::Local() : nullptr),
+        last_(counters_ != nullptr ? Stats::Now() : 0) {}
+
+  void Lap(Stage stage, uint64_t calls = 1) {
+    if (counters_ == nullptr)
+      return;
+    uint64_t now = Stats::Now();
+    counters_->nanos[static_cast<int>(stage)] += now - last_;
+    counters_->calls[static_cast<int>(stage)] += calls;
+    last_ = now;
+  }
+  // 丢弃自上次 Lap 以来的时间 (已由其他计时器记录)
+  void Skip() {
+    if (counters_ != nullptr)
+      last_ = Stats::Now();
+  }
+  // 自上次 Lap/Skip 以来的微秒数, 未启用时为 0
+  uint64_t SinceMicros() const {
+    return counters_ != nullptr ? (Stats::Now() - last_) / 1000 : 0;
+  }
+
+private:
+  StageCounters *counters_;
+  uint64_t last_;
+};
+
+#endif // !__HAS_STATS__
@@ -0,0 +1,195 @@
+#include "tensor.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <numeric>
+#include <random>
+
+namespace {
+/**
+ * @brief npy 1.0 文件头, 总长按 64 字节对齐
+ */
+std::string npy_header(const char *descr, const std::vector<size_t> &shape) {
+  std::string dict = "{'descr': '";
+  dict += descr;
+  dict += "', 'fortran_order': False, 'shape': (";
+  for (size_t i = 0; i < shape.size(); ++i) {
+    dict += std::to_string(shape[i]);
+    if (i + 1 < shape.size() || shape.size() == 1)
+      dict += shape.size() == 1 ? "," : ", ";
+  }
+  dict += "), }";
+  size_t total = 10 + dict.size() + 1;
+  dict.append((64 - total % 64) % 64, ' ');
+  dict += '\n';
+  std::string header("\x93NUMPY\x01\x00", 8);
+  header += static_cast<char>(dict.size() & 0xFF);
+  header += static_cast<char>(dict.size() >> 8);
+  return header + dict;
+}
+
+bool write_array(const std::filesystem::path &path, bool npy,
+                 const char *descr, const std::vector<size_t> &shape,
+                 const void *data, size_t bytes) {
+  std::FILE *file = std::fopen(path.c_str(), "wb");
+  if (file == nullptr)
+    return false;
+  bool ok = true;
+  if (npy) {
+    std::string header = npy_header(descr, shape);
+    ok = std::fwrite(header.data(), 1, header.size(), file) == header.size();
+  }
+  ok = ok && std::fwrite(data, 1, bytes, file) == bytes;
+  return (std::fclose(file) == 0) && ok;
+}
+
+uint64_t sample_seed(uint64_t seed, std::string_view label,
+                     std::string_view identity) {
+  uint64_t hash = 0xcbf29ce484222325ULL ^ seed;
+  auto mix = [&](std::string_view text) {
+    for (unsigned char c : text) {
+      hash ^= c;
+      hash *= 0x100000001b3ULL;
+    }
+  };
+  mix(label);
+  hash ^= 0xff; // 分隔两段, 避免 ("ab", "c") 与 ("a", "bc") 相同
+  hash *= 0x100000001b3ULL;
+  mix(identity);
+  return hash;
+}
+} // namespace
+
+bool TensorWriter::Open(const std::filesystem::path &prefix) {
+  prefix_ = prefix;
+  std::error_code ec;
+  if (prefix.has_parent_path())
+    std::filesystem::create_directories(prefix.parent_path(), ec);
+  Reset(current_);
+  // 先写 meta 占位, 确认目录可写
+  std::ofstream meta(prefix_.string() + ".meta.json");
+  return static_cast<bool>(meta);
+}
+
+void TensorWriter::Reset(Chunk &chunk) const {
+  chunk.rows = 0;
+  chunk.contexts.assign(options_.chunk_rows * options_.max_contexts * 3, 0);
+  chunk.mask.assign(options_.chunk_rows * options_.max_contexts, 0);
+  chunk.labels.assign(options_.chunk_rows, 0);
+  chunk.names.clear();
+}
+
+bool TensorWriter::Add(const std::string &label, std::string_view identity,
+                       const std::vector<PathContext> &contexts) {
+  if (contexts.empty())
+    return true;
+  // 超出 max_contexts 时无放回采样, 保留原顺序
+  thread_local std::vector<uint32_t> picked;
+  const size_t max_contexts = options_.max_contexts;
+  picked.resize(contexts.size());
+  std::iota(picked.begin(), picked.end(), 0);
+  if (contexts.size() > max_contexts) {
+    std::mt19937_64 gen(sample_seed(options_.seed, label, identity));
+    for (size_t i = 0; i < max_contexts; ++i) {
+      std::uniform_int_distribution<size_t> pick(i, picked.size() - 1);
+      std::swap(picked[i], picked[pick(gen)]);
+    }
+    picked.resize(max_contexts);
+    std::sort(picked.begin(), picked.end());
+  }
+
+  Chunk full;
+  size_t full_index = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto label_it =
+        labels_.emplace(label, static_cast<int32_t>(labels_.size() + 1)).first;
+    size_t row = current_.rows++;
+    int32_t *out = current_.contexts.data() + row * max_contexts * 3;
+    uint8_t *mask = current_.mask.data() + row * max_contexts;
+    for (size_t k = 0; k < picked.size(); ++k) {
+      const PathContext &context = contexts[picked[k]];
+      out[k * 3] = static_cast<int32_t>(context.token1);
+      out[k * 3 + 1] = static_cast<int32_t>(context.path);
+      out[k * 3 + 2] = static_cast<int32_t>(context.token2);
+      mask[k] = 1;
+    }
+    current_.labels[row] = label_it->second;
+    current_.names += label;
+    current_.names += '\n';
+    rows_++;
+    if (current_.rows < options_.chunk_rows)
+      return ok_;
+    // 块满后换入新缓冲区, 在锁外写出
+    std::swap(full, current_);
+    full_index = chunks_++;
+    Reset(current_);
+  }
+  bool ok = WriteChunk(full_index, full);
+  std::lock_guard<std::mutex> lock(mutex_);
+  ok_ = ok_ && ok;
+  return ok_;
+}
+
+std::string TensorWriter::ChunkPath(size_t index, const char *name,
+                                    const char *raw_extension) const {
+  char number[16];
+  std::snprintf(number, sizeof(number), ".%05zu.", index);
+  return prefix_.string() + number + name +
+         (options_.npy && *raw_extension != '\0' ? ".npy" : raw_extension);
+}
+
+bool TensorWriter::WriteChunk(size_t index, const Chunk &chunk) const {
+  const size_t rows = chunk.rows, width = options_.max_contexts;
+  std::ofstream names(ChunkPath(index, "names.txt", ""));
+  names << chunk.names;
+  return static_cast<bool>(names) &&
+         write_array(ChunkPath(index, "contexts", ".i32"), options_.npy,
+                     "<i4", {rows, width, 3}, chunk.contexts.data(),
+                     rows * width * 3 * sizeof(int32_t)) &&
+         write_array(ChunkPath(index, "mask", ".u8"), options_.npy, "|b1",
+                     {rows, width}, chunk.mask.data(), rows * width) &&
+         write_array(ChunkPath(index, "labels", ".i32"), options_.npy, "<i4",
+                     {rows}, chunk.labels.data(), rows * sizeof(int32_t));
+}
+
+size_t TensorWriter::Size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return rows_;
+}
+
+bool TensorWriter::Finish() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (current_.rows != 0)
+    ok_ = WriteChunk(chunks_++, current_) && ok_;
+  current_ = Chunk();
+
+  std::vector<std::pair<int32_t, const std::string *>> vocab;
+  vocab.reserve(labels_.size());
+  for (const auto &entry : labels_)
+    vocab.emplace_back(entry.second, &entry.first);
+  std::sort(vocab.begin(), vocab.end());
+  std::ofstream label_file(prefix_.string() + ".label_vocab.txt");
+  for (const auto &entry : vocab)
+    label_file << *entry.second << " " << entry.first << "\n";
+  ok_ = ok_ && static_cast<bool>(label_file);
+
+  std::vector<int64_t> order(rows_);
+  std::iota(order.begin(), order.end(), 0);
+  std::shuffle(order.begin(), order.end(), std::mt19937_64(options_.seed));
+  ok_ = ok_ && write_array(prefix_.string() +
+                               (options_.npy ? ".order.npy" : ".order.i64"),
+                           options_.npy, "<i8", {rows_}, order.data(),
+                           rows_ * sizeof(int64_t));
+
+  std::ofstream meta(prefix_.string() + ".meta.json");
+  meta << "{\n  \"format\": \"" << (options_.npy ? "npy" : "raw")
+       << "\",\n  \"rows\": " << rows_
+       << ",\n  \"max_contexts\": " << options_.max_contexts
+       << ",\n  \"chunk_rows\": " << options_.chunk_rows
+       << ",\n  \"chunks\": " << chunks_
+       << ",\n  \"labels\": " << labels_.size()
+       << ",\n  \"seed\": " << options_.seed << "\n}\n";
+  ok_ = ok_ && static_cast<bool>(meta);
+  return ok_;
+}
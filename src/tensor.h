@@ -0,0 +1,75 @@
+#ifndef __HAS_TENSOR__
+#define __HAS_TENSOR__
+#include "vocab_extractor.h"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * 定长张量输出, 训练端直接 np.load(mmap_mode='r') 而不必解析文本再补齐:
+ *   <前缀>.<块号>.contexts  int32 [n, max_contexts, 3]  (token1, path, token2)
+ *   <前缀>.<块号>.mask      bool  [n, max_contexts]     有效上下文为 1
+ *   <前缀>.<块号>.labels    int32 [n]                   标签ID, 见 label_vocab
+ *   <前缀>.<块号>.names.txt 每行一个标签原文
+ *   <前缀>.label_vocab.txt  "标签 ID", ID 从 1 起
+ *   <前缀>.order            int64 [N] 以种子生成的全局行号乱序
+ *   <前缀>.meta.json        各块行数与形状
+ * npy 格式文件加 .npy 扩展名; raw 格式为同样布局的小端裸数组 (.i32/.u8/.i64),
+ * 除最后一块外每块恰好 chunk_rows 行, 全局行号 = 块号 * chunk_rows + 块内行号
+ */
+struct TensorOptions {
+  size_t max_contexts = 200; // 超出时按种子无放回采样
+  size_t chunk_rows = 16384;
+  bool npy = true;
+  uint64_t seed = 0;
+};
+
+/**
+ * @brief 定长张量写入, Add 可由多个工作线程并发调用
+ * 行的采样只取决于种子、标签与样本来源, 与线程调度无关;
+ * 块内行序取决于完成顺序
+ */
+class TensorWriter {
+public:
+  explicit TensorWriter(const TensorOptions &options) : options_(options) {}
+  TensorWriter(const TensorWriter &) = delete;
+  TensorWriter &operator=(const TensorWriter &) = delete;
+
+  bool Open(const std::filesystem::path &prefix);
+  // 没有上下文的样本不写入; identity 区分同名标签的样本 (如文件路径与
+  // 函数起始字节), 否则各文件的同名函数会采到相同的下标
+  bool Add(const std::string &label, std::string_view identity,
+           const std::vector<PathContext> &contexts);
+  bool Finish();
+  size_t Size() const;
+
+private:
+  struct Chunk {
+    std::vector<int32_t> contexts;
+    std::vector<uint8_t> mask;
+    std::vector<int32_t> labels;
+    std::string names;
+    size_t rows = 0;
+  };
+  void Reset(Chunk &chunk) const;
+  // raw_extension 为空时不附加扩展名, 用于文本文件
+  std::string ChunkPath(size_t index, const char *name,
+                        const char *raw_extension) const;
+  bool WriteChunk(size_t index, const Chunk &chunk) const;
+
+  const TensorOptions options_;
+  std::filesystem::path prefix_;
+  mutable std::mutex mutex_;
+  Chunk current_;
+  size_t chunks_ = 0; // 已分配块号的块数
+  size_t rows_ = 0;
+  bool ok_ = true;
+  std::unordered_map<std::string, int32_t> labels_;
+};
+
+#endif // !__HAS_TENSOR__
@@ -0,0 +1,185 @@
+#include "cli.h"
+#include "numaplace.h"
+#include "vocab_extractor.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * 词汇表查询基准: 比较 NUMA 放置方式下查询吞吐随线程数的扩展
+ *   off        词汇表由主线程按默认策略分配, 线程不绑定
+ *   interleave 词汇表页在各节点间交错
+ *   replicate  每节点一份副本, 线程绑定到节点并查询本地副本
+ * 每个线程以本地复制的键样本按抽取器的比例 (两次 token 一次 path)
+ * 查询词汇表, 固定时长后统计次数
+ */
+
+constexpr size_t SAMPLE_KEYS = 1 << 16; // 每个线程的键样本数
+
+struct Keys {
+  std::vector<std::string> tokens;
+  std::vector<std::vector<unsigned int>> paths;
+};
+
+Keys sample_keys(const Vocab &vocab, uint64_t seed) {
+  Keys keys;
+  for (const auto &entry : vocab.token)
+    keys.tokens.push_back(entry.first);
+  for (const auto &entry : vocab.path)
+    keys.paths.push_back(entry.first);
+  std::mt19937_64 gen(seed);
+  std::shuffle(keys.tokens.begin(), keys.tokens.end(), gen);
+  std::shuffle(keys.paths.begin(), keys.paths.end(), gen);
+  keys.tokens.resize(std::min(keys.tokens.size(), SAMPLE_KEYS));
+  keys.paths.resize(std::min(keys.paths.size(), SAMPLE_KEYS));
+  return keys;
+}
+
+/**
+ * @return 每秒查询次数
+ */
+double run(const NumaTopology &topology, NumaMode mode, bool pin,
+           const Vocab &shared, const NodeReplicas<Vocab> &replicas,
+           unsigned num_threads, double seconds) {
+  std::atomic<uint64_t> lookups{0}, found{0};
+  std::atomic<unsigned> ready{0};
+  std::atomic<bool> start{false}, stop{false};
+  std::vector<std::thread> threads;
+  for (unsigned i = 0; i < num_threads; ++i) {
+    threads.emplace_back([&, i]() {
+      const size_t node = topology.NodeOf(i);
+      if (pin)
+        pin_thread_cpu(topology.CpuOf(i));
+      else if (mode == NumaMode::Replicate)
+        pin_thread_node(topology.Nodes()[node]);
+      const Vocab &vocab =
+          mode == NumaMode::Replicate ? replicas.Get(node) : shared;
+      // 键样本在线程内复制, 只测量词汇表本身的访问
+      Keys keys = sample_keys(vocab, i);
+      ready++;
+      while (!start.load())
+        std::this_thread::yield();
+      uint64_t count = 0, hits = 0;
+      size_t t = 0, p = 0;
+      while (!stop.load(std::memory_order_relaxed)) {
+        for (int k = 0; k < 256; ++k) {
+          hits += vocab.token.count(keys.tokens[t]);
+          t = t + 1 == keys.tokens.size() ? 0 : t + 1;
+          hits += vocab.token.count(keys.tokens[t]);
+          t = t + 1 == keys.tokens.size() ? 0 : t + 1;
+          hits += vocab.path.count(keys.paths[p]);
+          p = p + 1 == keys.paths.size() ? 0 : p + 1;
+        }
+        count += 3 * 256;
+      }
+      lookups += count;
+      found += hits;
+    });
+  }
+  while (ready.load() != num_threads)
+    std::this_thread::yield();
+  auto begin = std::chrono::steady_clock::now();
+  start = true;
+  std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+  stop = true;
+  for (auto &t : threads)
+    t.join();
+  double elapsed = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - begin)
+                       .count();
+  if (found.load() != lookups.load())
+    std::cerr << "查询结果不一致: " << found << "/" << lookups << "\n";
+  return lookups.load() / elapsed;
+}
+
+std::vector<unsigned> parse_counts(const std::string &value) {
+  std::vector<unsigned> counts;
+  size_t begin = 0;
+  while (begin < value.size()) {
+    size_t end = std::min(value.find(',', begin), value.size());
+    counts.push_back(
+        std::max(1ul, std::stoul(value.substr(begin, end - begin))));
+    begin = end + 1;
+  }
+  return counts;
+}
+
+int main(int argc, char **argv) {
+  std::vector<std::string> positional;
+  std::vector<unsigned> thread_counts;
+  std::vector<NumaMode> modes = {NumaMode::Off, NumaMode::Interleave,
+                                 NumaMode::Replicate};
+  double seconds = 2;
+  bool pin = false;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i], value;
+    if (Cli::MatchOption(arg, "--threads", value)) {
+      thread_counts = parse_counts(value);
+    } else if (Cli::MatchOption(arg, "--seconds", value)) {
+      seconds = std::stod(value);
+    } else if (Cli::MatchOption(arg, "--numa", value)) {
+      bool ok;
+      modes = {NumaTopology::ParseMode(value, ok)};
+      if (!ok) {
+        std::cerr << "未知的 NUMA 模式: " << value << "\n";
+        return 1;
+      }
+    } else if (arg == "--pin-threads") {
+      pin = true;
+    } else {
+      positional.push_back(arg);
+    }
+  }
+  if (positional.size() != 1) {
+    std::cerr << "用法: " << argv[0]
+              << " <词汇表目录> [--threads=N[,N...]] [--seconds=S]"
+                 " [--numa=off|interleave|replicate] [--pin-threads]\n";
+    return 1;
+  }
+
+  NumaTopology topology;
+  topology.Load();
+  size_t cpu_count = 0;
+  for (const NumaNode &node : topology.Nodes())
+    cpu_count += node.cpus.size();
+  if (thread_counts.empty()) {
+    // 默认从单线程倍增到全部CPU
+    for (unsigned n = 1; n < cpu_count; n *= 2)
+      thread_counts.push_back(n);
+    thread_counts.push_back(static_cast<unsigned>(cpu_count));
+  }
+  std::clog << topology.NodeCount() << "个 NUMA 节点, " << cpu_count
+            << "个CPU" << std::endl;
+
+  for (NumaMode mode : modes) {
+    Vocab vocab;
+    NodeReplicas<Vocab> replicas;
+    if (mode == NumaMode::Interleave)
+      set_memory_interleave(topology.Nodes());
+    vocab.Load(positional[0]);
+    if (mode == NumaMode::Interleave)
+      reset_memory_policy();
+    if (vocab.token.empty() || vocab.path.empty()) {
+      std::cerr << "词汇表为空: " << positional[0] << "\n";
+      return 1;
+    }
+    if (mode == NumaMode::Replicate)
+      replicas.Build(topology, vocab);
+    double single = 0;
+    for (unsigned n : thread_counts) {
+      double rate = run(topology, mode, pin, vocab, replicas, n, seconds);
+      if (single == 0)
+        single = rate / n;
+      std::cout << NumaTopology::ModeName(mode) << (pin ? "+pin" : "")
+                << " threads=" << n << ": " << rate << " 次/s, 每线程 "
+                << rate / n << " 次/s, 扩展效率 " << rate / n / single
+                << std::endl;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,604 @@
+#include "vocab_extractor.h"
+#include "astcache.h"
+#include "chunkpool.h"
+#include "perfcount.h"
+#include "randomwalk.h"
+#include "stats.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+namespace utils {
+bool is_leaf(TSNode node) { return ts_node_named_child_count(node) == 0; }
+bool is_comment(TSNode node) {
+  return std::string(ts_node_type(node)) == "comment";
+}
+bool is_line_comment(TSNode node) {
+  return std::string(ts_node_type(node)) == "line_comment";
+}
+bool is_block_comment(TSNode node) {
+  return std::string(ts_node_type(node)) == "block_comment";
+}
+bool is_whitespace(TSNode node) {
+  std::string type = ts_node_type(node);
+  return type.find("whitespace") != std::string::npos ||
+         type.find("newline") != std::string::npos;
+}
+} // namespace utils
+
+bool isRealNode(TSNode node) {
+  return (!ts_node_is_null(node) && utils::is_leaf(node) &&
+          !utils::is_comment(node) && !utils::is_line_comment(node) &&
+          !utils::is_block_comment(node) && !utils::is_whitespace(node) &&
+          !ts_node_is_error(node));
+}
+
+void traverse_ast(TSNode node, const std::function<void(TSNode)> &callback) {
+  callback(node);
+  uint32_t child_count = ts_node_named_child_count(node);
+  for (uint32_t i = 0; i < child_count; ++i) {
+    TSNode child = ts_node_named_child(node, i);
+    traverse_ast(child, callback);
+  }
+}
+
+void cleanNodeType(std::string &type) {
+  type.erase(std::remove_if(type.begin(), type.end(),
+                            [](unsigned char c) { return std::isspace(c); }),
+             type.end());
+  std::replace(type.begin(), type.end(), '_', '|');
+}
+
+std::string node_type_to_string(TSNode node) {
+  if (ts_node_is_null(node))
+    return "null";
+  std::string tmp = ts_node_type(node);
+  cleanNodeType(tmp);
+  return tmp;
+}
+
+TSNode find_lca(TSNode source, TSNode target) {
+  std::vector<TSNode> path1, path2;
+  TSNode current = source;
+  if (ts_node_eq(source, target))
+    return source;
+  while (!ts_node_is_null(current)) {
+    path1.emplace_back(current);
+    current = ts_node_parent(current);
+  }
+  current = target;
+  while (!ts_node_is_null(current)) {
+    path2.emplace_back(current);
+    current = ts_node_parent(current);
+  }
+  TSNode lca = TSNode{};
+  int i = path1.size() - 1, j = path2.size() - 1;
+  while (i >= 0 && j >= 0 && ts_node_eq(path1[i], path2[j])) {
+    lca = path1[i];
+    i--;
+    j--;
+  }
+  return lca;
+}
+
+SourceLang lang_for_path(const std::filesystem::path &file_path) {
+  return file_path.extension() == ".c" ? SourceLang::C : SourceLang::Cpp;
+}
+
+TSParser *thread_parser(SourceLang lang) {
+  struct ParserPair {
+    TSParser *parsers[2] = {nullptr, nullptr};
+    ~ParserPair() {
+      for (TSParser *parser : parsers)
+        if (parser != nullptr)
+          ts_parser_delete(parser);
+    }
+  };
+  thread_local ParserPair pair;
+  TSParser *&parser = pair.parsers[static_cast<int>(lang)];
+  if (parser == nullptr) {
+    parser = ts_parser_new();
+    ts_parser_set_language(parser, lang == SourceLang::C ? tree_sitter_c()
+                                                         : tree_sitter_cpp());
+  }
+  return parser;
+}
+
+namespace {
+/**
+ * @brief 函数定义相关的符号与字段ID, 每种语言查找一次
+ */
+struct FunctionSymbols {
+  TSSymbol definition;
+  TSSymbol declarator_symbol; // function_declarator
+  TSFieldId declarator;
+  TSFieldId name;
+
+  explicit FunctionSymbols(const TSLanguage *language) {
+    auto symbol = [&](const char *type) {
+      return ts_language_symbol_for_name(language, type, std::strlen(type),
+                                         true);
+    };
+    auto field = [&](const char *field_name) {
+      return ts_language_field_id_for_name(language, field_name,
+                                           std::strlen(field_name));
+    };
+    definition = symbol("function_definition");
+    declarator_symbol = symbol("function_declarator");
+    declarator = field("declarator");
+    name = field("name");
+  }
+};
+
+const FunctionSymbols &function_symbols(const TSLanguage *language) {
+  static const FunctionSymbols c_symbols(tree_sitter_c());
+  static const FunctionSymbols cpp_symbols(tree_sitter_cpp());
+  return language == tree_sitter_c() ? c_symbols : cpp_symbols;
+}
+
+/**
+ * @brief 取函数定义的函数名节点, 穿过指针/引用声明符与限定名
+ */
+TSNode function_name(TSNode definition, const FunctionSymbols &symbols) {
+  TSNode node = ts_node_child_by_field_id(definition, symbols.declarator);
+  while (!ts_node_is_null(node) &&
+         ts_node_symbol(node) != symbols.declarator_symbol) {
+    TSNode next = ts_node_child_by_field_id(node, symbols.declarator);
+    // reference_declarator 没有 declarator 字段, 声明符是最后一个具名子节点
+    uint32_t count = ts_node_named_child_count(node);
+    if (ts_node_is_null(next) && count != 0)
+      next = ts_node_named_child(node, count - 1);
+    node = next;
+  }
+  if (ts_node_is_null(node))
+    return node;
+  node = ts_node_child_by_field_id(node, symbols.declarator);
+  // qualified_identifier / template_function 的 name 字段
+  while (!ts_node_is_null(node)) {
+    TSNode inner = ts_node_child_by_field_id(node, symbols.name);
+    if (ts_node_is_null(inner))
+      break;
+    node = inner;
+  }
+  return node;
+}
+} // namespace
+
+void find_functions(TSNode root, std::string_view source,
+                    std::vector<FunctionUnit> &functions) {
+  functions.clear();
+  const FunctionSymbols &symbols = function_symbols(ts_node_language(root));
+  TSTreeCursor cursor = ts_tree_cursor_new(root);
+  bool descend = true;
+  while (true) {
+    if (descend) {
+      TSNode node = ts_tree_cursor_current_node(&cursor);
+      if (ts_node_symbol(node) == symbols.definition) {
+        // 不进入函数体, 局部类中的成员函数随外层函数一起抽取
+        TSNode name = function_name(node, symbols);
+        if (!ts_node_is_null(name)) {
+          FunctionUnit unit{node, 0, ""};
+          uint32_t start = ts_node_start_byte(name);
+          unit.label = std::string(
+              source.substr(start, ts_node_end_byte(name) - start));
+          cleanNodeType(unit.label);
+          // destructor_name 等非叶节点遮蔽其最后一个叶节点
+          while (ts_node_named_child_count(name) != 0)
+            name = ts_node_named_child(name,
+                                       ts_node_named_child_count(name) - 1);
+          unit.name_byte = ts_node_start_byte(name);
+          if (!unit.label.empty())
+            functions.push_back(std::move(unit));
+        }
+      } else if (ts_tree_cursor_goto_first_child(&cursor)) {
+        continue;
+      }
+    }
+    if (ts_tree_cursor_goto_next_sibling(&cursor)) {
+      descend = true;
+      continue;
+    }
+    if (!ts_tree_cursor_goto_parent(&cursor))
+      break;
+    descend = false;
+  }
+  ts_tree_cursor_delete(&cursor);
+}
+
+/**
+ * @brief 叶节点对按起点下标 i 分块采样, 小文件或未给出共享池时在本线程一次完成
+ * 各块的种子在调度前按顺序从 gen 抽取, 结果按块顺序合并, 与线程数无关
+ */
+template <typename Range>
+static void sample_chunked(std::mt19937 &gen, const ExtractOptions &options,
+                           int leaves_count, std::vector<PathContext> &contexts,
+                           const Range &range) {
+  size_t chunk = options.chunk_leaves;
+  if (options.pool == nullptr || chunk == 0 ||
+      static_cast<size_t>(leaves_count) <= chunk) {
+    range(gen, 0, leaves_count, contexts);
+    return;
+  }
+  size_t chunks = (leaves_count + chunk - 1) / chunk;
+  std::vector<uint32_t> seeds(chunks);
+  for (uint32_t &seed : seeds)
+    seed = static_cast<uint32_t>(gen());
+  std::vector<std::vector<PathContext>> parts(chunks);
+  options.pool->Run(chunks, [&](size_t c) {
+    std::mt19937 chunk_gen(seeds[c]);
+    int begin = static_cast<int>(c * chunk);
+    int end = std::min(leaves_count, static_cast<int>((c + 1) * chunk));
+    range(chunk_gen, begin, end, parts[c]);
+  });
+  for (const auto &part : parts)
+    contexts.insert(contexts.end(), part.begin(), part.end());
+}
+
+ExtractStatus lca_path_traverse(const Vocab &vocab, TSNode root,
+                                std::string_view source, std::mt19937 &gen,
+                                const ExtractOptions &options,
+                                std::vector<PathContext> &contexts) {
+  StageClock clock;
+  PerfScope traverse_perf(PerfRegion::Traverse);
+  const size_t first_context = contexts.size();
+  std::vector<TSNode> leaves;
+  size_t leaves_seen = 0;
+  traverse_ast(root, [&](TSNode node) {
+    if (isRealNode(node) && !ts_node_eq(node, root) &&
+        (options.max_leaves == 0 || ++leaves_seen <= options.max_leaves))
+      leaves.emplace_back(node);
+  });
+  clock.Lap(Stage::LeafCollect);
+  if (options.max_leaves != 0 && leaves_seen > options.max_leaves)
+    return ExtractStatus::OverLimit;
+
+  int leaves_count = leaves.size();
+  if (leaves_count < 2)
+    return ExtractStatus::TooFewLeaves;
+
+  // 叶节点对按起点下标分块, 大文件的各块可在共享池中并行
+  auto range = [&](std::mt19937 &range_gen, int begin, int end,
+                   std::vector<PathContext> &out) {
+    StageClock clock;
+    std::uniform_int_distribution<int> isGen(0, 1);
+    std::uniform_real_distribution<double> keep(0.0, 1.0);
+    // 被采样丢弃的叶节点对不计时, 其耗时并入下一个保留对的采样阶段
+    uint64_t sampled = 0;
+    for (int i = begin; i < end; i++) {
+      for (int j = i + 1; j < std::min(leaves_count, i + options.path_width);
+           j++) {
+        sampled++;
+        if (isGen(range_gen) == 0 ||
+            (options.keep_rate < 1.0 && keep(range_gen) >= options.keep_rate))
+          continue;
+        clock.Lap(Stage::PairSample, sampled);
+        sampled = 0;
+        bool perf_pair = Perf::SamplePair();
+        PerfScope path_perf(PerfRegion::PathBuild, perf_pair);
+
+        TSNode node1 = leaves[i];
+        TSNode node2 = leaves[j];
+
+        TSNode lca = find_lca(node1, node2);
+        std::vector<TSNode> path;
+        TSNode current = node1;
+        while (!ts_node_eq(current, lca)) {
+          if (ts_node_is_named(current) && !ts_node_is_error(current))
+            path.push_back(current);
+          current = ts_node_parent(current);
+        }
+
+        std::vector<TSNode> rpath;
+        current = node2;
+        while (!ts_node_eq(current, lca)) {
+          if (ts_node_is_named(current) && !ts_node_is_error(current))
+            rpath.push_back(current);
+          current = ts_node_parent(current);
+        }
+
+        path.insert(path.end(), rpath.rbegin(), rpath.rend());
+        path_perf.Stop();
+        clock.Lap(Stage::PathBuild);
+
+        PerfScope vocab_perf(PerfRegion::VocabLookup, perf_pair);
+        std::string token1, token2;
+        PathContext context{0, 0, 0};
+        std::vector<unsigned int> path_int;
+        for (auto it = path.begin(); it != path.end(); ++it) {
+          TSNode node = *it;
+          if (it == path.begin()) {
+            token1 = source.substr(ts_node_start_byte(node),
+                                   ts_node_end_byte(node) -
+                                       ts_node_start_byte(node));
+            cleanNodeType(token1);
+            auto it1 = vocab.token.find(token1);
+            context.token1 = (it1 != vocab.token.end()) ? it1->second : 0;
+            if (ts_node_start_byte(node) == options.mask_byte)
+              context.token1 = options.mask_token;
+          }
+
+          std::string tmp = node_type_to_string(node);
+          auto type_it = vocab.type.find(tmp);
+          unsigned int type_id =
+              (type_it != vocab.type.end()) ? type_it->second : 0;
+          path_int.push_back(type_id);
+
+          if (it == path.end() - 1) {
+            token2 = source.substr(ts_node_start_byte(node),
+                                   ts_node_end_byte(node) -
+                                       ts_node_start_byte(node));
+            cleanNodeType(token2);
+            auto it2 = vocab.token.find(token2);
+            context.token2 = (it2 != vocab.token.end()) ? it2->second : 0;
+            if (ts_node_start_byte(node) == options.mask_byte)
+              context.token2 = options.mask_token;
+
+            auto path_it = vocab.path.find(path_int);
+            context.path = (path_it != vocab.path.end()) ? path_it->second : 0;
+          }
+        }
+        out.push_back(context);
+        vocab_perf.Stop();
+        clock.Lap(Stage::VocabLookup);
+      }
+    }
+    if (sampled != 0)
+      clock.Lap(Stage::PairSample, sampled);
+  };
+  sample_chunked(gen, options, leaves_count, contexts, range);
+  traverse_perf.Stop(contexts.size() - first_context);
+  return ExtractStatus::Ok;
+}
+
+std::vector<uint32_t> flat_type_ids(const Vocab &vocab,
+                                    const std::vector<std::string> &names) {
+  std::vector<uint32_t> ids(names.size(), 0);
+  for (size_t i = 0; i < names.size(); ++i) {
+    auto it = vocab.type.find(names[i]);
+    if (it != vocab.type.end())
+      ids[i] = it->second;
+  }
+  return ids;
+}
+
+ExtractStatus lca_path_traverse(const Vocab &vocab, const FlatAst &ast,
+                                const std::vector<uint32_t> &type_ids,
+                                std::mt19937 &gen,
+                                const ExtractOptions &options,
+                                std::vector<PathContext> &contexts) {
+  StageClock clock;
+  PerfScope traverse_perf(PerfRegion::Traverse);
+  const size_t first_context = contexts.size();
+  if (options.max_leaves != 0 && ast.leaf_count > options.max_leaves)
+    return ExtractStatus::OverLimit;
+  int leaves_count = static_cast<int>(ast.leaf_count);
+  if (leaves_count < 2)
+    return ExtractStatus::TooFewLeaves;
+  clock.Lap(Stage::LeafCollect);
+
+  const FlatNode *nodes = ast.nodes;
+  auto type_id = [&](uint32_t index) -> uint32_t {
+    uint16_t type = nodes[index].type;
+    return type < type_ids.size() ? type_ids[type] : 0;
+  };
+  auto token_id = [&](uint32_t index) -> uint32_t {
+    const FlatNode &node = nodes[index];
+    if (node.start == options.mask_byte)
+      return options.mask_token;
+    std::string token(ast.source.substr(node.start, node.end - node.start));
+    cleanNodeType(token);
+    auto it = vocab.token.find(token);
+    return it != vocab.token.end() ? it->second : 0;
+  };
+
+  auto range = [&](std::mt19937 &range_gen, int begin, int end,
+                   std::vector<PathContext> &out) {
+    StageClock clock;
+    std::uniform_int_distribution<int> isGen(0, 1);
+    std::uniform_real_distribution<double> keep(0.0, 1.0);
+    std::vector<unsigned int> path_int;
+    std::vector<unsigned int> rpath;
+    uint64_t sampled = 0;
+    for (int i = begin; i < end; i++) {
+      for (int j = i + 1; j < std::min(leaves_count, i + options.path_width);
+           j++) {
+        sampled++;
+        if (isGen(range_gen) == 0 ||
+            (options.keep_rate < 1.0 && keep(range_gen) >= options.keep_rate))
+          continue;
+        clock.Lap(Stage::PairSample, sampled);
+        sampled = 0;
+        bool perf_pair = Perf::SamplePair();
+        PerfScope path_perf(PerfRegion::PathBuild, perf_pair);
+
+        // 按深度对齐后同步上溯求 LCA, 路径不含 LCA 与 ERROR 节点
+        uint32_t a = ast.leaves[i], b = ast.leaves[j];
+        path_int.clear();
+        rpath.clear();
+        while (nodes[a].depth > nodes[b].depth) {
+          if (nodes[a].type != FLAT_ERROR_TYPE)
+            path_int.push_back(type_id(a));
+          a = nodes[a].parent;
+        }
+        while (nodes[b].depth > nodes[a].depth) {
+          if (nodes[b].type != FLAT_ERROR_TYPE)
+            rpath.push_back(type_id(b));
+          b = nodes[b].parent;
+        }
+        while (a != b) {
+          if (nodes[a].type != FLAT_ERROR_TYPE)
+            path_int.push_back(type_id(a));
+          if (nodes[b].type != FLAT_ERROR_TYPE)
+            rpath.push_back(type_id(b));
+          a = nodes[a].parent;
+          b = nodes[b].parent;
+        }
+        path_int.insert(path_int.end(), rpath.rbegin(), rpath.rend());
+        path_perf.Stop();
+        clock.Lap(Stage::PathBuild);
+
+        PerfScope vocab_perf(PerfRegion::VocabLookup, perf_pair);
+        PathContext context{0, 0, 0};
+        context.token1 = token_id(ast.leaves[i]);
+        context.token2 = token_id(ast.leaves[j]);
+        auto path_it = vocab.path.find(path_int);
+        context.path = (path_it != vocab.path.end()) ? path_it->second : 0;
+        out.push_back(context);
+        vocab_perf.Stop();
+        clock.Lap(Stage::VocabLookup);
+      }
+    }
+    if (sampled != 0)
+      clock.Lap(Stage::PairSample, sampled);
+  };
+  sample_chunked(gen, options, leaves_count, contexts, range);
+  traverse_perf.Stop(contexts.size() - first_context);
+  return ExtractStatus::Ok;
+}
+
+ExtractStatus random_walk_traverse(const Vocab &vocab, const FlatAst &ast,
+                                   const std::vector<uint32_t> &type_ids,
+                                   std::mt19937 &gen,
+                                   const ExtractOptions &options,
+                                   const WalkOptions &walk,
+                                   std::vector<PathContext> &contexts) {
+  StageClock clock;
+  PerfScope traverse_perf(PerfRegion::Traverse);
+  const size_t first_context = contexts.size();
+  if (options.max_leaves != 0 && ast.leaf_count > options.max_leaves)
+    return ExtractStatus::OverLimit;
+  if (ast.leaf_count < 2)
+    return ExtractStatus::TooFewLeaves;
+  thread_local RandomWalker walker;
+  walker.Prepare(ast.nodes, ast.node_count, ast.leaves, ast.leaf_count);
+  clock.Lap(Stage::LeafCollect);
+
+  const FlatNode *nodes = ast.nodes;
+  auto token_id = [&](uint32_t index) -> uint32_t {
+    const FlatNode &node = nodes[index];
+    if (node.start == options.mask_byte)
+      return options.mask_token;
+    thread_local std::string token;
+    token.assign(ast.source.substr(node.start, node.end - node.start));
+    cleanNodeType(token);
+    auto it = vocab.token.find(token);
+    return it != vocab.token.end() ? it->second : 0;
+  };
+  std::uniform_real_distribution<double> keep(0.0, 1.0);
+  thread_local std::vector<unsigned int> path_int;
+  walker.Walk(gen, walk, [&](const uint32_t *path, size_t length) {
+    if (options.keep_rate < 1.0 && keep(gen) >= options.keep_rate)
+      return;
+    path_int.clear();
+    for (size_t k = 0; k < length; ++k) {
+      uint16_t type = nodes[path[k]].type;
+      if (type != FLAT_ERROR_TYPE)
+        path_int.push_back(type < type_ids.size() ? type_ids[type] : 0);
+    }
+    PathContext context{0, 0, 0};
+    context.token1 = token_id(path[0]);
+    context.token2 = token_id(path[length - 1]);
+    auto path_it = vocab.path.find(path_int);
+    context.path = (path_it != vocab.path.end()) ? path_it->second : 0;
+    contexts.push_back(context);
+  });
+  clock.Lap(Stage::PathBuild);
+  traverse_perf.Stop(contexts.size() - first_context);
+  return ExtractStatus::Ok;
+}
+
+void ContextSet::Reserve(size_t n) {
+  // 装载因子不超过 1/2
+  size_t capacity = 64;
+  while (capacity < n * 2)
+    capacity <<= 1;
+  if (capacity > slots_.size()) {
+    slots_.assign(capacity, 0);
+    epochs_.assign(capacity, 0);
+    epoch_ = 0;
+  }
+  if (++epoch_ == 0) {
+    // 轮次回绕时真正清空一次
+    std::fill(epochs_.begin(), epochs_.end(), 0);
+    epoch_ = 1;
+  }
+}
+
+void ContextSet::Compact(std::vector<PathContext> &contexts,
+                         std::vector<uint32_t> &counts) {
+  counts.clear();
+  if (contexts.empty())
+    return;
+  Reserve(contexts.size());
+  const size_t mask = slots_.size() - 1;
+  size_t unique = 0;
+  for (size_t i = 0; i < contexts.size(); ++i) {
+    const PathContext context = contexts[i];
+    uint64_t h = (static_cast<uint64_t>(context.token1) << 32 | context.path) *
+                     0x9e3779b97f4a7c15ULL ^
+                 context.token2 * 0xc2b2ae3d27d4eb4fULL;
+    size_t slot = (h ^ (h >> 29)) & mask;
+    while (true) {
+      if (epochs_[slot] != epoch_) {
+        epochs_[slot] = epoch_;
+        slots_[slot] = static_cast<uint32_t>(unique);
+        contexts[unique++] = context;
+        counts.push_back(1);
+        break;
+      }
+      const PathContext &seen = contexts[slots_[slot]];
+      if (seen.token1 == context.token1 && seen.path == context.path &&
+          seen.token2 == context.token2) {
+        counts[slots_[slot]]++;
+        break;
+      }
+      slot = (slot + 1) & mask;
+    }
+  }
+  contexts.resize(unique);
+}
+
+static void load_token_vocab(Vocab &vocab,
+                             const std::filesystem::path &file_path) {
+  std::ifstream infile(file_path);
+  std::string token;
+  unsigned int id;
+  while (infile >> token >> id)
+    vocab.token[token] = id;
+}
+
+static void load_type_vocab(Vocab &vocab,
+                            const std::filesystem::path &file_path) {
+  std::ifstream infile(file_path);
+  std::string type;
+  unsigned int id;
+  while (infile >> type >> id)
+    vocab.type[type] = id;
+}
+
+static void load_path_vocab(Vocab &vocab,
+                            const std::filesystem::path &file_path) {
+  std::ifstream infile(file_path);
+  std::string line;
+  while (std::getline(infile, line)) {
+    std::stringstream ss(line);
+    std::vector<unsigned int> path_vec;
+    std::string part;
+    // Parse all parts except the last one (ID)
+    while (std::getline(ss, part, ',')) {
+      part.erase(part.find_last_not_of(" \t") + 1); // Trim trailing spaces
+      if (ss.peek() == EOF) {                       // Last part is the ID
+        vocab.path[path_vec] = std::stoi(part);
+        break;
+      }
+      path_vec.push_back(std::stoi(part));
+    }
+  }
+}
+
+void Vocab::Load(const std::filesystem::path &vocab_dir) {
+  load_token_vocab(*this, vocab_dir / "token_vocab.txt");
+  load_type_vocab(*this, vocab_dir / "type_vocab.txt");
+  load_path_vocab(*this, vocab_dir / "path_vocab.txt");
+}
@@ -0,0 +1,137 @@
+#ifndef __HAS_VOCAB_EXTRACTOR__
+#define __HAS_VOCAB_EXTRACTOR__
+#include "pathcontext.h"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <tree_sitter/api.h>
+#include <unordered_map>
+#include <vector>
+
+extern "C" TSLanguage *tree_sitter_c();
+extern "C" TSLanguage *tree_sitter_cpp();
+
+struct VectorHash {
+  template <typename T> size_t operator()(const std::vector<T> &vec) const {
+    return std::hash<std::string>()(std::string(vec.begin(), vec.end()));
+  }
+};
+
+/**
+ * @brief 由 astparser_mulitthread 生成的只读词汇表
+ */
+struct Vocab {
+  std::unordered_map<std::string, unsigned int> token;
+  std::unordered_map<std::string, unsigned int> type;
+  std::unordered_map<std::vector<unsigned int>, unsigned int, VectorHash> path;
+  // 从 vocab_dir 下的 token/type/path_vocab.txt 加载
+  void Load(const std::filesystem::path &vocab_dir);
+};
+
+/**
+ * @brief 单文件内的路径上下文去重, 开放寻址 + 线性探测
+ * 槽位以轮次标记清空, 跨文件复用时无需重新分配或清零
+ */
+class ContextSet {
+public:
+  // 原地压缩 contexts, 保留首次出现的顺序, counts[i] 为第 i 个三元组的出现次数
+  void Compact(std::vector<PathContext> &contexts,
+               std::vector<uint32_t> &counts);
+
+private:
+  void Reserve(size_t n);
+  std::vector<uint32_t> slots_;  // 压缩后下标
+  std::vector<uint32_t> epochs_; // 槽位所属轮次, 与 epoch_ 不等即为空
+  uint32_t epoch_ = 0;
+};
+
+class ChunkPool;
+
+struct ExtractOptions {
+  int path_width = 200;      // 叶节点对的最大下标间距
+  size_t max_leaves = 0;     // 叶节点上限, 0 不限制
+  double keep_rate = 1.0;    // 叶节点对的额外保留率
+  ChunkPool *pool = nullptr; // 非空时大文件的叶节点对分块提交到共享池
+  size_t chunk_leaves = 0;   // 每块的叶节点数, 0 不分块
+  // 起始于 mask_byte 的叶节点以 mask_token 代替, 用于遮蔽函数名
+  uint32_t mask_byte = UINT32_MAX;
+  uint32_t mask_token = 0;
+};
+
+enum class ExtractStatus { Ok, TooFewLeaves, OverLimit };
+
+enum class SourceLang : uint8_t { C = 0, Cpp = 1 };
+
+namespace utils {
+bool is_leaf(TSNode node);
+bool is_comment(TSNode node);
+bool is_line_comment(TSNode node);
+bool is_block_comment(TSNode node);
+bool is_whitespace(TSNode node);
+} // namespace utils
+
+bool isRealNode(TSNode node);
+void traverse_ast(TSNode node, const std::function<void(TSNode)> &callback);
+void cleanNodeType(std::string &type);
+std::string node_type_to_string(TSNode node);
+TSNode find_lca(TSNode source, TSNode target);
+
+SourceLang lang_for_path(const std::filesystem::path &file_path);
+/**
+ * @brief 当前线程常驻的解析器, 每种语言一个, 首次调用时创建
+ */
+TSParser *thread_parser(SourceLang lang);
+
+/**
+ * @brief 函数级抽取的单位: 一个函数定义, 以函数名为样本标签
+ */
+struct FunctionUnit {
+  TSNode node;        // function_definition
+  uint32_t name_byte; // 函数名叶节点的起始字节, 抽取时遮蔽
+  std::string label;  // 清理后的函数名
+};
+/**
+ * @brief 按符号ID查找 root 下的函数定义, 不进入函数体内部
+ */
+void find_functions(TSNode root, std::string_view source,
+                    std::vector<FunctionUnit> &functions);
+
+/**
+ * @brief lca path extractor, 结果追加到 contexts
+ */
+ExtractStatus lca_path_traverse(const Vocab &vocab, TSNode root,
+                                std::string_view source, std::mt19937 &gen,
+                                const ExtractOptions &options,
+                                std::vector<PathContext> &contexts);
+struct FlatAst;
+/**
+ * @brief 扁平语法树 (astcache.h) 上的 lca path extractor
+ * 叶节点顺序与随机数消耗和 TSNode 版本相同, 同一种子得到相同结果
+ * @param type_ids 符号 -> 类型词汇表ID, 由 flat_type_ids 生成
+ */
+ExtractStatus lca_path_traverse(const Vocab &vocab, const FlatAst &ast,
+                                const std::vector<uint32_t> &type_ids,
+                                std::mt19937 &gen,
+                                const ExtractOptions &options,
+                                std::vector<PathContext> &contexts);
+struct WalkOptions;
+/**
+ * @brief 扁平语法树上的随机游走抽取 (randomwalk.h), 每条到达另一叶节点的
+ * 游走产生一个上下文, 路径为途经节点 (含两端, 不含 ERROR) 的类型ID序列;
+ * keep_rate 作为每条游走的保留率, 不使用 path_width 与分块
+ */
+ExtractStatus random_walk_traverse(const Vocab &vocab, const FlatAst &ast,
+                                   const std::vector<uint32_t> &type_ids,
+                                   std::mt19937 &gen,
+                                   const ExtractOptions &options,
+                                   const WalkOptions &walk,
+                                   std::vector<PathContext> &contexts);
+// 把缓存中的类型名表一次性映射为类型词汇表ID, 未登录为 0
+std::vector<uint32_t> flat_type_ids(const Vocab &vocab,
+                                    const std::vector<std::string> &names);
+
+#endif // !__HAS_VOCAB_EXTRACTOR__
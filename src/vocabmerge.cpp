@@ -0,0 +1,266 @@
+#include "cli.h"
+#include "vocab_extractor.h"
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * 合并 astparser_mulitthread --shard=i/N 生成的分片:
+ *   各分片目录含 token/type/path_vocab.txt、对应的 *_freq.txt 与 contexts.txt,
+ *   其中的ID只在分片内有效
+ *   第一遍按键累计各分片的出现次数, 按次数降序分配全局ID (1 起, 0 为未登录),
+ *   路径以节点类型名序列为键, 与分片内的类型ID无关
+ *   第二遍逐个分片建立 局部ID -> 全局ID 的映射, 流式改写 contexts.txt 到标准输出
+ * 输出目录得到的词汇表与频次文件格式与分片相同, 可再次参与合并
+ */
+
+using FreqTable = std::unordered_map<std::string, uint64_t>;
+
+/**
+ * @brief 读取 "ID 出现次数" 文件, 缺失的ID次数为 0
+ */
+std::vector<uint64_t> load_freq(const std::filesystem::path &file_path) {
+  std::vector<uint64_t> freq;
+  std::ifstream infile(file_path);
+  uint64_t id, count;
+  while (infile >> id >> count) {
+    if (id >= freq.size())
+      freq.resize(id + 1);
+    freq[id] = count;
+  }
+  return freq;
+}
+
+uint64_t freq_of(const std::vector<uint64_t> &freq, unsigned int id) {
+  return id < freq.size() ? freq[id] : 0;
+}
+
+/**
+ * @brief 分片内的 类型ID -> 类型名
+ */
+std::vector<std::string> type_names(const Vocab &vocab) {
+  std::vector<std::string> names;
+  for (const auto &entry : vocab.type) {
+    if (entry.second >= names.size())
+      names.resize(entry.second + 1);
+    names[entry.second] = entry.first;
+  }
+  return names;
+}
+
+/**
+ * @brief 路径的跨分片键: 以空格连接的类型名 (清理后的类型名不含空白)
+ */
+std::string path_key(const std::vector<unsigned int> &path,
+                     const std::vector<std::string> &names) {
+  std::string key;
+  for (unsigned int type : path) {
+    if (!key.empty())
+      key += ' ';
+    key += type < names.size() ? names[type] : std::string();
+  }
+  return key;
+}
+
+/**
+ * @brief 按次数降序、键升序分配全局ID, 次数低于 min_count 的键不分配
+ */
+std::unordered_map<std::string, unsigned int>
+assign_ids(const FreqTable &table, uint64_t min_count,
+           std::vector<std::pair<std::string, uint64_t>> &sorted) {
+  sorted.assign(table.begin(), table.end());
+  sorted.erase(std::remove_if(sorted.begin(), sorted.end(),
+                              [&](const auto &entry) {
+                                return entry.second < min_count;
+                              }),
+               sorted.end());
+  std::sort(sorted.begin(), sorted.end(), [](const auto &a, const auto &b) {
+    return a.second != b.second ? a.second > b.second : a.first < b.first;
+  });
+  std::unordered_map<std::string, unsigned int> ids;
+  ids.reserve(sorted.size());
+  for (size_t i = 0; i < sorted.size(); ++i)
+    ids.emplace(sorted[i].first, static_cast<unsigned int>(i + 1));
+  return ids;
+}
+
+/**
+ * @brief 局部ID -> 全局ID, 未分配的键映射为 0
+ */
+template <typename Map, typename KeyOf>
+std::vector<unsigned int>
+remap_table(const Map &local, const std::unordered_map<std::string,
+                                                       unsigned int> &global,
+            const KeyOf &key_of) {
+  std::vector<unsigned int> remap;
+  for (const auto &entry : local) {
+    if (entry.second >= remap.size())
+      remap.resize(entry.second + 1, 0);
+    auto it = global.find(key_of(entry.first));
+    remap[entry.second] = it != global.end() ? it->second : 0;
+  }
+  return remap;
+}
+
+/**
+ * @brief 改写一行 "名称 t1,p,t2[,次数] ...", 次数等其余字段原样保留
+ */
+void remap_line(const std::string &line, const std::vector<unsigned int> *maps,
+                std::string &out) {
+  size_t i = line.find(' ');
+  if (i == std::string::npos) {
+    out += line;
+    return;
+  }
+  out.append(line, 0, i);
+  while (i < line.size()) {
+    if (line[i] == ' ') {
+      out += ' ';
+      i++;
+      continue;
+    }
+    // 前三个字段依次为 token / path / token
+    for (int field = 0; i < line.size() && line[i] != ' '; ++field) {
+      if (field != 0) {
+        out += ',';
+        i++; // 跳过 ','
+      }
+      size_t end = line.find_first_of(", ", i);
+      if (end == std::string::npos)
+        end = line.size();
+      if (field < 3 && end > i) {
+        unsigned long id = std::stoul(line.substr(i, end - i));
+        const std::vector<unsigned int> &map = maps[field == 1 ? 1 : 0];
+        out += std::to_string(id < map.size() ? map[id] : 0);
+      } else {
+        out.append(line, i, end - i);
+      }
+      i = end;
+    }
+  }
+}
+
+void write_vocab(const std::filesystem::path &file_path,
+                 const std::vector<std::pair<std::string, uint64_t>> &sorted) {
+  std::ofstream out(file_path);
+  for (size_t i = 0; i < sorted.size(); ++i)
+    out << sorted[i].first << " " << i + 1 << "\n";
+}
+
+void write_freq(const std::filesystem::path &file_path,
+                const std::vector<std::pair<std::string, uint64_t>> &sorted) {
+  std::ofstream out(file_path);
+  for (size_t i = 0; i < sorted.size(); ++i)
+    out << i + 1 << " " << sorted[i].second << "\n";
+}
+
+int main(int argc, char **argv) {
+  std::ios::sync_with_stdio(false);
+  std::vector<std::string> positional;
+  uint64_t min_count = 1;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i], value;
+    if (Cli::MatchOption(arg, "--min-count", value))
+      min_count = std::max(1ul, std::stoul(value));
+    else
+      positional.push_back(arg);
+  }
+  if (positional.size() < 2) {
+    std::cerr << "用法: " << argv[0]
+              << " <输出目录> <分片目录>... [--min-count=N]\n"
+                 "合并后的上下文写到标准输出\n";
+    return 1;
+  }
+  const std::filesystem::path output_dir(positional[0]);
+  const std::vector<std::filesystem::path> shards(positional.begin() + 1,
+                                                  positional.end());
+
+  // 第一遍: 累计出现次数
+  FreqTable tokens, types, paths;
+  for (const auto &dir : shards) {
+    Vocab vocab;
+    vocab.Load(dir);
+    if (vocab.token.empty() && vocab.type.empty()) {
+      std::cerr << "分片词汇表为空: " << dir << "\n";
+      return 1;
+    }
+    std::vector<uint64_t> token_freq = load_freq(dir / "token_freq.txt");
+    std::vector<uint64_t> type_freq = load_freq(dir / "type_freq.txt");
+    std::vector<uint64_t> path_freq = load_freq(dir / "path_freq.txt");
+    for (const auto &entry : vocab.token)
+      tokens[entry.first] += freq_of(token_freq, entry.second);
+    for (const auto &entry : vocab.type)
+      types[entry.first] += freq_of(type_freq, entry.second);
+    std::vector<std::string> names = type_names(vocab);
+    for (const auto &entry : vocab.path)
+      paths[path_key(entry.first, names)] += freq_of(path_freq, entry.second);
+    std::clog << "已读取分片: " << dir << "\n";
+  }
+
+  // 分配全局ID并写出词汇表
+  std::vector<std::pair<std::string, uint64_t>> sorted;
+  std::filesystem::create_directories(output_dir);
+  auto token_ids = assign_ids(tokens, min_count, sorted);
+  write_vocab(output_dir / "token_vocab.txt", sorted);
+  write_freq(output_dir / "token_freq.txt", sorted);
+  // 类型数很少, 全部保留, 以免路径中出现未登录类型
+  auto type_ids = assign_ids(types, 1, sorted);
+  write_vocab(output_dir / "type_vocab.txt", sorted);
+  write_freq(output_dir / "type_freq.txt", sorted);
+  auto path_ids = assign_ids(paths, min_count, sorted);
+  {
+    std::ofstream out(output_dir / "path_vocab.txt");
+    for (size_t i = 0; i < sorted.size(); ++i) {
+      size_t begin = 0;
+      const std::string &key = sorted[i].first;
+      while (begin <= key.size()) {
+        size_t end = std::min(key.find(' ', begin), key.size());
+        auto it = type_ids.find(key.substr(begin, end - begin));
+        out << (it != type_ids.end() ? it->second : 0) << ",";
+        begin = end + 1;
+      }
+      out << " " << i + 1 << "\n";
+    }
+  }
+  write_freq(output_dir / "path_freq.txt", sorted);
+  std::clog << "全局词汇表: token " << token_ids.size() << ", type "
+            << type_ids.size() << ", path " << path_ids.size() << " -> "
+            << output_dir << "\n";
+
+  // 第二遍: 逐个分片改写上下文
+  uint64_t lines = 0;
+  std::string line, out;
+  for (const auto &dir : shards) {
+    Vocab vocab;
+    vocab.Load(dir);
+    std::vector<std::string> names = type_names(vocab);
+    std::vector<unsigned int> maps[2] = {
+        remap_table(vocab.token, token_ids,
+                    [](const std::string &key) { return key; }),
+        remap_table(vocab.path, path_ids,
+                    [&](const std::vector<unsigned int> &key) {
+                      return path_key(key, names);
+                    })};
+    std::ifstream contexts(dir / "contexts.txt");
+    if (!contexts) {
+      std::cerr << "无法读取: " << dir / "contexts.txt" << "\n";
+      return 1;
+    }
+    while (std::getline(contexts, line)) {
+      out.clear();
+      remap_line(line, maps, out);
+      out += '\n';
+      std::cout << out;
+      lines++;
+    }
+  }
+  std::cout.flush();
+  std::clog << "已改写" << lines << "行上下文\n";
+  return 0;
+}
@@ -0,0 +1,125 @@
+#include "watch.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace {
+constexpr uint32_t DIR_EVENTS = IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE |
+                                IN_DELETE_SELF | IN_ONLYDIR;
+} // namespace
+
+DirectoryWatcher::~DirectoryWatcher() {
+  if (fd_ >= 0)
+    ::close(fd_);
+}
+
+bool DirectoryWatcher::Start(const std::filesystem::path &root,
+                             std::string &error) {
+  fd_ = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd_ < 0) {
+    error = std::strerror(errno);
+    return false;
+  }
+  AddTree(std::filesystem::absolute(root).lexically_normal(), nullptr);
+  if (dirs_.empty()) {
+    error = "无法监视目录 (检查 fs.inotify.max_user_watches)";
+    return false;
+  }
+  return true;
+}
+
+void DirectoryWatcher::AddTree(const std::filesystem::path &dir,
+                               std::vector<SourceFile> *files) {
+  std::vector<std::filesystem::path> pending{dir};
+  while (!pending.empty()) {
+    std::filesystem::path current = std::move(pending.back());
+    pending.pop_back();
+    // 先加监视再扫描, 两者之间写入的文件至多重复交付, 不会遗漏
+    int wd = ::inotify_add_watch(fd_, current.c_str(), DIR_EVENTS);
+    if (wd < 0)
+      continue;
+    dirs_[wd] = current;
+    std::error_code ec;
+    std::filesystem::directory_iterator it(
+        current, std::filesystem::directory_options::skip_permission_denied,
+        ec);
+    for (; !ec && it != std::filesystem::directory_iterator();
+         it.increment(ec)) {
+      const auto &path = it->path();
+      if (ignore_.Ignored(path))
+        continue;
+      std::error_code type_ec;
+      auto type = it->symlink_status(type_ec).type();
+      if (type == std::filesystem::file_type::directory) {
+        pending.push_back(path);
+        continue;
+      }
+      uint8_t lang;
+      if (files != nullptr && extensions_.Lookup(path, lang) &&
+          it->is_regular_file(type_ec))
+        files->push_back({path, lang});
+    }
+  }
+}
+
+void DirectoryWatcher::Run(const std::function<bool()> &stop,
+                           const Discovery::Sink &sink, int poll_ms) {
+  alignas(struct inotify_event) char buffer[64 * 1024];
+  std::vector<SourceFile> batch;
+  while (!stop()) {
+    struct pollfd pfd = {fd_, POLLIN, 0};
+    int ready = ::poll(&pfd, 1, poll_ms);
+    if (ready <= 0)
+      continue; // 超时或被信号打断, 回到循环检查 stop
+    ssize_t length;
+    while ((length = ::read(fd_, buffer, sizeof(buffer))) > 0) {
+      for (char *p = buffer; p < buffer + length;) {
+        const auto *event = reinterpret_cast<struct inotify_event *>(p);
+        p += sizeof(struct inotify_event) + event->len;
+        if (event->mask & IN_Q_OVERFLOW) {
+          overflows_.fetch_add(1, std::memory_order_relaxed);
+          continue;
+        }
+        auto dir = dirs_.find(event->wd);
+        if (dir == dirs_.end())
+          continue;
+        if (event->mask & IN_IGNORED) {
+          dirs_.erase(dir); // 目录被删除或移走, 内核已撤销监视
+          continue;
+        }
+        if (event->len == 0)
+          continue;
+        std::filesystem::path path = dir->second / event->name;
+        if (ignore_.Ignored(path))
+          continue;
+        if (event->mask & IN_ISDIR) {
+          if (event->mask & (IN_CREATE | IN_MOVED_TO))
+            AddTree(path, &batch);
+          continue;
+        }
+        uint8_t lang;
+        if ((event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) &&
+            extensions_.Lookup(path, lang))
+          batch.push_back({std::move(path), lang});
+      }
+    }
+    if (batch.empty())
+      continue;
+    // 同一批内多次写入的文件只交付一次
+    std::sort(batch.begin(), batch.end(),
+              [](const SourceFile &a, const SourceFile &b) {
+                return a.path < b.path;
+              });
+    batch.erase(std::unique(batch.begin(), batch.end(),
+                            [](const SourceFile &a, const SourceFile &b) {
+                              return a.path == b.path;
+                            }),
+                batch.end());
+    delivered_.fetch_add(batch.size(), std::memory_order_relaxed);
+    sink(batch);
+    batch.clear();
+  }
+}
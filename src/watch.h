@@ -0,0 +1,53 @@
+#ifndef __HAS_WATCH__
+#define __HAS_WATCH__
+#include "discovery.h"
+#include <atomic>
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief 基于 inotify 的目录监视, 供 --watch 持续接收新导出的提交
+ * Start 递归监视 root 下所有未被忽略的目录, 应在首轮遍历之前调用,
+ * 遍历期间写入的文件由排队的事件补上;
+ * 文件在写入后关闭 (IN_CLOSE_WRITE) 或移入 (IN_MOVED_TO) 时才交付,
+ * 不会读到写了一半的文件; 新建的子目录加入监视后立即扫描一遍,
+ * 补上加入监视之前已写入的文件
+ */
+class DirectoryWatcher {
+public:
+  DirectoryWatcher(const ExtensionMap &extensions, const IgnoreRules &ignore)
+      : extensions_(extensions), ignore_(ignore) {}
+  DirectoryWatcher(const DirectoryWatcher &) = delete;
+  DirectoryWatcher &operator=(const DirectoryWatcher &) = delete;
+  ~DirectoryWatcher();
+
+  bool Start(const std::filesystem::path &root, std::string &error);
+  /**
+   * @brief 读取事件并按批交付给 sink, 直到 stop() 返回 true
+   * 每次读出的一批事件去重后立即交付, 无事件时每 poll_ms 检查一次 stop
+   */
+  void Run(const std::function<bool()> &stop, const Discovery::Sink &sink,
+           int poll_ms = 200);
+  size_t Directories() const { return dirs_.size(); }
+  size_t Delivered() const { return delivered_.load(); }
+  // 内核事件队列溢出的次数, 溢出期间的新文件会丢失, 需重跑补齐
+  size_t Overflows() const { return overflows_.load(); }
+
+private:
+  // 监视 dir 及其子目录, files 非空时收集其中已有的源文件
+  void AddTree(const std::filesystem::path &dir,
+               std::vector<SourceFile> *files);
+
+  const ExtensionMap &extensions_;
+  const IgnoreRules &ignore_;
+  int fd_ = -1;
+  std::unordered_map<int, std::filesystem::path> dirs_; // wd -> 目录
+  std::atomic<size_t> delivered_{0};
+  std::atomic<size_t> overflows_{0};
+};
+
+#endif // !__HAS_WATCH__
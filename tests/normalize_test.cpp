@@ -0,0 +1,80 @@
+#include "normalize.h"
+#include <iostream>
+#include <string>
+
+/**
+ * normalize_source 的表驱动测试, 不依赖 tree-sitter
+ * 编译运行: make test
+ */
+struct Case {
+  const char *name;
+  bool cpp;
+  const char *input;
+  const char *expected;
+};
+
+const Case CASES[] = {
+    {"行尾空白与空白行", true, "int a;   \n\n\t\nint b;\n",
+     "int a;\nint b;\n"},
+    {"原始字符串内的注释与空白保留", true,
+     "auto s = R\"x(a // b\n  /* c */ )x\"; // d\n",
+     "auto s = R\"x(a // b\n  /* c */ )x\";\n"},
+    {"原始字符串内的右括号与引号", true,
+     "auto s = R\"x()\" // )x\"; int b;\n", "auto s = R\"x()\" // )x\"; int b;\n"},
+    {"带前缀的原始字符串", true, "auto s = u8R\"(/*)\"; /* c */\n",
+     "auto s = u8R\"(/*)\";\n"},
+    {"C 中的 R 只是标识符", false, "int R = 1; // c\n", "int R = 1;\n"},
+    {"数字分隔符", true, "int x = 1'000'000; // c\nchar c = 'a';\n",
+     "int x = 1'000'000;\nchar c = 'a';\n"},
+    {"十六进制数字分隔符", true, "int x = 0xff'ff; // c\n",
+     "int x = 0xff'ff;\n"},
+    {"以数字结尾的标识符后的字符字面量", true, "v2 = '/'; // c\n",
+     "v2 = '/';\n"},
+    {"续行的行注释", true, "// a \\\n b\nint x;\n", "int x;\n"},
+    {"CRLF 续行的行注释", true, "// a \\\r\n b\r\nint x;\r\n", "int x;\n"},
+    {"跨行的块注释", true, "int a; /* x\n y\n */ int b;\n",
+     "int a;  int b;\n"},
+    {"块注释不连接两侧记号", true, "a/*x\ny*/b\n", "a b\n"},
+    {"未闭合的块注释", true, "int a; /* x\n", "int a;\n"},
+    {"字符字面量中的双引号", true, "char q = '\"'; // c\n",
+     "char q = '\"';\n"},
+    {"字符字面量中的转义单引号", true, "char s = '\\''; // c\n",
+     "char s = '\\'';\n"},
+    {"字符串中的注释记号", true, "const char *u = \"http://x/*y*/\"; // c\n",
+     "const char *u = \"http://x/*y*/\";\n"},
+    {"字符串中的转义引号", true, "s = \"a\\\"//b\"; // c\n",
+     "s = \"a\\\"//b\";\n"},
+    {"续行符之后的空白行保留", true, "#define A 1 \\\n   \nint b;\n",
+     "#define A 1 \\\n\nint b;\n"},
+};
+
+std::string escape(const std::string &text) {
+  std::string out;
+  for (char c : text) {
+    if (c == '\n')
+      out += "\\n";
+    else if (c == '\r')
+      out += "\\r";
+    else if (c == '\t')
+      out += "\\t";
+    else
+      out += c;
+  }
+  return out;
+}
+
+int main() {
+  int failed = 0;
+  std::string out;
+  for (const Case &c : CASES) {
+    normalize_source(c.input, c.cpp, out);
+    if (out != c.expected) {
+      failed++;
+      std::cerr << "失败: " << c.name << "\n  期望: " << escape(c.expected)
+                << "\n  实际: " << escape(out) << "\n";
+    }
+  }
+  std::cout << sizeof(CASES) / sizeof(CASES[0]) - failed << "/"
+            << sizeof(CASES) / sizeof(CASES[0]) << " 通过\n";
+  return failed == 0 ? 0 : 1;
+}